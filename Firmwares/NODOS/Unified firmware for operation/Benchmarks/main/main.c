@@ -0,0 +1,766 @@
+/************************************************************************************************
+ * Programa: Banco de micro-pruebas de rendimiento de las rutas críticas de los nodos.
+ *
+ * Descripción: Mide la misma implementación que ejecutan los nodos (componentes node_logic,
+ * espnow_group y metrics) sin periféricos ni radio: conversión LM35, codificación y
+ * decodificación de tramas, manejo de recv_cb hasta la cola, lógica de detección, búsqueda de
+ * pares, costo del registro, el códec de series de tiempo (ts_codec), del que además se
+ * reporta la tasa de compresión sobre trazas típicas del LM35, y el seqlock de shared_state,
+ * que se somete además a una prueba de estrés con un escritor concurrente (otro núcleo en el
+ * ESP32, otro hilo en linux). Los pools de block_pool se comparan contra malloc y
+ * heap_caps_malloc y se someten a la misma prueba de estrés con dos consumidores. rule_engine se
+ * mide por evento sobre una tabla de 256 reglas. Cada caso reporta ciclos/op y ops/s en líneas
+ * "BENCH" que tools/bench_report.py compara contra la línea base almacenada. Al final se
+ * simula una sesión de espnow_ota sobre 1 y 50 nodos con la reparación por rondas de los
+ * firmwares (espnow_ota_proto) en tiempo simulado.
+ * En el objetivo linux se compila solo lo independiente de la radio y el tiempo se toma del
+ * reloj monotónico del host (ciclos/op = 0).
+ *
+ * Autor:
+ *   - Victor Manuel Patiño Delgado.
+ *
+ * Licencia: THE BEER-WARE LICENSE.
+ * As long as you retain this notice you can do whatever you want with this stuff.
+ * If we meet some day, and you think this stuff is worth it, you can buy me a beer in return.
+************************************************************************************************/
+
+//***   Bibliotecas y declaraciones de preprocesador    ***//
+    #include <stdio.h>
+    #include <stdlib.h>
+    #include <stdarg.h>
+    #include <string.h>
+    #include <math.h>
+    #include "freertos/FreeRTOS.h"
+    #include "freertos/task.h"
+    #include "freertos/queue.h"
+    #include "esp_log.h"
+    #include "sdkconfig.h"
+    #include "node_logic.h"
+    #include "ts_codec.h"
+    #include "shared_state.h"
+    #include "block_pool.h"
+    #include "rule_engine.h"
+    #include "espnow_group_frame.h"
+    #include "espnow_ota_proto.h"
+    #if CONFIG_IDF_TARGET_LINUX
+    #include <time.h>
+    #else
+    #include "esp_cpu.h"
+    #include "esp_timer.h"
+    #include "esp_now.h"
+    #include "esp_heap_caps.h"
+    #include "espnow_group.h"
+    #include "metrics.h"
+    #endif
+
+//***   Definición de constantes y macros   ***//
+    #define BENCH_ITERATIONS 10000
+    #define BENCH_LOG_ITERATIONS 1000
+    #define BENCH_PEERS 16
+    #define BENCH_TRACE_LEN 2048
+    // Trama ESP-NOW de 250 bytes menos la cabecera de grupo de 8.
+    #define BENCH_TS_ROOM 242
+    #define BENCH_TS_DECIMALS 1
+    // Lote sin comprimir: marca de tiempo y float de 4 bytes por muestra.
+    #define BENCH_RAW_SAMPLE_LEN 8
+    #define BENCH_STRESS_READS 200000
+    // Bloque típico de evento o registro; los bloques retenidos simulan una cola a medio llenar.
+    #define BENCH_BLOCK_SIZE 64
+    #define BENCH_BLOCK_HELD 8
+    // Reglas de tres condiciones (zona, nodo y todos) sobre la tabla completa de nodos.
+    #define BENCH_RULES 256
+    #define BENCH_RULE_ZONES 8
+    // Flota simulada de espnow_ota: imagen típica de nodo y pérdida independiente por trama y nodo.
+    #define BENCH_OTA_IMAGE_KB 1024
+    #define BENCH_OTA_MAX_NODES 50
+    #define BENCH_OTA_LOSS_PCT 5
+    #define BENCH_OTA_CHUNKS ((BENCH_OTA_IMAGE_KB * 1024 + ESPNOW_OTA_CHUNK_SIZE - 1) / ESPNOW_OTA_CHUNK_SIZE)
+    #define BENCH_OTA_BITMAP ((BENCH_OTA_CHUNKS + 7) / 8)
+    // Tiempo de aire a 1 Mbit/s (tasa por defecto de ESP-NOW): preámbulo largo, DIFS más el
+    // backoff medio de 802.11b y 43 bytes de trama de acción y FCS alrededor del payload.
+    #define BENCH_AIR_PREAMBLE_US 192
+    #define BENCH_AIR_ACCESS_US (50 + 310)
+    #define BENCH_AIR_OVERHEAD 43
+
+    static const char *TAG = "bench";
+
+    static volatile uint32_t sink;
+    static QueueHandle_t rx_queue;
+    static uint8_t peer_table[BENCH_PEERS][NODE_MAC_LEN];
+    static uint8_t encoded_frame[256];
+    static size_t encoded_len;
+    static uint32_t trace_time[BENCH_TRACE_LEN];
+    static float trace_value[BENCH_TRACE_LEN];
+    static uint8_t ts_frame[BENCH_TS_ROOM];
+    static size_t ts_frame_len;
+    static uint32_t lcg_state;
+    static char rules_text[BENCH_RULES * 80 + RULE_ENGINE_MAX_NODES * 40];
+    static volatile uint32_t rules_fired;
+    static volatile bool stress_running;
+    static volatile bool stress_done;
+
+//***   Estructuras de datos y tipos personalizados ***//
+    typedef struct {
+        const char *name;
+        uint32_t iterations;
+        void (*run)(uint32_t iterations);
+    } bench_case_t;
+
+    typedef struct {
+        uint8_t src_addr[NODE_MAC_LEN];
+        sensor_data_t data;
+    } rx_frame_t;
+
+    // Cada campo se deriva del contador: una copia mezclada de dos escrituras lo delata.
+    typedef struct {
+        uint32_t counter;
+        uint32_t complement;
+        uint32_t tick;
+        uint32_t check;
+    } stress_state_t;
+
+    // Estado de un nodo en la simulación: el mismo mapa de recibidos que lleva espnow_ota.
+    typedef struct {
+        bool active;
+        bool done;
+        uint16_t received;
+        uint32_t done_ms;
+        uint8_t bitmap[BENCH_OTA_BITMAP];
+    } ota_sim_node_t;
+
+    typedef enum {
+        TRACE_STEADY,       // Interior, 1 s, ruido de ±1 paso de ADC
+        TRACE_DIURNAL,      // Ciclo de 24 h muestreado cada 10 s
+    } trace_kind_t;
+
+//***   Declaraciones de funciones (prototipos) ***//
+    static void bench_lm35_convert(uint32_t iterations);
+    static void bench_frame_encode(uint32_t iterations);
+    static void bench_frame_decode(uint32_t iterations);
+    static void bench_recv_cb(uint32_t iterations);
+    static void bench_process(uint32_t iterations);
+    static void bench_peer_lookup(uint32_t iterations);
+    static void bench_log_cost(uint32_t iterations);
+    static void bench_ts_encode(uint32_t iterations);
+    static void bench_ts_decode(uint32_t iterations);
+    static void bench_seqlock_read(uint32_t iterations);
+    static void bench_seqlock_write(uint32_t iterations);
+    static void stress_writer_task(void *pvParameters);
+    static void report_seqlock_stress(void);
+    static void bench_pool_alloc(uint32_t iterations);
+    static void bench_malloc(uint32_t iterations);
+    #if !CONFIG_IDF_TARGET_LINUX
+    static void bench_heap_caps(uint32_t iterations);
+    #endif
+    static void bench_rule_eval(uint32_t iterations);
+    static void pool_stress_task(void *pvParameters);
+    static uint32_t pool_stress_round(uint32_t owner, uint32_t round);
+    static void report_pool_stress(void);
+    static void run_case(const bench_case_t *bench);
+    static void prepare_frame(void);
+    static void prepare_rules(void);
+    static void count_rule_action(const rule_engine_action_t *action);
+    static void prepare_trace(trace_kind_t kind);
+    static void report_ts_ratio(const char *name, trace_kind_t kind);
+    static uint32_t lcg_next(void);
+    static void report_ota_fleet(uint8_t nodes);
+    static bool ota_sim_lost(void);
+    static uint32_t ota_air_us(size_t payload_len);
+
+    static const bench_case_t cases[] = {
+        {"lm35_convert", BENCH_ITERATIONS, bench_lm35_convert},
+        {"frame_encode", BENCH_ITERATIONS, bench_frame_encode},
+        {"frame_decode", BENCH_ITERATIONS, bench_frame_decode},
+        {"recv_cb", BENCH_ITERATIONS, bench_recv_cb},
+        {"process", BENCH_ITERATIONS, bench_process},
+        {"peer_lookup", BENCH_ITERATIONS, bench_peer_lookup},
+        {"log_cost", BENCH_LOG_ITERATIONS, bench_log_cost},
+        {"ts_encode", BENCH_ITERATIONS, bench_ts_encode},
+        {"ts_decode", BENCH_ITERATIONS, bench_ts_decode},
+        {"seqlock_read", BENCH_ITERATIONS, bench_seqlock_read},
+        {"seqlock_write", BENCH_ITERATIONS, bench_seqlock_write},
+        {"pool_alloc", BENCH_ITERATIONS, bench_pool_alloc},
+        {"malloc", BENCH_ITERATIONS, bench_malloc},
+    #if !CONFIG_IDF_TARGET_LINUX
+        {"heap_caps", BENCH_ITERATIONS, bench_heap_caps},
+    #endif
+        {"rule_eval", BENCH_ITERATIONS, bench_rule_eval},
+    };
+
+    static shared_seqlock_t stress_lock = SHARED_SEQLOCK_INITIALIZER;
+    static stress_state_t stress_state;
+    BLOCK_POOL_DEFINE(bench_pool, BENCH_BLOCK_SIZE, 2 * BENCH_BLOCK_HELD);
+    static ota_sim_node_t ota_nodes[BENCH_OTA_MAX_NODES];
+    static uint8_t ota_pending[BENCH_OTA_BITMAP];
+    static uint8_t ota_need[BENCH_OTA_BITMAP];
+
+//***   Función principal (main)    ***//
+    void app_main(void)
+    {
+        //***   Declaración de variables locales   ***//
+        //***   Inicialización y asignaciones  ***//
+            rx_queue = xQueueCreate(8, sizeof(rx_frame_t));
+            for (uint8_t i = 0; i < BENCH_PEERS; i++) {
+                memset(peer_table[i], 0x10 + i, NODE_MAC_LEN);
+            }
+        #if !CONFIG_IDF_TARGET_LINUX
+            espnow_group_subscribe(CONFIG_ESPNOW_GROUP_ZONE);
+        #endif
+            prepare_frame();
+            prepare_trace(TRACE_STEADY);
+            prepare_rules();
+
+        //***   Estructura de control - Bucle(s) o condicionales    ***//
+            printf("BENCH-TARGET %s\n", CONFIG_IDF_TARGET);
+            for (uint8_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+                run_case(&cases[i]);
+            }
+            report_ts_ratio("steady", TRACE_STEADY);
+            report_ts_ratio("diurnal", TRACE_DIURNAL);
+            report_seqlock_stress();
+            report_pool_stress();
+            printf("rule_eval: %u rules, %lu fired\n", rule_engine_rule_count(), (unsigned long)rules_fired);
+            report_ota_fleet(1);
+            report_ota_fleet(BENCH_OTA_MAX_NODES);
+            printf("BENCH-DONE\n");
+
+        //***   Retorno de valores y finalización del programa  ***//
+        #if CONFIG_IDF_TARGET_LINUX
+            fflush(stdout);
+            exit(0);
+        #endif
+    }
+
+//***Implementación de funciones***//
+    #if CONFIG_IDF_TARGET_LINUX
+    static inline uint32_t bench_cycles(void)
+    {
+        return 0;
+    }
+
+    static inline int64_t bench_time_ns(void)
+    {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        return (int64_t)now.tv_sec * 1000000000LL + now.tv_nsec;
+    }
+    #else
+    static inline uint32_t bench_cycles(void)
+    {
+        return esp_cpu_get_cycle_count();
+    }
+
+    static inline int64_t bench_time_ns(void)
+    {
+        return esp_timer_get_time() * 1000;
+    }
+    #endif
+
+    static void run_case(const bench_case_t *bench)
+    {
+        // Calentamiento: cachés de flash y ramas predichas.
+        bench->run(bench->iterations / 10);
+
+        vTaskDelay(1);
+        int64_t start_ns = bench_time_ns();
+        uint32_t start_cycles = bench_cycles();
+        bench->run(bench->iterations);
+        uint32_t cycles = bench_cycles() - start_cycles;
+        int64_t elapsed_ns = bench_time_ns() - start_ns;
+
+        double cycles_per_op = (double)cycles / bench->iterations;
+        double ns_per_op = (double)elapsed_ns / bench->iterations;
+        double ops_per_s = elapsed_ns > 0 ? bench->iterations * 1e9 / elapsed_ns : 0;
+        printf("BENCH %s cycles_per_op=%.1f ns_per_op=%.1f ops_per_s=%.0f\n", bench->name, cycles_per_op, ns_per_op, ops_per_s);
+    }
+
+    static void prepare_frame(void)
+    {
+        sensor_data_t data = {.packet_id = 0x01, .lm35_temperature = 24.5f, .pir_state = 1, .radar_state = 0};
+    #if CONFIG_IDF_TARGET_LINUX
+        encoded_len = node_sensor_encode(encoded_frame, sizeof(encoded_frame), &data);
+    #else
+        uint8_t payload[ESPNOW_GROUP_MAX_PAYLOAD];
+        size_t payload_len = node_sensor_encode(payload, sizeof(payload), &data);
+        encoded_len = espnow_group_encode(encoded_frame, CONFIG_ESPNOW_GROUP_ZONE, ESPNOW_MSG_SENSOR, 0, 1,
+                                          payload, payload_len);
+    #endif
+    }
+
+    static void bench_lm35_convert(uint32_t iterations)
+    {
+        float accumulator = 0;
+        for (uint32_t i = 0; i < iterations; i++) {
+            accumulator += node_lm35_celsius(i & 0x0FFF);
+        }
+        sink = (uint32_t)accumulator;
+    }
+
+    static void bench_frame_encode(uint32_t iterations)
+    {
+        sensor_data_t data = {.packet_id = 0x01, .lm35_temperature = 24.5f};
+        uint8_t frame[256];
+        for (uint32_t i = 0; i < iterations; i++) {
+            data.pir_state = i & 1;
+        #if CONFIG_IDF_TARGET_LINUX
+            sink = node_sensor_encode(frame, sizeof(frame), &data);
+        #else
+            uint8_t payload[ESPNOW_GROUP_MAX_PAYLOAD];
+            size_t len = node_sensor_encode(payload, sizeof(payload), &data);
+            sink = espnow_group_encode(frame, CONFIG_ESPNOW_GROUP_ZONE, ESPNOW_MSG_SENSOR, 0, (uint16_t)i, payload, len);
+        #endif
+        }
+    }
+
+    static void bench_frame_decode(uint32_t iterations)
+    {
+        sensor_data_t data;
+        for (uint32_t i = 0; i < iterations; i++) {
+        #if CONFIG_IDF_TARGET_LINUX
+            sink = node_sensor_decode(encoded_frame, encoded_len, &data);
+        #else
+            const espnow_group_hdr_t *hdr;
+            size_t payload_len;
+            esp_now_recv_info_t info = {.src_addr = peer_table[0], .des_addr = peer_table[1]};
+            const uint8_t *payload = espnow_group_recv(&info, encoded_frame, encoded_len, &hdr, &payload_len);
+            sink = node_sensor_decode(payload, payload_len, &data);
+        #endif
+        }
+    }
+
+    // Ruta completa del callback de los nodos de detección hasta entregar la trama a rx_task.
+    static void bench_recv_cb(uint32_t iterations)
+    {
+        rx_frame_t frame;
+        for (uint32_t i = 0; i < iterations; i++) {
+        #if CONFIG_IDF_TARGET_LINUX
+            bool valid = node_sensor_decode(encoded_frame, encoded_len, &frame.data);
+        #else
+            const espnow_group_hdr_t *hdr;
+            size_t payload_len;
+            esp_now_recv_info_t info = {.src_addr = peer_table[0], .des_addr = peer_table[1]};
+            const uint8_t *payload = espnow_group_recv(&info, encoded_frame, encoded_len, &hdr, &payload_len);
+            if (payload != NULL) {metrics_strip(hdr->flags & ESPNOW_GROUP_FLAG_METRICS, payload, &payload_len, NULL);}
+            bool valid = payload != NULL && hdr->type == ESPNOW_MSG_SENSOR && node_sensor_decode(payload, payload_len, &frame.data);
+        #endif
+            if (valid) {
+                memcpy(frame.src_addr, peer_table[0], NODE_MAC_LEN);
+                xQueueSend(rx_queue, &frame, 0);
+                xQueueReceive(rx_queue, &frame, 0);
+            }
+        }
+        sink = frame.data.pir_state;
+    }
+
+    static void bench_process(uint32_t iterations)
+    {
+        detection_state_t state = {0};
+        uint32_t level = 0;
+        for (uint32_t i = 0; i < iterations; i++) {
+            // Alterna flancos y vencimientos para recorrer todas las ramas.
+            state.pir = (i & 3) == 0;
+            state.radar = (i & 7) == 1;
+            level += node_detection_process(&state, i & 0x3FF, (i >> 1) & 0x3FF, 500);
+        }
+        sink = level;
+    }
+
+    static void bench_peer_lookup(uint32_t iterations)
+    {
+        uint8_t miss[NODE_MAC_LEN] = {0xAA, 0xBB, 0xCC, 0xDD, 0xEE, 0xFF};
+        int found = 0;
+        for (uint32_t i = 0; i < iterations; i++) {
+            // Peor caso (último y ausente) alternados.
+            const uint8_t *mac = (i & 1) ? peer_table[BENCH_PEERS - 1] : miss;
+            found += node_peer_index((const uint8_t (*)[NODE_MAC_LEN])peer_table, BENCH_PEERS, mac);
+        }
+        sink = found;
+    }
+
+    static int null_vprintf(const char *format, va_list args)
+    {
+        char line[128];
+        return vsnprintf(line, sizeof(line), format, args);
+    }
+
+    // Formateo completo de una línea de log típica, sin el costo del UART.
+    static void bench_log_cost(uint32_t iterations)
+    {
+        vprintf_like_t previous = esp_log_set_vprintf(null_vprintf);
+        for (uint32_t i = 0; i < iterations; i++) {
+            ESP_LOGI(TAG, "Data sent: LM35 Temperature=%.2f°C, PIR=%d, Radar=%d", 24.5f + i, (int)(i & 1), 0);
+        }
+        esp_log_set_vprintf(previous);
+    }
+
+    static uint32_t lcg_next(void)
+    {
+        lcg_state = lcg_state * 1664525u + 1013904223u;
+        return lcg_state >> 16;
+    }
+
+    // Trazas deterministas que pasan por la misma conversión LM35 que los nodos, así el valor
+    // queda cuantizado en pasos de ADC como en campo.
+    static void prepare_trace(trace_kind_t kind)
+    {
+        lcg_state = 12345;
+        uint32_t timestamp = 0;
+        uint32_t period_ms = kind == TRACE_STEADY ? 1000 : 10000;
+        for (uint32_t i = 0; i < BENCH_TRACE_LEN; i++) {
+            float celsius = 24.5f;
+            if (kind == TRACE_DIURNAL) {celsius = 22.0f + 8.0f * sinf(2.0f * (float)M_PI * timestamp / 86400000.0f);}
+            int32_t adc = lroundf(celsius / 500.0f * 4095.0f) + (int32_t)(lcg_next() % 3) - 1;
+            trace_time[i] = timestamp;
+            trace_value[i] = node_lm35_celsius(adc);
+            timestamp += period_ms + (lcg_next() % 5) - 2;
+        }
+
+        ts_encoder_t encoder;
+        ts_encoder_init(&encoder, ts_frame, sizeof(ts_frame), BENCH_TS_DECIMALS);
+        for (uint32_t i = 0; i < BENCH_TRACE_LEN && ts_encoder_append(&encoder, trace_time[i], trace_value[i]); i++) {}
+        ts_frame_len = ts_encoder_size(&encoder);
+    }
+
+    static void report_ts_ratio(const char *name, trace_kind_t kind)
+    {
+        prepare_trace(kind);
+        ts_encoder_t encoder;
+        uint32_t frames = 0;
+        size_t bytes = 0;
+        uint32_t mismatches = 0;
+        uint32_t i = 0;
+        while (i < BENCH_TRACE_LEN) {
+            uint32_t first = i;
+            ts_encoder_init(&encoder, ts_frame, sizeof(ts_frame), BENCH_TS_DECIMALS);
+            while (i < BENCH_TRACE_LEN && ts_encoder_append(&encoder, trace_time[i], trace_value[i])) {i++;}
+            frames++;
+            bytes += ts_encoder_size(&encoder);
+
+            // Ida y vuelta: la marca de tiempo es exacta y el valor dentro de medio decimal.
+            ts_decoder_t decoder;
+            uint32_t timestamp;
+            float value;
+            ts_decoder_init(&decoder, ts_frame, ts_encoder_size(&encoder));
+            for (uint32_t j = first; ts_decoder_next(&decoder, &timestamp, &value); j++) {
+                if (timestamp != trace_time[j] || fabsf(value - trace_value[j]) > 0.051f) {mismatches++;}
+            }
+        }
+
+        float samples_per_frame = (float)BENCH_TRACE_LEN / frames;
+        printf("  ts_codec %s: %.1f samples/frame, %.2f bits/sample, ratio %.1fx vs %d B/sample, %lu mismatches\n",
+               name, samples_per_frame, bytes * 8.0f / BENCH_TRACE_LEN,
+               (float)BENCH_TRACE_LEN * BENCH_RAW_SAMPLE_LEN / bytes, BENCH_RAW_SAMPLE_LEN, (unsigned long)mismatches);
+    }
+
+    static void bench_ts_encode(uint32_t iterations)
+    {
+        uint8_t frame[BENCH_TS_ROOM];
+        ts_encoder_t encoder;
+        ts_encoder_init(&encoder, frame, sizeof(frame), BENCH_TS_DECIMALS);
+        for (uint32_t i = 0; i < iterations; i++) {
+            uint32_t index = i % BENCH_TRACE_LEN;
+            if (!ts_encoder_append(&encoder, trace_time[index], trace_value[index])) {
+                ts_encoder_init(&encoder, frame, sizeof(frame), BENCH_TS_DECIMALS);
+                ts_encoder_append(&encoder, trace_time[index], trace_value[index]);
+            }
+        }
+        sink = ts_encoder_size(&encoder);
+    }
+
+    static void bench_ts_decode(uint32_t iterations)
+    {
+        ts_decoder_t decoder;
+        uint32_t timestamp = 0;
+        float value = 0;
+        ts_decoder_init(&decoder, ts_frame, ts_frame_len);
+        for (uint32_t i = 0; i < iterations; i++) {
+            if (!ts_decoder_next(&decoder, &timestamp, &value)) {
+                ts_decoder_init(&decoder, ts_frame, ts_frame_len);
+                ts_decoder_next(&decoder, &timestamp, &value);
+            }
+        }
+        sink = timestamp + (uint32_t)value;
+    }
+
+    static void bench_seqlock_read(uint32_t iterations)
+    {
+        stress_state_t copy = {0};
+        for (uint32_t i = 0; i < iterations; i++) {
+            shared_seqlock_read(&stress_lock, &copy, &stress_state, sizeof(copy));
+        }
+        sink = copy.counter;
+    }
+
+    static void bench_seqlock_write(uint32_t iterations)
+    {
+        for (uint32_t i = 0; i < iterations; i++) {
+            shared_seqlock_write_begin(&stress_lock);
+            stress_state.counter = i;
+            stress_state.complement = ~i;
+            shared_seqlock_write_end(&stress_lock);
+        }
+    }
+
+    static void stress_writer_task(void *pvParameters)
+    {
+        uint32_t counter = 0;
+        while (stress_running) {
+            counter++;
+            shared_seqlock_write_begin(&stress_lock);
+            stress_state.counter = counter;
+            stress_state.complement = ~counter;
+            stress_state.tick = counter * 2654435761u;
+            stress_state.check = counter ^ stress_state.tick;
+            shared_seqlock_write_end(&stress_lock);
+        }
+        *(uint32_t *)pvParameters = counter;
+        stress_done = true;
+        vTaskDelete(NULL);
+    }
+
+    // Un escritor sin pausas contra lecturas continuas: ninguna copia debe salir mezclada y
+    // el contador visto por el lector nunca retrocede.
+    static void report_seqlock_stress(void)
+    {
+        static uint32_t writes;
+        writes = 0;
+        stress_state = (stress_state_t){.complement = ~0u};
+        stress_running = true;
+        stress_done = false;
+        xTaskCreatePinnedToCore(stress_writer_task, "stress_writer", 2048, &writes, uxTaskPriorityGet(NULL),
+                                NULL, portNUM_PROCESSORS - 1);
+
+        stress_state_t copy;
+        uint32_t retries = 0, torn = 0, backwards = 0, last_counter = 0;
+        for (uint32_t i = 0; i < BENCH_STRESS_READS; i++) {
+            retries += shared_seqlock_read(&stress_lock, &copy, &stress_state, sizeof(copy));
+            if (copy.complement != ~copy.counter || copy.tick != copy.counter * 2654435761u ||
+                copy.check != (copy.counter ^ copy.tick)) {torn++;}
+            if (copy.counter < last_counter) {backwards++;}
+            last_counter = copy.counter;
+        }
+        stress_running = false;
+        while (!stress_done) {vTaskDelay(1);}
+
+        printf("  seqlock stress: %lu reads, %lu writes, %lu retries, %lu torn, %lu backwards\n",
+               (unsigned long)BENCH_STRESS_READS, (unsigned long)writes, (unsigned long)retries,
+               (unsigned long)torn, (unsigned long)backwards);
+    }
+
+    // Cada iteración libera el bloque más antiguo de los retenidos y toma uno nuevo.
+    static void bench_pool_alloc(uint32_t iterations)
+    {
+        void *held[BENCH_BLOCK_HELD] = {0};
+        for (uint32_t i = 0; i < iterations; i++) {
+            void **slot = &held[i % BENCH_BLOCK_HELD];
+            if (*slot != NULL) {block_pool_give(&bench_pool, *slot);}
+            *slot = block_pool_take(&bench_pool);
+        }
+        for (uint8_t i = 0; i < BENCH_BLOCK_HELD; i++) {
+            if (held[i] != NULL) {block_pool_give(&bench_pool, held[i]);}
+        }
+    }
+
+    static void bench_malloc(uint32_t iterations)
+    {
+        void *held[BENCH_BLOCK_HELD] = {0};
+        for (uint32_t i = 0; i < iterations; i++) {
+            void **slot = &held[i % BENCH_BLOCK_HELD];
+            free(*slot);
+            *slot = malloc(BENCH_BLOCK_SIZE);
+        }
+        for (uint8_t i = 0; i < BENCH_BLOCK_HELD; i++) {free(held[i]);}
+    }
+
+    #if !CONFIG_IDF_TARGET_LINUX
+    static void bench_heap_caps(uint32_t iterations)
+    {
+        void *held[BENCH_BLOCK_HELD] = {0};
+        for (uint32_t i = 0; i < iterations; i++) {
+            void **slot = &held[i % BENCH_BLOCK_HELD];
+            heap_caps_free(*slot);
+            *slot = heap_caps_malloc(BENCH_BLOCK_SIZE, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+        }
+        for (uint8_t i = 0; i < BENCH_BLOCK_HELD; i++) {heap_caps_free(held[i]);}
+    }
+    #endif
+
+    // Toma BENCH_BLOCK_HELD bloques, los marca con dueño y ronda, verifica la marca y los
+    // devuelve. Un bloque entregado a los dos consumidores a la vez aparece sobrescrito.
+    static uint32_t pool_stress_round(uint32_t owner, uint32_t round)
+    {
+        uint32_t *held[BENCH_BLOCK_HELD];
+        uint32_t stamp = (owner << 24) | (round & 0xFFFFFF);
+        uint32_t corrupt = 0;
+        for (uint8_t i = 0; i < BENCH_BLOCK_HELD; i++) {
+            held[i] = block_pool_take(&bench_pool);
+            if (held[i] != NULL) {held[i][1] = stamp + i;}
+        }
+        for (uint8_t i = 0; i < BENCH_BLOCK_HELD; i++) {
+            if (held[i] == NULL) {continue;}
+            if (held[i][1] != stamp + i) {corrupt++;}
+            block_pool_give(&bench_pool, held[i]);
+        }
+        return corrupt;
+    }
+
+    static void pool_stress_task(void *pvParameters)
+    {
+        uint32_t round = 0;
+        uint32_t corrupt = 0;
+        while (stress_running) {corrupt += pool_stress_round(2, round++);}
+        *(uint32_t *)pvParameters = corrupt;
+        stress_done = true;
+        vTaskDelete(NULL);
+    }
+
+    // Dos consumidores sobre un pool que alcanza justo para ambos: ningún bloque debe
+    // entregarse dos veces y, al terminar, todos vuelven al pool.
+    static void report_pool_stress(void)
+    {
+        static uint32_t other_corrupt;
+        other_corrupt = 0;
+        uint32_t failures_before = bench_pool.failures;
+        stress_running = true;
+        stress_done = false;
+        xTaskCreatePinnedToCore(pool_stress_task, "pool_stress", 2048, &other_corrupt, uxTaskPriorityGet(NULL),
+                                NULL, portNUM_PROCESSORS - 1);
+
+        uint32_t corrupt = 0;
+        for (uint32_t round = 0; round < BENCH_STRESS_READS / BENCH_BLOCK_HELD; round++) {
+            corrupt += pool_stress_round(1, round);
+        }
+        stress_running = false;
+        while (!stress_done) {vTaskDelay(1);}
+
+        printf("  pool stress: %lu rounds, %lu corrupt, %lu failures, high water %lu/%u, %lu in use\n",
+               (unsigned long)(BENCH_STRESS_READS / BENCH_BLOCK_HELD), (unsigned long)(corrupt + other_corrupt),
+               (unsigned long)(bench_pool.failures - failures_before), (unsigned long)bench_pool.high_water,
+               bench_pool.count, (unsigned long)bench_pool.in_use);
+    }
+
+    // 32 nodos en 8 zonas; cada regla combina radar en una zona, umbral de temperatura de un
+    // nodo y PIR en cualquiera, así cada sensor tiene BENCH_RULES condiciones que recorrer.
+    static void prepare_rules(void)
+    {
+        size_t len = 0;
+        for (uint8_t node = 0; node < RULE_ENGINE_MAX_NODES; node++) {
+            len += snprintf(rules_text + len, sizeof(rules_text) - len, "node n%u 02:00:00:00:00:%02x\n", node, node);
+        }
+        for (uint8_t zone = 0; zone < BENCH_RULE_ZONES; zone++) {
+            len += snprintf(rules_text + len, sizeof(rules_text) - len, "zone z%u", zone);
+            for (uint8_t node = zone; node < RULE_ENGINE_MAX_NODES; node += BENCH_RULE_ZONES) {
+                len += snprintf(rules_text + len, sizeof(rules_text) - len, " n%u", node);
+            }
+            len += snprintf(rules_text + len, sizeof(rules_text) - len, "\n");
+        }
+        for (uint16_t rule = 0; rule < BENCH_RULES; rule++) {
+            len += snprintf(rules_text + len, sizeof(rules_text) - len,
+                            "rule radar@z%u and temp@n%u < %u and pir@* -> servo 0 300 on n%u\n",
+                            rule % BENCH_RULE_ZONES, rule % RULE_ENGINE_MAX_NODES, 20 + rule % 20,
+                            (rule + 1) % RULE_ENGINE_MAX_NODES);
+        }
+        if (rule_engine_load(rules_text, len, count_rule_action) != ESP_OK) {ESP_LOGE(TAG, "Rule table did not compile");}
+    }
+
+    static void count_rule_action(const rule_engine_action_t *action)
+    {
+        rules_fired++;
+    }
+
+    // Un evento por operación: nodo y lectura al azar, sensores en rotación.
+    static void bench_rule_eval(uint32_t iterations)
+    {
+        uint32_t fired = 0;
+        for (uint32_t i = 0; i < iterations; i++) {
+            uint32_t random = lcg_next();
+            rule_sensor_t sensor = (rule_sensor_t)(i % RULE_SENSOR_COUNT);
+            float value = sensor == RULE_SENSOR_TEMP ? 10.0f + (random >> 5) % 30 : (float)(random & 1);
+            fired += rule_engine_event(random % RULE_ENGINE_MAX_NODES, sensor, value);
+        }
+        sink = fired;
+    }
+
+    // Sesión de espnow_ota en tiempo simulado, con los mismos pasos que ota_serve_session: ronda
+    // de fragmentos pendientes, doble cierre, reportes de faltantes unidos con
+    // espnow_ota_merge_report y nueva ronda con la unión. Un nodo que pierde el anuncio de
+    // inicio descarta fragmentos hasta oír el cierre, como rx_handle_announce. La pérdida y el
+    // tiempo de aire son supuestos; las colisiones entre reportes no se modelan.
+    static void report_ota_fleet(uint8_t nodes)
+    {
+        const uint32_t image_size = BENCH_OTA_IMAGE_KB * 1024;
+        const uint16_t chunk_count = espnow_ota_chunk_count(image_size);
+        // La pausa entre fragmentos se redondea a ticks; el envío no va más rápido que el aire.
+        const uint32_t pace_us = pdMS_TO_TICKS(CONFIG_ESPNOW_OTA_CHUNK_INTERVAL_MS) * portTICK_PERIOD_MS * 1000;
+        espnow_ota_report_t report;
+        uint64_t now_us = 0;
+        uint32_t sent = 0;
+        uint8_t round;
+
+        lcg_state = nodes;
+        memset(ota_nodes, 0, sizeof(ota_nodes));
+        memset(ota_pending, 0xFF, sizeof(ota_pending));
+        for (round = 0; round < CONFIG_ESPNOW_OTA_MAX_ROUNDS; round++) {
+            for (uint8_t n = 0; n < nodes; n++) {
+                if (!ota_nodes[n].done && !ota_sim_lost()) {ota_nodes[n].active = true;}
+            }
+            now_us += ota_air_us(sizeof(espnow_ota_announce_t));
+
+            for (uint16_t index = 0; index < chunk_count; index++) {
+                if (!ESPNOW_OTA_BIT_GET(ota_pending, index)) {continue;}
+                uint32_t air_us = ota_air_us(offsetof(espnow_ota_chunk_t, data) + espnow_ota_chunk_len(image_size, index));
+                now_us += air_us > pace_us ? air_us : pace_us;
+                sent++;
+                for (uint8_t n = 0; n < nodes; n++) {
+                    ota_sim_node_t *node = &ota_nodes[n];
+                    if (!node->active || node->done || ota_sim_lost() || ESPNOW_OTA_BIT_GET(node->bitmap, index)) {continue;}
+                    ESPNOW_OTA_BIT_SET(node->bitmap, index);
+                    if (++node->received == chunk_count) {
+                        node->done = true;
+                        node->done_ms = now_us / 1000;
+                    }
+                }
+            }
+
+            // Cierre emitido dos veces: solo calla el nodo que pierde ambos.
+            uint16_t missing_reports = 0;
+            memset(ota_need, 0, sizeof(ota_need));
+            for (uint8_t n = 0; n < nodes; n++) {
+                ota_sim_node_t *node = &ota_nodes[n];
+                if (node->done || (ota_sim_lost() && ota_sim_lost())) {continue;}
+                node->active = true;
+                for (uint32_t base = 0; base < chunk_count; base += ESPNOW_OTA_REPORT_CHUNKS) {
+                    if (espnow_ota_report_block(node->bitmap, chunk_count, base, &report) && !ota_sim_lost()) {
+                        espnow_ota_merge_report(ota_need, sizeof(ota_need), &report);
+                        missing_reports++;
+                    }
+                }
+            }
+            now_us += (ESPNOW_OTA_ROUND_END_GAP_MS + CONFIG_ESPNOW_OTA_REPORT_WINDOW_MS) * 1000ULL;
+            memcpy(ota_pending, ota_need, sizeof(ota_pending));
+            if (missing_reports == 0) {break;}
+        }
+
+        uint8_t complete = 0;
+        uint32_t fleet_ms = 0;
+        for (uint8_t n = 0; n < nodes; n++) {
+            if (!ota_nodes[n].done) {continue;}
+            complete++;
+            if (ota_nodes[n].done_ms > fleet_ms) {fleet_ms = ota_nodes[n].done_ms;}
+        }
+        printf("  ota fleet: %u node(s), %u KB at %u%% loss: %u round(s), %lu chunks sent (%lu resent), "
+               "%u/%u complete, last node at %.1f s, session %.1f s\n",
+               nodes, BENCH_OTA_IMAGE_KB, BENCH_OTA_LOSS_PCT, round < CONFIG_ESPNOW_OTA_MAX_ROUNDS ? round + 1 : round,
+               (unsigned long)sent, (unsigned long)(sent - chunk_count), complete, nodes, fleet_ms / 1000.0,
+               now_us / 1e6);
+    }
+
+    static bool ota_sim_lost(void)
+    {
+        return lcg_next() % 100 < BENCH_OTA_LOSS_PCT;
+    }
+
+    static uint32_t ota_air_us(size_t payload_len)
+    {
+        return BENCH_AIR_PREAMBLE_US + BENCH_AIR_ACCESS_US + (BENCH_AIR_OVERHEAD + sizeof(espnow_group_hdr_t) + payload_len) * 8;
+    }
@@ -25,6 +25,7 @@
     #include "string.h"
     #include "freertos/FreeRTOS.h"
     #include "freertos/task.h"
+    #include "freertos/queue.h"
     #include "esp_now.h"
     #include "esp_wifi.h"
     #include "esp_netif.h"
@@ -35,6 +36,22 @@
     #include "driver/gpio.h"
     #include "driver/adc.h"
     #include "esp_adc_cal.h"
+    #include "espnow_group.h"
+    #include "espnow_ota.h"
+    #include "espnow_secure.h"
+    #include "task_layout.h"
+    #include "static_alloc.h"
+    #include "fast_boot.h"
+    #include "pulse_sense.h"
+    #include "thermal_gov.h"
+    #include "metrics.h"
+    #include "trace.h"
+    #include "node_logic.h"
+    #include "shared_state.h"
+    #include "crash_guard.h"
+    #include "rule_engine.h"
+    #include "link_quality.h"
+    #include "esp_timer.h"
     #include "driver/ledc.h"
     #include "driver/gpio.h"
 
@@ -45,9 +62,6 @@
     #define GPIO_INPUT_PIN 5
     #define GPIO_OUTPUT_PIN 1
 
-    #define SERVO_MIN_PULSEWIDTH 300
-    #define SERVO_MAX_PULSEWIDTH 700
-
     #define ESP_CHANNEL 1
 
     #define ADC_CHANNEL_LM35 ADC1_CHANNEL_3
@@ -55,7 +69,16 @@
     #define RADAR_SENSOR_PIN GPIO_NUM_6
     #define LED_PIN GPIO_NUM_47
 
-    #define LM35_PACKET_ID 0x01
+    #define LM35_PACKET_ID NODE_LM35_PACKET_ID
+
+    // Espera máxima de las tareas de radio en su cola, por debajo del plazo del watchdog.
+    #define WDT_POLL pdMS_TO_TICKS(1000)
+
+    #if CONFIG_PULSE_SENSE_ENABLE
+        #define SENSOR_INTR_TYPE GPIO_INTR_DISABLE
+    #else
+        #define SENSOR_INTR_TYPE GPIO_INTR_NEGEDGE
+    #endif
 
     static const char *TAG = "Dispositivo1";
 
@@ -66,13 +89,17 @@
     };
     static uint8_t remote_mac[ESP_NOW_ETH_ALEN];
 
-    static volatile uint8_t pir_state = 0;
-    static volatile uint8_t radar_state = 0;
-    static TickType_t last_detection_time_pir = 0;
-    static TickType_t last_detection_time_radar = 0;
-    static volatile uint8_t led_state = 0;
+    // led_state lo escriben process() y rx_task y lo lee servo_control.
+    static shared_flag_t led_state = SHARED_FLAG_INITIALIZER(0);
+    // Barridos pedidos por reglas de la pasarela; solo recv_cb lo incrementa, después de fijar
+    // cuánto se sostiene el extremo (0: NODE_SERVO_PAUSE_MS).
+    static shared_flag_t rule_sweeps = SHARED_FLAG_INITIALIZER(0);
+    static shared_flag_t rule_hold_ms = SHARED_FLAG_INITIALIZER(0);
+    static uint8_t own_mac[ESP_NOW_ETH_ALEN];
     static const TickType_t detection_timeout = pdMS_TO_TICKS(500);
-    static esp_adc_cal_characteristics_t *adc_chars;
+    static QueueHandle_t tx_queue = NULL;
+    static QueueHandle_t rx_queue = NULL;
+    static esp_adc_cal_characteristics_t adc_chars;
 
     static uint8_t last_pir_state = -1;
     static uint8_t last_radar_state = -1;
@@ -80,83 +107,105 @@
 //***   Declaraciones de funciones (prototipos) ***//
     static esp_err_t init_wifi(void);
     static esp_err_t init_esp_now(void);
-    void recv_cb(const esp_now_recv_info_t *esp_now_info, const uint8_t *data, uint8_t data_len);
+    void recv_cb(const esp_now_recv_info_t *esp_now_info, const uint8_t *data, int data_len);
     void send_cb(const uint8_t *mac_addr, esp_now_send_status_t status);
     static esp_err_t register_peer(uint8_t *peer_addr);
     static void input_init();
+    static void send_boot_frame(void);
+    static void restore_detection(void);
     static float read_lm35_temperature();
+    #if CONFIG_PULSE_SENSE_ENABLE
+    static void pulse_sample_cb(const pulse_sense_sample_t *sample, void *arg);
+    #else
     void IRAM_ATTR pir_isr_handler(void* arg);
     void IRAM_ATTR radar_isr_handler(void* arg);
+    #endif
     void process();
+    void sensing_task(void *pvParameters);
+    void tx_task(void *pvParameters);
+    void rx_task(void *pvParameters);
     void servo_control(void *pvParameters);
 
 //***   Estructuras de datos y tipos personalizados ***//
     typedef struct {
-        float temperature;
-        uint8_t pir_state;
-        uint8_t radar_state;
-    } device_data_t;
+        uint8_t src_addr[ESP_NOW_ETH_ALEN];
+        uint16_t seq;
+        sensor_data_t data;
+    } rx_frame_t;
 
+    // Estado de detección escrito desde las ISRs (o el callback de pulse_sense) y leído por
+    // process() y sensing_task; se lee siempre completo a través del seqlock.
     typedef struct {
-        uint8_t packet_id;
-        float lm35_temperature;
-        uint8_t pir_state;
-        uint8_t radar_state;
-        device_data_t other_device_data;
-    } sensor_data_t;
+        uint8_t pir;
+        uint8_t radar;
+        TickType_t last_pir;            // Tick del último flanco de cada sensor
+        TickType_t last_radar;
+        uint32_t detection_time_us;     // Inicio de la detección en curso, 0 si ya se actuó
+    } detection_shared_t;
+
+    // Lo que se retiene en RTC para reanudar tras un fallo.
+    typedef struct {
+        uint8_t pir;
+        uint8_t radar;
+    } retained_detection_t;
+
+    static detection_shared_t detection;
+    static shared_seqlock_t detection_lock = SHARED_SEQLOCK_INITIALIZER;
 
 //***   Función principal (main)    ***//
     void app_main(void)
     {
         //***   Declaración de variables locales   ***//
         //***   Inicialización y asignaciones  ***//  
+        #if CONFIG_CRASH_GUARD_ENABLE
+            ESP_ERROR_CHECK(crash_guard_init());
+        #endif
+            tx_queue = STATIC_QUEUE_CREATE(1, sizeof(sensor_data_t));
+            rx_queue = STATIC_QUEUE_CREATE(8, sizeof(rx_frame_t));
             ESP_ERROR_CHECK(init_wifi());
             ESP_ERROR_CHECK(init_esp_now());
+            ESP_ERROR_CHECK(espnow_group_init());
 
             input_init();
-
-            for (uint8_t i = 0; i < sizeof(mac_de_los_dispositivos_destino) / sizeof(mac_de_los_dispositivos_destino[0]); i++) {
-                ESP_ERROR_CHECK(register_peer(mac_de_los_dispositivos_destino[i]));
+            restore_detection();
+        #if CONFIG_FAST_BOOT_ENABLE
+            // Alerta al aire antes de la inicialización no crítica.
+            send_boot_frame();
+            ESP_ERROR_CHECK(fast_boot_deferred_init());
+        #endif
+
+            if (fast_boot_restore_peers() == 0) {
+                for (uint8_t i = 0; i < sizeof(mac_de_los_dispositivos_destino) / sizeof(mac_de_los_dispositivos_destino[0]); i++) {
+                    ESP_ERROR_CHECK(register_peer(mac_de_los_dispositivos_destino[i]));
+                }
             }
+            // Registra la pasarela como par cifrado: solo sus órdenes autenticadas mueven el servo.
+            ESP_ERROR_CHECK(espnow_secure_init());
+            ESP_ERROR_CHECK(espnow_ota_init());
+            ESP_ERROR_CHECK(thermal_gov_start());
 
             gpio_reset_pin(LED_PIN);
             gpio_set_direction(LED_PIN, GPIO_MODE_OUTPUT);
             gpio_set_level(LED_PIN, 0);
 
         //***   Estructura de control - Bucle(s) o condicionales    ***//
-            while (1)
-            {
-                //***   Llamadas a funciones   ***//
-                    process();
-                    xTaskCreate(servo_control, "servo_control_task", 4096, NULL, 5, NULL);
-                    float temperature = read_lm35_temperature();
-
-                //***   Operaciones y cálculos  ***//
-                    sensor_data_t sensor_data;
-                    sensor_data.packet_id = LM35_PACKET_ID;
-                    sensor_data.lm35_temperature = temperature;
-                    sensor_data.pir_state = pir_state;
-                    sensor_data.radar_state = radar_state;
-
-                    sensor_data.other_device_data.temperature = 0.0;
-                    sensor_data.other_device_data.pir_state = 0;
-                    sensor_data.other_device_data.radar_state = 0;
-
-                //***   Entrada y salida de datos   ***//
-                    for (uint8_t i = 0; i < sizeof(mac_de_los_dispositivos_destino) / sizeof(mac_de_los_dispositivos_destino[0]); i++) {
-                        esp_now_send(mac_de_los_dispositivos_destino[i], (uint8_t *)&sensor_data, sizeof(sensor_data));
-                    }
-                    ESP_LOGI(TAG, "Data sent: LM35 Temperature=%.2f°C, PIR=%d, Radar=%d", sensor_data.lm35_temperature, sensor_data.pir_state, sensor_data.radar_state);
-
-                //***   Liberación de memoria (si es necesario) ***//
-                //***   Retorno de valores y finalización del programa  ***//
-                    vTaskDelay(pdMS_TO_TICKS(500));
-            }
+        //***   Llamadas a funciones   ***//
+            ESP_ERROR_CHECK(TASK_LAYOUT_CREATE(rx_task, "rx_task", 3072, NULL, TASK_CLASS_RADIO_RX, NULL));
+            ESP_ERROR_CHECK(TASK_LAYOUT_CREATE(tx_task, "tx_task", 3072, NULL, TASK_CLASS_RADIO_TX, NULL));
+            ESP_ERROR_CHECK(TASK_LAYOUT_CREATE(servo_control, "servo_control_task", 4096, NULL, TASK_CLASS_ACTUATION, NULL));
+            ESP_ERROR_CHECK(TASK_LAYOUT_CREATE(sensing_task, "sensing_task", 4096, NULL, TASK_CLASS_SENSING, NULL));
+            task_layout_start_monitor();
+            trace_start();
+            static_alloc_seal();
+            crash_guard_ready();
     }
 
 //***Implementación de funciones***//
     static esp_err_t init_wifi(void)
     {
+    #if CONFIG_FAST_BOOT_ENABLE
+        esp_err_t err = fast_boot_wifi_init(ESP_CHANNEL);
+    #else
         wifi_init_config_t wifi_init_config = WIFI_INIT_CONFIG_DEFAULT();
         esp_netif_init();
         esp_event_loop_create_default();
@@ -166,47 +215,68 @@
         esp_wifi_set_storage(WIFI_STORAGE_FLASH);
         esp_wifi_start();
         ESP_LOGI(TAG, "wifi init completed");
-        return ESP_OK;
+        esp_err_t err = ESP_OK;
+    #endif
+    #if CONFIG_LINK_QUALITY_ENABLE
+        if (err == ESP_OK) {err = link_quality_set_protocol();}
+    #endif
+        return err;
     }
 
     static esp_err_t init_esp_now(void)
     {
+        esp_read_mac(own_mac, ESP_MAC_WIFI_STA);
         esp_now_init();
         esp_now_register_recv_cb(recv_cb);
         esp_now_register_send_cb(send_cb);
+    #if CONFIG_LINK_QUALITY_ENABLE
+        ESP_ERROR_CHECK(link_quality_start());
+    #endif
         ESP_LOGI(TAG, "esp now init completed");
         return ESP_OK;
     }
 
-    void recv_cb(const esp_now_recv_info_t *esp_now_info, const uint8_t *data, uint8_t data_len)
+    void recv_cb(const esp_now_recv_info_t *esp_now_info, const uint8_t *data, int data_len)
     {
-        if (data_len == sizeof(sensor_data_t))
+        TRACE_BEGIN(TRACE_RECV_CB);
+        link_quality_on_recv(esp_now_info);
+        const espnow_group_hdr_t *hdr;
+        size_t payload_len;
+        const uint8_t *payload = espnow_group_recv(esp_now_info, data, data_len, &hdr, &payload_len);
+        if (payload != NULL && (espnow_ota_handle(esp_now_info, hdr, payload, payload_len) ||
+                                espnow_secure_handle(esp_now_info, hdr, payload, payload_len))) {
+            TRACE_END(TRACE_RECV_CB);
+            return;
+        }
+        if (payload != NULL) {metrics_strip(hdr->flags & ESPNOW_GROUP_FLAG_METRICS, payload, &payload_len, NULL);}
+
+        // Orden de una regla de la pasarela: de sus actuadores este nodo solo tiene el servo 0. Con
+        // cifrado habilitado solo cuenta si llega con etiqueta válida de la pasarela.
+        rule_engine_actuation_t actuation;
+        if (payload != NULL && hdr->type == ESPNOW_MSG_ACTUATE &&
+            espnow_secure_verify(esp_now_info, hdr, payload, &payload_len) &&
+            rule_engine_actuation_decode(payload, payload_len, own_mac, &actuation) &&
+            actuation.actuator == RULE_ACTUATOR_SERVO && actuation.index == 0)
         {
-            sensor_data_t *received_data = (sensor_data_t *)data;
-
-            if (received_data->packet_id == LM35_PACKET_ID)
-            {
-                float received_temperature = received_data->lm35_temperature;
-                uint8_t received_pir_state = received_data->pir_state;
-                uint8_t received_radar_state = received_data->radar_state;
-
-                memcpy(remote_mac, esp_now_info->src_addr, ESP_NOW_ETH_ALEN);
-
-                ESP_LOGI(TAG, "Recv: " MACSTR ": Temperature=%.2f°C, PIR=%d, Radar=%d",
-                        MAC2STR(remote_mac), received_temperature, received_pir_state, received_radar_state);
-
-                if (received_radar_state) {
-                    led_state = 1;
-                } else {
-                    led_state = 0;
-                }
+            shared_flag_set(&rule_hold_ms, actuation.duration_ms);
+            shared_flag_set(&rule_sweeps, shared_flag_get(&rule_sweeps) + 1);
+        }
 
-            }
+        rx_frame_t frame;
+        if (payload != NULL && hdr->type == ESPNOW_MSG_SENSOR && node_sensor_decode(payload, payload_len, &frame.data))
+        {
+            memcpy(frame.src_addr, esp_now_info->src_addr, ESP_NOW_ETH_ALEN);
+            frame.seq = hdr->seq;
+            if (rx_queue == NULL || xQueueSend(rx_queue, &frame, 0) != pdTRUE) {metrics_inc(METRIC_RADIO_RX_DROP);}
+            else {metrics_max(METRIC_QUEUE_DEPTH, uxQueueMessagesWaiting(rx_queue));}
         }
+        TRACE_END_ARG(TRACE_RECV_CB, payload != NULL ? hdr->seq : 0);
     }
 
     void send_cb(const uint8_t *mac_addr, esp_now_send_status_t status)
     {
+        fast_boot_tx_done();
+        link_quality_on_send(mac_addr, status);
         if (status == ESP_NOW_SEND_SUCCESS)
         {
             ESP_LOGI(TAG, "Data sent to " MACSTR " successfully", MAC2STR(mac_addr));
@@ -214,16 +284,13 @@
         else
         {
             ESP_LOGW(TAG, "Data sending to " MACSTR " failed", MAC2STR(mac_addr));
+            metrics_inc(METRIC_RADIO_TX_FAIL);
         }
     }
 
     static esp_err_t register_peer(uint8_t *peer_addr)
     {
-        esp_now_peer_info_t esp_now_peer_info = {};
-        memcpy(esp_now_peer_info.peer_addr, peer_addr, ESP_NOW_ETH_ALEN);
-        esp_now_peer_info.channel = ESP_CHANNEL;
-        esp_now_peer_info.ifidx = ESP_IF_WIFI_STA;
-        esp_now_add_peer(&esp_now_peer_info);
+        fast_boot_add_peer(peer_addr, ESP_CHANNEL);
         return ESP_OK;
     }
 
@@ -231,28 +298,35 @@
     {
         adc1_config_width(ADC_WIDTH_BIT_12);
         adc1_config_channel_atten(ADC1_CHANNEL_6, ADC_ATTEN_DB_11);
-        adc_chars = calloc(1, sizeof(esp_adc_cal_characteristics_t));
-        esp_adc_cal_value_t val_type = esp_adc_cal_characterize(ADC_UNIT_1, ADC_ATTEN_DB_11, ADC_WIDTH_BIT_12, 1100, adc_chars);
+        // Tras un fallo se reutiliza la caracterización del arranque anterior (mismo firmware).
+        if (!crash_guard_restore(CRASH_GUARD_SLOT_CALIBRATION, &adc_chars, sizeof(adc_chars))) {
+            esp_adc_cal_characterize(ADC_UNIT_1, ADC_ATTEN_DB_11, ADC_WIDTH_BIT_12, 1100, &adc_chars);
+            crash_guard_retain(CRASH_GUARD_SLOT_CALIBRATION, &adc_chars, sizeof(adc_chars));
+        }
 
         gpio_config_t io_conf;
 
-        io_conf.intr_type = GPIO_INTR_NEGEDGE;
+        io_conf.intr_type = SENSOR_INTR_TYPE;
         io_conf.pin_bit_mask = (1ULL << PIR_PIN);
         io_conf.mode = GPIO_MODE_INPUT;
         io_conf.pull_up_en = GPIO_PULLUP_DISABLE;
         io_conf.pull_down_en = GPIO_PULLDOWN_DISABLE;
         gpio_config(&io_conf);
 
-        io_conf.intr_type = GPIO_INTR_NEGEDGE;
+        io_conf.intr_type = SENSOR_INTR_TYPE;
         io_conf.pin_bit_mask = (1ULL << RADAR_SENSOR_PIN);
         io_conf.mode = GPIO_MODE_INPUT;
         io_conf.pull_up_en = GPIO_PULLUP_DISABLE;
         io_conf.pull_down_en = GPIO_PULLDOWN_DISABLE;
         gpio_config(&io_conf);
 
+    #if CONFIG_PULSE_SENSE_ENABLE
+        ESP_ERROR_CHECK(pulse_sense_start(PIR_PIN, RADAR_SENSOR_PIN, pulse_sample_cb, NULL));
+    #else
         gpio_install_isr_service(0);
         gpio_isr_handler_add(PIR_PIN, pir_isr_handler, NULL);
         gpio_isr_handler_add(RADAR_SENSOR_PIN, radar_isr_handler, NULL);
+    #endif
     }
 
     static float read_lm35_temperature()
@@ -264,44 +338,127 @@
             vTaskDelay(pdMS_TO_TICKS(50));
         }
         adc_reading /= 10;
-        float voltage = adc_reading * (5.0 / 4095.0);
-        float temperature = (voltage) * 100.0;
-        return temperature;
+        metrics_add(METRIC_ADC_SAMPLES, 10);
+        return node_lm35_celsius(adc_reading);
     }
 
+    // Primera trama sin esperar el promediado del LM35 (10 muestras, 500 ms).
+    static void send_boot_frame(void)
+    {
+        if (fast_boot_woken_by_gpio()) {
+            shared_seqlock_write_begin(&detection_lock);
+            detection.pir = 1;
+            detection.last_pir = xTaskGetTickCount();
+            shared_seqlock_write_end(&detection_lock);
+        }
+        detection_shared_t snapshot;
+        shared_seqlock_read(&detection_lock, &snapshot, &detection, sizeof(snapshot));
+        sensor_data_t sensor_data = {
+            .packet_id = LM35_PACKET_ID,
+            .lm35_temperature = node_lm35_celsius(adc1_get_raw(ADC_CHANNEL_LM35)),
+            .pir_state = snapshot.pir,
+            .radar_state = snapshot.radar,
+        };
+        uint8_t frame[ESPNOW_GROUP_MAX_PAYLOAD];
+        size_t frame_len = node_sensor_encode(frame, sizeof(frame), &sensor_data);
+        espnow_group_send(CONFIG_ESPNOW_GROUP_ZONE, ESPNOW_MSG_SENSOR, 0, frame, frame_len);
+    }
+
+    // Reanudación en caliente: una detección activa antes del fallo sigue vigente un
+    // detection_timeout completo en lugar de perderse.
+    static void restore_detection(void)
+    {
+        retained_detection_t retained;
+        if (!crash_guard_restore(CRASH_GUARD_SLOT_APP, &retained, sizeof(retained))) {return;}
+        TickType_t now = xTaskGetTickCount();
+        shared_seqlock_write_begin(&detection_lock);
+        if (retained.pir) {
+            detection.pir = 1;
+            detection.last_pir = now;
+        }
+        if (retained.radar) {
+            detection.radar = 1;
+            detection.last_radar = now;
+        }
+        shared_seqlock_write_end(&detection_lock);
+        ESP_LOGI(TAG, "Detection restored: PIR=%d, Radar=%d", retained.pir, retained.radar);
+    }
+
+    #if CONFIG_PULSE_SENSE_ENABLE
+    // Una muestra por periodo del front end PCNT en lugar de una interrupción por flanco.
+    static void pulse_sample_cb(const pulse_sense_sample_t *sample, void *arg)
+    {
+        TickType_t now = xTaskGetTickCount();
+        uint32_t now_us = (uint32_t)esp_timer_get_time();
+        if (sample->pir_edges || sample->radar_edges) {
+            shared_seqlock_write_begin(&detection_lock);
+            // El flanco ocurrió dentro de la ventana: se toma su punto medio.
+            if (!detection.pir && !detection.radar) {detection.detection_time_us = now_us - sample->window_us / 2;}
+            if (sample->pir_edges > 0) {
+                detection.pir = 1;
+                detection.last_pir = now;
+            }
+            if (sample->radar_edges > 0) {
+                detection.radar = 1;
+                detection.last_radar = now;
+            }
+            shared_seqlock_write_end(&detection_lock);
+        }
+        if (sample->pir_edges > 0) {
+            TRACE_INSTANT(TRACE_ISR_PIR, 0);
+            metrics_add(METRIC_ISR_PIR, sample->pir_edges);
+        }
+        if (sample->radar_edges > 0) {
+            TRACE_INSTANT(TRACE_ISR_RADAR, 0);
+            metrics_add(METRIC_ISR_RADAR, sample->radar_edges);
+            ESP_LOGD(TAG, "Radar: %lu edges, Doppler %.1f Hz, %.2f m/s", (unsigned long)sample->radar_edges,
+                     sample->radar_doppler_hz, sample->radar_speed_mps);
+        }
+        metrics_set(METRIC_RADAR_DOPPLER_HZ, (uint32_t)sample->radar_doppler_hz);
+    }
+    #else
     void IRAM_ATTR pir_isr_handler(void *arg)
     {
-        pir_state = 1;
-        last_detection_time_pir = xTaskGetTickCount();
+        uint32_t now_us = (uint32_t)esp_timer_get_time();
+        shared_seqlock_write_begin(&detection_lock);
+        if (!detection.pir && !detection.radar) {detection.detection_time_us = now_us;}
+        detection.pir = 1;
+        detection.last_pir = xTaskGetTickCountFromISR();
+        shared_seqlock_write_end(&detection_lock);
+        TRACE_INSTANT(TRACE_ISR_PIR, 0);
+        metrics_inc(METRIC_ISR_PIR);
     }
 
     void IRAM_ATTR radar_isr_handler(void *arg)
     {
-        radar_state = 1;
-        last_detection_time_radar = xTaskGetTickCount();
+        uint32_t now_us = (uint32_t)esp_timer_get_time();
+        shared_seqlock_write_begin(&detection_lock);
+        if (!detection.pir && !detection.radar) {detection.detection_time_us = now_us;}
+        detection.radar = 1;
+        detection.last_radar = xTaskGetTickCountFromISR();
+        shared_seqlock_write_end(&detection_lock);
+        TRACE_INSTANT(TRACE_ISR_RADAR, 0);
+        metrics_inc(METRIC_ISR_RADAR);
     }
+    #endif
 
     void process() {
-        uint8_t presence_detected_pir = 0;
-        uint8_t presence_detected_radar = 0;
-
-        if (pir_state) {presence_detected_pir = 1;}
-        if (radar_state) {presence_detected_radar = 1;}
-
-        if (presence_detected_pir || presence_detected_radar || led_state) { 
-            led_state = 1;
-            gpio_set_level(LED_PIN, 1);
-        } else {led_state = 0;gpio_set_level(LED_PIN, 0);}
-
-        if ((xTaskGetTickCount() - last_detection_time_pir) >= detection_timeout) {
-            pir_state = 0;
-            led_state = 0;
-
-        }
-        if ((xTaskGetTickCount() - last_detection_time_radar) >= detection_timeout) {
-            radar_state = 0;
-            led_state = 0;
+        detection_shared_t snapshot;
+        shared_seqlock_read(&detection_lock, &snapshot, &detection, sizeof(snapshot));
+        const detection_state_t previous = {snapshot.pir, snapshot.radar, (uint8_t)shared_flag_get(&led_state)};
+        detection_state_t state = previous;
+        TickType_t now = xTaskGetTickCount();
+        gpio_set_level(LED_PIN, node_detection_process(&state, now - snapshot.last_pir,
+                                                       now - snapshot.last_radar, detection_timeout));
+        // Solo se propagan los vencimientos; un flanco llegado durante el ciclo (marca de
+        // tiempo distinta a la del snapshot) se conserva.
+        if ((previous.pir && !state.pir) || (previous.radar && !state.radar)) {
+            shared_seqlock_write_begin(&detection_lock);
+            if (previous.pir && !state.pir && detection.last_pir == snapshot.last_pir) {detection.pir = 0;}
+            if (previous.radar && !state.radar && detection.last_radar == snapshot.last_radar) {detection.radar = 0;}
+            shared_seqlock_write_end(&detection_lock);
         }
+        shared_flag_set(&led_state, state.led);
     }
 
     void servo_control(void *pvParameters) {
@@ -325,37 +482,158 @@
         gpio_set_direction(GPIO_INPUT_PIN, GPIO_MODE_INPUT);
         gpio_set_direction(GPIO_OUTPUT_PIN, GPIO_MODE_OUTPUT);
         uint8_t direction = 1;
-        uint8_t previous_input = 0;
-        TickType_t lastToggleTime = xTaskGetTickCount();
+        actuation_gate_t gate = {.previous_input = 0, .last_start = xTaskGetTickCount()};
+        uint32_t handled_sweeps = shared_flag_get(&rule_sweeps);
+        crash_guard_watch();
 
         while (1) {
-            uint8_t input = led_state;
+            crash_guard_feed();
+            // Un pedido de regla es un pulso de una vuelta: flanco de subida si la entrada estaba
+            // en reposo, sujeto al mismo enfriamiento que una detección.
+            uint32_t sweeps = shared_flag_get(&rule_sweeps);
+            bool rule_pulse = sweeps != handled_sweeps;
+            uint8_t input = shared_flag_get(&led_state) | rule_pulse;
+            handled_sweeps = sweeps;
+            // La duración de la regla reemplaza la pausa en el extremo del barrido.
+            uint32_t hold_ms = rule_pulse ? shared_flag_get(&rule_hold_ms) : 0;
+            if (hold_ms == 0) {hold_ms = NODE_SERVO_PAUSE_MS;}
             TickType_t currentTime = xTaskGetTickCount();
 
-            if (input == 1 && previous_input == 0 &&
-                (currentTime - lastToggleTime) >= pdMS_TO_TICKS(1000)) {
-                lastToggleTime = currentTime;
+            // Con menor ciclo de trabajo permitido se espacian los barridos del servo.
+            const TickType_t cooldown = pdMS_TO_TICKS(NODE_ACTUATION_COOLDOWN_MS * 100 / thermal_gov_actuator_percent());
+
+            if (node_actuation_gate(&gate, input, currentTime, cooldown)) {
                 gpio_set_level(GPIO_OUTPUT_PIN, 1);
-                for (uint8_t duty = SERVO_MIN_PULSEWIDTH; duty <= SERVO_MAX_PULSEWIDTH; duty++) {
+                // Latencia detección-actuación; se descartan detecciones remotas o antiguas.
+                shared_seqlock_write_begin(&detection_lock);
+                uint32_t detection_time_us = detection.detection_time_us;
+                detection.detection_time_us = 0;
+                shared_seqlock_write_end(&detection_lock);
+                uint32_t elapsed_us = (uint32_t)esp_timer_get_time() - detection_time_us;
+                if (detection_time_us != 0 && elapsed_us < 1000000) {task_layout_record_latency(elapsed_us);}
+                metrics_inc(METRIC_ACTUATIONS);
+                TRACE_BEGIN(TRACE_SERVO_ACTUATE);
+                for (uint16_t duty = NODE_SERVO_MIN_PULSEWIDTH; duty <= NODE_SERVO_MAX_PULSEWIDTH; duty++) {
+                    crash_guard_feed();
                     ledc_set_duty(ledc_conf.speed_mode, ledc_conf.channel, duty);
                     ledc_update_duty(ledc_conf.speed_mode, ledc_conf.channel);
-                    vTaskDelay(pdMS_TO_TICKS(10));
+                    vTaskDelay(pdMS_TO_TICKS(NODE_SERVO_STEP_MS));
+                }
+                // Una regla puede pedir hasta 65 s: se sostiene por tramos sin dejar de alimentar el watchdog.
+                for (uint32_t held = 0; held < hold_ms; held += NODE_SERVO_PAUSE_MS) {
+                    crash_guard_feed();
+                    vTaskDelay(pdMS_TO_TICKS(hold_ms - held < NODE_SERVO_PAUSE_MS ? hold_ms - held : NODE_SERVO_PAUSE_MS));
                 }
-                vTaskDelay(pdMS_TO_TICKS(500));
                 direction = -direction;
-                for (uint8_t duty = SERVO_MAX_PULSEWIDTH; duty >= SERVO_MIN_PULSEWIDTH; duty--) {
+                for (uint16_t duty = NODE_SERVO_MAX_PULSEWIDTH; duty >= NODE_SERVO_MIN_PULSEWIDTH; duty--) {
+                    crash_guard_feed();
                     ledc_set_duty(ledc_conf.speed_mode, ledc_conf.channel, duty);
                     ledc_update_duty(ledc_conf.speed_mode, ledc_conf.channel);
-                    vTaskDelay(pdMS_TO_TICKS(10));
+                    vTaskDelay(pdMS_TO_TICKS(NODE_SERVO_STEP_MS));
                 }
-                vTaskDelay(pdMS_TO_TICKS(500));
+                vTaskDelay(pdMS_TO_TICKS(NODE_SERVO_PAUSE_MS));
                 direction = -direction;
+                TRACE_END(TRACE_SERVO_ACTUATE);
             } else {
                 ledc_set_duty(ledc_conf.speed_mode, ledc_conf.channel, 0);
                 ledc_update_duty(ledc_conf.speed_mode, ledc_conf.channel);
                 gpio_set_level(GPIO_OUTPUT_PIN, 0);
             }
-            previous_input = input;
             vTaskDelay(pdMS_TO_TICKS(10));
         }
-    }
\ No newline at end of file
+    }
+
+    void sensing_task(void *pvParameters)
+    {
+        uint8_t cycles_since_report = 0;
+        uint8_t reported_pir = 0;
+        uint8_t reported_radar = 0;
+        crash_guard_watch();
+
+        while (1)
+        {
+                crash_guard_feed();
+            //***   Llamadas a funciones   ***//
+                TRACE_BEGIN(TRACE_PROCESS);
+                process();
+                TRACE_END(TRACE_PROCESS);
+                TRACE_BEGIN(TRACE_LM35_READ);
+                float temperature = read_lm35_temperature();
+                TRACE_END(TRACE_LM35_READ);
+                thermal_gov_report_enclosure(temperature);
+
+            //***   Operaciones y cálculos  ***//
+                detection_shared_t snapshot;
+                shared_seqlock_read(&detection_lock, &snapshot, &detection, sizeof(snapshot));
+                const retained_detection_t retained = {snapshot.pir, snapshot.radar};
+                crash_guard_retain(CRASH_GUARD_SLOT_APP, &retained, sizeof(retained));
+                sensor_data_t sensor_data;
+                sensor_data.packet_id = LM35_PACKET_ID;
+                sensor_data.lm35_temperature = temperature;
+                sensor_data.pir_state = snapshot.pir;
+                sensor_data.radar_state = snapshot.radar;
+
+                sensor_data.other_device_data.temperature = 0.0;
+                sensor_data.other_device_data.pir_state = 0;
+                sensor_data.other_device_data.radar_state = 0;
+
+            //***   Entrada y salida de datos   ***//
+                // Un cambio de detección sale de inmediato; el reporte periódico se espacia con el nivel térmico.
+                if (sensor_data.pir_state != reported_pir || sensor_data.radar_state != reported_radar ||
+                    ++cycles_since_report >= thermal_gov_report_scale()) {
+                    xQueueOverwrite(tx_queue, &sensor_data);
+                    reported_pir = sensor_data.pir_state;
+                    reported_radar = sensor_data.radar_state;
+                    cycles_since_report = 0;
+                }
+
+            //***   Liberación de memoria (si es necesario) ***//
+            //***   Retorno de valores y finalización del programa  ***//
+                vTaskDelay(pdMS_TO_TICKS(500));
+        }
+    }
+
+    void tx_task(void *pvParameters)
+    {
+        sensor_data_t sensor_data;
+        uint8_t frame[ESPNOW_GROUP_MAX_PAYLOAD];
+        crash_guard_watch();
+        while (1)
+        {
+            crash_guard_feed();
+            if (xQueueReceive(tx_queue, &sensor_data, WDT_POLL) != pdTRUE) {continue;}
+            size_t frame_len = node_sensor_encode(frame, sizeof(frame), &sensor_data);
+            size_t metrics_len = metrics_piggyback(frame + frame_len, sizeof(frame) - frame_len);
+            espnow_group_send(CONFIG_ESPNOW_GROUP_ZONE, ESPNOW_MSG_SENSOR, metrics_len ? ESPNOW_GROUP_FLAG_METRICS : 0,
+                              frame, frame_len + metrics_len);
+            ESP_LOGI(TAG, "Data sent: LM35 Temperature=%.2f°C, PIR=%d, Radar=%d", sensor_data.lm35_temperature, sensor_data.pir_state, sensor_data.radar_state);
+        }
+    }
+
+    void rx_task(void *pvParameters)
+    {
+        rx_frame_t frame;
+        crash_guard_watch();
+        while (1)
+        {
+            crash_guard_feed();
+            if (xQueueReceive(rx_queue, &frame, WDT_POLL) != pdTRUE) {continue;}
+            TRACE_BEGIN_ARG(TRACE_RX_TASK, frame.seq);
+            const sensor_data_t *received_data = &frame.data;
+
+            if (received_data->packet_id == LM35_PACKET_ID)
+            {
+                float received_temperature = received_data->lm35_temperature;
+                uint8_t received_pir_state = received_data->pir_state;
+                uint8_t received_radar_state = received_data->radar_state;
+
+                memcpy(remote_mac, frame.src_addr, ESP_NOW_ETH_ALEN);
+
+                ESP_LOGI(TAG, "Recv: " MACSTR ": Temperature=%.2f°C, PIR=%d, Radar=%d",
+                        MAC2STR(remote_mac), received_temperature, received_pir_state, received_radar_state);
+
+                shared_flag_set(&led_state, node_remote_actuator_level(received_data));
+            }
+            TRACE_END(TRACE_RX_TASK);
+        }
+    }
@@ -32,6 +32,22 @@
     #include "nvs_flash.h"
     #include "esp_log.h"
     #include "driver/gpio.h"
+    #include "espnow_group.h"
+    #include "espnow_ota.h"
+    #include "espnow_secure.h"
+    #include "metrics.h"
+    #include "node_metrics.h"
+    #include "node_logic.h"
+    #include "static_alloc.h"
+    #include "sensor_anomaly.h"
+    #include "mqtt_uplink.h"
+    #include "ws_dashboard.h"
+    #include "cmd_sync.h"
+    #include "link_quality.h"
+    #include "rollup.h"
+    #include "frame_capture.h"
+    #include "load_gen.h"
+    #include "rule_engine.h"
 
 //***   Definición de constantes y macros   ***//
     #define ESP_CHANNEL 1
@@ -39,6 +55,8 @@
     #define DISCONNECT_THRESHOLD_MS 2000
     #define MAX_DISCONNECT_TIMEOUT_MS 3000
     #define MAX_RESPONDERS 4
+    #define ENCLOSURE_LIMIT_C 60.0f
+    #define LM35_MAX_C 150.0f          // Máximo del rango del LM35; por encima es falla o riel
 
     uint8_t led_state = 0;
 
@@ -54,13 +72,29 @@
     static TickType_t last_update[MAX_RESPONDERS] = {0};
     static const char *TAG = "esp_now_init";
 
+    #if CONFIG_RULE_ENGINE_ENABLE
+    extern const char default_rules_start[] asm("_binary_rules_txt_start");
+    extern const char default_rules_end[] asm("_binary_rules_txt_end");
+    #endif
+
 //***   Declaraciones de funciones (prototipos) ***//
     static esp_err_t init_wifi(void);
-    void recv_cb(const esp_now_recv_info_t *esp_now_info, const uint8_t *data, uint8_t data_len);
+    void recv_cb(const esp_now_recv_info_t *esp_now_info, const uint8_t *data, int data_len);
     void check_disconnections();
     void send_cb(const uint8_t *mac_addr, esp_now_send_status_t status);
     static esp_err_t init_esp_now(void);
-    static esp_err_t register_peer(uint8_t *peer_addr);
+    static esp_err_t register_peers(void);
+    static esp_err_t send_command(const uint8_t *mac, const void *payload, size_t len);
+    static void poll_terminal(void);
+    static esp_err_t init_anomaly_detection(void);
+    static void publish_anomaly(const sensor_anomaly_event_t *event);
+    #if CONFIG_FRAME_CAPTURE_UPLINK && CONFIG_MQTT_UPLINK_ENABLE
+    static void capture_to_uplink(const frame_capture_record_t *record, const uint8_t *frame);
+    #endif
+    #if CONFIG_RULE_ENGINE_ENABLE
+    static esp_err_t init_rules(void);
+    static void run_rule_action(const rule_engine_action_t *action);
+    #endif
     esp_err_t init_led(void);
     esp_err_t toggle_led(void);
 
@@ -71,15 +105,56 @@
         //***   Declaración de variables locales   ***//
         //***   Inicialización y asignaciones  ***//   
             init_wifi();
+        #if CONFIG_LOAD_GEN_ENABLE
+            // Rol generador de carga: misma imagen, solo la radio y la tarea del generador. Sin
+            // registro por trama en send_cb: la consola limitaría la tasa.
+            esp_log_level_set(TAG, ESP_LOG_WARN);
+            ESP_ERROR_CHECK(init_esp_now());
+            ESP_ERROR_CHECK(espnow_group_init());
+            ESP_ERROR_CHECK(load_gen_start());
+            return;
+        #endif
+        #if CONFIG_MQTT_UPLINK_ENABLE && CONFIG_ROLLUP_ENABLE
+            // Historial de cualquier nodo: publicar "<mac> raw|minute|hour" en <prefijo>/<MAC>/query.
+            mqtt_uplink_set_query_handler(rollup_query);
+        #endif
+        #if CONFIG_MQTT_UPLINK_ENABLE
+            ESP_ERROR_CHECK(mqtt_uplink_start());
+        #endif
+        #if CONFIG_WS_DASHBOARD_ENABLE
+            ESP_ERROR_CHECK(ws_dashboard_start());
+        #endif
+        #if CONFIG_FRAME_CAPTURE_UPLINK && CONFIG_MQTT_UPLINK_ENABLE
+            ESP_ERROR_CHECK(frame_capture_start(capture_to_uplink));
+        #elif CONFIG_FRAME_CAPTURE_ENABLE
+            ESP_ERROR_CHECK(frame_capture_start(NULL));
+        #endif
+        #if CONFIG_RULE_ENGINE_ENABLE
+            // Antes de la radio: las reglas se evalúan desde recv_cb.
+            if (init_rules() != ESP_OK) {ESP_LOGW(TAG, "Running without automation rules");}
+        #endif
             init_esp_now();
+            ESP_ERROR_CHECK(espnow_secure_init());
             register_peers();
+            espnow_group_init();
+            espnow_group_subscribe(ESPNOW_GROUP_GATEWAY);
+            espnow_ota_serve_partition(ESPNOW_GROUP_ALL);
+            espnow_secure_start_rotation();
+            ESP_ERROR_CHECK(cmd_sync_gateway_start(send_command));
             init_led();
+            ESP_ERROR_CHECK(init_anomaly_detection());
+            // newlib reserva el búfer de stdin en la primera lectura; sin búfer, poll_terminal
+            // no toca el heap después del sellado.
+            setvbuf(stdin, NULL, _IONBF, 0);
+            static_alloc_guard_current_task();
+            static_alloc_seal();
 
         //***   Estructura de control - Bucle(s) o condicionales    ***//
         while (1)
         {
             //***   Llamadas a funciones   ***//
                 check_disconnections();
+                poll_terminal();
                 toggle_led();
 
             //***   Operaciones y cálculos  ***//
@@ -91,6 +166,7 @@
                     if (i < MAX_RESPONDERS - 1){printf(", ");}
                 }
                 printf("\n");
+                node_metrics_publish();
                 
             //***   Liberación de memoria (si es necesario) ***//
             //***   Retorno de valores y finalización del programa  ***//
@@ -106,33 +182,94 @@
         esp_event_loop_create_default();
         nvs_flash_init();
         esp_wifi_init(&wifi_init_config);
+    #if CONFIG_WS_DASHBOARD_SOFTAP
+        // Punto de acceso para el tablero en el mismo canal de ESP-NOW: la radio no cambia de canal.
+        esp_netif_create_default_wifi_ap();
+        wifi_config_t ap_config = {
+            .ap = {
+                .ssid = CONFIG_WS_DASHBOARD_SSID,
+                .ssid_len = sizeof(CONFIG_WS_DASHBOARD_SSID) - 1,
+                .password = CONFIG_WS_DASHBOARD_PASSWORD,
+                .channel = ESP_CHANNEL,
+                .authmode = sizeof(CONFIG_WS_DASHBOARD_PASSWORD) > 1 ? WIFI_AUTH_WPA2_PSK : WIFI_AUTH_OPEN,
+                .max_connection = CONFIG_WS_DASHBOARD_MAX_CLIENTS,
+            },
+        };
+        esp_wifi_set_mode(WIFI_MODE_APSTA);
+        esp_wifi_set_config(WIFI_IF_AP, &ap_config);
+    #else
         esp_wifi_set_mode(WIFI_MODE_STA);
+    #endif
         esp_wifi_set_storage(WIFI_STORAGE_FLASH);
         esp_wifi_start();
+    #if CONFIG_LINK_QUALITY_ENABLE
+        // Con pares mixtos la pasarela usa el perfil "recibir LR" o el automático.
+        return link_quality_set_protocol();
+    #else
         return ESP_OK;
+    #endif
     }
 
     void recv_cb(const esp_now_recv_info_t *esp_now_info, const uint8_t *data, int data_len)
     {
-        if (data_len == sizeof(float))
+        frame_capture_record(esp_now_info, data, data_len);
+        link_quality_on_recv(esp_now_info);
+        const espnow_group_hdr_t *hdr;
+        size_t payload_len;
+        const uint8_t *payload = espnow_group_recv(esp_now_info, data, data_len, &hdr, &payload_len);
+        if (payload != NULL && espnow_ota_handle(esp_now_info, hdr, payload, payload_len)) {return;}
+        if (payload != NULL && espnow_secure_handle(esp_now_info, hdr, payload, payload_len)) {return;}
+
+        metrics_snapshot_t snapshot;
+        if (payload != NULL && metrics_strip(hdr->flags & ESPNOW_GROUP_FLAG_METRICS, payload, &payload_len, &snapshot)) {
+            node_metrics_update(esp_now_info->src_addr, &snapshot);
+        }
+        // Las tramas de un generador de carga se atribuyen al nodo virtual que indican.
+        const uint8_t *src = esp_now_info->src_addr;
+        uint8_t virtual_src[ESP_NOW_ETH_ALEN];
+        if (payload != NULL && load_gen_virtual_source(hdr, src, payload, &payload_len, virtual_src)) {src = virtual_src;}
+        if (payload != NULL && load_gen_handle(esp_now_info, hdr, payload, payload_len)) {return;}
+
+    #if CONFIG_RULE_ENGINE_ENABLE
+        sensor_data_t sensor;
+        if (payload != NULL && hdr->type == ESPNOW_MSG_SENSOR && node_sensor_decode(payload, payload_len, &sensor))
+        {
+            int node = rule_engine_node(src);
+            rule_engine_event(node, RULE_SENSOR_RADAR, sensor.radar_state);
+            rule_engine_event(node, RULE_SENSOR_PIR, sensor.pir_state);
+            rule_engine_event(node, RULE_SENSOR_TEMP, sensor.lm35_temperature);
+            metrics_inc(METRIC_GW_PROCESSED);
+        }
+    #endif
+
+        if (payload != NULL && hdr->type == ESPNOW_MSG_TEMPERATURE &&
+            (payload_len == sizeof(float) || payload_len == sizeof(float) + sizeof(uint32_t)))
         {
             float temperature;
-            memcpy(&temperature, data, sizeof(float));
-            uint8_t index = -1;
-            for (uint8_t i = 0; i < MAX_RESPONDERS; i++)
+            memcpy(&temperature, payload, sizeof(float));
+            if (payload_len > sizeof(float))
             {
-                if (memcmp(esp_now_info->src_addr, responder_macs[i], ESP_NOW_ETH_ALEN) == 0)
-                {
-                    index = i;
-                    break;
-                }
+                uint32_t applied_epoch;
+                memcpy(&applied_epoch, payload + sizeof(float), sizeof(applied_epoch));
+                cmd_sync_report(src, applied_epoch);
             }
-            if (index >= 0 && index < MAX_RESPONDERS)
+            sensor_anomaly_observe(src, SENSOR_ANOMALY_LM35, temperature);
+            rollup_insert(src, temperature);
+        #if CONFIG_RULE_ENGINE_ENABLE
+            rule_engine_event(rule_engine_node(src), RULE_SENSOR_TEMP, temperature);
+        #endif
+            mqtt_uplink_post_value(MQTT_UPLINK_TELEMETRY, src, "temp_c", temperature);
+            ws_dashboard_update(src, WS_FIELD_TEMP_C, temperature);
+            ws_dashboard_update(src, WS_FIELD_RSSI, esp_now_info->rx_ctrl->rssi);
+            ws_dashboard_update(src, WS_FIELD_ONLINE, 1);
+            int index = node_peer_index((const uint8_t (*)[NODE_MAC_LEN])responder_macs, MAX_RESPONDERS, src);
+            if (index >= 0)
             {
                 temperatures[index] = temperature;
                 connected[index] = true;
                 last_update[index] = xTaskGetTickCount();
             }
+            metrics_inc(METRIC_GW_PROCESSED);
         }
     }
 
@@ -145,20 +282,28 @@
             {
                 connected[i] = false;
                 temperatures[i] = 0.0;
+                ws_dashboard_update(responder_macs[i], WS_FIELD_ONLINE, 0);
             }
         }
     }
 
     void send_cb(const uint8_t *mac_addr, esp_now_send_status_t status)
     {
+        espnow_secure_send_status(mac_addr, status);
+        link_quality_on_send(mac_addr, status);
+        load_gen_on_send(mac_addr, status);
         if (status == ESP_NOW_SEND_SUCCESS){ESP_LOGI(TAG, "Data sent to " MACSTR " successfully", MAC2STR(mac_addr));}
-        else{ESP_LOGW(TAG, "Data sending to " MACSTR " failed", MAC2STR(mac_addr));}
+        else{ESP_LOGW(TAG, "Data sending to " MACSTR " failed", MAC2STR(mac_addr)); metrics_inc(METRIC_RADIO_TX_FAIL);}
     }
 
     static esp_err_t init_esp_now(void)
     {
         esp_err_t err = esp_now_init();
         if (err == ESP_OK){esp_now_register_recv_cb(recv_cb);}
+        if (err == ESP_OK){esp_now_register_send_cb(send_cb);}
+    #if CONFIG_LINK_QUALITY_ENABLE
+        if (err == ESP_OK){err = link_quality_start();}
+    #endif
         return err;
     }
 
@@ -166,15 +311,59 @@
     {
         for (uint8_t i = 0; i < MAX_RESPONDERS; i++)
         {
+        #if CONFIG_ESPNOW_SECURE_ENABLE
+            // Los respondedores reciben comandos: pares cifrados.
+            espnow_secure_add_peer(responder_macs[i], ESP_CHANNEL);
+        #else
             esp_now_peer_info_t esp_now_peer_info = {};
             memcpy(esp_now_peer_info.peer_addr, responder_macs[i], ESP_NOW_ETH_ALEN);
             esp_now_peer_info.channel = ESP_CHANNEL;
             esp_now_peer_info.ifidx = ESP_IF_WIFI_STA;
             esp_err_t err = esp_now_add_peer(&esp_now_peer_info);
+        #endif
         }
+    #if CONFIG_ESPNOW_SECURE_ENABLE && CONFIG_RULE_ENGINE_ENABLE
+        // Los nodos declarados en las reglas reciben órdenes de actuación: también cifrados.
+        const uint8_t *mac;
+        for (uint8_t node = 0; (mac = rule_engine_node_mac(node)) != NULL; node++) {espnow_secure_add_peer(mac, ESP_CHANNEL);}
+    #endif
         return ESP_OK;
     }
 
+    // Riel bajo en 0 ADC y alto en el máximo del LM35: la escala completa del ADC (500 °C) solo
+    // aparece con el sensor desconectado o en corto a 5 V.
+    static esp_err_t init_anomaly_detection(void)
+    {
+        sensor_anomaly_profile_t lm35 = {
+            .rail_low = node_lm35_celsius(0),
+            .rail_high = LM35_MAX_C,
+            .high_limit = ENCLOSURE_LIMIT_C,
+        };
+        sensor_anomaly_set_profile(SENSOR_ANOMALY_LM35, &lm35);
+        return sensor_anomaly_start(publish_anomaly);
+    }
+
+    static void publish_anomaly(const sensor_anomaly_event_t *event)
+    {
+        char json[160];
+        int len = snprintf(json, sizeof(json), "{\"sensor\":%u,\"raised\":%u,\"active\":%u,\"value\":%.2f,\"mean\":%.2f,\"sd\":%.2f}",
+                           event->sensor, event->raised, event->active, event->value, event->mean, event->stddev);
+        if (len > 0 && len < (int)sizeof(json)) {mqtt_uplink_post_json(MQTT_UPLINK_EVENTS, event->mac, json, len);}
+        ws_dashboard_update(event->mac, WS_FIELD_ANOMALY, event->active);
+    }
+
+    #if CONFIG_FRAME_CAPTURE_UPLINK && CONFIG_MQTT_UPLINK_ENABLE
+    // La trama capturada viaja en hexadecimal en el tópico de telemetría del nodo de origen.
+    static void capture_to_uplink(const frame_capture_record_t *record, const uint8_t *frame)
+    {
+        char json[64 + 2 * ESP_NOW_MAX_DATA_LEN];
+        int len = snprintf(json, sizeof(json), "{\"t_us\":%lld,\"rssi\":%d,\"frame\":\"", (long long)record->time_us, record->rssi);
+        for (uint8_t i = 0; i < record->len; i++) {len += snprintf(json + len, sizeof(json) - len, "%02x", frame[i]);}
+        len += snprintf(json + len, sizeof(json) - len, "\"}");
+        mqtt_uplink_post_json(MQTT_UPLINK_TELEMETRY, record->src, json, len);
+    }
+    #endif
+
     esp_err_t init_led(void)
     {
         gpio_reset_pin(LED_PIN);
@@ -182,18 +371,91 @@
         return ESP_OK;
     }
 
+    // Latido local de la pasarela; los actuadores remotos solo reciben cambios por cmd_sync.
     esp_err_t toggle_led(void)
     {
         led_state = !led_state;
         gpio_set_level(LED_PIN, led_state);
+        return ESP_OK;
+    }
 
+    static esp_err_t send_command(const uint8_t *mac, const void *payload, size_t len)
+    {
+    #if CONFIG_ESPNOW_SECURE_ENABLE
+        // Un unicast cifrado por respondedor conectado (o solo al atrasado); la radio reintenta hasta el ACK.
+        esp_err_t err = ESP_OK;
         for (uint8_t i = 0; i < MAX_RESPONDERS; i++)
         {
-            if (connected[i])
+            bool target = mac == NULL ? connected[i] : memcmp(mac, responder_macs[i], ESP_NOW_ETH_ALEN) == 0;
+            if (target && espnow_secure_send(responder_macs[i], ESPNOW_MSG_COMMAND, payload, len) != ESP_OK) {err = ESP_FAIL;}
+        }
+        return err;
+    #else
+        // Sin unicast en la capa de grupo: la reparación también va al grupo y los nodos al día
+        // la descartan por época.
+        return espnow_group_send(ESPNOW_GROUP_ALL, ESPNOW_MSG_COMMAND, ESPNOW_GROUP_FLAG_CRITICAL, payload, len);
+    #endif
+    }
+
+    // Líneas "<actuador> <valor>" desde el terminal de control visual por la UART de consola,
+    // p. ej. "0 1" enciende el LED de los respondedores. Lectura sin bloqueo.
+    static void poll_terminal(void)
+    {
+        static char line[16];
+        static uint8_t line_len;
+        int c;
+        while ((c = fgetc(stdin)) != EOF)
+        {
+            if (c != '\n' && c != '\r')
+            {
+                if (line_len < sizeof(line) - 1) {line[line_len++] = (char)c;}
+                continue;
+            }
+            line[line_len] = '\0';
+            unsigned actuator, value;
+            if (line_len > 0 && sscanf(line, "%u %u", &actuator, &value) == 2 && actuator <= UINT8_MAX)
             {
-                uint8_t data = led_state;
-                esp_err_t result = esp_now_send(responder_macs[i], &data, sizeof(data));
+                if (cmd_sync_set(actuator, value != 0) != ESP_OK) {ESP_LOGW(TAG, "Invalid actuator %u", actuator);}
             }
+            line_len = 0;
         }
-        return ESP_OK;
-    }
\ No newline at end of file
+        clearerr(stdin);
+    }
+
+    #if CONFIG_RULE_ENGINE_ENABLE
+    // La partición "rules" permite cambiar el comportamiento sin recompilar; vacía, rigen las
+    // reglas incrustadas (main/rules.txt).
+    static esp_err_t init_rules(void)
+    {
+        esp_err_t err = rule_engine_load_partition(run_rule_action);
+        if (err == ESP_ERR_NOT_FOUND) {
+            err = rule_engine_load(default_rules_start, default_rules_end - default_rules_start, run_rule_action);
+        }
+        return err;
+    }
+
+    // Desde recv_cb. Con cifrado, un unicast autenticado por destino, como los comandos; sin él,
+    // una única trama crítica al grupo global con la lista de destinos, que los nodos filtran
+    // por su MAC y recuperan por NACK si la pierden.
+    static void run_rule_action(const rule_engine_action_t *action)
+    {
+        uint8_t payload[RULE_ENGINE_ACTUATION_MAX_LEN];
+    #if CONFIG_ESPNOW_SECURE_ENABLE
+        esp_err_t err = ESP_OK;
+        for (uint8_t node = 0; node < RULE_ENGINE_MAX_NODES; node++)
+        {
+            if (!(action->targets & (1u << node))) {continue;}
+            rule_engine_action_t single = *action;
+            single.targets = 1u << node;
+            size_t len = rule_engine_actuation_encode(&single, payload, sizeof(payload));
+            if (len == 0 || espnow_secure_send(rule_engine_node_mac(node), ESPNOW_MSG_ACTUATE, payload, len) != ESP_OK) {err = ESP_FAIL;}
+        }
+    #else
+        size_t len = rule_engine_actuation_encode(action, payload, sizeof(payload));
+        esp_err_t err = len == 0 ? ESP_ERR_INVALID_SIZE :
+                        espnow_group_send(ESPNOW_GROUP_ALL, ESPNOW_MSG_ACTUATE, ESPNOW_GROUP_FLAG_CRITICAL, payload, len);
+    #endif
+        if (err != ESP_OK) {ESP_LOGW(TAG, "Rule %u action not sent", action->rule);}
+        else {metrics_inc(METRIC_CMD_SENT);}
+    }
+    #endif
@@ -0,0 +1,146 @@
+/************************************************************************************************
+ * Módulo: Recolección de métricas de los nodos en la pasarela.
+ *
+ * Descripción: Tabla fija de nodos indexada por MAC. El callback de recepción solo copia el
+ * snapshot bajo un spinlock; el formateo y la salida se hacen en el lazo principal. Un aumento
+ * del número de tareas entre snapshots se reporta como posible fuga de tareas.
+ *
+ * Autor:
+ *   - Victor Manuel Patiño Delgado.
+ *
+ * Licencia: THE BEER-WARE LICENSE.
+ * As long as you retain this notice you can do whatever you want with this stuff.
+ * If we meet some day, and you think this stuff is worth it, you can buy me a beer in return.
+************************************************************************************************/
+
+//***   Bibliotecas y declaraciones de preprocesador    ***//
+    #include <stdio.h>
+    #include <string.h>
+    #include <stdbool.h>
+    #include "freertos/FreeRTOS.h"
+    #include "freertos/task.h"
+    #include "esp_now.h"
+    #include "esp_mac.h"
+    #include "esp_timer.h"
+    #include "esp_log.h"
+    #include "sdkconfig.h"
+    #include "node_metrics.h"
+    #include "mqtt_uplink.h"
+
+//***   Definición de constantes y macros   ***//
+    #define MAX_NODES 16
+
+    static const char *TAG = "node_metrics";
+
+//***   Estructuras de datos y tipos personalizados ***//
+    typedef struct {
+        bool valid;
+        bool fresh;
+        uint8_t mac[ESP_NOW_ETH_ALEN];
+        TickType_t last_seen;
+        uint32_t previous_tasks;
+        metrics_snapshot_t snapshot;
+    } node_entry_t;
+
+    static portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+    static node_entry_t nodes[MAX_NODES];
+    static int64_t last_local_us;
+
+//***   Declaraciones de funciones (prototipos) ***//
+    static void publish_snapshot(const uint8_t *mac, const metrics_snapshot_t *snapshot, uint32_t previous_tasks);
+
+//***Implementación de funciones***//
+    void node_metrics_update(const uint8_t *mac, const metrics_snapshot_t *snapshot)
+    {
+        taskENTER_CRITICAL(&lock);
+        node_entry_t *entry = NULL;
+        node_entry_t *oldest = &nodes[0];
+        for (uint8_t i = 0; i < MAX_NODES; i++) {
+            if (nodes[i].valid && memcmp(nodes[i].mac, mac, ESP_NOW_ETH_ALEN) == 0) {
+                entry = &nodes[i];
+                break;
+            }
+            if (!nodes[i].valid) {oldest = &nodes[i];}
+            else if (oldest->valid && (int32_t)(nodes[i].last_seen - oldest->last_seen) < 0) {oldest = &nodes[i];}
+        }
+        if (entry == NULL) {
+            entry = oldest;
+            memset(entry, 0, sizeof(*entry));
+            entry->valid = true;
+            memcpy(entry->mac, mac, ESP_NOW_ETH_ALEN);
+        }
+        entry->fresh = true;
+        entry->last_seen = xTaskGetTickCount();
+        entry->snapshot = *snapshot;
+        taskEXIT_CRITICAL(&lock);
+    }
+
+    void node_metrics_publish(void)
+    {
+        for (uint8_t i = 0; i < MAX_NODES; i++) {
+            metrics_snapshot_t snapshot;
+            uint8_t mac[ESP_NOW_ETH_ALEN];
+            uint32_t previous_tasks;
+
+            taskENTER_CRITICAL(&lock);
+            bool fresh = nodes[i].valid && nodes[i].fresh;
+            if (fresh) {
+                snapshot = nodes[i].snapshot;
+                memcpy(mac, nodes[i].mac, ESP_NOW_ETH_ALEN);
+                previous_tasks = nodes[i].previous_tasks;
+                nodes[i].previous_tasks = snapshot.values[METRIC_TASK_COUNT];
+                nodes[i].fresh = false;
+            }
+            taskEXIT_CRITICAL(&lock);
+
+            if (fresh) {publish_snapshot(mac, &snapshot, previous_tasks);}
+        }
+
+        // Métricas propias de la pasarela con el mismo periodo que los nodos.
+        int64_t now = esp_timer_get_time();
+        if (CONFIG_METRICS_PERIOD_MS > 0 && (now - last_local_us) >= (int64_t)CONFIG_METRICS_PERIOD_MS * 1000) {
+            last_local_us = now;
+            metrics_snapshot_t local;
+            uint8_t own_mac[ESP_NOW_ETH_ALEN];
+            esp_read_mac(own_mac, ESP_MAC_WIFI_STA);
+            metrics_capture(&local);
+            publish_snapshot(own_mac, &local, 0);
+        }
+    }
+
+    static void publish_snapshot(const uint8_t *mac, const metrics_snapshot_t *snapshot, uint32_t previous_tasks)
+    {
+        char line[640];
+        int len = snprintf(line, sizeof(line), MACSTR, MAC2STR(mac));
+        // Un nodo con firmware anterior reporta menos métricas; solo se publican las recibidas.
+        for (uint8_t i = 0; i < snapshot->value_count && len > 0 && len < (int)sizeof(line); i++) {
+            len += snprintf(line + len, sizeof(line) - len, " %s=%lu", metrics_name(i), (unsigned long)snapshot->values[i]);
+        }
+        ESP_LOGI(TAG, "%s", line);
+
+    #if CONFIG_MQTT_UPLINK_ENABLE
+        // El mismo snapshot como objeto JSON para el tópico de métricas.
+        len = 0;
+        for (uint8_t i = 0; i < snapshot->value_count && len >= 0 && len < (int)sizeof(line); i++) {
+            len += snprintf(line + len, sizeof(line) - len, "%c\"%s\":%lu", i == 0 ? '{' : ',', metrics_name(i),
+                            (unsigned long)snapshot->values[i]);
+        }
+        if (len > 0 && len + 1 < (int)sizeof(line)) {
+            line[len++] = '}';
+            mqtt_uplink_post_json(MQTT_UPLINK_METRICS, mac, line, len);
+        }
+    #endif
+
+        for (uint8_t i = 0; i < snapshot->task_count; i++) {
+            const metrics_task_t *task = &snapshot->tasks[i];
+            ESP_LOGI(TAG, MACSTR " task=%.*s stack_free=%u cpu=%u%% core=%d", MAC2STR(mac),
+                     METRICS_TASK_NAME_LEN, task->name, task->stack_free, task->cpu_percent,
+                     task->core == 0xFF ? -1 : task->core);
+        }
+
+        uint32_t tasks = snapshot->values[METRIC_TASK_COUNT];
+        if (previous_tasks != 0 && tasks > previous_tasks) {
+            ESP_LOGW(TAG, MACSTR " task count grew %lu -> %lu, possible task leak", MAC2STR(mac),
+                     (unsigned long)previous_tasks, (unsigned long)tasks);
+        }
+    }
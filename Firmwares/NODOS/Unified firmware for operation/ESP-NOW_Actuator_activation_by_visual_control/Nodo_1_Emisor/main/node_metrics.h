@@ -0,0 +1,25 @@
+/************************************************************************************************
+ * Módulo: Recolección de métricas de los nodos en la pasarela.
+ *
+ * Descripción: Conserva el último snapshot de métricas recibido de cada nodo y lo publica por
+ * el enlace ascendente (consola) desde el lazo principal, fuera del contexto de recepción.
+ *
+ * Autor:
+ *   - Victor Manuel Patiño Delgado.
+ *
+ * Licencia: THE BEER-WARE LICENSE.
+ * As long as you retain this notice you can do whatever you want with this stuff.
+ * If we meet some day, and you think this stuff is worth it, you can buy me a beer in return.
+************************************************************************************************/
+#pragma once
+
+//***   Bibliotecas y declaraciones de preprocesador    ***//
+    #include <stdint.h>
+    #include "metrics.h"
+
+//***   Declaraciones de funciones (prototipos) ***//
+    // Desde recv_cb: registra el snapshot separado de la trama de telemetría.
+    void node_metrics_update(const uint8_t *mac, const metrics_snapshot_t *snapshot);
+
+    // Desde el lazo principal: publica los snapshots nuevos y el propio de la pasarela.
+    void node_metrics_publish(void);
@@ -32,6 +32,14 @@
     #include "esp_mac.h"
     #include "nvs_flash.h"
     #include "esp_log.h"
+    #include "espnow_group.h"
+    #include "espnow_ota.h"
+    #include "espnow_secure.h"
+    #include "metrics.h"
+    #include "static_alloc.h"
+    #include "thermal_gov.h"
+    #include "cmd_sync.h"
+    #include "link_quality.h"
 
 //***   Definición de constantes y macros   ***//
     #define ESP_CHANNEL 1
@@ -51,12 +59,13 @@
 
 //***   Declaraciones de funciones (prototipos) ***//
     static esp_err_t init_wifi(void);
-    void recv_cb(const esp_now_recv_info_t *esp_now_info, const uint8_t *data, uint8_t data_len);
+    void recv_cb(const esp_now_recv_info_t *esp_now_info, const uint8_t *data, int data_len);
     void send_cb(const uint8_t *mac_addr, esp_now_send_status_t status);
     static esp_err_t init_esp_now(void);
     static esp_err_t register_peer(uint8_t *peer_addr);
     esp_err_t init_lm35(void);
     float read_lm35(void);
+    static void apply_command(uint8_t actuator, uint8_t value);
 
 //***   Estructuras de datos y tipos personalizados ***//
 //***   Función principal (main)    ***//
@@ -66,27 +75,43 @@
         //***   Inicialización y asignaciones  ***//   
             ESP_ERROR_CHECK(init_wifi());
             ESP_ERROR_CHECK(init_esp_now());
+            ESP_ERROR_CHECK(espnow_secure_init());
             ESP_ERROR_CHECK(register_peer(initiator_mac));
+            ESP_ERROR_CHECK(espnow_group_init());
+            ESP_ERROR_CHECK(espnow_ota_init());
             ESP_ERROR_CHECK(init_lm35());
+            ESP_ERROR_CHECK(thermal_gov_start());
 
             gpio_reset_pin(LED_PIN);
             gpio_set_direction(LED_PIN, GPIO_MODE_OUTPUT);
             gpio_set_level(LED_PIN, 0);
+            cmd_sync_node_init(apply_command);
+            static_alloc_guard_current_task();
+            static_alloc_seal();
 
         //***   Estructura de control - Bucle(s) o condicionales    ***//
         while (1)
         {
             //***   Llamadas a funciones   ***//
                 lm35_value = read_lm35();
+                thermal_gov_report_enclosure(lm35_value);
 
             //***   Operaciones y cálculos  ***//
             //***   Entrada y salida de datos   ***//
-                esp_now_send(initiator_mac, (uint8_t *)&lm35_value, sizeof(lm35_value));
+                // Temperatura y época de comandos aplicada: la pasarela repara con ella.
+                uint8_t frame[ESPNOW_GROUP_MAX_PAYLOAD];
+                uint32_t applied_epoch = cmd_sync_applied_epoch();
+                size_t frame_len = sizeof(lm35_value) + sizeof(applied_epoch);
+                memcpy(frame, &lm35_value, sizeof(lm35_value));
+                memcpy(frame + sizeof(lm35_value), &applied_epoch, sizeof(applied_epoch));
+                size_t metrics_len = metrics_piggyback(frame + frame_len, sizeof(frame) - frame_len);
+                espnow_group_send(ESPNOW_GROUP_GATEWAY, ESPNOW_MSG_TEMPERATURE, metrics_len ? ESPNOW_GROUP_FLAG_METRICS : 0,
+                                  frame, frame_len + metrics_len);
                 ESP_LOGI(TAG, "Temperature sent: %.2f °C", lm35_value);
 
             //***   Liberación de memoria (si es necesario) ***//
             //***   Retorno de valores y finalización del programa  ***//
-                vTaskDelay(pdMS_TO_TICKS(1000));
+                vTaskDelay(pdMS_TO_TICKS(1000 * thermal_gov_report_scale()));
         }
     }
 
@@ -102,21 +127,38 @@
         esp_wifi_set_storage(WIFI_STORAGE_FLASH);
         esp_wifi_start();
         ESP_LOGI(TAG, "wifi init completed");
+    #if CONFIG_LINK_QUALITY_ENABLE
+        return link_quality_set_protocol();
+    #else
         return ESP_OK;
+    #endif
     }
 
-    void recv_cb(const esp_now_recv_info_t *esp_now_info, const uint8_t *data, uint8_t data_len)
+    void recv_cb(const esp_now_recv_info_t *esp_now_info, const uint8_t *data, int data_len)
     {
-        if (data_len == sizeof(uint8_t))
-        {
-            uint8_t led_state = data[0];
-            gpio_set_level(LED_PIN, led_state);
-            ESP_LOGI(TAG, "Received LED state from " MACSTR ": %d", MAC2STR(esp_now_info->src_addr), led_state);
+        link_quality_on_recv(esp_now_info);
+        const espnow_group_hdr_t *hdr;
+        size_t payload_len;
+        const uint8_t *payload = espnow_group_recv(esp_now_info, data, data_len, &hdr, &payload_len);
+        if (payload != NULL && espnow_ota_handle(esp_now_info, hdr, payload, payload_len)) {return;}
+        if (payload != NULL && espnow_secure_handle(esp_now_info, hdr, payload, payload_len)) {return;}
+
+        // Con cifrado habilitado solo se actúa sobre comandos con etiqueta válida del par.
+        if (payload != NULL && espnow_secure_verify(esp_now_info, hdr, payload, &payload_len)) {
+            cmd_sync_handle(hdr, payload, payload_len);
         }
     }
 
+    // Solo se invoca cuando el valor cambia; duplicados y reparaciones no tocan el GPIO.
+    static void apply_command(uint8_t actuator, uint8_t value)
+    {
+        if (actuator == CMD_SYNC_ACTUATOR_LED) {gpio_set_level(LED_PIN, value);}
+        ESP_LOGD(TAG, "Actuator %u -> %u", actuator, value);
+    }
+
     void send_cb(const uint8_t *mac_addr, esp_now_send_status_t status)
     {
+        link_quality_on_send(mac_addr, status);
         if (status == ESP_NOW_SEND_SUCCESS)
         {
             ESP_LOGI(TAG, "Data sent to " MACSTR " successfully", MAC2STR(mac_addr));
@@ -131,6 +173,11 @@
     {
         esp_now_init();
         esp_now_register_recv_cb(recv_cb);
+        // La entrega de cada envío unicast alimenta la selección de tasa.
+        esp_now_register_send_cb(send_cb);
+    #if CONFIG_LINK_QUALITY_ENABLE
+        ESP_ERROR_CHECK(link_quality_start());
+    #endif
         ESP_LOGI(TAG, "esp now init completed");
         return ESP_OK;
     }
@@ -156,6 +203,7 @@
     float read_lm35(void)
     {
         uint32_t adc_reading = adc1_get_raw(LM35_GPIO_PIN);
+        metrics_inc(METRIC_ADC_SAMPLES);
         uint32_t millivolts = esp_adc_cal_raw_to_voltage(adc_reading, &adc_chars);
         return (float)(millivolts / 10.0); 
     }
\ No newline at end of file
@@ -33,6 +33,9 @@
     #include "esp_mac.h"
     #include "nvs_flash.h"
     #include "esp_log.h"
+    #include "espnow_group.h"
+    #include "metrics.h"
+    #include "static_alloc.h"
 
 //***   Definición de constantes y macros   ***//
     #define ESP_CHANNEL 1
@@ -51,7 +54,8 @@
         {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF}, //MAC2
         {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF}  //MAC3
     };
-    static esp_now_peer_info_t *peers = NULL;
+    #define MAX_PEERS (sizeof(initiator_macs) / ESP_NOW_ETH_ALEN)
+    static esp_now_peer_info_t peers[MAX_PEERS];
     static const char *TAG = "esp_now_resp";
 
     static int num_peers = 0;
@@ -59,7 +63,7 @@
 
 //***   Declaraciones de funciones (prototipos) ***//
     static esp_err_t init_wifi(void);
-    void recv_cb(const esp_now_recv_info_t *esp_now_info, const uint8_t *data, uint8_t data_len);
+    void recv_cb(const esp_now_recv_info_t *esp_now_info, const uint8_t *data, int data_len);
     void send_cb(const uint8_t *mac_addr, esp_now_send_status_t status);
     static esp_err_t init_esp_now(void);
     static esp_err_t register_peer(uint8_t *peer_addr);
@@ -77,11 +81,14 @@ void app_main(void)
         for (int i = 0; i < sizeof(initiator_macs) / ESP_NOW_ETH_ALEN; i++) {
             ESP_ERROR_CHECK(register_peer(initiator_macs[i]));
         }
+        ESP_ERROR_CHECK(espnow_group_init());
         ESP_ERROR_CHECK(init_lm35());
 
         gpio_reset_pin(LED_PIN);
         gpio_set_direction(LED_PIN, GPIO_MODE_OUTPUT);
         gpio_set_level(LED_PIN, 0);
+        static_alloc_guard_current_task();
+        static_alloc_seal();
 
     //***   Estructura de control - Bucle(s) o condicionales    ***//
         while (1)
@@ -91,10 +98,12 @@ void app_main(void)
 
             //***   Operaciones y cálculos  ***//
             //***   Entrada y salida de datos   ***//
-                for (int i = 0; i < num_peers; i++) {
-                    esp_now_send(peers[i].peer_addr, (uint8_t *)&lm35_value, sizeof(lm35_value));
-                    ESP_LOGI(TAG, "Temperature sent to " MACSTR ": %.2f °C", MAC2STR(peers[i].peer_addr), lm35_value);
-                }
+                uint8_t frame[ESPNOW_GROUP_MAX_PAYLOAD];
+                memcpy(frame, &lm35_value, sizeof(lm35_value));
+                size_t metrics_len = metrics_piggyback(frame + sizeof(lm35_value), sizeof(frame) - sizeof(lm35_value));
+                espnow_group_send(CONFIG_ESPNOW_GROUP_ZONE, ESPNOW_MSG_TEMPERATURE, metrics_len ? ESPNOW_GROUP_FLAG_METRICS : 0,
+                                  frame, sizeof(lm35_value) + metrics_len);
+                ESP_LOGI(TAG, "Temperature sent to zone %d (%d peers): %.2f °C", CONFIG_ESPNOW_GROUP_ZONE, num_peers, lm35_value);
 
             //***   Liberación de memoria (si es necesario) ***//
             //***   Retorno de valores y finalización del programa  ***//
@@ -117,11 +126,15 @@ void app_main(void)
         return ESP_OK;
     }
 
-    void recv_cb(const esp_now_recv_info_t *esp_now_info, const uint8_t *data, uint8_t data_len)
+    void recv_cb(const esp_now_recv_info_t *esp_now_info, const uint8_t *data, int data_len)
     {
-        if (data_len == sizeof(uint8_t))
+        const espnow_group_hdr_t *hdr;
+        size_t payload_len;
+        const uint8_t *payload = espnow_group_recv(esp_now_info, data, data_len, &hdr, &payload_len);
+
+        if (payload != NULL && hdr->type == ESPNOW_MSG_LED_STATE && payload_len == sizeof(uint8_t))
         {
-            uint8_t led_state = data[0];
+            uint8_t led_state = payload[0];
             gpio_set_level(LED_PIN, led_state);
             ESP_LOGI(TAG, "Received LED state from " MACSTR ": %d", MAC2STR(esp_now_info->src_addr), led_state);
         }
@@ -143,15 +156,9 @@ void app_main(void)
 
     static esp_err_t register_peer(uint8_t *peer_addr)
     {
-        if (peers == NULL) {
-            peers = (esp_now_peer_info_t *)malloc(sizeof(esp_now_peer_info_t));
-        } else {
-            esp_now_peer_info_t *new_peers = (esp_now_peer_info_t *)realloc(peers, (num_peers + 1) * sizeof(esp_now_peer_info_t));
-            if (new_peers == NULL) {
-                ESP_LOGE(TAG, "Failed to reallocate memory for peers");
-                return ESP_FAIL;
-            }
-            peers = new_peers;
+        if (num_peers >= (int)MAX_PEERS) {
+            ESP_LOGE(TAG, "Peer table full (%d)", (int)MAX_PEERS);
+            return ESP_ERR_NO_MEM;
         }
         esp_now_peer_info_t *peer = &peers[num_peers];
         memcpy(peer->peer_addr, peer_addr, ESP_NOW_ETH_ALEN);
@@ -173,6 +180,7 @@ void app_main(void)
     float read_lm35(void)
     {
         uint32_t adc_reading = adc1_get_raw(LM35_GPIO_PIN);
+        metrics_inc(METRIC_ADC_SAMPLES);
         uint32_t millivolts = esp_adc_cal_raw_to_voltage(adc_reading, &adc_chars);
         return (float)(millivolts / 10.0); 
     }
\ No newline at end of file
@@ -0,0 +1,332 @@
+/************************************************************************************************
+ * Programa: Banco de pruebas de radio ESP-NOW, en claro frente a cifrado (CCMP) y Wi-Fi LR.
+ *
+ * Descripción: Dos placas: el iniciador mide y el reflector responde. Para cada modo (claro y
+ * cifrado con PMK/LMK) se mide la latencia de ida y vuelta de un eco unicast y el rendimiento
+ * de una ráfaga unicast esperando la confirmación de la radio de cada trama, igual que la
+ * entrega de comandos de los nodos. El cambio de modo se acuerda por broadcast, que nunca va
+ * cifrado. Con RADIO_BENCH_LONG_RANGE se repite en claro a 1 Mbit/s y a las dos tasas LR;
+ * la fase lleva la tasa y el reflector la aplica después de confirmar. Los resultados salen en
+ * líneas "BENCH" compatibles con tools/bench_report.py, con objetivo "<chip>-radio" para
+ * guardar su propia línea base.
+ *
+ * Autor:
+ *   - Victor Manuel Patiño Delgado.
+ *
+ * Licencia: THE BEER-WARE LICENSE.
+ * As long as you retain this notice you can do whatever you want with this stuff.
+ * If we meet some day, and you think this stuff is worth it, you can buy me a beer in return.
+************************************************************************************************/
+
+//***   Bibliotecas y declaraciones de preprocesador    ***//
+    #include <stdio.h>
+    #include <string.h>
+    #include "freertos/FreeRTOS.h"
+    #include "freertos/task.h"
+    #include "freertos/queue.h"
+    #include "esp_now.h"
+    #include "esp_wifi.h"
+    #include "esp_mac.h"
+    #include "esp_timer.h"
+    #include "esp_log.h"
+    #include "nvs_flash.h"
+    #include "sdkconfig.h"
+
+//***   Definición de constantes y macros   ***//
+    #define BENCH_MAGIC 0xBE
+    #define BENCH_PMK "bench-pmk-000001"
+    #define BENCH_LMK "bench-lmk-000001"
+    #define REPLY_TIMEOUT pdMS_TO_TICKS(100)
+
+    static const char *TAG = "radio_bench";
+    static const uint8_t broadcast_mac[ESP_NOW_ETH_ALEN] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+
+//***   Estructuras de datos y tipos personalizados ***//
+    typedef enum {
+        KIND_PHASE,         // Broadcast: el reflector configura el par en el modo indicado
+        KIND_PHASE_ACK,
+        KIND_ECHO,
+        KIND_ECHO_REPLY,
+        KIND_FLOOD,
+        KIND_FLOOD_END,     // El reflector responde con las tramas de ráfaga recibidas
+        KIND_FLOOD_REPORT,
+    } bench_kind_t;
+
+    typedef struct __attribute__((packed)) {
+        uint8_t magic;
+        uint8_t kind;
+        uint8_t encrypt;
+        uint8_t rate;           // wifi_phy_rate_t de la fase
+        uint32_t seq;
+        uint32_t count;
+    } bench_hdr_t;
+
+    typedef struct {
+        uint8_t src_addr[ESP_NOW_ETH_ALEN];
+        bench_hdr_t hdr;
+    } bench_event_t;
+
+    static QueueHandle_t event_queue;
+    static TaskHandle_t send_waiter;
+    static volatile uint32_t flood_count;
+    static uint8_t phase_rate = WIFI_PHY_RATE_1M_L;
+    static uint8_t frame[ESP_NOW_MAX_DATA_LEN];
+
+//***   Declaraciones de funciones (prototipos) ***//
+    static void init_radio(void);
+    static esp_err_t set_peer(const uint8_t *mac, bool encrypt);
+    static esp_err_t send_frame(const uint8_t *mac, uint8_t kind, bool encrypt, uint32_t seq, uint32_t count, size_t len);
+    static bool wait_event(uint8_t kind, uint32_t seq, bench_event_t *event);
+    void recv_cb(const esp_now_recv_info_t *esp_now_info, const uint8_t *data, int data_len);
+    void send_cb(const uint8_t *mac_addr, esp_now_send_status_t status);
+    #if CONFIG_RADIO_BENCH_INITIATOR
+    static bool enter_phase(const uint8_t *peer, bool encrypt, wifi_phy_rate_t rate);
+    static double bench_rtt(const uint8_t *peer, bool encrypt, const char *mode);
+    static double bench_throughput(const uint8_t *peer, bool encrypt, const char *mode);
+    #else
+    static void reflector_loop(void);
+    #endif
+
+//***   Función principal (main)    ***//
+    void app_main(void)
+    {
+        //***   Declaración de variables locales   ***//
+        //***   Inicialización y asignaciones  ***//
+            event_queue = xQueueCreate(16, sizeof(bench_event_t));
+            init_radio();
+
+        //***   Estructura de control - Bucle(s) o condicionales    ***//
+        #if CONFIG_RADIO_BENCH_INITIATOR
+            uint8_t peer[ESP_NOW_ETH_ALEN];
+            sscanf(CONFIG_RADIO_BENCH_PEER_MAC, "%hhx:%hhx:%hhx:%hhx:%hhx:%hhx",
+                   &peer[0], &peer[1], &peer[2], &peer[3], &peer[4], &peer[5]);
+            send_waiter = xTaskGetCurrentTaskHandle();
+
+            double rtt_ns[2] = {0};
+            double frames_per_s[2] = {0};
+            printf("BENCH-TARGET %s-radio\n", CONFIG_IDF_TARGET);
+            for (uint8_t encrypt = 0; encrypt <= 1; encrypt++) {
+                const char *mode = encrypt ? "ccmp" : "plain";
+                if (!enter_phase(peer, encrypt, WIFI_PHY_RATE_1M_L)) {
+                    ESP_LOGE(TAG, "Reflector " MACSTR " did not answer", MAC2STR(peer));
+                    return;
+                }
+                rtt_ns[encrypt] = bench_rtt(peer, encrypt, mode);
+                frames_per_s[encrypt] = bench_throughput(peer, encrypt, mode);
+            }
+        #if CONFIG_RADIO_BENCH_LONG_RANGE
+            static const struct {wifi_phy_rate_t rate; const char *mode;} lr_phases[] = {
+                {WIFI_PHY_RATE_LORA_500K, "lr500"},
+                {WIFI_PHY_RATE_LORA_250K, "lr250"},
+            };
+            double lr_rtt_ns[2] = {0};
+            double lr_frames_per_s[2] = {0};
+            for (uint8_t i = 0; i < 2; i++) {
+                if (!enter_phase(peer, false, lr_phases[i].rate)) {
+                    ESP_LOGE(TAG, "Reflector " MACSTR " did not answer in %s", MAC2STR(peer), lr_phases[i].mode);
+                    return;
+                }
+                lr_rtt_ns[i] = bench_rtt(peer, false, lr_phases[i].mode);
+                lr_frames_per_s[i] = bench_throughput(peer, false, lr_phases[i].mode);
+            }
+        #endif
+            printf("BENCH-DONE\n");
+            if (rtt_ns[0] > 0 && frames_per_s[1] > 0) {
+                printf("CCMP overhead: latency %+.1f%%, throughput %+.1f%%\n",
+                       (rtt_ns[1] / rtt_ns[0] - 1) * 100, (frames_per_s[1] / frames_per_s[0] - 1) * 100);
+            }
+        #if CONFIG_RADIO_BENCH_LONG_RANGE
+            for (uint8_t i = 0; i < 2; i++) {
+                if (rtt_ns[0] > 0 && frames_per_s[0] > 0 && lr_frames_per_s[i] > 0) {
+                    printf("%s vs 1 Mbit/s: latency %+.1f%%, throughput %+.1f%%\n", lr_phases[i].mode,
+                           (lr_rtt_ns[i] / rtt_ns[0] - 1) * 100, (lr_frames_per_s[i] / frames_per_s[0] - 1) * 100);
+                }
+            }
+        #endif
+        #else
+            reflector_loop();
+        #endif
+    }
+
+//***Implementación de funciones***//
+    static void init_radio(void)
+    {
+        nvs_flash_init();
+        wifi_init_config_t wifi_init_config = WIFI_INIT_CONFIG_DEFAULT();
+        ESP_ERROR_CHECK(esp_wifi_init(&wifi_init_config));
+        ESP_ERROR_CHECK(esp_wifi_set_storage(WIFI_STORAGE_RAM));
+        ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
+        ESP_ERROR_CHECK(esp_wifi_start());
+        ESP_ERROR_CHECK(esp_wifi_set_channel(CONFIG_RADIO_BENCH_CHANNEL, WIFI_SECOND_CHAN_NONE));
+    #if CONFIG_RADIO_BENCH_LONG_RANGE
+        // Con LR en la máscara la STA sigue recibiendo 802.11b/g/n: las fases se acuerdan igual.
+        ESP_ERROR_CHECK(esp_wifi_set_protocol(WIFI_IF_STA, WIFI_PROTOCOL_11B | WIFI_PROTOCOL_11G | WIFI_PROTOCOL_11N | WIFI_PROTOCOL_LR));
+    #endif
+        ESP_ERROR_CHECK(esp_now_init());
+        ESP_ERROR_CHECK(esp_now_register_recv_cb(recv_cb));
+        ESP_ERROR_CHECK(esp_now_register_send_cb(send_cb));
+        ESP_ERROR_CHECK(esp_now_set_pmk((const uint8_t *)BENCH_PMK));
+        ESP_ERROR_CHECK(set_peer(broadcast_mac, false));
+
+        uint8_t mac[ESP_NOW_ETH_ALEN];
+        esp_wifi_get_mac(WIFI_IF_STA, mac);
+        printf("Radio bench ready on " MACSTR ", channel %d\n", MAC2STR(mac), CONFIG_RADIO_BENCH_CHANNEL);
+    }
+
+    static esp_err_t set_peer(const uint8_t *mac, bool encrypt)
+    {
+        esp_now_peer_info_t esp_now_peer_info = {};
+        memcpy(esp_now_peer_info.peer_addr, mac, ESP_NOW_ETH_ALEN);
+        memcpy(esp_now_peer_info.lmk, BENCH_LMK, ESP_NOW_KEY_LEN);
+        esp_now_peer_info.channel = CONFIG_RADIO_BENCH_CHANNEL;
+        esp_now_peer_info.ifidx = ESP_IF_WIFI_STA;
+        esp_now_peer_info.encrypt = encrypt;
+        return esp_now_is_peer_exist(mac) ? esp_now_mod_peer(&esp_now_peer_info) : esp_now_add_peer(&esp_now_peer_info);
+    }
+
+    static esp_err_t send_frame(const uint8_t *mac, uint8_t kind, bool encrypt, uint32_t seq, uint32_t count, size_t len)
+    {
+        bench_hdr_t hdr = {.magic = BENCH_MAGIC, .kind = kind, .encrypt = encrypt, .rate = phase_rate, .seq = seq, .count = count};
+        if (len < sizeof(hdr)) {len = sizeof(hdr);}
+        memcpy(frame, &hdr, sizeof(hdr));
+        return esp_now_send(mac, frame, len);
+    }
+
+    static bool wait_event(uint8_t kind, uint32_t seq, bench_event_t *event)
+    {
+        TickType_t start = xTaskGetTickCount();
+        while (xTaskGetTickCount() - start < REPLY_TIMEOUT) {
+            if (xQueueReceive(event_queue, event, REPLY_TIMEOUT) == pdTRUE && event->hdr.kind == kind && event->hdr.seq == seq) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void recv_cb(const esp_now_recv_info_t *esp_now_info, const uint8_t *data, int data_len)
+    {
+        bench_event_t event;
+        if (data_len < (int)sizeof(bench_hdr_t) || data[0] != BENCH_MAGIC) {return;}
+        // La ráfaga se cuenta aquí: encolarla saturaría la cola.
+        if (data[1] == KIND_FLOOD) {
+            flood_count++;
+            return;
+        }
+        memcpy(event.src_addr, esp_now_info->src_addr, ESP_NOW_ETH_ALEN);
+        memcpy(&event.hdr, data, sizeof(bench_hdr_t));
+        xQueueSend(event_queue, &event, 0);
+    }
+
+    void send_cb(const uint8_t *mac_addr, esp_now_send_status_t status)
+    {
+        TaskHandle_t waiter = send_waiter;
+        if (waiter != NULL) {xTaskNotify(waiter, status == ESP_NOW_SEND_SUCCESS ? 1 : 2, eSetValueWithOverwrite);}
+    }
+
+    #if CONFIG_RADIO_BENCH_INITIATOR
+    static bool enter_phase(const uint8_t *peer, bool encrypt, wifi_phy_rate_t rate)
+    {
+        bench_event_t event;
+        xQueueReset(event_queue);
+        // La fase anuncia la tasa nueva pero viaja a la vigente; se cambia tras la confirmación.
+        phase_rate = rate;
+        for (uint8_t attempt = 0; attempt < 20; attempt++) {
+            send_frame(broadcast_mac, KIND_PHASE, encrypt, attempt, 0, 0);
+            if (wait_event(KIND_PHASE_ACK, attempt, &event)) {
+                set_peer(peer, encrypt);
+                ESP_ERROR_CHECK(esp_wifi_config_espnow_rate(WIFI_IF_STA, rate));
+                vTaskDelay(pdMS_TO_TICKS(50));
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static double bench_rtt(const uint8_t *peer, bool encrypt, const char *mode)
+    {
+        bench_event_t event;
+        int64_t total_us = 0;
+        int64_t max_us = 0;
+        uint32_t received = 0;
+
+        xQueueReset(event_queue);
+        for (uint32_t seq = 0; seq < CONFIG_RADIO_BENCH_FRAMES; seq++) {
+            int64_t start_us = esp_timer_get_time();
+            send_frame(peer, KIND_ECHO, encrypt, seq, 0, CONFIG_RADIO_BENCH_PAYLOAD);
+            if (!wait_event(KIND_ECHO_REPLY, seq, &event)) {continue;}
+            int64_t rtt_us = esp_timer_get_time() - start_us;
+            total_us += rtt_us;
+            if (rtt_us > max_us) {max_us = rtt_us;}
+            received++;
+        }
+
+        double mean_ns = received > 0 ? (double)total_us * 1000 / received : 0;
+        printf("BENCH espnow_%s_rtt cycles_per_op=0 ns_per_op=%.0f ops_per_s=%.0f\n", mode, mean_ns,
+               mean_ns > 0 ? 1e9 / mean_ns : 0);
+        printf("  %s rtt: max %lld us, lost %lu/%d\n", mode, (long long)max_us,
+               (unsigned long)(CONFIG_RADIO_BENCH_FRAMES - received), CONFIG_RADIO_BENCH_FRAMES);
+        return mean_ns;
+    }
+
+    // Cada trama espera la confirmación de la radio antes de la siguiente, como un comando.
+    static double bench_throughput(const uint8_t *peer, bool encrypt, const char *mode)
+    {
+        uint32_t acked = 0;
+        uint32_t status = 0;
+
+        xTaskNotifyStateClear(NULL);
+        int64_t start_us = esp_timer_get_time();
+        for (uint32_t seq = 0; seq < CONFIG_RADIO_BENCH_FRAMES; seq++) {
+            if (send_frame(peer, KIND_FLOOD, encrypt, seq, 0, CONFIG_RADIO_BENCH_PAYLOAD) != ESP_OK) {continue;}
+            if (xTaskNotifyWait(0, UINT32_MAX, &status, REPLY_TIMEOUT) == pdTRUE && status == 1) {acked++;}
+        }
+        int64_t elapsed_us = esp_timer_get_time() - start_us;
+
+        bench_event_t event;
+        uint32_t delivered = 0;
+        xQueueReset(event_queue);
+        send_frame(peer, KIND_FLOOD_END, encrypt, 0, 0, 0);
+        if (wait_event(KIND_FLOOD_REPORT, 0, &event)) {delivered = event.hdr.count;}
+
+        double frames_per_s = elapsed_us > 0 ? acked * 1e6 / elapsed_us : 0;
+        printf("BENCH espnow_%s_tput cycles_per_op=0 ns_per_op=%.0f ops_per_s=%.0f\n", mode,
+               acked > 0 ? (double)elapsed_us * 1000 / acked : 0, frames_per_s);
+        printf("  %s tput: %.1f kbit/s, acked %lu, delivered %lu of %d\n", mode,
+               frames_per_s * CONFIG_RADIO_BENCH_PAYLOAD * 8 / 1000, (unsigned long)acked,
+               (unsigned long)delivered, CONFIG_RADIO_BENCH_FRAMES);
+        return frames_per_s;
+    }
+    #else
+    static void reflector_loop(void)
+    {
+        bench_event_t event;
+        while (1) {
+            if (xQueueReceive(event_queue, &event, portMAX_DELAY) != pdTRUE) {continue;}
+            bool encrypt = event.hdr.encrypt;
+            switch (event.hdr.kind) {
+                case KIND_PHASE:
+                    set_peer(event.src_addr, encrypt);
+                    flood_count = 0;
+                    send_frame(broadcast_mac, KIND_PHASE_ACK, encrypt, event.hdr.seq, 0, 0);
+                    // Tras confirmar a la tasa vigente; un reintento de la fase se oye igual.
+                    if (event.hdr.rate != phase_rate) {
+                        vTaskDelay(pdMS_TO_TICKS(10));
+                        phase_rate = event.hdr.rate;
+                        esp_wifi_config_espnow_rate(WIFI_IF_STA, phase_rate);
+                    }
+                    printf("Phase %s at rate 0x%02x with " MACSTR "\n", encrypt ? "ccmp" : "plain", phase_rate,
+                           MAC2STR(event.src_addr));
+                    break;
+                case KIND_ECHO:
+                    send_frame(event.src_addr, KIND_ECHO_REPLY, encrypt, event.hdr.seq, 0, CONFIG_RADIO_BENCH_PAYLOAD);
+                    break;
+                case KIND_FLOOD_END:
+                    send_frame(event.src_addr, KIND_FLOOD_REPORT, encrypt, 0, flood_count, 0);
+                    flood_count = 0;
+                    break;
+                default:
+                    break;
+            }
+        }
+    }
+    #endif
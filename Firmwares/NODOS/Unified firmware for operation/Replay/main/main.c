@@ -0,0 +1,306 @@
+/************************************************************************************************
+ * Programa: Reproducción acelerada de capturas de tráfico ESP-NOW.
+ *
+ * Descripción: Reinyecta las tramas grabadas por frame_capture en la lógica de aplicación de
+ * los nodos, con los intervalos originales divididos por CONFIG_REPLAY_SPEED. Las tramas de
+ * sensores pasan por la reacción del receptor (node_remote_actuator_level y el arranque del
+ * barrido con node_actuation_gate, incluido el tiempo en que servo_control no consulta la
+ * entrada); las de temperatura, en el ESP32/QEMU, por sensor_anomaly con el reloj de la
+ * captura. Cada salida se imprime como "REPLAY-OUT <ms de captura> ..." y no depende de la
+ * aceleración ni del objetivo, así que dos versiones del firmware se comparan con un diff.
+ * Al final, "REPLAY-STATS" informa caudal y latencia de entrega (desde el instante en que la
+ * trama debía llegar hasta que la lógica terminó con ella). tools/capture_replay.py extrae
+ * las capturas y compara dos ejecuciones.
+ *
+ * Autor:
+ *   - Victor Manuel Patiño Delgado.
+ *
+ * Licencia: THE BEER-WARE LICENSE.
+ * As long as you retain this notice you can do whatever you want with this stuff.
+ * If we meet some day, and you think this stuff is worth it, you can buy me a beer in return.
+************************************************************************************************/
+
+//***   Bibliotecas y declaraciones de preprocesador    ***//
+    #include <stdio.h>
+    #include <stdlib.h>
+    #include <string.h>
+    #include "freertos/FreeRTOS.h"
+    #include "freertos/task.h"
+    #include "esp_log.h"
+    #include "sdkconfig.h"
+    #include "node_logic.h"
+    #include "espnow_group_frame.h"
+    #if CONFIG_IDF_TARGET_LINUX
+    #include <time.h>
+    #else
+    #include "esp_timer.h"
+    #include "sensor_anomaly.h"
+    #endif
+
+//***   Definición de constantes y macros   ***//
+    #define ENCLOSURE_LIMIT_C 60.0f     // Perfil del LM35 de la pasarela
+    #define LM35_MAX_C 150.0f
+    #define LATE_US 1000                // Entregas más tardías no siguen el ritmo de la captura
+    #define YIELD_FRAMES 1024           // Sin pausas, se cede un tick para el watchdog
+
+    #define MAC_FMT "%02x:%02x:%02x:%02x:%02x:%02x"
+    #define MAC_ARGS(mac) (mac)[0], (mac)[1], (mac)[2], (mac)[3], (mac)[4], (mac)[5]
+
+    static const char *TAG = "replay";
+
+    extern const char capture_start[] asm("_binary_capture_cap_start");
+    extern const char capture_end[] asm("_binary_capture_cap_end");
+
+//***   Estructuras de datos y tipos personalizados ***//
+    typedef struct {
+        int64_t time_us;
+        uint8_t src[NODE_MAC_LEN];
+        int rssi;
+        size_t len;
+        uint8_t data[ESPNOW_GROUP_FRAME_MAX_LEN];
+    } capture_frame_t;
+
+    // Actuador del receptor: entrada vigente y barrido en curso.
+    typedef struct {
+        actuation_gate_t gate;
+        uint8_t input;
+        uint8_t src[NODE_MAC_LEN];
+        bool sweeping;
+        uint32_t sweep_end_ms;
+    } actuator_t;
+
+    static actuator_t actuator;
+    static uint32_t decoded;
+    static uint32_t outputs;
+
+//***   Declaraciones de funciones (prototipos) ***//
+    static int64_t replay_now_us(void);
+    static void wait_until(int64_t due_us);
+    static const char *next_frame(const char *cursor, capture_frame_t *frame);
+    static uint32_t count_frames(void);
+    static void replay_frame(const capture_frame_t *frame, uint32_t now_ms);
+    static void on_sensor(const uint8_t *src, const sensor_data_t *data, uint32_t now_ms);
+    static void finish_sweep(uint32_t now_ms);
+    static void poll_actuator(uint32_t now_ms);
+    #if !CONFIG_IDF_TARGET_LINUX
+    static void on_temperature(const uint8_t *src, float temperature, uint32_t now_ms);
+    #endif
+    static int compare_u32(const void *a, const void *b);
+
+//***   Función principal (main)    ***//
+    void app_main(void)
+    {
+        //***   Declaración de variables locales   ***//
+            capture_frame_t frame;
+            uint32_t total = count_frames();
+            uint32_t *latency_us = malloc((total > 0 ? total : 1) * sizeof(uint32_t));
+            uint32_t count = 0;
+            uint32_t late = 0;
+
+        //***   Inicialización y asignaciones  ***//
+        #if !CONFIG_IDF_TARGET_LINUX
+            sensor_anomaly_profile_t lm35 = {
+                .rail_low = node_lm35_celsius(0),
+                .rail_high = LM35_MAX_C,
+                .high_limit = ENCLOSURE_LIMIT_C,
+            };
+            sensor_anomaly_set_profile(SENSOR_ANOMALY_LM35, &lm35);
+            ESP_ERROR_CHECK(sensor_anomaly_start(NULL));
+            // Las salidas se imprimen aquí, en orden; el registro de la tarea de publicación sobra.
+            esp_log_level_set("sensor_anomaly", ESP_LOG_ERROR);
+        #endif
+            if (latency_us == NULL) {
+                ESP_LOGE(TAG, "No memory for %lu latencies", (unsigned long)total);
+                return;
+            }
+
+        //***   Estructura de control - Bucle(s) o condicionales    ***//
+            printf("REPLAY-TARGET %s speed=%d frames=%lu\n", CONFIG_IDF_TARGET, CONFIG_REPLAY_SPEED, (unsigned long)total);
+            const char *cursor = next_frame(capture_start, &frame);
+            const int64_t first_us = frame.time_us;
+            const int64_t start_us = replay_now_us();
+            while (cursor != NULL && count < total) {
+                int64_t offset_us = frame.time_us - first_us;
+                int64_t due_us = start_us + (CONFIG_REPLAY_SPEED > 0 ? offset_us / CONFIG_REPLAY_SPEED : 0);
+                if (CONFIG_REPLAY_SPEED > 0) {wait_until(due_us);}
+                else {due_us = replay_now_us();}
+
+                if (replay_now_us() - due_us > LATE_US) {late++;}
+                replay_frame(&frame, (uint32_t)(offset_us / 1000));
+                latency_us[count++] = (uint32_t)(replay_now_us() - due_us);
+
+            #if !CONFIG_IDF_TARGET_LINUX
+                if (CONFIG_REPLAY_SPEED == 0 && count % YIELD_FRAMES == 0) {vTaskDelay(1);}
+            #endif
+                cursor = next_frame(cursor, &frame);
+            }
+            const int64_t wall_us = replay_now_us() - start_us;
+
+        //***   Entrada y salida de datos   ***//
+            qsort(latency_us, count, sizeof(uint32_t), compare_u32);
+            uint32_t p50 = count > 0 ? latency_us[count / 2] : 0;
+            uint32_t p99 = count > 0 ? latency_us[(count - 1) * 99 / 100] : 0;
+            uint32_t max = count > 0 ? latency_us[count - 1] : 0;
+            printf("REPLAY-STATS frames=%lu decoded=%lu outputs=%lu wall_ms=%.1f frames_per_s=%.0f "
+                   "lat_p50_us=%lu lat_p99_us=%lu lat_max_us=%lu late=%lu\n",
+                   (unsigned long)count, (unsigned long)decoded, (unsigned long)outputs, wall_us / 1000.0,
+                   wall_us > 0 ? count * 1e6 / wall_us : 0.0, (unsigned long)p50, (unsigned long)p99,
+                   (unsigned long)max, (unsigned long)late);
+            printf("REPLAY-DONE\n");
+
+        //***   Liberación de memoria (si es necesario) ***//
+            free(latency_us);
+
+        //***   Retorno de valores y finalización del programa  ***//
+        #if CONFIG_IDF_TARGET_LINUX
+            fflush(stdout);
+            exit(0);
+        #endif
+    }
+
+//***Implementación de funciones***//
+    #if CONFIG_IDF_TARGET_LINUX
+    static int64_t replay_now_us(void)
+    {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        return (int64_t)now.tv_sec * 1000000LL + now.tv_nsec / 1000;
+    }
+    #else
+    static int64_t replay_now_us(void)
+    {
+        return esp_timer_get_time();
+    }
+    #endif
+
+    // Duerme los ticks completos y espera activamente el resto, por debajo de la resolución del tick.
+    static void wait_until(int64_t due_us)
+    {
+        int64_t remaining;
+        while ((remaining = due_us - replay_now_us()) > 0) {
+            TickType_t ticks = pdMS_TO_TICKS(remaining / 1000);
+            if (ticks > 1) {vTaskDelay(ticks - 1);}
+        }
+    }
+
+    // Próxima línea "#CAP <t_us> <mac> <rssi> <hex>" desde cursor; NULL al terminar la captura.
+    static const char *next_frame(const char *cursor, capture_frame_t *frame)
+    {
+        while (cursor != NULL && cursor < capture_end && *cursor != '\0') {
+            const char *end = memchr(cursor, '\n', capture_end - cursor);
+            const char *next = end != NULL ? end + 1 : NULL;
+            if (end == NULL) {end = capture_end;}
+
+            long long time_us;
+            unsigned int mac[NODE_MAC_LEN];
+            int rssi, consumed = 0;
+            if (strncmp(cursor, "#CAP ", 5) == 0 &&
+                sscanf(cursor + 5, "%lld %x:%x:%x:%x:%x:%x %d %n", &time_us, &mac[0], &mac[1], &mac[2], &mac[3],
+                       &mac[4], &mac[5], &rssi, &consumed) == 8 && consumed > 0)
+            {
+                frame->time_us = time_us;
+                for (uint8_t i = 0; i < NODE_MAC_LEN; i++) {frame->src[i] = (uint8_t)mac[i];}
+                frame->rssi = rssi;
+                frame->len = 0;
+                for (const char *hex = cursor + 5 + consumed; hex + 1 < end && frame->len < ESPNOW_GROUP_FRAME_MAX_LEN; hex += 2) {
+                    unsigned int byte;
+                    if (sscanf(hex, "%2x", &byte) != 1) {break;}
+                    frame->data[frame->len++] = (uint8_t)byte;
+                }
+                return next != NULL ? next : capture_end;
+            }
+            cursor = next;
+        }
+        return NULL;
+    }
+
+    static uint32_t count_frames(void)
+    {
+        capture_frame_t frame;
+        uint32_t count = 0;
+        for (const char *cursor = next_frame(capture_start, &frame); cursor != NULL; cursor = next_frame(cursor, &frame)) {
+            count++;
+        }
+        return count;
+    }
+
+    // Lo mismo que hacen los recv_cb y rx_task de los nodos con la trama, sin la radio.
+    static void replay_frame(const capture_frame_t *frame, uint32_t now_ms)
+    {
+        const uint8_t *payload;
+        size_t payload_len;
+        const espnow_group_hdr_t *hdr = espnow_group_parse(frame->data, frame->len, &payload, &payload_len);
+        if (hdr == NULL) {return;}
+
+        if ((hdr->flags & ESPNOW_GROUP_FLAG_METRICS) && payload_len > 0) {
+            // El snapshot de métricas termina con su longitud, como lo quita metrics_strip.
+            size_t block = payload[payload_len - 1];
+            if (block + 1 <= payload_len) {payload_len -= block + 1;}
+        }
+        // Las tramas de load_gen se atribuyen a su nodo virtual, como en la pasarela.
+        uint8_t src[NODE_MAC_LEN];
+        uint16_t vnode;
+        if (espnow_group_strip_vnode(hdr, payload, &payload_len, &vnode)) {espnow_group_vnode_mac(frame->src, vnode, src);}
+        else {memcpy(src, frame->src, NODE_MAC_LEN);}
+
+        sensor_data_t data;
+        if (hdr->type == ESPNOW_MSG_SENSOR && node_sensor_decode(payload, payload_len, &data)) {
+            decoded++;
+            on_sensor(src, &data, now_ms);
+        }
+        else if (hdr->type == ESPNOW_MSG_TEMPERATURE && (payload_len == sizeof(float) || payload_len == sizeof(float) + sizeof(uint32_t))) {
+            decoded++;
+        #if !CONFIG_IDF_TARGET_LINUX
+            float temperature;
+            memcpy(&temperature, payload, sizeof(float));
+            on_temperature(src, temperature, now_ms);
+        #endif
+        }
+    }
+
+    static void on_sensor(const uint8_t *src, const sensor_data_t *data, uint32_t now_ms)
+    {
+        if (data->packet_id != NODE_LM35_PACKET_ID) {return;}
+        // Un barrido que terminó antes de esta trama ya vio la entrada anterior.
+        finish_sweep(now_ms);
+        actuator.input = node_remote_actuator_level(data);
+        memcpy(actuator.src, src, NODE_MAC_LEN);
+        if (!actuator.sweeping) {poll_actuator(now_ms);}
+    }
+
+    // servo_control no consulta la entrada durante un barrido: al terminarlo ve la vigente.
+    static void finish_sweep(uint32_t now_ms)
+    {
+        if (!actuator.sweeping || now_ms < actuator.sweep_end_ms) {return;}
+        actuator.sweeping = false;
+        poll_actuator(actuator.sweep_end_ms);
+    }
+
+    static void poll_actuator(uint32_t now_ms)
+    {
+        if (!node_actuation_gate(&actuator.gate, actuator.input, now_ms, NODE_ACTUATION_COOLDOWN_MS)) {return;}
+        printf("REPLAY-OUT %lu ACT " MAC_FMT "\n", (unsigned long)now_ms, MAC_ARGS(actuator.src));
+        outputs++;
+        actuator.sweeping = true;
+        actuator.sweep_end_ms = now_ms + NODE_SERVO_SWEEP_MS;
+    }
+
+    #if !CONFIG_IDF_TARGET_LINUX
+    static void on_temperature(const uint8_t *src, float temperature, uint32_t now_ms)
+    {
+        uint8_t raised = sensor_anomaly_observe_at(src, SENSOR_ANOMALY_LM35, temperature, now_ms);
+        for (uint8_t bit = 0; raised != 0 && bit < 8; bit++) {
+            if (!(raised & (1 << bit))) {continue;}
+            printf("REPLAY-OUT %lu ALERT " MAC_FMT " %s\n", (unsigned long)now_ms, MAC_ARGS(src),
+                   sensor_anomaly_kind_name((sensor_anomaly_kind_t)(1 << bit)));
+            outputs++;
+        }
+    }
+    #endif
+
+    static int compare_u32(const void *a, const void *b)
+    {
+        uint32_t x = *(const uint32_t *)a;
+        uint32_t y = *(const uint32_t *)b;
+        return (x > y) - (x < y);
+    }
@@ -0,0 +1,163 @@
+/************************************************************************************************
+ * Módulo: Pools de bloques de tamaño fijo sin bloqueo.
+ *
+ * Descripción: La cabeza de la lista libre empaqueta el índice del bloque (16 bits) con una
+ * etiqueta que avanza en cada cambio: un extractor que leyó la cabeza, fue interrumpido y
+ * encuentra de nuevo el mismo índice (liberado y vuelto a entregar entre medio) falla el
+ * intercambio en lugar de instalar un enlace obsoleto. El enlace se lee de un bloque que otro
+ * núcleo pudo haber tomado ya; ese valor se descarta con el mismo intercambio fallido. Las
+ * funciones van en IRAM para poder llamarse con la caché de flash deshabilitada.
+ *
+ * Autor:
+ *   - Victor Manuel Patiño Delgado.
+ *
+ * Licencia: THE BEER-WARE LICENSE.
+ * As long as you retain this notice you can do whatever you want with this stuff.
+ * If we meet some day, and you think this stuff is worth it, you can buy me a beer in return.
+************************************************************************************************/
+
+//***   Bibliotecas y declaraciones de preprocesador    ***//
+    #include <stdbool.h>
+    #include <string.h>
+    #include <assert.h>
+    #include "block_pool.h"
+    #if CONFIG_IDF_TARGET_LINUX
+        #define POOL_ATTR
+    #else
+        #include "esp_attr.h"
+        #include "metrics.h"
+        #define POOL_ATTR IRAM_ATTR
+    #endif
+
+//***   Definición de constantes y macros   ***//
+    #define INDEX_MASK 0xFFFFu
+    #define TAG_ONE 0x10000u
+    #define LINK_SIZE 4
+    #define POISON_BYTE 0xA5
+
+//***   Estructuras de datos y tipos personalizados ***//
+    BLOCK_POOL_DEFINE(small_pool, CONFIG_BLOCK_POOL_SMALL_SIZE, CONFIG_BLOCK_POOL_SMALL_COUNT);
+    BLOCK_POOL_DEFINE(medium_pool, CONFIG_BLOCK_POOL_MEDIUM_SIZE, CONFIG_BLOCK_POOL_MEDIUM_COUNT);
+    BLOCK_POOL_DEFINE(frame_pool, CONFIG_BLOCK_POOL_FRAME_SIZE, CONFIG_BLOCK_POOL_FRAME_COUNT);
+
+    // Ordenadas por tamaño creciente.
+    static block_pool_t *const classes[BLOCK_POOL_CLASS_COUNT] = {
+        [BLOCK_POOL_SMALL] = &small_pool,
+        [BLOCK_POOL_MEDIUM] = &medium_pool,
+        [BLOCK_POOL_FRAME] = &frame_pool,
+    };
+
+//***   Declaraciones de funciones (prototipos) ***//
+    static void record_take(block_pool_t *pool);
+    #if CONFIG_BLOCK_POOL_POISON
+    static bool is_poisoned(const block_pool_t *pool, const uint8_t *block);
+    #endif
+
+//***Implementación de funciones***//
+    void *POOL_ATTR block_pool_take(block_pool_t *pool)
+    {
+        uint32_t head = __atomic_load_n(&pool->head, __ATOMIC_ACQUIRE);
+        while ((head & INDEX_MASK) != 0) {
+            uint8_t *block = pool->storage + ((head & INDEX_MASK) - 1) * pool->block_size;
+            uint32_t next = __atomic_load_n((uint32_t *)block, __ATOMIC_RELAXED);
+            uint32_t popped = ((head + TAG_ONE) & ~INDEX_MASK) | (next & INDEX_MASK);
+            if (__atomic_compare_exchange_n(&pool->head, &head, popped, true, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE)) {
+            #if CONFIG_BLOCK_POOL_POISON
+                // Se rompe el veneno al entregarlo: un bloque devuelto sin escribir no es doble liberación.
+                if (pool->block_size > LINK_SIZE) {
+                    assert(is_poisoned(pool, block) && "block_pool: write after free");
+                    block[LINK_SIZE] = (uint8_t)~POISON_BYTE;
+                }
+            #endif
+                record_take(pool);
+                return block;
+            }
+        }
+
+        // Lista vacía: el siguiente bloque nunca usado, si queda.
+        uint32_t fresh = __atomic_load_n(&pool->fresh, __ATOMIC_RELAXED);
+        while (fresh < pool->count) {
+            if (__atomic_compare_exchange_n(&pool->fresh, &fresh, fresh + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                record_take(pool);
+                return pool->storage + fresh * pool->block_size;
+            }
+        }
+
+        __atomic_fetch_add(&pool->failures, 1, __ATOMIC_RELAXED);
+    #if !CONFIG_IDF_TARGET_LINUX
+        metrics_inc(METRIC_POOL_FAILURES);
+    #endif
+        return NULL;
+    }
+
+    void POOL_ATTR block_pool_give(block_pool_t *pool, void *block)
+    {
+        size_t offset = (uint8_t *)block - pool->storage;
+        assert(offset < (size_t)pool->count * pool->block_size && offset % pool->block_size == 0);
+    #if CONFIG_BLOCK_POOL_POISON
+        // Un bloque de 4 bytes es todo enlace: no queda nada que envenenar ni que verificar.
+        if (pool->block_size > LINK_SIZE) {
+            assert(!is_poisoned(pool, block) && "block_pool: double free");
+            memset((uint8_t *)block + LINK_SIZE, POISON_BYTE, pool->block_size - LINK_SIZE);
+        }
+    #endif
+
+        uint32_t index = offset / pool->block_size + 1;
+        uint32_t head = __atomic_load_n(&pool->head, __ATOMIC_RELAXED);
+        uint32_t pushed;
+        do {
+            __atomic_store_n((uint32_t *)block, head & INDEX_MASK, __ATOMIC_RELAXED);
+            pushed = ((head + TAG_ONE) & ~INDEX_MASK) | index;
+        } while (!__atomic_compare_exchange_n(&pool->head, &head, pushed, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+        __atomic_fetch_sub(&pool->in_use, 1, __ATOMIC_RELAXED);
+    }
+
+    void *POOL_ATTR block_pool_alloc(size_t size)
+    {
+        for (uint8_t i = 0; i < BLOCK_POOL_CLASS_COUNT; i++) {
+            if (size > classes[i]->block_size) {continue;}
+            void *block = block_pool_take(classes[i]);
+            if (block != NULL) {return block;}
+        }
+        return NULL;
+    }
+
+    void POOL_ATTR block_pool_free(void *block)
+    {
+        if (block == NULL) {return;}
+        for (uint8_t i = 0; i < BLOCK_POOL_CLASS_COUNT; i++) {
+            block_pool_t *pool = classes[i];
+            if ((uint8_t *)block >= pool->storage && (uint8_t *)block < pool->storage + pool->count * pool->block_size) {
+                block_pool_give(pool, block);
+                return;
+            }
+        }
+        assert(!"block_pool: block not from a size class");
+    }
+
+    const block_pool_t *block_pool_class(block_pool_class_t pool_class)
+    {
+        return pool_class < BLOCK_POOL_CLASS_COUNT ? classes[pool_class] : NULL;
+    }
+
+    static void POOL_ATTR record_take(block_pool_t *pool)
+    {
+        uint32_t in_use = __atomic_add_fetch(&pool->in_use, 1, __ATOMIC_RELAXED);
+        uint32_t high_water = __atomic_load_n(&pool->high_water, __ATOMIC_RELAXED);
+        while (in_use > high_water &&
+               !__atomic_compare_exchange_n(&pool->high_water, &high_water, in_use, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        }
+    #if !CONFIG_IDF_TARGET_LINUX
+        if (in_use > high_water) {metrics_max(METRIC_POOL_PEAK_PCT, in_use * 100 / pool->count);}
+    #endif
+    }
+
+    #if CONFIG_BLOCK_POOL_POISON
+    static bool POOL_ATTR is_poisoned(const block_pool_t *pool, const uint8_t *block)
+    {
+        for (uint16_t i = LINK_SIZE; i < pool->block_size; i++) {
+            if (block[i] != POISON_BYTE) {return false;}
+        }
+        return true;
+    }
+    #endif
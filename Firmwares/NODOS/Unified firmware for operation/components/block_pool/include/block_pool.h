@@ -0,0 +1,75 @@
+/************************************************************************************************
+ * Módulo: Pools de bloques de tamaño fijo sin bloqueo.
+ *
+ * Descripción: Asignación de bloques de tamaño fijo desde almacenamiento estático, apta para
+ * ISRs y callbacks: sin heap (sin fragmentación ni búsquedas), sin secciones críticas y en
+ * tiempo constante. Cada pool es una pila de bloques libres con etiqueta anti-ABA actualizada
+ * por comparación e intercambio; los bloques nunca usados se entregan en orden, así un pool
+ * definido con BLOCK_POOL_DEFINE no necesita inicialización. Tres clases de tamaño globales
+ * (chica, mediana, trama) cubren los usos comunes con block_pool_alloc/block_pool_free.
+ *
+ * Autor:
+ *   - Victor Manuel Patiño Delgado.
+ *
+ * Licencia: THE BEER-WARE LICENSE.
+ * As long as you retain this notice you can do whatever you want with this stuff.
+ * If we meet some day, and you think this stuff is worth it, you can buy me a beer in return.
+************************************************************************************************/
+#pragma once
+
+//***   Bibliotecas y declaraciones de preprocesador    ***//
+    #include <stdint.h>
+    #include <stddef.h>
+    #include "sdkconfig.h"
+
+    #ifdef __cplusplus
+    extern "C" {
+    #endif
+
+//***   Definición de constantes y macros   ***//
+    // Los bloques se alinean a 4 bytes: los primeros 4 guardan el enlace mientras está libre.
+    #define BLOCK_POOL_ALIGN(size) ((((size) < 4 ? 4 : (size)) + 3) & ~3u)
+
+    // Pool estático propio de blocks bloques de size bytes; blocks hasta 65535.
+    #define BLOCK_POOL_DEFINE(name, size, blocks) \
+        static uint8_t name##_storage[BLOCK_POOL_ALIGN(size) * (blocks)] __attribute__((aligned(4))); \
+        static block_pool_t name = {.storage = name##_storage, .block_size = BLOCK_POOL_ALIGN(size), .count = (blocks)}
+
+//***   Estructuras de datos y tipos personalizados ***//
+    typedef struct {
+        uint8_t *storage;
+        uint16_t block_size;
+        uint16_t count;
+        uint32_t head;          // (etiqueta << 16) | (índice + 1); índice 0: lista vacía
+        uint32_t fresh;         // Bloques nunca usados ya entregados
+        uint32_t in_use;
+        uint32_t high_water;    // Máximo de in_use
+        uint32_t failures;      // Pedidos sin bloque disponible
+    } block_pool_t;
+
+    typedef enum {
+        BLOCK_POOL_SMALL,
+        BLOCK_POOL_MEDIUM,
+        BLOCK_POOL_FRAME,
+        BLOCK_POOL_CLASS_COUNT
+    } block_pool_class_t;
+
+//***   Declaraciones de funciones (prototipos) ***//
+    // Un bloque de pool o NULL si está agotado. Sin bloqueo, apta para ISR.
+    void *block_pool_take(block_pool_t *pool);
+
+    // Devuelve un bloque a su pool. Sin bloqueo, apta para ISR.
+    void block_pool_give(block_pool_t *pool, void *block);
+
+    // Bloque de la clase más chica que aloje size; si está agotada se intenta la siguiente.
+    void *block_pool_alloc(size_t size);
+
+    // Libera un bloque de block_pool_alloc; la clase se deduce de la dirección. NULL se ignora.
+    void block_pool_free(void *block);
+
+    // Pool de una clase, para consultar sus contadores.
+    const block_pool_t *block_pool_class(block_pool_class_t pool_class);
+
+    #ifdef __cplusplus
+    }
+    #endif
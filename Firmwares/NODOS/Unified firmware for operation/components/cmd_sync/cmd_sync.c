@@ -0,0 +1,216 @@
+/************************************************************************************************
+ * Módulo: Distribución de comandos con época, solo por cambio de estado.
+ *
+ * Descripción: Del lado de la pasarela, la reparación solo actúa sobre un nodo que ya reportó
+ * después del último cambio y aun así sigue atrasado: el retardo normal entre aplicar un
+ * comando y reportarlo no genera reenvíos. Del lado del nodo, recv_cb es el único escritor
+ * de las épocas aplicadas; la lectura para la telemetría es atómica.
+ *
+ * Autor:
+ *   - Victor Manuel Patiño Delgado.
+ *
+ * Licencia: THE BEER-WARE LICENSE.
+ * As long as you retain this notice you can do whatever you want with this stuff.
+ * If we meet some day, and you think this stuff is worth it, you can buy me a beer in return.
+************************************************************************************************/
+
+//***   Bibliotecas y declaraciones de preprocesador    ***//
+    #include <string.h>
+    #include "freertos/FreeRTOS.h"
+    #include "freertos/task.h"
+    #include "nvs.h"
+    #include "esp_mac.h"
+    #include "esp_log.h"
+    #include "cmd_sync.h"
+    #include "metrics.h"
+    #include "task_layout.h"
+
+//***   Definición de constantes y macros   ***//
+    #define NVS_NAMESPACE "cmd_sync"
+    #define EPOCH_COUNTER_MASK 0xFFFFu
+    #define FRAME_LEN(count) (1 + (count) * sizeof(cmd_sync_entry_t))
+
+    static const char *TAG = "cmd_sync";
+
+//***   Estructuras de datos y tipos personalizados ***//
+    typedef struct {
+        bool used;
+        uint8_t value;
+        uint32_t epoch;
+    } desired_t;
+
+    typedef struct {
+        bool valid;
+        uint8_t mac[CMD_SYNC_MAC_LEN];
+        uint32_t applied;
+        TickType_t reported_at;
+    } peer_t;
+
+    static portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+    static desired_t desired[CONFIG_CMD_SYNC_MAX_ACTUATORS];
+    static peer_t peers[CONFIG_CMD_SYNC_MAX_PEERS];
+    static uint32_t last_epoch;
+    static TickType_t changed_at;
+    static cmd_sync_send_fn_t send_fn;
+
+    static cmd_sync_apply_fn_t apply_fn;
+    static uint32_t node_epochs[CONFIG_CMD_SYNC_MAX_ACTUATORS];
+    static uint8_t node_values[CONFIG_CMD_SYNC_MAX_ACTUATORS];
+    static uint32_t node_applied;
+
+//***   Declaraciones de funciones (prototipos) ***//
+    static esp_err_t advance_generation(void);
+    static size_t build_frame(cmd_sync_frame_t *frame, uint32_t *max_epoch);
+    static void refresh_task(void *pvParameters);
+
+//***Implementación de funciones***//
+    esp_err_t cmd_sync_gateway_start(cmd_sync_send_fn_t send)
+    {
+        send_fn = send;
+        esp_err_t err = advance_generation();
+        if (err != ESP_OK) {return err;}
+        ESP_LOGI(TAG, "Epochs start at 0x%08lx, repair every %d ms", (unsigned long)last_epoch, CONFIG_CMD_SYNC_REFRESH_MS);
+        return TASK_LAYOUT_CREATE(refresh_task, "cmd_refresh", 3072, NULL, TASK_CLASS_BACKGROUND, NULL);
+    }
+
+    esp_err_t cmd_sync_set(uint8_t actuator, uint8_t value)
+    {
+        if (actuator >= CONFIG_CMD_SYNC_MAX_ACTUATORS) {return ESP_ERR_INVALID_ARG;}
+        if (desired[actuator].used && desired[actuator].value == value) {return ESP_OK;}
+
+        // Contador agotado: nueva generación antes de emitir, las épocas siguen creciendo.
+        if (((last_epoch + 1) & EPOCH_COUNTER_MASK) == 0) {
+            esp_err_t err = advance_generation();
+            if (err != ESP_OK) {return err;}
+        }
+
+        taskENTER_CRITICAL(&lock);
+        last_epoch++;
+        desired[actuator] = (desired_t){.used = true, .value = value, .epoch = last_epoch};
+        changed_at = xTaskGetTickCount();
+        taskEXIT_CRITICAL(&lock);
+
+        cmd_sync_frame_t frame;
+        uint32_t max_epoch;
+        size_t len = build_frame(&frame, &max_epoch);
+        ESP_LOGI(TAG, "Actuator %u -> %u, epoch 0x%08lx", actuator, value, (unsigned long)max_epoch);
+        metrics_inc(METRIC_CMD_SENT);
+        return send_fn(NULL, &frame, len);
+    }
+
+    void cmd_sync_report(const uint8_t *mac, uint32_t applied_epoch)
+    {
+        taskENTER_CRITICAL(&lock);
+        peer_t *slot = NULL;
+        for (uint8_t i = 0; i < CONFIG_CMD_SYNC_MAX_PEERS; i++) {
+            if (peers[i].valid && memcmp(peers[i].mac, mac, CMD_SYNC_MAC_LEN) == 0) {
+                slot = &peers[i];
+                break;
+            }
+            if (!peers[i].valid && slot == NULL) {slot = &peers[i];}
+        }
+        if (slot != NULL) {
+            slot->valid = true;
+            memcpy(slot->mac, mac, CMD_SYNC_MAC_LEN);
+            slot->applied = applied_epoch;
+            slot->reported_at = xTaskGetTickCount();
+        }
+        taskEXIT_CRITICAL(&lock);
+    }
+
+    void cmd_sync_node_init(cmd_sync_apply_fn_t apply)
+    {
+        apply_fn = apply;
+    }
+
+    bool cmd_sync_handle(const espnow_group_hdr_t *hdr, const uint8_t *payload, size_t payload_len)
+    {
+        if (hdr->type != ESPNOW_MSG_COMMAND || payload_len < 1) {return false;}
+        uint8_t count = payload[0];
+        if (count > CONFIG_CMD_SYNC_MAX_ACTUATORS || payload_len != FRAME_LEN(count)) {return false;}
+
+        uint32_t applied = node_applied;
+        for (uint8_t i = 0; i < count; i++) {
+            cmd_sync_entry_t entry;
+            memcpy(&entry, payload + FRAME_LEN(i), sizeof(entry));
+            if (entry.actuator >= CONFIG_CMD_SYNC_MAX_ACTUATORS || entry.epoch <= node_epochs[entry.actuator]) {continue;}
+
+            // Primera época o valor distinto: se mueve el actuador; una reparación con el
+            // mismo valor solo avanza la época.
+            bool changed = node_epochs[entry.actuator] == 0 || node_values[entry.actuator] != entry.value;
+            node_epochs[entry.actuator] = entry.epoch;
+            node_values[entry.actuator] = entry.value;
+            if (changed && apply_fn != NULL) {
+                apply_fn(entry.actuator, entry.value);
+                metrics_inc(METRIC_CMD_APPLIED);
+            }
+            if (entry.epoch > applied) {applied = entry.epoch;}
+        }
+        __atomic_store_n(&node_applied, applied, __ATOMIC_RELAXED);
+        return true;
+    }
+
+    uint32_t cmd_sync_applied_epoch(void)
+    {
+        return __atomic_load_n(&node_applied, __ATOMIC_RELAXED);
+    }
+
+    static esp_err_t advance_generation(void)
+    {
+        nvs_handle_t nvs;
+        esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs);
+        if (err != ESP_OK) {return err;}
+        uint16_t generation = 0;
+        nvs_get_u16(nvs, "gen", &generation);
+        generation++;
+        err = nvs_set_u16(nvs, "gen", generation);
+        if (err == ESP_OK) {err = nvs_commit(nvs);}
+        nvs_close(nvs);
+        if (err == ESP_OK) {last_epoch = (uint32_t)generation << 16;}
+        return err;
+    }
+
+    static size_t build_frame(cmd_sync_frame_t *frame, uint32_t *max_epoch)
+    {
+        frame->count = 0;
+        *max_epoch = 0;
+        taskENTER_CRITICAL(&lock);
+        for (uint8_t i = 0; i < CONFIG_CMD_SYNC_MAX_ACTUATORS; i++) {
+            if (!desired[i].used) {continue;}
+            frame->entries[frame->count++] = (cmd_sync_entry_t){i, desired[i].value, desired[i].epoch};
+            if (desired[i].epoch > *max_epoch) {*max_epoch = desired[i].epoch;}
+        }
+        taskEXIT_CRITICAL(&lock);
+        return FRAME_LEN(frame->count);
+    }
+
+    static void refresh_task(void *pvParameters)
+    {
+        cmd_sync_frame_t frame;
+        uint8_t lagging[CONFIG_CMD_SYNC_MAX_PEERS][CMD_SYNC_MAC_LEN];
+
+        while (1) {
+            vTaskDelay(pdMS_TO_TICKS(CONFIG_CMD_SYNC_REFRESH_MS));
+
+            uint32_t max_epoch;
+            size_t len = build_frame(&frame, &max_epoch);
+            if (frame.count == 0) {continue;}
+
+            uint8_t lagging_count = 0;
+            taskENTER_CRITICAL(&lock);
+            for (uint8_t i = 0; i < CONFIG_CMD_SYNC_MAX_PEERS; i++) {
+                // Atrasado aun después de reportar tras el último cambio: la trama se perdió.
+                if (peers[i].valid && peers[i].applied < max_epoch && (int32_t)(peers[i].reported_at - changed_at) > 0) {
+                    memcpy(lagging[lagging_count++], peers[i].mac, CMD_SYNC_MAC_LEN);
+                }
+            }
+            taskEXIT_CRITICAL(&lock);
+
+            for (uint8_t i = 0; i < lagging_count; i++) {
+                ESP_LOGW(TAG, "Repairing " MACSTR ", behind epoch 0x%08lx", MAC2STR(lagging[i]), (unsigned long)max_epoch);
+                metrics_inc(METRIC_CMD_REPAIRS);
+                metrics_inc(METRIC_CMD_SENT);
+                send_fn(lagging[i], &frame, len);
+            }
+        }
+    }
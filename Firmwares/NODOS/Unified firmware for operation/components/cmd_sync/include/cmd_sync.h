@@ -0,0 +1,80 @@
+/************************************************************************************************
+ * Módulo: Distribución de comandos con época, solo por cambio de estado.
+ *
+ * Descripción: La pasarela guarda el estado deseado de cada actuador junto con una época que
+ * solo crece (generación guardada en NVS en los 16 bits altos, contador en los bajos, así un
+ * reinicio de la pasarela nunca repite épocas). Un comando sale únicamente cuando el estado
+ * cambia y siempre lleva el estado completo, de modo que la última trama recibida basta para
+ * converger. Los nodos aplican cada actuador solo si su época es mayor que la aplicada
+ * (idempotente ante duplicados y reordenamientos) y reportan la época aplicada en su
+ * telemetría. Una reparación periódica de baja tasa reenvía el estado solo a los nodos que
+ * reportan una época atrasada.
+ *
+ * Autor:
+ *   - Victor Manuel Patiño Delgado.
+ *
+ * Licencia: THE BEER-WARE LICENSE.
+ * As long as you retain this notice you can do whatever you want with this stuff.
+ * If we meet some day, and you think this stuff is worth it, you can buy me a beer in return.
+************************************************************************************************/
+#pragma once
+
+//***   Bibliotecas y declaraciones de preprocesador    ***//
+    #include <stdint.h>
+    #include <stdbool.h>
+    #include <stddef.h>
+    #include "esp_err.h"
+    #include "espnow_group.h"
+    #include "sdkconfig.h"
+
+    #ifdef __cplusplus
+    extern "C" {
+    #endif
+
+//***   Definición de constantes y macros   ***//
+    #define CMD_SYNC_MAC_LEN 6
+
+    #define CMD_SYNC_ACTUATOR_LED 0     // LED / relé principal del nodo
+
+//***   Estructuras de datos y tipos personalizados ***//
+    typedef struct __attribute__((packed)) {
+        uint8_t actuator;
+        uint8_t value;
+        uint32_t epoch;                 // Época en que se fijó este valor
+    } cmd_sync_entry_t;
+
+    // Payload de ESPNOW_MSG_COMMAND: count entradas seguidas, una por actuador asignado.
+    typedef struct __attribute__((packed)) {
+        uint8_t count;
+        cmd_sync_entry_t entries[CONFIG_CMD_SYNC_MAX_ACTUATORS];
+    } cmd_sync_frame_t;
+
+    // mac NULL: todos los nodos. La aplicación elige el transporte (grupo o unicast cifrado).
+    typedef esp_err_t (*cmd_sync_send_fn_t)(const uint8_t *mac, const void *payload, size_t len);
+
+    // Se invoca una vez por actuador cuyo valor cambió; desde recv_cb, debe ser breve.
+    typedef void (*cmd_sync_apply_fn_t)(uint8_t actuator, uint8_t value);
+
+//***   Declaraciones de funciones (prototipos) ***//
+    // Pasarela: lee y avanza la generación en NVS y arranca la reparación periódica.
+    esp_err_t cmd_sync_gateway_start(cmd_sync_send_fn_t send);
+
+    // Pasarela: fija el estado deseado. Si no cambia no se transmite nada. Llamar siempre
+    // desde la misma tarea.
+    esp_err_t cmd_sync_set(uint8_t actuator, uint8_t value);
+
+    // Pasarela: época aplicada reportada por un nodo en su telemetría. Apta para recv_cb.
+    void cmd_sync_report(const uint8_t *mac, uint32_t applied_epoch);
+
+    // Nodo: registra la función que mueve los actuadores.
+    void cmd_sync_node_init(cmd_sync_apply_fn_t apply);
+
+    // Nodo: procesa una trama ESPNOW_MSG_COMMAND; false si no lo es o está mal formada.
+    bool cmd_sync_handle(const espnow_group_hdr_t *hdr, const uint8_t *payload, size_t payload_len);
+
+    // Nodo: mayor época aplicada, para la telemetría.
+    uint32_t cmd_sync_applied_epoch(void);
+
+    #ifdef __cplusplus
+    }
+    #endif
@@ -0,0 +1,226 @@
+/************************************************************************************************
+ * Módulo: Recuperación ante fallos con watchdog de tareas y estado retenido en RTC.
+ *
+ * Descripción: El registro vive en RTC_NOINIT: el cargador de arranque no lo toca en un reinicio
+ * por software, pánico o watchdog, y tras un encendido contiene basura, por eso lleva un número
+ * mágico que incluye su tamaño (una versión con otro formato lo descarta) y cada bloque su
+ * propia suma de verificación (un fallo a mitad de una copia lo invalida). El snapshot de
+ * métricas se copia con un periodo fijo, no en el pánico: el manejador de pánico no debe
+ * depender del estado de la aplicación.
+ *
+ * Autor:
+ *   - Victor Manuel Patiño Delgado.
+ *
+ * Licencia: THE BEER-WARE LICENSE.
+ * As long as you retain this notice you can do whatever you want with this stuff.
+ * If we meet some day, and you think this stuff is worth it, you can buy me a beer in return.
+************************************************************************************************/
+
+//***   Bibliotecas y declaraciones de preprocesador    ***//
+    #include <string.h>
+    #include "freertos/FreeRTOS.h"
+    #include "freertos/task.h"
+    #include "esp_attr.h"
+    #include "esp_system.h"
+    #include "esp_timer.h"
+    #include "esp_log.h"
+    #include "crash_guard.h"
+    #include "metrics.h"
+    #include "task_layout.h"
+    #if CONFIG_CRASH_GUARD_ENABLE
+    #include "esp_task_wdt.h"
+    #endif
+
+//***   Definición de constantes y macros   ***//
+    #define RECORD_MAGIC (0x43524153u ^ (uint32_t)sizeof(rtc_record_t))   // "CRAS" ^ formato
+    #define FNV_OFFSET 2166136261u
+    #define FNV_PRIME 16777619u
+
+    // La reconfiguración reemplaza la máscara: se conservan los núcleos que vigila menuconfig.
+    #if CONFIG_ESP_TASK_WDT_CHECK_IDLE_TASK_CPU0
+        #define IDLE_CORE0 (1u << 0)
+    #else
+        #define IDLE_CORE0 0
+    #endif
+    #if CONFIG_ESP_TASK_WDT_CHECK_IDLE_TASK_CPU1
+        #define IDLE_CORE1 (1u << 1)
+    #else
+        #define IDLE_CORE1 0
+    #endif
+
+    static const char *TAG = "crash_guard";
+
+//***   Estructuras de datos y tipos personalizados ***//
+    #if CONFIG_CRASH_GUARD_ENABLE
+    typedef struct {
+        uint32_t checksum;
+        uint16_t len;
+        uint8_t data[CONFIG_CRASH_GUARD_SLOT_SIZE];
+    } retained_slot_t;
+
+    typedef struct {
+        uint32_t magic;
+        uint32_t boots;                 // Arranques desde el último encendido
+        uint32_t crashes;               // Pánicos, watchdogs y caídas de tensión
+        uint32_t uptime_s;              // Tiempo en marcha en la última copia
+        uint32_t metrics[METRIC_COUNT]; // Snapshot de la última copia
+        retained_slot_t slots[CRASH_GUARD_SLOT_COUNT];
+    } rtc_record_t;
+
+    static RTC_NOINIT_ATTR rtc_record_t record;
+    static bool warm;
+    static bool ready_reported;
+    #endif
+
+//***   Declaraciones de funciones (prototipos) ***//
+    #if CONFIG_CRASH_GUARD_ENABLE
+    static uint32_t slot_checksum(const void *data, size_t len);
+    static void checkpoint(void);
+    static void checkpoint_task(void *pvParameters);
+    #endif
+
+//***Implementación de funciones***//
+    #if CONFIG_CRASH_GUARD_ENABLE
+    esp_err_t crash_guard_init(void)
+    {
+        esp_reset_reason_t reason = esp_reset_reason();
+        bool crashed = reason == ESP_RST_PANIC || reason == ESP_RST_INT_WDT || reason == ESP_RST_TASK_WDT ||
+                       reason == ESP_RST_WDT || reason == ESP_RST_BROWNOUT;
+
+        if (record.magic != RECORD_MAGIC || reason == ESP_RST_POWERON || reason == ESP_RST_UNKNOWN) {
+            memset(&record, 0, sizeof(record));
+            record.magic = RECORD_MAGIC;
+        } else if (crashed) {
+            // Tras una caída de tensión la RAM RTC puede estar degradada: se cuenta, no se reanuda.
+            warm = reason != ESP_RST_BROWNOUT;
+            ESP_LOGW(TAG, "Reset reason %d after %lu s up, crash %lu of %lu boots", reason,
+                     (unsigned long)record.uptime_s, (unsigned long)record.crashes + 1, (unsigned long)record.boots + 1);
+            for (uint8_t i = 0; i < METRIC_COUNT; i++) {
+                if (record.metrics[i] != 0) {ESP_LOGI(TAG, "  before crash: %s=%lu", metrics_name(i), (unsigned long)record.metrics[i]);}
+            }
+        }
+        record.boots++;
+        if (crashed) {record.crashes++;}
+        if (!warm) {memset(record.slots, 0, sizeof(record.slots));}
+
+        metrics_set(METRIC_CRASHES, record.crashes);
+        metrics_set(METRIC_RESET_REASON, reason);
+        metrics_set(METRIC_CRASH_UPTIME_S, crashed ? record.uptime_s : 0);
+        record.uptime_s = 0;
+
+        esp_task_wdt_config_t config = {
+            .timeout_ms = CONFIG_CRASH_GUARD_WDT_TIMEOUT_MS,
+            .idle_core_mask = IDLE_CORE0 | IDLE_CORE1,
+            .trigger_panic = true,
+        };
+        esp_err_t err = esp_task_wdt_reconfigure(&config);
+        if (err == ESP_ERR_INVALID_STATE) {err = esp_task_wdt_init(&config);}
+        if (err != ESP_OK) {return err;}
+
+        esp_register_shutdown_handler(checkpoint);
+        return TASK_LAYOUT_CREATE(checkpoint_task, "crash_ckpt", 2048, NULL, TASK_CLASS_BACKGROUND, NULL);
+    }
+
+    bool crash_guard_warm_start(void)
+    {
+        return warm;
+    }
+
+    esp_err_t crash_guard_watch(void)
+    {
+        return esp_task_wdt_add(NULL);
+    }
+
+    void crash_guard_feed(void)
+    {
+        esp_task_wdt_reset();
+    }
+
+    void crash_guard_retain(crash_guard_slot_t slot, const void *data, size_t len)
+    {
+        if (slot >= CRASH_GUARD_SLOT_COUNT || len > CONFIG_CRASH_GUARD_SLOT_SIZE) {return;}
+        retained_slot_t *retained = &record.slots[slot];
+        // Suma al final: un fallo a mitad de la copia deja el bloque inválido, no mezclado.
+        retained->checksum = 0;
+        retained->len = len;
+        memcpy(retained->data, data, len);
+        retained->checksum = slot_checksum(data, len);
+    }
+
+    bool crash_guard_restore(crash_guard_slot_t slot, void *data, size_t len)
+    {
+        if (!warm || slot >= CRASH_GUARD_SLOT_COUNT) {return false;}
+        const retained_slot_t *retained = &record.slots[slot];
+        if (retained->len != len || retained->checksum != slot_checksum(retained->data, len)) {return false;}
+        memcpy(data, retained->data, len);
+        return true;
+    }
+
+    void crash_guard_ready(void)
+    {
+        if (ready_reported) {return;}
+        ready_reported = true;
+        uint32_t recovery_ms = (uint32_t)(esp_timer_get_time() / 1000);
+        metrics_set(METRIC_RECOVERY_MS, recovery_ms);
+        ESP_LOGI(TAG, "%s start ready in %lu ms (boot %lu, %lu crashes)", warm ? "Warm" : "Cold",
+                 (unsigned long)recovery_ms, (unsigned long)record.boots, (unsigned long)record.crashes);
+    }
+
+    static uint32_t slot_checksum(const void *data, size_t len)
+    {
+        // FNV-1a sobre longitud y datos; nunca 0, que marca un bloque en escritura.
+        const uint8_t *bytes = data;
+        uint32_t hash = (FNV_OFFSET ^ (uint32_t)len) * FNV_PRIME;
+        for (size_t i = 0; i < len; i++) {hash = (hash ^ bytes[i]) * FNV_PRIME;}
+        return hash != 0 ? hash : 1;
+    }
+
+    static void checkpoint(void)
+    {
+        for (uint8_t i = 0; i < METRIC_COUNT; i++) {
+            record.metrics[i] = __atomic_load_n(&metrics_values[i], __ATOMIC_RELAXED);
+        }
+        record.uptime_s = (uint32_t)(esp_timer_get_time() / 1000000);
+    }
+
+    static void checkpoint_task(void *pvParameters)
+    {
+        while (1) {
+            checkpoint();
+            vTaskDelay(pdMS_TO_TICKS(CONFIG_CRASH_GUARD_CHECKPOINT_MS));
+        }
+    }
+    #else
+    esp_err_t crash_guard_init(void)
+    {
+        ESP_LOGW(TAG, "CRASH_GUARD_ENABLE is off");
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    bool crash_guard_warm_start(void)
+    {
+        return false;
+    }
+
+    esp_err_t crash_guard_watch(void)
+    {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    void crash_guard_feed(void)
+    {
+    }
+
+    void crash_guard_retain(crash_guard_slot_t slot, const void *data, size_t len)
+    {
+    }
+
+    bool crash_guard_restore(crash_guard_slot_t slot, void *data, size_t len)
+    {
+        return false;
+    }
+
+    void crash_guard_ready(void)
+    {
+    }
+    #endif
@@ -0,0 +1,63 @@
+/************************************************************************************************
+ * Módulo: Recuperación ante fallos con watchdog de tareas y estado retenido en RTC.
+ *
+ * Descripción: Las tareas de la aplicación se suscriben al watchdog de tareas; una tarea
+ * bloqueada provoca un pánico y un reinicio en lugar de un nodo vivo pero mudo. Un registro en
+ * memoria RTC sin inicializar sobrevive a ese reinicio: motivo, conteo de fallos, snapshot de
+ * métricas y bloques de estado de la aplicación. Tras un pánico o un watchdog el arranque es
+ * "en caliente": la aplicación recupera sus bloques en lugar de recalibrar y reconstruir.
+ *
+ * Autor:
+ *   - Victor Manuel Patiño Delgado.
+ *
+ * Licencia: THE BEER-WARE LICENSE.
+ * As long as you retain this notice you can do whatever you want with this stuff.
+ * If we meet some day, and you think this stuff is worth it, you can buy me a beer in return.
+************************************************************************************************/
+#pragma once
+
+//***   Bibliotecas y declaraciones de preprocesador    ***//
+    #include <stdint.h>
+    #include <stdbool.h>
+    #include <stddef.h>
+    #include "esp_err.h"
+    #include "sdkconfig.h"
+
+    #ifdef __cplusplus
+    extern "C" {
+    #endif
+
+//***   Estructuras de datos y tipos personalizados ***//
+    typedef enum {
+        CRASH_GUARD_SLOT_CALIBRATION,   // Caracterización del ADC
+        CRASH_GUARD_SLOT_APP,           // Estado propio de la aplicación (detección, salidas)
+        CRASH_GUARD_SLOT_COUNT
+    } crash_guard_slot_t;
+
+//***   Declaraciones de funciones (prototipos) ***//
+    // Llamar al inicio de app_main: clasifica el reinicio, valida el registro RTC, configura el
+    // watchdog de tareas con pánico y arranca la copia periódica de métricas.
+    esp_err_t crash_guard_init(void);
+
+    // true si el arranque actual sigue a un pánico o watchdog con el registro RTC íntegro.
+    bool crash_guard_warm_start(void);
+
+    // Suscribe la tarea que llama al watchdog; debe llamar crash_guard_feed() al menos una
+    // vez por CONFIG_CRASH_GUARD_WDT_TIMEOUT_MS.
+    esp_err_t crash_guard_watch(void);
+    void crash_guard_feed(void);
+
+    // Copia un bloque a memoria RTC (a lo sumo CONFIG_CRASH_GUARD_SLOT_SIZE bytes). Barato:
+    // una copia y una suma de verificación, apto para cada ciclo de una tarea.
+    void crash_guard_retain(crash_guard_slot_t slot, const void *data, size_t len);
+
+    // Solo en un arranque en caliente y si el bloque está íntegro y mide len: lo copia en
+    // data y devuelve true. En cualquier otro caso data no se modifica.
+    bool crash_guard_restore(crash_guard_slot_t slot, void *data, size_t len);
+
+    // Marca el fin de la recuperación: publica el tiempo desde el arranque en las métricas.
+    void crash_guard_ready(void);
+
+    #ifdef __cplusplus
+    }
+    #endif
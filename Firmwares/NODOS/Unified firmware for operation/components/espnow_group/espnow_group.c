@@ -0,0 +1,330 @@
+/************************************************************************************************
+ * Módulo: Direccionamiento por grupos sobre ESP-NOW.
+ *
+ * Descripción: Emisión única a la dirección broadcast con filtrado por suscripción en el
+ * receptor. Las tramas críticas se retienen en un anillo de retransmisión; cada receptor lleva
+ * una ventana de 32 secuencias por emisor y grupo para detectar pérdidas (NACK) y descartar
+ * duplicados cuando la retransmisión fue solicitada por otro nodo. Los contadores de secuencia
+ * propios viven en RTC_NOINIT: tras un pánico o watchdog el emisor continúa donde iba y los
+ * receptores no descartan sus tramas como duplicados antiguos. Las tramas retenidas viven en
+ * bloques de block_pool: se arman directamente en el bloque y el anillo solo intercambia
+ * punteros bajo el candado. Con ESPNOW_GROUP_GATEWAY_MAC configurada, el grupo de la pasarela
+ * sale en unicast hacia ella: la radio reintenta hasta el ACK y send_cb informa la entrega real,
+ * que link_quality necesita para bajar de tasa o pasar a LR.
+ *
+ * Autor:
+ *   - Victor Manuel Patiño Delgado.
+ *
+ * Licencia: THE BEER-WARE LICENSE.
+ * As long as you retain this notice you can do whatever you want with this stuff.
+ * If we meet some day, and you think this stuff is worth it, you can buy me a beer in return.
+************************************************************************************************/
+
+//***   Bibliotecas y declaraciones de preprocesador    ***//
+    #include <stdio.h>
+    #include <string.h>
+    #include "freertos/FreeRTOS.h"
+    #include "freertos/task.h"
+    #include "esp_attr.h"
+    #include "esp_system.h"
+    #include "esp_now.h"
+    #include "esp_wifi.h"
+    #include "esp_mac.h"
+    #include "esp_log.h"
+    #include "sdkconfig.h"
+    #include "espnow_group.h"
+    #include "metrics.h"
+    #include "trace.h"
+    #include "block_pool.h"
+
+//***   Definición de constantes y macros   ***//
+    #define RETX_DEPTH CONFIG_ESPNOW_GROUP_RETX_DEPTH
+    #define MAX_SOURCES CONFIG_ESPNOW_GROUP_MAX_SOURCES
+    #define NACK_HOLDOFF pdMS_TO_TICKS(CONFIG_ESPNOW_GROUP_NACK_HOLDOFF_MS)
+    #define SEQ_WINDOW 32
+    #define SEQ_MAGIC 0x53455153u   // "SEQS"
+
+    _Static_assert(ESPNOW_GROUP_FRAME_MAX_LEN == ESP_NOW_MAX_DATA_LEN, "espnow_group_frame.h out of sync with ESP-NOW");
+
+    static const char *TAG = "espnow_group";
+    static const uint8_t broadcast_mac[ESP_NOW_ETH_ALEN] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+
+//***   Estructuras de datos y tipos personalizados ***//
+    typedef struct __attribute__((packed)) {
+        uint8_t target[ESP_NOW_ETH_ALEN];
+        uint8_t group_id;
+        uint8_t count;
+        uint16_t seq[RETX_DEPTH];
+    } nack_payload_t;
+
+    typedef struct {
+        bool valid;
+        uint8_t group_id;
+        uint16_t seq;
+        uint8_t len;
+        TickType_t last_retx;
+        uint8_t *frame;     // Bloque de block_pool, propiedad del anillo
+    } retx_slot_t;
+
+    typedef struct {
+        bool valid;
+        uint8_t mac[ESP_NOW_ETH_ALEN];
+        uint8_t group_id;
+        uint16_t last_seq;
+        uint32_t window;    // bit n: recibida la secuencia last_seq - n
+    } source_t;
+
+    typedef struct {
+        uint32_t magic;
+        uint16_t critical[256];
+        uint16_t tx;
+    } seq_state_t;
+
+    static portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+    static uint8_t own_mac[ESP_NOW_ETH_ALEN];
+    static uint8_t gateway_mac[ESP_NOW_ETH_ALEN];   // Destino del grupo ESPNOW_GROUP_GATEWAY
+    static uint32_t subscriptions[256 / 32];
+    static RTC_NOINIT_ATTR seq_state_t seq_state;
+    static retx_slot_t retx_ring[RETX_DEPTH];
+    static uint8_t retx_next;
+    static source_t sources[MAX_SOURCES];
+    static uint8_t source_next;
+
+//***   Declaraciones de funciones (prototipos) ***//
+    static esp_err_t add_plain_peer(const uint8_t *mac);
+    static const uint8_t *destination(uint8_t group_id);
+    static void handle_nack(const uint8_t *payload, size_t len);
+    static bool track_critical(const uint8_t *src, uint8_t group_id, uint16_t seq);
+    static void send_nack(const uint8_t *src, uint8_t group_id, const uint16_t *seqs, uint8_t count);
+
+//***Implementación de funciones***//
+    esp_err_t espnow_group_init(void)
+    {
+        // Tras un encendido la memoria RTC no es confiable; en cualquier otro reinicio se
+        // conservan las secuencias.
+        esp_reset_reason_t reason = esp_reset_reason();
+        if (seq_state.magic != SEQ_MAGIC || reason == ESP_RST_POWERON || reason == ESP_RST_BROWNOUT ||
+            reason == ESP_RST_UNKNOWN) {
+            memset(&seq_state, 0, sizeof(seq_state));
+            seq_state.magic = SEQ_MAGIC;
+        }
+        esp_wifi_get_mac(WIFI_IF_STA, own_mac);
+        esp_err_t err = add_plain_peer(broadcast_mac);
+        if (err != ESP_OK) {return err;}
+
+        if (sscanf(CONFIG_ESPNOW_GROUP_GATEWAY_MAC, "%hhx:%hhx:%hhx:%hhx:%hhx:%hhx", &gateway_mac[0], &gateway_mac[1],
+                   &gateway_mac[2], &gateway_mac[3], &gateway_mac[4], &gateway_mac[5]) != ESP_NOW_ETH_ALEN) {
+            ESP_LOGE(TAG, "Bad gateway MAC \"%s\"", CONFIG_ESPNOW_GROUP_GATEWAY_MAC);
+            return ESP_ERR_INVALID_ARG;
+        }
+        // Si espnow_secure ya la registró como par cifrado, el enlace ascendente también va cifrado.
+        if (!(gateway_mac[0] & 0x01)) {
+            err = add_plain_peer(gateway_mac);
+            if (err != ESP_OK) {return err;}
+            ESP_LOGI(TAG, "Gateway group sent as unicast to " MACSTR, MAC2STR(gateway_mac));
+        }
+        espnow_group_subscribe(ESPNOW_GROUP_ALL);
+        espnow_group_subscribe(CONFIG_ESPNOW_GROUP_ZONE);
+        ESP_LOGI(TAG, "group addressing ready, zone %d", CONFIG_ESPNOW_GROUP_ZONE);
+        return ESP_OK;
+    }
+
+    void espnow_group_subscribe(uint8_t group_id)
+    {
+        taskENTER_CRITICAL(&lock);
+        subscriptions[group_id / 32] |= (1UL << (group_id % 32));
+        taskEXIT_CRITICAL(&lock);
+    }
+
+    void espnow_group_unsubscribe(uint8_t group_id)
+    {
+        if (group_id == ESPNOW_GROUP_ALL) {return;}
+        taskENTER_CRITICAL(&lock);
+        subscriptions[group_id / 32] &= ~(1UL << (group_id % 32));
+        taskEXIT_CRITICAL(&lock);
+    }
+
+    bool espnow_group_is_subscribed(uint8_t group_id)
+    {
+        return (subscriptions[group_id / 32] >> (group_id % 32)) & 1UL;
+    }
+
+    esp_err_t espnow_group_send(uint8_t group_id, uint8_t type, uint8_t flags, const void *payload, size_t len)
+    {
+        if (len > ESPNOW_GROUP_MAX_PAYLOAD) {return ESP_ERR_INVALID_SIZE;}
+        TRACE_BEGIN(TRACE_ESPNOW_SEND);
+
+        // Una crítica sin bloque disponible sale igual, pero no podrá atender un NACK.
+        uint8_t stack_frame[ESP_NOW_MAX_DATA_LEN];
+        uint8_t *frame = (flags & ESPNOW_GROUP_FLAG_CRITICAL) ? block_pool_alloc(ESP_NOW_MAX_DATA_LEN) : NULL;
+        bool retain = frame != NULL;
+        if (!retain) {frame = stack_frame;}
+
+        taskENTER_CRITICAL(&lock);
+        uint16_t seq = (flags & ESPNOW_GROUP_FLAG_CRITICAL) ? ++seq_state.critical[group_id] : ++seq_state.tx;
+        taskEXIT_CRITICAL(&lock);
+        size_t frame_len = espnow_group_encode(frame, group_id, type, flags, seq, payload, len);
+
+        esp_err_t err = esp_now_send(destination(group_id), frame, frame_len);
+        metrics_inc(err == ESP_OK ? METRIC_RADIO_TX : METRIC_RADIO_TX_FAIL);
+
+        if (retain) {
+            taskENTER_CRITICAL(&lock);
+            retx_slot_t *slot = &retx_ring[retx_next];
+            retx_next = (retx_next + 1) % RETX_DEPTH;
+            uint8_t *evicted = slot->valid ? slot->frame : NULL;
+            slot->valid = true;
+            slot->group_id = group_id;
+            slot->seq = seq;
+            slot->len = frame_len;
+            slot->last_retx = xTaskGetTickCount();
+            slot->frame = frame;
+            taskEXIT_CRITICAL(&lock);
+            block_pool_free(evicted);
+        }
+        TRACE_END_ARG(TRACE_ESPNOW_SEND, seq);
+        return err;
+    }
+
+    const uint8_t *espnow_group_recv(const esp_now_recv_info_t *esp_now_info, const uint8_t *data, int data_len,
+                                     const espnow_group_hdr_t **hdr, size_t *payload_len)
+    {
+        if (data_len < (int)sizeof(espnow_group_hdr_t)) {return NULL;}
+
+        const uint8_t *payload;
+        size_t len;
+        const espnow_group_hdr_t *received_hdr = espnow_group_parse(data, data_len, &payload, &len);
+        if (received_hdr == NULL) {
+            // Con la magia correcta es una trama de grupo dañada; sin ella, tráfico ajeno.
+            if (data[0] == ESPNOW_GROUP_MAGIC) {metrics_inc(METRIC_RADIO_RX_DROP);}
+            return NULL;
+        }
+        metrics_inc(METRIC_RADIO_RX);
+
+        if (received_hdr->type == ESPNOW_MSG_NACK) {
+            handle_nack(payload, len);
+            return NULL;
+        }
+        if (!espnow_group_is_subscribed(received_hdr->group_id)) {return NULL;}
+        if ((received_hdr->flags & ESPNOW_GROUP_FLAG_CRITICAL) &&
+            !track_critical(esp_now_info->src_addr, received_hdr->group_id, received_hdr->seq)) {
+            return NULL;
+        }
+
+        if (hdr) {*hdr = received_hdr;}
+        if (payload_len) {*payload_len = len;}
+        return payload;
+    }
+
+    static bool track_critical(const uint8_t *src, uint8_t group_id, uint16_t seq)
+    {
+        uint16_t missing[RETX_DEPTH];
+        uint8_t missing_count = 0;
+        bool deliver = true;
+
+        taskENTER_CRITICAL(&lock);
+        source_t *source = NULL;
+        for (uint8_t i = 0; i < MAX_SOURCES; i++) {
+            if (sources[i].valid && sources[i].group_id == group_id &&
+                memcmp(sources[i].mac, src, ESP_NOW_ETH_ALEN) == 0) {
+                source = &sources[i];
+                break;
+            }
+        }
+
+        if (source == NULL) {
+            source = &sources[source_next];
+            source_next = (source_next + 1) % MAX_SOURCES;
+            source->valid = true;
+            memcpy(source->mac, src, ESP_NOW_ETH_ALEN);
+            source->group_id = group_id;
+            source->last_seq = seq;
+            source->window = 1;
+        } else {
+            int16_t distance = (int16_t)(seq - source->last_seq);
+            if (distance > 0) {
+                // Secuencias intermedias nunca vistas: solicitar solo las aún retenidas por el emisor.
+                for (int16_t k = 1; k < distance && missing_count < RETX_DEPTH; k++) {
+                    missing[missing_count++] = seq - k;
+                }
+                source->window = (distance >= SEQ_WINDOW) ? 1 : ((source->window << distance) | 1);
+                source->last_seq = seq;
+            } else {
+                uint16_t back = (uint16_t)(-distance);
+                if (back >= SEQ_WINDOW || (source->window & (1UL << back))) {
+                    deliver = false;
+                } else {
+                    source->window |= (1UL << back);
+                }
+            }
+        }
+        taskEXIT_CRITICAL(&lock);
+
+        if (missing_count > 0) {send_nack(src, group_id, missing, missing_count);}
+        return deliver;
+    }
+
+    static void send_nack(const uint8_t *src, uint8_t group_id, const uint16_t *seqs, uint8_t count)
+    {
+        nack_payload_t nack = {};
+        memcpy(nack.target, src, ESP_NOW_ETH_ALEN);
+        nack.group_id = group_id;
+        nack.count = count;
+        memcpy(nack.seq, seqs, count * sizeof(uint16_t));
+
+        ESP_LOGW(TAG, "Lost %d critical frame(s) from " MACSTR " group %d", count, MAC2STR(src), group_id);
+        espnow_group_send(ESPNOW_GROUP_ALL, ESPNOW_MSG_NACK, 0, &nack,
+                          offsetof(nack_payload_t, seq) + count * sizeof(uint16_t));
+    }
+
+    static esp_err_t add_plain_peer(const uint8_t *mac)
+    {
+        if (esp_now_is_peer_exist(mac)) {return ESP_OK;}
+        esp_now_peer_info_t esp_now_peer_info = {};
+        memcpy(esp_now_peer_info.peer_addr, mac, ESP_NOW_ETH_ALEN);
+        esp_now_peer_info.channel = 0;
+        esp_now_peer_info.ifidx = ESP_IF_WIFI_STA;
+        esp_err_t err = esp_now_add_peer(&esp_now_peer_info);
+        if (err != ESP_OK) {ESP_LOGE(TAG, "Failed to add peer " MACSTR ": %s", MAC2STR(mac), esp_err_to_name(err));}
+        return err;
+    }
+
+    // Sin MAC de pasarela configurada gateway_mac es broadcast y todo sale igual.
+    static const uint8_t *destination(uint8_t group_id)
+    {
+        return group_id == ESPNOW_GROUP_GATEWAY ? gateway_mac : broadcast_mac;
+    }
+
+    static void handle_nack(const uint8_t *payload, size_t len)
+    {
+        nack_payload_t nack = {};
+        if (len < offsetof(nack_payload_t, seq) || len > sizeof(nack)) {return;}
+        memcpy(&nack, payload, len);
+        if (memcmp(nack.target, own_mac, ESP_NOW_ETH_ALEN) != 0) {return;}
+        if (len < offsetof(nack_payload_t, seq) + nack.count * sizeof(uint16_t)) {return;}
+
+        uint8_t frame[ESP_NOW_MAX_DATA_LEN];
+        for (uint8_t n = 0; n < nack.count; n++) {
+            uint8_t frame_len = 0;
+            TickType_t now = xTaskGetTickCount();
+
+            taskENTER_CRITICAL(&lock);
+            for (uint8_t i = 0; i < RETX_DEPTH; i++) {
+                retx_slot_t *slot = &retx_ring[i];
+                if (slot->valid && slot->group_id == nack.group_id && slot->seq == nack.seq[n] &&
+                    (now - slot->last_retx) >= NACK_HOLDOFF) {
+                    slot->last_retx = now;
+                    frame_len = slot->len;
+                    memcpy(frame, slot->frame, frame_len);
+                    break;
+                }
+            }
+            taskEXIT_CRITICAL(&lock);
+
+            if (frame_len > 0) {
+                ((espnow_group_hdr_t *)frame)->flags |= ESPNOW_GROUP_FLAG_RETX;
+                esp_now_send(destination(nack.group_id), frame, frame_len);
+                metrics_inc(METRIC_RADIO_RETX);
+            }
+        }
+    }
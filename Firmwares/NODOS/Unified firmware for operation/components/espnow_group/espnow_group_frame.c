@@ -0,0 +1,65 @@
+/************************************************************************************************
+ * Módulo: Formato en el aire de las tramas de grupo de ESP-NOW.
+ *
+ * Descripción: Codificación y validación de la cabecera y de los anexos. Sin estado ni
+ * dependencias de la radio: es lo único del componente que se compila para el objetivo linux.
+ *
+ * Autor:
+ *   - Victor Manuel Patiño Delgado.
+ *
+ * Licencia: THE BEER-WARE LICENSE.
+ * As long as you retain this notice you can do whatever you want with this stuff.
+ * If we meet some day, and you think this stuff is worth it, you can buy me a beer in return.
+************************************************************************************************/
+
+//***   Bibliotecas y declaraciones de preprocesador    ***//
+    #include <string.h>
+    #include "espnow_group_frame.h"
+
+//***Implementación de funciones***//
+    size_t espnow_group_encode(uint8_t *frame, uint8_t group_id, uint8_t type, uint8_t flags, uint16_t seq,
+                               const void *payload, size_t len)
+    {
+        if (len > ESPNOW_GROUP_MAX_PAYLOAD) {return 0;}
+        espnow_group_hdr_t hdr = {
+            .magic = ESPNOW_GROUP_MAGIC,
+            .type = type,
+            .group_id = group_id,
+            .flags = flags & (ESPNOW_GROUP_FLAG_CRITICAL | ESPNOW_GROUP_FLAG_METRICS | ESPNOW_GROUP_FLAG_VNODE |
+                              ESPNOW_GROUP_FLAG_AUTH),
+            .seq = seq,
+            .len = len
+        };
+        memcpy(frame, &hdr, sizeof(hdr));
+        if (len > 0) {memcpy(frame + sizeof(hdr), payload, len);}
+        return sizeof(hdr) + len;
+    }
+
+    const espnow_group_hdr_t *espnow_group_parse(const uint8_t *frame, size_t frame_len, const uint8_t **payload,
+                                                 size_t *payload_len)
+    {
+        if (frame_len < sizeof(espnow_group_hdr_t)) {return NULL;}
+        const espnow_group_hdr_t *hdr = (const espnow_group_hdr_t *)frame;
+        if (hdr->magic != ESPNOW_GROUP_MAGIC || hdr->len != frame_len - sizeof(espnow_group_hdr_t)) {return NULL;}
+
+        if (payload) {*payload = frame + sizeof(espnow_group_hdr_t);}
+        if (payload_len) {*payload_len = hdr->len;}
+        return hdr;
+    }
+
+    bool espnow_group_strip_vnode(const espnow_group_hdr_t *hdr, const uint8_t *payload, size_t *payload_len,
+                                  uint16_t *vnode)
+    {
+        if (!(hdr->flags & ESPNOW_GROUP_FLAG_VNODE) || *payload_len < ESPNOW_GROUP_VNODE_LEN) {return false;}
+        *payload_len -= ESPNOW_GROUP_VNODE_LEN;
+        if (vnode) {memcpy(vnode, payload + *payload_len, ESPNOW_GROUP_VNODE_LEN);}
+        return true;
+    }
+
+    void espnow_group_vnode_mac(const uint8_t *src, uint16_t vnode, uint8_t *mac)
+    {
+        memcpy(mac, src, ESPNOW_GROUP_MAC_LEN);
+        mac[0] |= 0x02;     // Administrada localmente: no choca con una MAC de fábrica
+        mac[4] = vnode >> 8;
+        mac[5] = vnode & 0xFF;
+    }
@@ -0,0 +1,51 @@
+/************************************************************************************************
+ * Módulo: Direccionamiento por grupos sobre ESP-NOW.
+ *
+ * Descripción: Todas las tramas se emiten a la dirección broadcast de ESP-NOW con una cabecera
+ * que identifica el grupo (zona) destino. Cada receptor filtra por sus suscripciones, de modo
+ * que una sola transmisión alcanza la zona completa sin importar la cantidad de nodos.
+ * Las tramas marcadas como críticas llevan una secuencia por grupo; el receptor que detecta un
+ * hueco responde con un NACK y el emisor retransmite la trama retenida.
+ *
+ * Autor:
+ *   - Victor Manuel Patiño Delgado.
+ *
+ * Licencia: THE BEER-WARE LICENSE.
+ * As long as you retain this notice you can do whatever you want with this stuff.
+ * If we meet some day, and you think this stuff is worth it, you can buy me a beer in return.
+************************************************************************************************/
+#pragma once
+
+//***   Bibliotecas y declaraciones de preprocesador    ***//
+    #include <stdint.h>
+    #include <stdbool.h>
+    #include <stddef.h>
+    #include "esp_err.h"
+    #include "esp_now.h"
+    #include "espnow_group_frame.h"
+
+    #ifdef __cplusplus
+    extern "C" {
+    #endif
+
+//***   Declaraciones de funciones (prototipos) ***//
+    // Registra el peer broadcast (y la pasarela si ESPNOW_GROUP_GATEWAY_MAC es unicast) y
+    // suscribe al grupo global y a la zona configurada.
+    esp_err_t espnow_group_init(void);
+
+    void espnow_group_subscribe(uint8_t group_id);
+    void espnow_group_unsubscribe(uint8_t group_id);
+    bool espnow_group_is_subscribed(uint8_t group_id);
+
+    // Una única transmisión broadcast hacia todos los suscriptores del grupo; el grupo de la
+    // pasarela va en unicast si su MAC está configurada.
+    esp_err_t espnow_group_send(uint8_t group_id, uint8_t type, uint8_t flags, const void *payload, size_t len);
+
+    // Invocar desde recv_cb. Atiende NACKs y duplicados internamente y devuelve el payload
+    // solo si la trama está dirigida a un grupo suscrito; NULL en caso contrario.
+    const uint8_t *espnow_group_recv(const esp_now_recv_info_t *esp_now_info, const uint8_t *data, int data_len,
+                                     const espnow_group_hdr_t **hdr, size_t *payload_len);
+
+    #ifdef __cplusplus
+    }
+    #endif
@@ -0,0 +1,100 @@
+/************************************************************************************************
+ * Módulo: Formato en el aire de las tramas de grupo de ESP-NOW.
+ *
+ * Descripción: Cabecera, banderas, tipos de trama y anexos de espnow_group, sin dependencias de
+ * la radio. Los firmwares lo reciben a través de espnow_group.h; Replay y Benchmarks lo usan
+ * también en el objetivo linux, donde solo se compila esta parte del componente, para que la
+ * decodificación de capturas no lleve una copia del formato.
+ *
+ * Autor:
+ *   - Victor Manuel Patiño Delgado.
+ *
+ * Licencia: THE BEER-WARE LICENSE.
+ * As long as you retain this notice you can do whatever you want with this stuff.
+ * If we meet some day, and you think this stuff is worth it, you can buy me a beer in return.
+************************************************************************************************/
+#pragma once
+
+//***   Bibliotecas y declaraciones de preprocesador    ***//
+    #include <stdint.h>
+    #include <stdbool.h>
+    #include <stddef.h>
+
+    #ifdef __cplusplus
+    extern "C" {
+    #endif
+
+//***   Definición de constantes y macros   ***//
+    #define ESPNOW_GROUP_MAGIC 0xFA
+    #define ESPNOW_GROUP_FRAME_MAX_LEN 250  // ESP_NOW_MAX_DATA_LEN
+
+    #define ESPNOW_GROUP_GATEWAY 0x00   // Tráfico ascendente hacia la pasarela
+    #define ESPNOW_GROUP_ALL 0xFF       // Todos los nodos, siempre suscrito
+
+    // Los anexos van tras el payload de aplicación en este orden: id de nodo virtual y luego
+    // el snapshot de métricas, que termina con su propia longitud (metrics_strip). El anexo de
+    // autenticación de espnow_secure va siempre al final y cubre la cabecera y todo lo anterior.
+    #define ESPNOW_GROUP_FLAG_CRITICAL 0x01 // Secuenciada y recuperable por NACK
+    #define ESPNOW_GROUP_FLAG_RETX 0x02     // Retransmisión de una trama crítica
+    #define ESPNOW_GROUP_FLAG_METRICS 0x04  // Payload seguido de un snapshot de métricas
+    #define ESPNOW_GROUP_FLAG_VNODE 0x08    // Payload seguido del id de nodo virtual de load_gen
+    #define ESPNOW_GROUP_FLAG_AUTH 0x10     // Payload seguido de contador y etiqueta de espnow_secure
+
+    #define ESPNOW_GROUP_VNODE_LEN sizeof(uint16_t)
+    #define ESPNOW_GROUP_MAC_LEN 6
+
+//***   Estructuras de datos y tipos personalizados ***//
+    // Tipos de trama de aplicación transportados sobre la cabecera de grupo.
+    typedef enum {
+        ESPNOW_MSG_NACK = 0x00,         // Interno: solicitud de retransmisión
+        ESPNOW_MSG_SENSOR = 0x01,       // sensor_data_t (LM35, PIR, Radar)
+        ESPNOW_MSG_TEMPERATURE = 0x02,  // float, temperatura LM35 [+ uint32_t época aplicada]
+        ESPNOW_MSG_LED_STATE = 0x03,    // uint8_t, estado del actuador
+        ESPNOW_MSG_COMMAND = 0x04,      // cmd_sync_frame_t, estado deseado con época
+        ESPNOW_MSG_ACTUATE = 0x05,      // rule_engine_actuation_t + MACs destino, orden de una regla
+        ESPNOW_MSG_OTA_ANNOUNCE = 0x10, // Metadatos de la sesión OTA
+        ESPNOW_MSG_OTA_CHUNK = 0x11,    // Fragmento de imagen
+        ESPNOW_MSG_OTA_REPORT = 0x12,   // Fragmentos faltantes de un nodo
+        ESPNOW_MSG_KEY_ROTATE = 0x20,   // Nueva LMK, solo en unicast cifrado
+        ESPNOW_MSG_KEY_CHECK = 0x21,    // Sondeo de la clave vigente, solo en unicast cifrado
+        ESPNOW_MSG_KEY_CONFIRM = 0x22,  // uint32_t, época con la que responde el nodo
+        ESPNOW_MSG_KEY_RESYNC = 0x23,   // uint32_t, último contador aceptado por quien lo pide
+        ESPNOW_MSG_LOAD_PROBE = 0x30,   // load_gen_probe_t, sonda de ida y vuelta del generador
+        ESPNOW_MSG_LOAD_ECHO = 0x31,    // load_gen_echo_t, respuesta de la pasarela
+    } espnow_msg_type_t;
+
+    // La secuencia es por grupo para tramas críticas y global para el resto.
+    // Ocho bytes para que el payload conserve la alineación del búfer de recepción.
+    typedef struct __attribute__((packed)) {
+        uint8_t magic;
+        uint8_t type;
+        uint8_t group_id;
+        uint8_t flags;
+        uint16_t seq;
+        uint16_t len;
+    } espnow_group_hdr_t;
+
+    #define ESPNOW_GROUP_MAX_PAYLOAD (ESPNOW_GROUP_FRAME_MAX_LEN - sizeof(espnow_group_hdr_t))
+
+//***   Declaraciones de funciones (prototipos) ***//
+    // Arma cabecera y payload en frame (ESPNOW_GROUP_FRAME_MAX_LEN bytes) sin transmitir;
+    // devuelve la longitud total o 0 si el payload no cabe.
+    size_t espnow_group_encode(uint8_t *frame, uint8_t group_id, uint8_t type, uint8_t flags, uint16_t seq,
+                               const void *payload, size_t len);
+
+    // Valida magia y longitud de una trama recibida. Devuelve la cabecera (dentro de frame) y
+    // el payload con sus anexos, o NULL si la trama no es de grupo.
+    const espnow_group_hdr_t *espnow_group_parse(const uint8_t *frame, size_t frame_len, const uint8_t **payload,
+                                                 size_t *payload_len);
+
+    // Quita el id de nodo virtual de payload_len (después de metrics_strip). Devuelve true y el
+    // id si la trama lo traía.
+    bool espnow_group_strip_vnode(const espnow_group_hdr_t *hdr, const uint8_t *payload, size_t *payload_len,
+                                  uint16_t *vnode);
+
+    // MAC a la que se atribuye el nodo virtual vnode del emisor src.
+    void espnow_group_vnode_mac(const uint8_t *src, uint16_t vnode, uint8_t *mac);
+
+    #ifdef __cplusplus
+    }
+    #endif
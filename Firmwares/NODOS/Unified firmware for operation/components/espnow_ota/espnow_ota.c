@@ -0,0 +1,463 @@
+/************************************************************************************************
+ * Módulo: Distribución de firmware OTA sobre ESP-NOW.
+ *
+ * Descripción: Implementación de ambos extremos del protocolo. La pasarela anuncia la sesión,
+ * emite todos los fragmentos y al final de cada ronda recolecta los mapas de faltantes de la
+ * flota; la ronda siguiente solo reemite la unión de lo faltante. El nodo desacopla la escritura
+ * en flash de la tarea Wi-Fi mediante una cola y una tarea propia, por lo que un fragmento
+ * perdido por cola llena se recupera en la siguiente ronda como cualquier otra pérdida.
+ * Con ESPNOW_SECURE_ENABLE el anuncio viaja autenticado por espnow_secure a cada par cifrado y
+ * el nodo descarta los que no verifican: nadie más puede abortar la sesión ni fijar el SHA-256
+ * de otra imagen. Los fragmentos siguen en broadcast; uno falso solo hace fallar el hash.
+ *
+ * Autor:
+ *   - Victor Manuel Patiño Delgado.
+ *
+ * Licencia: THE BEER-WARE LICENSE.
+ * As long as you retain this notice you can do whatever you want with this stuff.
+ * If we meet some day, and you think this stuff is worth it, you can buy me a beer in return.
+************************************************************************************************/
+
+//***   Bibliotecas y declaraciones de preprocesador    ***//
+    #include <string.h>
+    #include "freertos/FreeRTOS.h"
+    #include "freertos/task.h"
+    #include "freertos/queue.h"
+    #include "esp_log.h"
+    #include "esp_system.h"
+    #include "esp_random.h"
+    #include "esp_timer.h"
+    #include "esp_ota_ops.h"
+    #include "esp_partition.h"
+    #include "esp_image_format.h"
+    #include "nvs.h"
+    #include "mbedtls/sha256.h"
+    #include "sdkconfig.h"
+    #include "espnow_ota.h"
+    #include "espnow_secure.h"
+    #include "task_layout.h"
+    #include "static_alloc.h"
+    #include "block_pool.h"
+
+//***   Definición de constantes y macros   ***//
+    #define MAX_CHUNKS ((CONFIG_ESPNOW_OTA_MAX_IMAGE_KB * 1024 + ESPNOW_OTA_CHUNK_SIZE - 1) / ESPNOW_OTA_CHUNK_SIZE)
+    #define BITMAP_BYTES ((MAX_CHUNKS + 7) / 8)
+    #define REPORT_CHUNKS ESPNOW_OTA_REPORT_CHUNKS
+    #define SHA256_LEN ESPNOW_OTA_SHA256_LEN
+
+    #define PHASE_BEGIN ESPNOW_OTA_PHASE_BEGIN
+    #define PHASE_ROUND_END ESPNOW_OTA_PHASE_ROUND_END
+
+    #define BIT_SET ESPNOW_OTA_BIT_SET
+    #define BIT_GET ESPNOW_OTA_BIT_GET
+
+    static const char *TAG = "espnow_ota";
+    static const char *NVS_NAMESPACE = "espnow_ota";
+
+//***   Estructuras de datos y tipos personalizados ***//
+    typedef espnow_ota_announce_t ota_announce_t;
+    typedef espnow_ota_chunk_t ota_chunk_t;
+    typedef espnow_ota_report_t ota_report_t;
+
+    typedef struct {
+        uint8_t type;
+        uint8_t len;
+        uint8_t data[sizeof(ota_chunk_t)];
+    } ota_rx_msg_t;
+
+    // Estado del nodo, solo accedido por ota_rx_task.
+    static struct {
+        bool active;
+        uint32_t session_id;
+        uint32_t image_size;
+        uint16_t chunk_count;
+        uint16_t received_count;
+        uint16_t reported_round;    // ronda + 1 ya reportada, 0 si ninguna
+        uint8_t sha256[SHA256_LEN];
+        const esp_partition_t *partition;
+        esp_ota_handle_t handle;
+    } rx;
+    static uint8_t rx_bitmap[BITMAP_BYTES];
+    static QueueHandle_t rx_queue = NULL;
+
+    // Estado de la pasarela; need se actualiza desde recv_cb bajo el candado.
+    static struct {
+        bool running;
+        uint8_t group_id;
+        uint32_t session_id;
+        uint32_t image_size;
+        uint16_t chunk_count;
+        uint8_t sha256[SHA256_LEN];
+        const esp_partition_t *source;
+        uint16_t missing_reports;
+        uint16_t complete_reports;
+    } tx;
+    static uint8_t tx_need[BITMAP_BYTES];
+    static uint8_t tx_pending[BITMAP_BYTES];
+    static portMUX_TYPE tx_lock = portMUX_INITIALIZER_UNLOCKED;
+    static TaskHandle_t serve_task = NULL;
+
+//***   Declaraciones de funciones (prototipos) ***//
+    static esp_err_t partition_sha256(const esp_partition_t *partition, size_t size, uint8_t *digest);
+    static void ota_rx_task(void *pvParameters);
+    static void rx_handle_announce(const ota_announce_t *announce);
+    static void rx_handle_chunk(const ota_chunk_t *chunk, size_t data_len);
+    static void rx_send_reports(void);
+    static void rx_finish(void);
+    static bool rx_already_applied(const uint8_t *sha256);
+    static void ota_serve_task(void *pvParameters);
+    static void ota_serve_session(void);
+    static void tx_announce(uint8_t phase, uint8_t round);
+    static void tx_handle_report(const ota_report_t *report, size_t len);
+
+//***Implementación de funciones***//
+    esp_err_t espnow_ota_init(void)
+    {
+        esp_ota_img_states_t state;
+        const esp_partition_t *running = esp_ota_get_running_partition();
+        if (esp_ota_get_state_partition(running, &state) == ESP_OK && state == ESP_OTA_IMG_PENDING_VERIFY) {
+            esp_ota_mark_app_valid_cancel_rollback();
+            ESP_LOGI(TAG, "New firmware marked valid");
+        }
+
+        // La cola lleva punteros a bloques de block_pool: recv_cb copia el fragmento una vez.
+        rx_queue = STATIC_QUEUE_CREATE(CONFIG_ESPNOW_OTA_RX_QUEUE_LEN, sizeof(ota_rx_msg_t *));
+        if (rx_queue == NULL) {return ESP_ERR_NO_MEM;}
+        if (TASK_LAYOUT_CREATE(ota_rx_task, "espnow_ota_rx", 4096, NULL, TASK_CLASS_BACKGROUND, NULL) != ESP_OK) {return ESP_ERR_NO_MEM;}
+        return ESP_OK;
+    }
+
+    bool espnow_ota_handle(const esp_now_recv_info_t *esp_now_info, const espnow_group_hdr_t *hdr,
+                           const uint8_t *payload, size_t payload_len)
+    {
+        switch (hdr->type) {
+            case ESPNOW_MSG_OTA_ANNOUNCE:
+                // Con cifrado habilitado solo valen anuncios autenticados de un par cifrado.
+                if (!espnow_secure_verify(esp_now_info, hdr, payload, &payload_len)) {return true;}
+                __attribute__((fallthrough));
+            case ESPNOW_MSG_OTA_CHUNK:
+                if (rx_queue != NULL && payload_len <= sizeof(ota_chunk_t)) {
+                    ota_rx_msg_t *msg = block_pool_alloc(sizeof(ota_rx_msg_t));
+                    if (msg == NULL) {return true;}
+                    msg->type = hdr->type;
+                    msg->len = payload_len;
+                    memcpy(msg->data, payload, payload_len);
+                    if (xQueueSend(rx_queue, &msg, 0) != pdTRUE) {block_pool_free(msg);}
+                }
+                return true;
+            case ESPNOW_MSG_OTA_REPORT:
+                tx_handle_report((const ota_report_t *)payload, payload_len);
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    static esp_err_t partition_sha256(const esp_partition_t *partition, size_t size, uint8_t *digest)
+    {
+        mbedtls_sha256_context ctx;
+        uint8_t buf[256];
+        esp_err_t err = ESP_OK;
+
+        mbedtls_sha256_init(&ctx);
+        mbedtls_sha256_starts(&ctx, 0);
+        for (size_t offset = 0; offset < size; offset += sizeof(buf)) {
+            size_t n = (size - offset) < sizeof(buf) ? (size - offset) : sizeof(buf);
+            err = esp_partition_read(partition, offset, buf, n);
+            if (err != ESP_OK) {break;}
+            mbedtls_sha256_update(&ctx, buf, n);
+        }
+        mbedtls_sha256_finish(&ctx, digest);
+        mbedtls_sha256_free(&ctx);
+        return err;
+    }
+
+    //***   Nodo    ***//
+    static void ota_rx_task(void *pvParameters)
+    {
+        ota_rx_msg_t *msg;
+        while (1) {
+            if (xQueueReceive(rx_queue, &msg, portMAX_DELAY) != pdTRUE) {continue;}
+            if (msg->type == ESPNOW_MSG_OTA_ANNOUNCE && msg->len == sizeof(ota_announce_t)) {
+                ota_announce_t announce;
+                memcpy(&announce, msg->data, sizeof(announce));
+                rx_handle_announce(&announce);
+            } else if (msg->type == ESPNOW_MSG_OTA_CHUNK && msg->len > offsetof(ota_chunk_t, data)) {
+                rx_handle_chunk((const ota_chunk_t *)msg->data, msg->len - offsetof(ota_chunk_t, data));
+            }
+            block_pool_free(msg);
+        }
+    }
+
+    static void rx_handle_announce(const ota_announce_t *announce)
+    {
+        if (rx.active && memcmp(rx.sha256, announce->sha256, SHA256_LEN) == 0) {
+            // Misma imagen en una sesión nueva: se conserva lo ya recibido.
+            rx.session_id = announce->session_id;
+        } else {
+            if (rx_already_applied(announce->sha256)) {return;}
+            if (announce->chunk_count > MAX_CHUNKS) {
+                ESP_LOGE(TAG, "Image of %lu bytes exceeds CONFIG_ESPNOW_OTA_MAX_IMAGE_KB", (unsigned long)announce->image_size);
+                return;
+            }
+            if (rx.active) {esp_ota_abort(rx.handle);}
+            rx.active = false;
+
+            rx.partition = esp_ota_get_next_update_partition(NULL);
+            if (rx.partition == NULL || announce->image_size > rx.partition->size) {
+                ESP_LOGE(TAG, "No OTA partition large enough for %lu bytes", (unsigned long)announce->image_size);
+                return;
+            }
+            esp_err_t err = esp_ota_begin(rx.partition, announce->image_size, &rx.handle);
+            if (err != ESP_OK) {
+                ESP_LOGE(TAG, "esp_ota_begin failed: %s", esp_err_to_name(err));
+                return;
+            }
+            rx.active = true;
+            rx.session_id = announce->session_id;
+            rx.image_size = announce->image_size;
+            rx.chunk_count = announce->chunk_count;
+            rx.received_count = 0;
+            rx.reported_round = 0;
+            memcpy(rx.sha256, announce->sha256, SHA256_LEN);
+            memset(rx_bitmap, 0, sizeof(rx_bitmap));
+            ESP_LOGI(TAG, "OTA session %08lx started: %lu bytes in %u chunks into %s",
+                     (unsigned long)rx.session_id, (unsigned long)rx.image_size, rx.chunk_count, rx.partition->label);
+        }
+
+        if (announce->phase == PHASE_ROUND_END && rx.active && rx.reported_round != announce->round + 1) {
+            rx.reported_round = announce->round + 1;
+            vTaskDelay(pdMS_TO_TICKS(esp_random() % (CONFIG_ESPNOW_OTA_REPORT_WINDOW_MS / 2)));
+            rx_send_reports();
+        }
+    }
+
+    static void rx_handle_chunk(const ota_chunk_t *chunk, size_t data_len)
+    {
+        if (!rx.active || chunk->session_id != rx.session_id || chunk->index >= rx.chunk_count) {return;}
+        if (BIT_GET(rx_bitmap, chunk->index)) {return;}
+
+        uint32_t offset = (uint32_t)chunk->index * ESPNOW_OTA_CHUNK_SIZE;
+        if (data_len != espnow_ota_chunk_len(rx.image_size, chunk->index)) {return;}
+
+        esp_err_t err = esp_ota_write_with_offset(rx.handle, chunk->data, data_len, offset);
+        if (err != ESP_OK) {
+            ESP_LOGW(TAG, "Chunk %u write failed: %s", chunk->index, esp_err_to_name(err));
+            return;
+        }
+        BIT_SET(rx_bitmap, chunk->index);
+        if (++rx.received_count == rx.chunk_count) {rx_finish();}
+    }
+
+    static void rx_send_reports(void)
+    {
+        ota_report_t report = {.session_id = rx.session_id};
+
+        if (rx.received_count == rx.chunk_count) {
+            report.complete = 1;
+            espnow_group_send(ESPNOW_GROUP_GATEWAY, ESPNOW_MSG_OTA_REPORT, 0, &report, offsetof(ota_report_t, missing));
+            return;
+        }
+
+        for (uint32_t base = 0; base < rx.chunk_count; base += REPORT_CHUNKS) {
+            if (espnow_ota_report_block(rx_bitmap, rx.chunk_count, base, &report)) {
+                espnow_group_send(ESPNOW_GROUP_GATEWAY, ESPNOW_MSG_OTA_REPORT, 0, &report, sizeof(report));
+                vTaskDelay(pdMS_TO_TICKS(ESPNOW_OTA_REPORT_GAP_MS));
+            }
+        }
+    }
+
+    static void rx_finish(void)
+    {
+        uint8_t digest[SHA256_LEN];
+        esp_err_t err = partition_sha256(rx.partition, rx.image_size, digest);
+        if (err != ESP_OK || memcmp(digest, rx.sha256, SHA256_LEN) != 0) {
+            ESP_LOGE(TAG, "Image hash mismatch, discarding session %08lx", (unsigned long)rx.session_id);
+            esp_ota_abort(rx.handle);
+            rx.active = false;
+            return;
+        }
+
+        err = esp_ota_end(rx.handle);
+        rx.active = false;
+        if (err == ESP_OK) {err = esp_ota_set_boot_partition(rx.partition);}
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Image rejected: %s", esp_err_to_name(err));
+            return;
+        }
+
+        nvs_handle_t nvs;
+        if (nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs) == ESP_OK) {
+            nvs_set_blob(nvs, "applied_sha", rx.sha256, SHA256_LEN);
+            nvs_commit(nvs);
+            nvs_close(nvs);
+        }
+
+        ota_report_t report = {.session_id = rx.session_id, .complete = 1};
+        espnow_group_send(ESPNOW_GROUP_GATEWAY, ESPNOW_MSG_OTA_REPORT, 0, &report, offsetof(ota_report_t, missing));
+        ESP_LOGI(TAG, "Image verified, rebooting into %s", rx.partition->label);
+        vTaskDelay(pdMS_TO_TICKS(100));
+        esp_restart();
+    }
+
+    static bool rx_already_applied(const uint8_t *sha256)
+    {
+        nvs_handle_t nvs;
+        uint8_t applied[SHA256_LEN];
+        size_t len = sizeof(applied);
+        bool match = false;
+
+        if (nvs_open(NVS_NAMESPACE, NVS_READONLY, &nvs) == ESP_OK) {
+            match = nvs_get_blob(nvs, "applied_sha", applied, &len) == ESP_OK &&
+                    len == SHA256_LEN && memcmp(applied, sha256, SHA256_LEN) == 0;
+            nvs_close(nvs);
+        }
+        return match;
+    }
+
+    //***   Pasarela    ***//
+    esp_err_t espnow_ota_serve_partition(uint8_t group_id)
+    {
+        const esp_partition_t *source = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY,
+                                                                 ESPNOW_OTA_PARTITION_LABEL);
+        if (source == NULL) {return ESP_ERR_NOT_FOUND;}
+
+        esp_partition_pos_t pos = {.offset = source->address, .size = source->size};
+        esp_image_metadata_t metadata;
+        if (esp_image_verify(ESP_IMAGE_VERIFY_SILENT, &pos, &metadata) != ESP_OK) {
+            ESP_LOGI(TAG, "No valid node image in '%s'", ESPNOW_OTA_PARTITION_LABEL);
+            return ESP_ERR_NOT_FOUND;
+        }
+        return espnow_ota_serve(group_id, source, metadata.image_len);
+    }
+
+    esp_err_t espnow_ota_serve(uint8_t group_id, const esp_partition_t *source, size_t image_size)
+    {
+        if (tx.running) {return ESP_ERR_INVALID_STATE;}
+        if (image_size == 0 || image_size > (size_t)MAX_CHUNKS * ESPNOW_OTA_CHUNK_SIZE) {return ESP_ERR_INVALID_SIZE;}
+
+        esp_err_t err = partition_sha256(source, image_size, tx.sha256);
+        if (err != ESP_OK) {return err;}
+
+        tx.running = true;
+        tx.group_id = group_id;
+        tx.session_id = esp_random();
+        tx.image_size = image_size;
+        tx.chunk_count = espnow_ota_chunk_count(image_size);
+        tx.source = source;
+        taskENTER_CRITICAL(&tx_lock);
+        tx.missing_reports = 0;
+        tx.complete_reports = 0;
+        taskEXIT_CRITICAL(&tx_lock);
+
+        if (serve_task == NULL &&
+            TASK_LAYOUT_CREATE(ota_serve_task, "espnow_ota_tx", 4096, NULL, TASK_CLASS_BACKGROUND, &serve_task) != ESP_OK) {
+            tx.running = false;
+            return ESP_ERR_NO_MEM;
+        }
+        xTaskNotifyGive(serve_task);
+        return ESP_OK;
+    }
+
+    // Tarea persistente: la misma pila sirve todas las sesiones.
+    static void ota_serve_task(void *pvParameters)
+    {
+        while (1) {
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            ota_serve_session();
+        }
+    }
+
+    static void ota_serve_session(void)
+    {
+        ota_chunk_t chunk = {.session_id = tx.session_id};
+        int64_t start = esp_timer_get_time();
+        uint32_t sent = 0;
+        uint8_t round;
+
+        ESP_LOGI(TAG, "Serving %lu bytes (%u chunks) to group %d, session %08lx",
+                 (unsigned long)tx.image_size, tx.chunk_count, tx.group_id, (unsigned long)tx.session_id);
+
+        memset(tx_pending, 0xFF, sizeof(tx_pending));
+        for (round = 0; round < CONFIG_ESPNOW_OTA_MAX_ROUNDS; round++) {
+            tx_announce(PHASE_BEGIN, round);
+
+            for (uint16_t index = 0; index < tx.chunk_count; index++) {
+                if (!BIT_GET(tx_pending, index)) {continue;}
+                uint32_t offset = (uint32_t)index * ESPNOW_OTA_CHUNK_SIZE;
+                size_t len = espnow_ota_chunk_len(tx.image_size, index);
+                chunk.index = index;
+                esp_partition_read(tx.source, offset, chunk.data, len);
+                while (espnow_group_send(tx.group_id, ESPNOW_MSG_OTA_CHUNK, 0, &chunk,
+                                         offsetof(ota_chunk_t, data) + len) == ESP_ERR_ESPNOW_NO_MEM) {
+                    vTaskDelay(pdMS_TO_TICKS(CONFIG_ESPNOW_OTA_CHUNK_INTERVAL_MS));
+                }
+                sent++;
+                vTaskDelay(pdMS_TO_TICKS(CONFIG_ESPNOW_OTA_CHUNK_INTERVAL_MS));
+            }
+
+            taskENTER_CRITICAL(&tx_lock);
+            memset(tx_need, 0, sizeof(tx_need));
+            tx.missing_reports = 0;
+            taskEXIT_CRITICAL(&tx_lock);
+
+            // El cierre de ronda se repite: un nodo que no lo escuche no reportaría sus faltantes.
+            tx_announce(PHASE_ROUND_END, round);
+            vTaskDelay(pdMS_TO_TICKS(ESPNOW_OTA_ROUND_END_GAP_MS));
+            tx_announce(PHASE_ROUND_END, round);
+            vTaskDelay(pdMS_TO_TICKS(CONFIG_ESPNOW_OTA_REPORT_WINDOW_MS));
+
+            taskENTER_CRITICAL(&tx_lock);
+            uint16_t missing_reports = tx.missing_reports;
+            memcpy(tx_pending, tx_need, sizeof(tx_pending));
+            taskEXIT_CRITICAL(&tx_lock);
+
+            if (missing_reports == 0) {
+                round++;
+                break;
+            }
+            ESP_LOGI(TAG, "Round %d: %d report(s) with missing chunks", round, missing_reports);
+        }
+        // Aquí round cuenta las rondas emitidas, terminen por reportes vacíos o por MAX_ROUNDS.
+
+        ESP_LOGI(TAG, "OTA session %08lx finished in %lld ms: %d round(s), %lu chunks sent (%lu resent), %d node(s) complete",
+                 (unsigned long)tx.session_id, (long long)((esp_timer_get_time() - start) / 1000), round,
+                 (unsigned long)sent, (unsigned long)(sent - tx.chunk_count), tx.complete_reports);
+        tx.running = false;
+    }
+
+    static void tx_announce(uint8_t phase, uint8_t round)
+    {
+        ota_announce_t announce = {
+            .session_id = tx.session_id,
+            .image_size = tx.image_size,
+            .chunk_count = tx.chunk_count,
+            .phase = phase,
+            .round = round
+        };
+        memcpy(announce.sha256, tx.sha256, SHA256_LEN);
+    #if CONFIG_ESPNOW_SECURE_ENABLE
+        espnow_secure_send_all(ESPNOW_MSG_OTA_ANNOUNCE, &announce, sizeof(announce));
+    #else
+        espnow_group_send(tx.group_id, ESPNOW_MSG_OTA_ANNOUNCE, 0, &announce, sizeof(announce));
+    #endif
+    }
+
+    static void tx_handle_report(const ota_report_t *report, size_t len)
+    {
+        if (!tx.running || len < offsetof(ota_report_t, missing)) {return;}
+
+        ota_report_t received;
+        memset(&received, 0, sizeof(received));
+        memcpy(&received, report, len > sizeof(received) ? sizeof(received) : len);
+        if (received.session_id != tx.session_id) {return;}
+
+        taskENTER_CRITICAL(&tx_lock);
+        if (received.complete) {
+            tx.complete_reports++;
+        } else {
+            tx.missing_reports++;
+            espnow_ota_merge_report(tx_need, BITMAP_BYTES, &received);
+        }
+        taskEXIT_CRITICAL(&tx_lock);
+    }
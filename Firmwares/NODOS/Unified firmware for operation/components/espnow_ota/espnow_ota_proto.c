@@ -0,0 +1,53 @@
+/************************************************************************************************
+ * Módulo: Formato y reparación por rondas del protocolo OTA sobre ESP-NOW.
+ *
+ * Descripción: Mapas de faltantes del nodo y su unión en la pasarela. Sin estado propio: lo
+ * usan espnow_ota y el simulador de flota de Benchmarks.
+ *
+ * Autor:
+ *   - Victor Manuel Patiño Delgado.
+ *
+ * Licencia: THE BEER-WARE LICENSE.
+ * As long as you retain this notice you can do whatever you want with this stuff.
+ * If we meet some day, and you think this stuff is worth it, you can buy me a beer in return.
+************************************************************************************************/
+
+//***   Bibliotecas y declaraciones de preprocesador    ***//
+    #include <string.h>
+    #include "espnow_ota_proto.h"
+
+//***Implementación de funciones***//
+    uint16_t espnow_ota_chunk_count(uint32_t image_size)
+    {
+        return (image_size + ESPNOW_OTA_CHUNK_SIZE - 1) / ESPNOW_OTA_CHUNK_SIZE;
+    }
+
+    size_t espnow_ota_chunk_len(uint32_t image_size, uint16_t index)
+    {
+        uint32_t offset = (uint32_t)index * ESPNOW_OTA_CHUNK_SIZE;
+        if (offset >= image_size) {return 0;}
+        return (image_size - offset) < ESPNOW_OTA_CHUNK_SIZE ? (image_size - offset) : ESPNOW_OTA_CHUNK_SIZE;
+    }
+
+    bool espnow_ota_report_block(const uint8_t *received, uint16_t chunk_count, uint32_t base,
+                                 espnow_ota_report_t *report)
+    {
+        bool any_missing = false;
+        memset(report->missing, 0, sizeof(report->missing));
+        for (uint32_t i = 0; i < ESPNOW_OTA_REPORT_CHUNKS && base + i < chunk_count; i++) {
+            if (!ESPNOW_OTA_BIT_GET(received, base + i)) {
+                ESPNOW_OTA_BIT_SET(report->missing, i);
+                any_missing = true;
+            }
+        }
+        report->base = base;
+        return any_missing;
+    }
+
+    void espnow_ota_merge_report(uint8_t *need, size_t need_bytes, const espnow_ota_report_t *report)
+    {
+        // base siempre es múltiplo de REPORT_CHUNKS, la unión se hace byte a byte.
+        for (uint32_t j = 0; j < ESPNOW_OTA_REPORT_BITMAP_BYTES && report->base / 8 + j < need_bytes; j++) {
+            need[report->base / 8 + j] |= report->missing[j];
+        }
+    }
@@ -0,0 +1,55 @@
+/************************************************************************************************
+ * Módulo: Distribución de firmware OTA sobre ESP-NOW.
+ *
+ * Descripción: La pasarela transmite la imagen en fragmentos de 200 bytes hacia un grupo; una
+ * misma emisión sirve a todos los nodos. Cada nodo escribe los fragmentos en la partición OTA
+ * inactiva, lleva un mapa de bits de lo recibido y al cierre de cada ronda reporta solo los
+ * fragmentos faltantes, que la pasarela reemite en la siguiente. El SHA-256 de la imagen se
+ * verifica antes de conmutar la partición de arranque. Con ESPNOW_SECURE_ENABLE el anuncio que
+ * lo transporta llega autenticado a cada par cifrado, y solo ellos reciben la sesión.
+ *
+ * Autor:
+ *   - Victor Manuel Patiño Delgado.
+ *
+ * Licencia: THE BEER-WARE LICENSE.
+ * As long as you retain this notice you can do whatever you want with this stuff.
+ * If we meet some day, and you think this stuff is worth it, you can buy me a beer in return.
+************************************************************************************************/
+#pragma once
+
+//***   Bibliotecas y declaraciones de preprocesador    ***//
+    #include <stdint.h>
+    #include <stdbool.h>
+    #include <stddef.h>
+    #include "esp_err.h"
+    #include "esp_partition.h"
+    #include "esp_now.h"
+    #include "espnow_group.h"
+    #include "espnow_ota_proto.h"
+
+    #ifdef __cplusplus
+    extern "C" {
+    #endif
+
+//***   Definición de constantes y macros   ***//
+    #define ESPNOW_OTA_PARTITION_LABEL "node_fw"
+
+//***   Declaraciones de funciones (prototipos) ***//
+    // Nodo: crea la tarea receptora que escribe en la partición OTA inactiva.
+    esp_err_t espnow_ota_init(void);
+
+    // Pasarela: distribuye la imagen contenida en la partición indicada hacia el grupo.
+    // La sesión corre en su propia tarea; devuelve en cuanto la sesión fue lanzada.
+    esp_err_t espnow_ota_serve(uint8_t group_id, const esp_partition_t *source, size_t image_size);
+
+    // Pasarela: localiza la partición "node_fw" y la distribuye si contiene una imagen válida.
+    esp_err_t espnow_ota_serve_partition(uint8_t group_id);
+
+    // Invocar desde recv_cb con el payload entregado por espnow_group_recv.
+    // Devuelve true si la trama pertenecía al protocolo OTA.
+    bool espnow_ota_handle(const esp_now_recv_info_t *esp_now_info, const espnow_group_hdr_t *hdr,
+                           const uint8_t *payload, size_t payload_len);
+
+    #ifdef __cplusplus
+    }
+    #endif
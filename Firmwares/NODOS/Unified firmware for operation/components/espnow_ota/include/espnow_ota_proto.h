@@ -0,0 +1,84 @@
+/************************************************************************************************
+ * Módulo: Formato y reparación por rondas del protocolo OTA sobre ESP-NOW.
+ *
+ * Descripción: Tramas del protocolo y las dos operaciones de la reparación: el nodo arma el
+ * mapa de faltantes de cada bloque de REPORT_CHUNKS fragmentos y la pasarela une los mapas de
+ * la flota en lo que reemite la ronda siguiente. Sin radio ni flash: en el objetivo linux solo
+ * se compila esta parte del componente, que el simulador de flota de Benchmarks ejecuta con
+ * la misma temporización que espnow_ota.
+ *
+ * Autor:
+ *   - Victor Manuel Patiño Delgado.
+ *
+ * Licencia: THE BEER-WARE LICENSE.
+ * As long as you retain this notice you can do whatever you want with this stuff.
+ * If we meet some day, and you think this stuff is worth it, you can buy me a beer in return.
+************************************************************************************************/
+#pragma once
+
+//***   Bibliotecas y declaraciones de preprocesador    ***//
+    #include <stdint.h>
+    #include <stdbool.h>
+    #include <stddef.h>
+
+    #ifdef __cplusplus
+    extern "C" {
+    #endif
+
+//***   Definición de constantes y macros   ***//
+    #define ESPNOW_OTA_CHUNK_SIZE 200
+    #define ESPNOW_OTA_SHA256_LEN 32
+    #define ESPNOW_OTA_REPORT_BITMAP_BYTES 200
+    #define ESPNOW_OTA_REPORT_CHUNKS (ESPNOW_OTA_REPORT_BITMAP_BYTES * 8)
+
+    #define ESPNOW_OTA_PHASE_BEGIN 0
+    #define ESPNOW_OTA_PHASE_ROUND_END 1
+
+    // Temporización del protocolo además de la configurable en Kconfig.
+    #define ESPNOW_OTA_ROUND_END_GAP_MS 20  // Entre las dos emisiones del cierre de ronda
+    #define ESPNOW_OTA_REPORT_GAP_MS 5      // Entre reportes consecutivos de un nodo
+
+    #define ESPNOW_OTA_BIT_SET(map, i) ((map)[(i) / 8] |= (1 << ((i) % 8)))
+    #define ESPNOW_OTA_BIT_GET(map, i) (((map)[(i) / 8] >> ((i) % 8)) & 1)
+
+//***   Estructuras de datos y tipos personalizados ***//
+    typedef struct __attribute__((packed)) {
+        uint32_t session_id;
+        uint32_t image_size;
+        uint16_t chunk_count;
+        uint8_t phase;
+        uint8_t round;
+        uint8_t sha256[ESPNOW_OTA_SHA256_LEN];
+    } espnow_ota_announce_t;
+
+    typedef struct __attribute__((packed)) {
+        uint32_t session_id;
+        uint16_t index;
+        uint8_t data[ESPNOW_OTA_CHUNK_SIZE];
+    } espnow_ota_chunk_t;
+
+    typedef struct __attribute__((packed)) {
+        uint32_t session_id;
+        uint16_t base;
+        uint8_t complete;
+        uint8_t reserved;
+        uint8_t missing[ESPNOW_OTA_REPORT_BITMAP_BYTES];
+    } espnow_ota_report_t;
+
+//***   Declaraciones de funciones (prototipos) ***//
+    uint16_t espnow_ota_chunk_count(uint32_t image_size);
+
+    // Bytes de datos del fragmento index (el último puede ser más corto).
+    size_t espnow_ota_chunk_len(uint32_t image_size, uint16_t index);
+
+    // Nodo: llena report->base y report->missing con lo que falta en el bloque que empieza en
+    // base según el mapa de recibidos. Devuelve false si el bloque está completo.
+    bool espnow_ota_report_block(const uint8_t *received, uint16_t chunk_count, uint32_t base,
+                                 espnow_ota_report_t *report);
+
+    // Pasarela: une el reporte al mapa need (need_bytes) de lo que se reemite.
+    void espnow_ota_merge_report(uint8_t *need, size_t need_bytes, const espnow_ota_report_t *report);
+
+    #ifdef __cplusplus
+    }
+    #endif
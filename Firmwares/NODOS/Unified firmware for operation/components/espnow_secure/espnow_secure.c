@@ -0,0 +1,763 @@
+/************************************************************************************************
+ * Módulo: Comandos cifrados sobre ESP-NOW.
+ *
+ * Descripción: La radio no informa en recv_cb si una trama llegó cifrada, y la MAC de origen
+ * se puede falsificar, así que cada trama lleva al final un contador y una etiqueta
+ * HMAC-SHA256 truncada con la LMK del par sobre la cabecera, el payload y el contador. El
+ * receptor descarta etiquetas inválidas y contadores repetidos. El contador del emisor avanza
+ * por generaciones guardadas en NVS, como las épocas de cmd_sync, y nunca se repite tras un
+ * reinicio. El receptor guarda en NVS la última generación aceptada de cada par antes de
+ * aceptarla; tras reiniciarse rechaza toda esa generación, así que una trama capturada no se
+ * puede repetir. Al rechazar un contador viejo con etiqueta válida le pide al par KEY_RESYNC con
+ * su último contador aceptado, y el par salta a una generación posterior.
+ *
+ * Rotación: la pasarela guarda la nueva clave de cada par en NVS, se la envía y reintenta hasta
+ * que el nodo responde KEY_CONFIRM con la nueva época. Al vencer el plazo ambos extremos la
+ * activan; en la pasarela solo los pares que confirmaron. Cada clave lleva una época para
+ * descartar reintentos y claves antiguas.
+ *
+ * Recuperación: la confirmación puede perderse después de que el nodo ya la programó, o el nodo
+ * puede reiniciarse antes del plazo, y en ambos casos cada extremo queda con una clave distinta.
+ * Por eso la pasarela conserva la clave anterior y la última ofrecida de cada par. Tras cada
+ * rotación, al arrancar y cada CHECK_PERIOD_S mientras un par no responda, lo sondea con
+ * KEY_CHECK probando la vigente, la ofrecida y la anterior, y adopta la primera con la que el
+ * nodo contesta. El nodo no busca: siempre responde con la clave que tiene.
+ *
+ * Autor:
+ *   - Victor Manuel Patiño Delgado.
+ *
+ * Licencia: THE BEER-WARE LICENSE.
+ * As long as you retain this notice you can do whatever you want with this stuff.
+ * If we meet some day, and you think this stuff is worth it, you can buy me a beer in return.
+************************************************************************************************/
+
+//***   Bibliotecas y declaraciones de preprocesador    ***//
+    #include <stdio.h>
+    #include <string.h>
+    #include "freertos/FreeRTOS.h"
+    #include "freertos/task.h"
+    #include "esp_now.h"
+    #include "esp_wifi.h"
+    #include "esp_mac.h"
+    #include "esp_random.h"
+    #include "esp_timer.h"
+    #include "esp_log.h"
+    #include "nvs.h"
+    #include "mbedtls/sha256.h"
+    #include "sdkconfig.h"
+    #include "espnow_secure.h"
+    #include "task_layout.h"
+
+//***   Definición de constantes y macros   ***//
+    #define CONFIRM_TIMEOUT pdMS_TO_TICKS(200)
+    #define RETRY_INTERVAL pdMS_TO_TICKS(200)
+    #define CHECK_ATTEMPTS 3
+    #define NOTIFY_CONFIRM 1
+    #define NOTIFY_FAIL 2
+    #define SHA256_LEN 32
+    #define SHA256_BLOCK_LEN 64
+    #define TAG_LEN 16
+    #define COUNTER_MASK 0xFFFFu
+    #define RESYNC_INTERVAL_US 1000000LL    // Entre pedidos de KEY_RESYNC al mismo par
+
+    static const char *TAG = "espnow_secure";
+    #if CONFIG_ESPNOW_SECURE_ENABLE
+    static const char *NVS_NAMESPACE = "espnow_sec";
+    #endif
+
+//***   Estructuras de datos y tipos personalizados ***//
+    #if CONFIG_ESPNOW_SECURE_ENABLE
+    typedef struct __attribute__((packed)) {
+        uint32_t epoch;
+        uint8_t lmk[ESP_NOW_KEY_LEN];
+        uint16_t switch_ms;
+    } rotate_payload_t;
+
+    // Anexo de autenticación al final del payload; la etiqueta cubre todo lo anterior.
+    typedef struct __attribute__((packed)) {
+        uint32_t counter;
+        uint8_t tag[TAG_LEN];
+    } auth_trailer_t;
+
+    typedef struct __attribute__((packed)) {
+        uint32_t epoch;
+        uint8_t lmk[ESP_NOW_KEY_LEN];
+    } stored_key_t;
+
+    typedef struct {
+        bool valid;
+        uint8_t mac[ESP_NOW_ETH_ALEN];
+        uint8_t channel;
+        stored_key_t key;           // Vigente en la radio, también firma las tramas
+        stored_key_t previous;      // Pasarela: candidata si el par no llegó a cambiar
+        stored_key_t next;          // Ofrecida o recibida; en la pasarela, candidata si el par cambió solo
+        uint32_t rx_counter;        // Último contador aceptado del par; tras reiniciar, fin de su generación
+        int64_t resync_at_us;       // Próximo KEY_RESYNC permitido
+        bool pending;               // Clave recibida o enviada, a la espera del plazo
+        bool confirmed;             // Pasarela: el par respondió KEY_CONFIRM con la nueva época
+        bool verified;              // Pasarela: el par respondió con la clave vigente
+        int64_t switch_at_us;
+    } secure_peer_t;
+
+    static portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+    static secure_peer_t peers[CONFIG_ESPNOW_SECURE_MAX_PEERS];
+    static uint8_t own_mac[ESP_NOW_ETH_ALEN];
+    static uint16_t tx_seq;
+    static uint32_t tx_counter;
+    static esp_timer_handle_t switch_timer;
+    static TaskHandle_t status_waiter;
+    static uint8_t status_mac[ESP_NOW_ETH_ALEN];
+    static volatile uint32_t confirm_epoch;
+    #endif
+
+//***   Declaraciones de funciones (prototipos) ***//
+    #if CONFIG_ESPNOW_SECURE_ENABLE
+    static void key_name(char *name, char prefix, const uint8_t *mac);
+    static void load_peer_keys(secure_peer_t *peer);
+    static void store_peer_key(const uint8_t *mac, const stored_key_t *key);
+    static void store_candidate(const uint8_t *mac, char prefix, const stored_key_t *key);
+    static esp_err_t apply_lmk(const uint8_t *mac, uint8_t channel, const uint8_t *lmk);
+    static esp_err_t set_key(secure_peer_t *peer, const stored_key_t *key);
+    static esp_err_t advance_generation(uint16_t at_least);
+    static esp_err_t store_generation(const uint8_t *mac, uint16_t generation);
+    static void request_resync(secure_peer_t *peer, uint32_t floor);
+    static void compute_tag(const uint8_t *lmk, const uint8_t *data, size_t len, uint8_t *tag);
+    static secure_peer_t *find_peer(const uint8_t *mac);
+    static void accept_rotation(secure_peer_t *peer, const uint8_t *payload, size_t len);
+    static bool request_confirm(secure_peer_t *peer, uint8_t type, const void *payload, size_t len, uint32_t epoch);
+    static bool verify_peer(secure_peer_t *peer);
+    static bool verify_peers(void);
+    static void activate_pending(void);
+    static void switch_timer_cb(void *arg);
+    static void rotation_task(void *pvParameters);
+    #endif
+
+//***Implementación de funciones***//
+    #if CONFIG_ESPNOW_SECURE_ENABLE
+    esp_err_t espnow_secure_init(void)
+    {
+        if (strlen(CONFIG_ESPNOW_SECURE_PMK) != ESP_NOW_KEY_LEN || strlen(CONFIG_ESPNOW_SECURE_LMK) != ESP_NOW_KEY_LEN) {
+            ESP_LOGE(TAG, "ESPNOW_SECURE_PMK and ESPNOW_SECURE_LMK must be %d characters", ESP_NOW_KEY_LEN);
+            return ESP_ERR_INVALID_ARG;
+        }
+        esp_wifi_get_mac(WIFI_IF_STA, own_mac);
+
+        uint8_t pmk[ESP_NOW_KEY_LEN];
+        size_t len = sizeof(pmk);
+        nvs_handle_t nvs;
+        esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs);
+        if (err != ESP_OK) {return err;}
+        if (nvs_get_blob(nvs, "pmk", pmk, &len) != ESP_OK || len != sizeof(pmk)) {
+            memcpy(pmk, CONFIG_ESPNOW_SECURE_PMK, sizeof(pmk));
+            nvs_set_blob(nvs, "pmk", pmk, sizeof(pmk));
+            nvs_commit(nvs);
+            ESP_LOGW(TAG, "No provisioned PMK, using the factory default");
+        }
+        nvs_close(nvs);
+        err = esp_now_set_pmk(pmk);
+        if (err != ESP_OK) {return err;}
+        err = advance_generation(0);
+        if (err != ESP_OK) {return err;}
+
+        const esp_timer_create_args_t timer_args = {.callback = switch_timer_cb, .name = "key_switch"};
+        err = esp_timer_create(&timer_args, &switch_timer);
+        if (err != ESP_OK) {return err;}
+
+        uint8_t gateway[ESP_NOW_ETH_ALEN];
+        if (sscanf(CONFIG_ESPNOW_SECURE_GATEWAY_MAC, "%hhx:%hhx:%hhx:%hhx:%hhx:%hhx", &gateway[0], &gateway[1],
+                   &gateway[2], &gateway[3], &gateway[4], &gateway[5]) == ESP_NOW_ETH_ALEN) {
+            uint8_t channel = 0;
+            wifi_second_chan_t second;
+            esp_wifi_get_channel(&channel, &second);
+            err = espnow_secure_add_peer(gateway, channel);
+            // Tras un reinicio la pasarela debe saltar a una generación que este nodo todavía acepte.
+            secure_peer_t *peer = find_peer(gateway);
+            if (err == ESP_OK && peer->rx_counter != 0) {request_resync(peer, peer->rx_counter);}
+            return err;
+        }
+        return ESP_OK;
+    }
+
+    esp_err_t espnow_secure_add_peer(const uint8_t *mac, uint8_t channel)
+    {
+        secure_peer_t *peer = find_peer(mac);
+        taskENTER_CRITICAL(&lock);
+        for (uint8_t i = 0; i < CONFIG_ESPNOW_SECURE_MAX_PEERS && peer == NULL; i++) {
+            if (!peers[i].valid) {
+                peer = &peers[i];
+                memset(peer, 0, sizeof(*peer));
+                memcpy(peer->mac, mac, ESP_NOW_ETH_ALEN);
+            }
+        }
+        taskEXIT_CRITICAL(&lock);
+        if (peer == NULL) {
+            ESP_LOGE(TAG, "Encrypted peer table full, " MACSTR " not added", MAC2STR(mac));
+            return ESP_ERR_ESPNOW_FULL;
+        }
+
+        load_peer_keys(peer);
+        peer->channel = channel;
+        esp_err_t err = apply_lmk(mac, channel, peer->key.lmk);
+        peer->valid = err == ESP_OK;
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to add encrypted peer " MACSTR ": %s", MAC2STR(mac), esp_err_to_name(err));
+        } else {
+            ESP_LOGI(TAG, "Encrypted peer " MACSTR " (key epoch %lu)", MAC2STR(mac), (unsigned long)peer->key.epoch);
+        }
+        return err;
+    }
+
+    esp_err_t espnow_secure_send(const uint8_t *mac, uint8_t type, const void *payload, size_t len)
+    {
+        secure_peer_t *peer = find_peer(mac);
+        if (peer == NULL) {return ESP_ERR_ESPNOW_NOT_FOUND;}
+        if (len > ESPNOW_GROUP_MAX_PAYLOAD - sizeof(auth_trailer_t)) {return ESP_ERR_INVALID_SIZE;}
+
+        // Contador agotado: nueva generación antes de firmar, el contador sigue creciendo.
+        if (((tx_counter + 1) & COUNTER_MASK) == 0) {
+            esp_err_t err = advance_generation(0);
+            if (err != ESP_OK) {return err;}
+        }
+
+        uint8_t body[ESPNOW_GROUP_MAX_PAYLOAD];
+        uint8_t frame[ESP_NOW_MAX_DATA_LEN];
+        uint8_t lmk[ESP_NOW_KEY_LEN];
+        auth_trailer_t trailer = {};
+        taskENTER_CRITICAL(&lock);
+        uint16_t seq = ++tx_seq;
+        trailer.counter = ++tx_counter;
+        memcpy(lmk, peer->key.lmk, ESP_NOW_KEY_LEN);
+        taskEXIT_CRITICAL(&lock);
+
+        if (len > 0) {memcpy(body, payload, len);}
+        memcpy(body + len, &trailer, sizeof(trailer));
+        size_t frame_len = espnow_group_encode(frame, ESPNOW_GROUP_ALL, type, ESPNOW_GROUP_FLAG_AUTH, seq, body,
+                                               len + sizeof(trailer));
+        if (frame_len == 0) {return ESP_ERR_INVALID_SIZE;}
+        compute_tag(lmk, frame, frame_len - TAG_LEN, frame + frame_len - TAG_LEN);
+        return esp_now_send(mac, frame, frame_len);
+    }
+
+    esp_err_t espnow_secure_send_all(uint8_t type, const void *payload, size_t len)
+    {
+        esp_err_t err = ESP_ERR_ESPNOW_NOT_FOUND;
+        for (uint8_t i = 0; i < CONFIG_ESPNOW_SECURE_MAX_PEERS; i++) {
+            if (!peers[i].valid) {continue;}
+            esp_err_t sent = espnow_secure_send(peers[i].mac, type, payload, len);
+            if (err == ESP_ERR_ESPNOW_NOT_FOUND || sent != ESP_OK) {err = sent;}
+        }
+        return err;
+    }
+
+    bool espnow_secure_verify(const esp_now_recv_info_t *esp_now_info, const espnow_group_hdr_t *hdr,
+                              const uint8_t *payload, size_t *len)
+    {
+        // Broadcast nunca va cifrado.
+        if (memcmp(esp_now_info->des_addr, own_mac, ESP_NOW_ETH_ALEN) != 0) {return false;}
+        secure_peer_t *peer = find_peer(esp_now_info->src_addr);
+        // La etiqueta cubre la cabecera, que espnow_group_recv deja justo antes del payload.
+        if (peer == NULL || !(hdr->flags & ESPNOW_GROUP_FLAG_AUTH) || *len < sizeof(auth_trailer_t) ||
+            payload != (const uint8_t *)hdr + sizeof(*hdr)) {
+            return false;
+        }
+
+        auth_trailer_t trailer;
+        uint8_t lmk[ESP_NOW_KEY_LEN];
+        uint8_t tag[TAG_LEN];
+        memcpy(&trailer, payload + *len - sizeof(trailer), sizeof(trailer));
+        taskENTER_CRITICAL(&lock);
+        memcpy(lmk, peer->key.lmk, ESP_NOW_KEY_LEN);
+        taskEXIT_CRITICAL(&lock);
+        compute_tag(lmk, (const uint8_t *)hdr, sizeof(*hdr) + *len - TAG_LEN, tag);
+
+        uint8_t diff = 0;
+        for (uint8_t i = 0; i < TAG_LEN; i++) {diff |= tag[i] ^ trailer.tag[i];}
+        if (diff != 0) {
+            ESP_LOGW(TAG, "Bad tag from " MACSTR ", frame dropped", MAC2STR(esp_now_info->src_addr));
+            return false;
+        }
+
+        taskENTER_CRITICAL(&lock);
+        uint32_t last = peer->rx_counter;
+        taskEXIT_CRITICAL(&lock);
+        if (trailer.counter <= last) {
+            ESP_LOGW(TAG, "Replayed counter 0x%08lx from " MACSTR, (unsigned long)trailer.counter,
+                     MAC2STR(esp_now_info->src_addr));
+            request_resync(peer, last);
+            return false;
+        }
+        // Generación nueva del par: se guarda antes de aceptar la trama, sin NVS no hay ventana cerrada.
+        if ((trailer.counter >> 16) != (last >> 16) && store_generation(peer->mac, trailer.counter >> 16) != ESP_OK) {
+            return false;
+        }
+        taskENTER_CRITICAL(&lock);
+        bool fresh = trailer.counter > peer->rx_counter;
+        if (fresh) {peer->rx_counter = trailer.counter;}
+        taskEXIT_CRITICAL(&lock);
+        if (!fresh) {return false;}
+        *len -= sizeof(trailer);
+        return true;
+    }
+
+    bool espnow_secure_handle(const esp_now_recv_info_t *esp_now_info, const espnow_group_hdr_t *hdr,
+                              const uint8_t *payload, size_t len)
+    {
+        if (hdr->type != ESPNOW_MSG_KEY_ROTATE && hdr->type != ESPNOW_MSG_KEY_CHECK && hdr->type != ESPNOW_MSG_KEY_CONFIRM &&
+            hdr->type != ESPNOW_MSG_KEY_RESYNC) {
+            return false;
+        }
+        secure_peer_t *peer = find_peer(esp_now_info->src_addr);
+        if (peer == NULL || !espnow_secure_verify(esp_now_info, hdr, payload, &len)) {
+            ESP_LOGW(TAG, "Ignoring key message from untrusted " MACSTR, MAC2STR(esp_now_info->src_addr));
+            return true;
+        }
+
+        if (hdr->type == ESPNOW_MSG_KEY_ROTATE) {
+            accept_rotation(peer, payload, len);
+        } else if (hdr->type == ESPNOW_MSG_KEY_CHECK) {
+            // La trama se descifró y verificó con la clave vigente: se responde con su época.
+            uint32_t epoch = peer->key.epoch;
+            espnow_secure_send(peer->mac, ESPNOW_MSG_KEY_CONFIRM, &epoch, sizeof(epoch));
+        } else if (hdr->type == ESPNOW_MSG_KEY_RESYNC) {
+            // El par descartó la generación vigente al reiniciarse: se salta más allá de su último contador.
+            uint32_t floor;
+            if (len == sizeof(floor)) {
+                memcpy(&floor, payload, sizeof(floor));
+                if (floor >= tx_counter && advance_generation((floor >> 16) + 1) == ESP_OK) {
+                    ESP_LOGI(TAG, "Counter moved past 0x%08lx for " MACSTR, (unsigned long)floor, MAC2STR(peer->mac));
+                }
+            }
+        } else {
+            TaskHandle_t waiter = status_waiter;
+            if (waiter != NULL && len == sizeof(uint32_t) && memcmp(peer->mac, status_mac, ESP_NOW_ETH_ALEN) == 0) {
+                uint32_t epoch;
+                memcpy(&epoch, payload, sizeof(epoch));
+                confirm_epoch = epoch;
+                xTaskNotify(waiter, NOTIFY_CONFIRM, eSetValueWithOverwrite);
+            }
+        }
+        return true;
+    }
+
+    void espnow_secure_send_status(const uint8_t *mac, esp_now_send_status_t status)
+    {
+        TaskHandle_t waiter = status_waiter;
+        if (waiter != NULL && status != ESP_NOW_SEND_SUCCESS && memcmp(mac, status_mac, ESP_NOW_ETH_ALEN) == 0) {
+            xTaskNotify(waiter, NOTIFY_FAIL, eSetValueWithOverwrite);
+        }
+    }
+
+    esp_err_t espnow_secure_rotate(void)
+    {
+        int64_t switch_at_us = esp_timer_get_time() + CONFIG_ESPNOW_SECURE_SWITCH_MS * 1000LL;
+        for (uint8_t i = 0; i < CONFIG_ESPNOW_SECURE_MAX_PEERS; i++) {
+            secure_peer_t *peer = &peers[i];
+            if (!peer->valid) {continue;}
+            // Sin clave verificada una época nueva solo agrandaría el desfase.
+            if (!peer->verified) {
+                ESP_LOGW(TAG, MACSTR " not verified, rotation skipped", MAC2STR(peer->mac));
+                continue;
+            }
+            stored_key_t next = {.epoch = peer->key.epoch + 1};
+            esp_fill_random(next.lmk, ESP_NOW_KEY_LEN);
+            // Se guarda antes de enviarla: si la pasarela se reinicia, sigue siendo candidata.
+            store_candidate(peer->mac, 'n', &next);
+            taskENTER_CRITICAL(&lock);
+            peer->next = next;
+            peer->pending = true;
+            peer->confirmed = false;
+            peer->switch_at_us = switch_at_us;
+            taskEXIT_CRITICAL(&lock);
+        }
+
+        status_waiter = xTaskGetCurrentTaskHandle();
+        bool all_confirmed = false;
+        while (!all_confirmed && esp_timer_get_time() < switch_at_us) {
+            for (uint8_t i = 0; i < CONFIG_ESPNOW_SECURE_MAX_PEERS; i++) {
+                secure_peer_t *peer = &peers[i];
+                if (!peer->valid || !peer->pending || peer->confirmed) {continue;}
+
+                int64_t remaining_ms = (switch_at_us - esp_timer_get_time()) / 1000;
+                if (remaining_ms <= 0) {break;}
+                rotate_payload_t rotate = {.epoch = peer->next.epoch, .switch_ms = (uint16_t)remaining_ms};
+                memcpy(rotate.lmk, peer->next.lmk, ESP_NOW_KEY_LEN);
+                peer->confirmed = request_confirm(peer, ESPNOW_MSG_KEY_ROTATE, &rotate, sizeof(rotate), peer->next.epoch);
+            }
+            all_confirmed = true;
+            for (uint8_t i = 0; i < CONFIG_ESPNOW_SECURE_MAX_PEERS; i++) {
+                if (peers[i].valid && peers[i].pending && !peers[i].confirmed) {all_confirmed = false;}
+            }
+            if (!all_confirmed) {vTaskDelay(RETRY_INTERVAL);}
+        }
+
+        int64_t wait_us = switch_at_us - esp_timer_get_time();
+        if (wait_us > 0) {vTaskDelay(pdMS_TO_TICKS(wait_us / 1000) + 1);}
+        activate_pending();
+        // El nodo activa un poco después: su plazo corre desde que recibió la clave.
+        vTaskDelay(RETRY_INTERVAL);
+        bool all_verified = verify_peers();
+        status_waiter = NULL;
+        return all_confirmed && all_verified ? ESP_OK : ESP_ERR_TIMEOUT;
+    }
+
+    esp_err_t espnow_secure_start_rotation(void)
+    {
+        return TASK_LAYOUT_CREATE(rotation_task, "key_rotation", 3072, NULL, TASK_CLASS_BACKGROUND, NULL);
+    }
+
+    static void rotation_task(void *pvParameters)
+    {
+        int64_t rotate_at_us = esp_timer_get_time() + CONFIG_ESPNOW_SECURE_ROTATE_PERIOD_S * 1000000LL;
+        while (1) {
+            status_waiter = xTaskGetCurrentTaskHandle();
+            verify_peers();
+            status_waiter = NULL;
+            if (CONFIG_ESPNOW_SECURE_ROTATE_PERIOD_S > 0 && esp_timer_get_time() >= rotate_at_us) {
+                rotate_at_us += CONFIG_ESPNOW_SECURE_ROTATE_PERIOD_S * 1000000LL;
+                if (espnow_secure_rotate() != ESP_OK) {
+                    ESP_LOGW(TAG, "Some peers are not on the new key yet; probing every %d s", CONFIG_ESPNOW_SECURE_CHECK_PERIOD_S);
+                }
+            }
+            vTaskDelay(pdMS_TO_TICKS(CONFIG_ESPNOW_SECURE_CHECK_PERIOD_S * 1000ULL));
+        }
+    }
+
+    // Nodo: programa la activación de una época nueva y confirma cada reintento de una conocida.
+    static void accept_rotation(secure_peer_t *peer, const uint8_t *payload, size_t len)
+    {
+        rotate_payload_t rotate;
+        if (len != sizeof(rotate)) {return;}
+        memcpy(&rotate, payload, sizeof(rotate));
+        uint32_t epoch = rotate.epoch;
+
+        bool schedule = false;
+        taskENTER_CRITICAL(&lock);
+        // Los reintentos de la misma época no mueven el plazo ya programado.
+        if (epoch > peer->key.epoch && !(peer->pending && peer->next.epoch == epoch)) {
+            peer->pending = true;
+            peer->confirmed = true;
+            peer->next.epoch = epoch;
+            memcpy(peer->next.lmk, rotate.lmk, ESP_NOW_KEY_LEN);
+            peer->switch_at_us = esp_timer_get_time() + rotate.switch_ms * 1000LL;
+            schedule = true;
+        }
+        bool known = epoch == peer->key.epoch || (peer->pending && peer->next.epoch == epoch);
+        taskEXIT_CRITICAL(&lock);
+
+        if (schedule) {
+            esp_timer_stop(switch_timer);
+            esp_timer_start_once(switch_timer, rotate.switch_ms * 1000ULL);
+            ESP_LOGI(TAG, "Key epoch %lu from " MACSTR " activates in %d ms", (unsigned long)epoch,
+                     MAC2STR(peer->mac), rotate.switch_ms);
+        }
+        if (known) {espnow_secure_send(peer->mac, ESPNOW_MSG_KEY_CONFIRM, &epoch, sizeof(epoch));}
+    }
+
+    // Pasarela: envía la trama y espera el KEY_CONFIRM del par con la época indicada.
+    static bool request_confirm(secure_peer_t *peer, uint8_t type, const void *payload, size_t len, uint32_t epoch)
+    {
+        memcpy(status_mac, peer->mac, ESP_NOW_ETH_ALEN);
+        xTaskNotifyStateClear(NULL);
+        if (espnow_secure_send(peer->mac, type, payload, len) != ESP_OK) {return false;}
+
+        TickType_t start = xTaskGetTickCount();
+        TickType_t elapsed;
+        uint32_t status;
+        while ((elapsed = xTaskGetTickCount() - start) < CONFIRM_TIMEOUT) {
+            if (xTaskNotifyWait(0, UINT32_MAX, &status, CONFIRM_TIMEOUT - elapsed) != pdTRUE) {break;}
+            if (status == NOTIFY_FAIL) {return false;}
+            if (status == NOTIFY_CONFIRM && confirm_epoch == epoch) {return true;}
+        }
+        return false;
+    }
+
+    // Pasarela: busca la clave con la que responde el par entre la vigente, la ofrecida y la
+    // anterior, y la adopta. Si no responde con ninguna se queda con la vigente.
+    static bool verify_peer(secure_peer_t *peer)
+    {
+        const stored_key_t current = peer->key;
+        const stored_key_t candidates[] = {current, peer->next, peer->previous};
+        for (uint8_t i = 0; i < sizeof(candidates) / sizeof(candidates[0]); i++) {
+            bool tried = false;
+            for (uint8_t j = 0; j < i; j++) {
+                if (memcmp(candidates[j].lmk, candidates[i].lmk, ESP_NOW_KEY_LEN) == 0) {tried = true;}
+            }
+            if (tried || (i > 0 && set_key(peer, &candidates[i]) != ESP_OK)) {continue;}
+
+            for (uint8_t attempt = 0; attempt < CHECK_ATTEMPTS; attempt++) {
+                if (!request_confirm(peer, ESPNOW_MSG_KEY_CHECK, NULL, 0, candidates[i].epoch)) {
+                    vTaskDelay(RETRY_INTERVAL);
+                    continue;
+                }
+                if (i > 0) {
+                    ESP_LOGW(TAG, MACSTR " answered on key epoch %lu, adopting it", MAC2STR(peer->mac),
+                             (unsigned long)candidates[i].epoch);
+                    peer->previous = current;
+                    store_candidate(peer->mac, 'p', &current);
+                    store_peer_key(peer->mac, &candidates[i]);
+                }
+                peer->verified = true;
+                return true;
+            }
+        }
+        set_key(peer, &current);
+        ESP_LOGW(TAG, MACSTR " did not answer on any known key", MAC2STR(peer->mac));
+        return false;
+    }
+
+    static bool verify_peers(void)
+    {
+        bool all_verified = true;
+        for (uint8_t i = 0; i < CONFIG_ESPNOW_SECURE_MAX_PEERS; i++) {
+            if (peers[i].valid && !peers[i].verified && !verify_peer(&peers[i])) {all_verified = false;}
+        }
+        return all_verified;
+    }
+
+    // Activa las claves cuyo plazo venció: en la pasarela solo las confirmadas por el par. Todo
+    // par con una rotación en curso queda por verificar, haya confirmado o no.
+    static void activate_pending(void)
+    {
+        int64_t now = esp_timer_get_time();
+        for (uint8_t i = 0; i < CONFIG_ESPNOW_SECURE_MAX_PEERS; i++) {
+            secure_peer_t *peer = &peers[i];
+            if (!peer->valid || !peer->pending || peer->switch_at_us > now) {continue;}
+            peer->pending = false;
+            peer->verified = false;
+            if (!peer->confirmed) {
+                ESP_LOGW(TAG, MACSTR " did not confirm key epoch %lu", MAC2STR(peer->mac), (unsigned long)peer->next.epoch);
+                continue;
+            }
+            const stored_key_t previous = peer->key;
+            const stored_key_t next = peer->next;
+            if (set_key(peer, &next) == ESP_OK) {
+                peer->previous = previous;
+                store_candidate(peer->mac, 'p', &previous);
+                store_peer_key(peer->mac, &next);
+                ESP_LOGI(TAG, MACSTR " now on key epoch %lu", MAC2STR(peer->mac), (unsigned long)next.epoch);
+            }
+        }
+    }
+
+    static void switch_timer_cb(void *arg)
+    {
+        activate_pending();
+    }
+
+    static void key_name(char *name, char prefix, const uint8_t *mac)
+    {
+        snprintf(name, 16, "%c%02x%02x%02x%02x%02x%02x", prefix, mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+    }
+
+    // Sin clave propia en NVS el par usa la LMK de fábrica, que también es la candidata por defecto.
+    static void load_peer_keys(secure_peer_t *peer)
+    {
+        char name[16];
+        size_t len = ESP_NOW_KEY_LEN;
+        nvs_handle_t nvs;
+        peer->key.epoch = 0;
+        memcpy(peer->key.lmk, CONFIG_ESPNOW_SECURE_LMK, ESP_NOW_KEY_LEN);
+        peer->previous = peer->key;
+        peer->next = peer->key;
+        if (nvs_open(NVS_NAMESPACE, NVS_READONLY, &nvs) != ESP_OK) {return;}
+        key_name(name, 'k', peer->mac);
+        if (nvs_get_blob(nvs, name, peer->key.lmk, &len) != ESP_OK || len != ESP_NOW_KEY_LEN) {
+            memcpy(peer->key.lmk, CONFIG_ESPNOW_SECURE_LMK, ESP_NOW_KEY_LEN);
+        } else {
+            uint32_t epoch = 0;
+            key_name(name, 'e', peer->mac);
+            nvs_get_u32(nvs, name, &epoch);
+            peer->key.epoch = epoch;
+        }
+        stored_key_t candidate;
+        len = sizeof(candidate);
+        key_name(name, 'p', peer->mac);
+        if (nvs_get_blob(nvs, name, &candidate, &len) == ESP_OK && len == sizeof(candidate)) {peer->previous = candidate;}
+        len = sizeof(candidate);
+        key_name(name, 'n', peer->mac);
+        if (nvs_get_blob(nvs, name, &candidate, &len) == ESP_OK && len == sizeof(candidate)) {peer->next = candidate;}
+        // Todo contador de la última generación aceptada pudo llegar antes del reinicio.
+        uint16_t generation;
+        key_name(name, 'g', peer->mac);
+        if (nvs_get_u16(nvs, name, &generation) == ESP_OK) {
+            uint32_t floor = ((uint32_t)generation << 16) | COUNTER_MASK;
+            if (floor > peer->rx_counter) {peer->rx_counter = floor;}
+        }
+        nvs_close(nvs);
+    }
+
+    static void store_peer_key(const uint8_t *mac, const stored_key_t *key)
+    {
+        char name[16];
+        nvs_handle_t nvs;
+        if (nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs) != ESP_OK) {
+            ESP_LOGE(TAG, "Key for " MACSTR " not persisted", MAC2STR(mac));
+            return;
+        }
+        key_name(name, 'k', mac);
+        nvs_set_blob(nvs, name, key->lmk, ESP_NOW_KEY_LEN);
+        key_name(name, 'e', mac);
+        nvs_set_u32(nvs, name, key->epoch);
+        nvs_commit(nvs);
+        nvs_close(nvs);
+    }
+
+    // Candidatas de la pasarela: 'p' la clave anterior y 'n' la última ofrecida.
+    static void store_candidate(const uint8_t *mac, char prefix, const stored_key_t *key)
+    {
+        char name[16];
+        nvs_handle_t nvs;
+        if (nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs) != ESP_OK) {
+            ESP_LOGE(TAG, "Candidate key for " MACSTR " not persisted", MAC2STR(mac));
+            return;
+        }
+        key_name(name, prefix, mac);
+        nvs_set_blob(nvs, name, key, sizeof(*key));
+        nvs_commit(nvs);
+        nvs_close(nvs);
+    }
+
+    static esp_err_t apply_lmk(const uint8_t *mac, uint8_t channel, const uint8_t *lmk)
+    {
+        esp_now_peer_info_t esp_now_peer_info = {};
+        memcpy(esp_now_peer_info.peer_addr, mac, ESP_NOW_ETH_ALEN);
+        memcpy(esp_now_peer_info.lmk, lmk, ESP_NOW_KEY_LEN);
+        esp_now_peer_info.channel = channel;
+        esp_now_peer_info.ifidx = ESP_IF_WIFI_STA;
+        esp_now_peer_info.encrypt = true;
+        return esp_now_is_peer_exist(mac) ? esp_now_mod_peer(&esp_now_peer_info) : esp_now_add_peer(&esp_now_peer_info);
+    }
+
+    // Cambia la LMK en la radio y la que firma las tramas.
+    static esp_err_t set_key(secure_peer_t *peer, const stored_key_t *key)
+    {
+        esp_err_t err = apply_lmk(peer->mac, peer->channel, key->lmk);
+        if (err != ESP_OK) {return err;}
+        taskENTER_CRITICAL(&lock);
+        peer->key = *key;
+        taskEXIT_CRITICAL(&lock);
+        return ESP_OK;
+    }
+
+    // Generación siguiente, o at_least si es mayor (KEY_RESYNC de un par).
+    static esp_err_t advance_generation(uint16_t at_least)
+    {
+        nvs_handle_t nvs;
+        esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs);
+        if (err != ESP_OK) {return err;}
+        uint16_t generation = 0;
+        nvs_get_u16(nvs, "gen", &generation);
+        generation++;
+        if (generation < at_least) {generation = at_least;}
+        err = nvs_set_u16(nvs, "gen", generation);
+        if (err == ESP_OK) {err = nvs_commit(nvs);}
+        nvs_close(nvs);
+        if (err == ESP_OK) {
+            taskENTER_CRITICAL(&lock);
+            tx_counter = (uint32_t)generation << 16;
+            taskEXIT_CRITICAL(&lock);
+        }
+        return err;
+    }
+
+    static esp_err_t store_generation(const uint8_t *mac, uint16_t generation)
+    {
+        char name[16];
+        nvs_handle_t nvs;
+        esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs);
+        if (err == ESP_OK) {
+            key_name(name, 'g', mac);
+            err = nvs_set_u16(nvs, name, generation);
+            if (err == ESP_OK) {err = nvs_commit(nvs);}
+            nvs_close(nvs);
+        }
+        if (err != ESP_OK) {ESP_LOGE(TAG, "Generation of " MACSTR " not persisted: %s", MAC2STR(mac), esp_err_to_name(err));}
+        return err;
+    }
+
+    // Un contador viejo con etiqueta válida es una repetición o un par que sigue en una generación
+    // que este extremo descartó al reiniciarse; al par legítimo le basta un pedido por intervalo.
+    static void request_resync(secure_peer_t *peer, uint32_t floor)
+    {
+        int64_t now = esp_timer_get_time();
+        if (now < peer->resync_at_us) {return;}
+        peer->resync_at_us = now + RESYNC_INTERVAL_US;
+        espnow_secure_send(peer->mac, ESPNOW_MSG_KEY_RESYNC, &floor, sizeof(floor));
+    }
+
+    // HMAC-SHA256 truncada. Se arma con dos pasadas de SHA-256 en la pila porque mbedtls_md
+    // reserva sus contextos en el heap y este puede estar sellado (static_alloc).
+    static void compute_tag(const uint8_t *lmk, const uint8_t *data, size_t len, uint8_t *tag)
+    {
+        uint8_t pad[SHA256_BLOCK_LEN];
+        uint8_t digest[SHA256_LEN];
+        mbedtls_sha256_context ctx;
+        for (uint8_t pass = 0; pass < 2; pass++) {
+            memset(pad, pass == 0 ? 0x36 : 0x5c, sizeof(pad));
+            for (uint8_t i = 0; i < ESP_NOW_KEY_LEN; i++) {pad[i] ^= lmk[i];}
+            mbedtls_sha256_init(&ctx);
+            mbedtls_sha256_starts(&ctx, 0);
+            mbedtls_sha256_update(&ctx, pad, sizeof(pad));
+            if (pass == 0) {mbedtls_sha256_update(&ctx, data, len);}
+            else {mbedtls_sha256_update(&ctx, digest, sizeof(digest));}
+            mbedtls_sha256_finish(&ctx, digest);
+            mbedtls_sha256_free(&ctx);
+        }
+        memcpy(tag, digest, TAG_LEN);
+    }
+
+    static secure_peer_t *find_peer(const uint8_t *mac)
+    {
+        for (uint8_t i = 0; i < CONFIG_ESPNOW_SECURE_MAX_PEERS; i++) {
+            if (peers[i].valid && memcmp(peers[i].mac, mac, ESP_NOW_ETH_ALEN) == 0) {return &peers[i];}
+        }
+        return NULL;
+    }
+    #else
+    esp_err_t espnow_secure_init(void)
+    {
+        return ESP_OK;
+    }
+
+    esp_err_t espnow_secure_add_peer(const uint8_t *mac, uint8_t channel)
+    {
+        ESP_LOGW(TAG, "ESPNOW_SECURE_ENABLE is off");
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    esp_err_t espnow_secure_send(const uint8_t *mac, uint8_t type, const void *payload, size_t len)
+    {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    esp_err_t espnow_secure_send_all(uint8_t type, const void *payload, size_t len)
+    {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    bool espnow_secure_verify(const esp_now_recv_info_t *esp_now_info, const espnow_group_hdr_t *hdr,
+                              const uint8_t *payload, size_t *len)
+    {
+        return true;
+    }
+
+    bool espnow_secure_handle(const esp_now_recv_info_t *esp_now_info, const espnow_group_hdr_t *hdr,
+                              const uint8_t *payload, size_t len)
+    {
+        return false;
+    }
+
+    void espnow_secure_send_status(const uint8_t *mac, esp_now_send_status_t status)
+    {
+    }
+
+    esp_err_t espnow_secure_rotate(void)
+    {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    esp_err_t espnow_secure_start_rotation(void)
+    {
+        return ESP_OK;
+    }
+    #endif
@@ -0,0 +1,75 @@
+/************************************************************************************************
+ * Módulo: Comandos cifrados sobre ESP-NOW.
+ *
+ * Descripción: Los comandos y tramas de actuación viajan en unicast hacia pares registrados
+ * con clave local (LMK), cifrados por el motor CCMP de la radio y firmados con una etiqueta
+ * HMAC y un contador que el receptor verifica, porque recv_cb no indica si la trama llegó
+ * cifrada. La PMK, la LMK de cada par y la última generación de contador aceptada de cada par
+ * se guardan en NVS, así que un reinicio no habilita repeticiones. La pasarela rota
+ * periódicamente la LMK de cada par: la nueva clave viaja cifrada con la vigente, el nodo
+ * confirma su recepción y ambos extremos la activan al vencer un plazo; si quedan desfasados,
+ * la pasarela sondea al par con las claves candidatas hasta encontrar la suya. La telemetría
+ * continúa en broadcast sin cifrar (ESP-NOW no cifra broadcast), por lo que ambos tráficos
+ * conviven y solo los destinatarios de comandos ocupan pares cifrados.
+ *
+ * Autor:
+ *   - Victor Manuel Patiño Delgado.
+ *
+ * Licencia: THE BEER-WARE LICENSE.
+ * As long as you retain this notice you can do whatever you want with this stuff.
+ * If we meet some day, and you think this stuff is worth it, you can buy me a beer in return.
+************************************************************************************************/
+#pragma once
+
+//***   Bibliotecas y declaraciones de preprocesador    ***//
+    #include <stdint.h>
+    #include <stdbool.h>
+    #include <stddef.h>
+    #include "esp_err.h"
+    #include "esp_now.h"
+    #include "espnow_group.h"
+    #include "sdkconfig.h"
+
+    #ifdef __cplusplus
+    extern "C" {
+    #endif
+
+//***   Declaraciones de funciones (prototipos) ***//
+    // Después de esp_now_init y nvs_flash_init: fija la PMK y, en los nodos, registra la
+    // pasarela configurada como par cifrado.
+    esp_err_t espnow_secure_init(void);
+
+    // Registra (o convierte) un par como cifrado con su LMK de NVS.
+    esp_err_t espnow_secure_add_peer(const uint8_t *mac, uint8_t channel);
+
+    // Unicast cifrado con cabecera de grupo; falla si el destino no es un par cifrado.
+    esp_err_t espnow_secure_send(const uint8_t *mac, uint8_t type, const void *payload, size_t len);
+
+    // espnow_secure_send a cada par cifrado; el primer error, o ESP_ERR_ESPNOW_NOT_FOUND sin pares.
+    esp_err_t espnow_secure_send_all(uint8_t type, const void *payload, size_t len);
+
+    // Verdadero si la trama llegó en unicast desde un par cifrado con etiqueta válida y contador
+    // nuevo; descuenta el anexo de autenticación de len. Ante un contador viejo le pide al par
+    // KEY_RESYNC. Con la opción deshabilitada acepta todo.
+    bool espnow_secure_verify(const esp_now_recv_info_t *esp_now_info, const espnow_group_hdr_t *hdr,
+                              const uint8_t *payload, size_t *len);
+
+    // Invocar desde recv_cb en nodos y pasarela; atiende la rotación, el sondeo de claves y
+    // KEY_RESYNC, y devuelve true si consumió la trama.
+    bool espnow_secure_handle(const esp_now_recv_info_t *esp_now_info, const espnow_group_hdr_t *hdr,
+                              const uint8_t *payload, size_t len);
+
+    // Invocar desde send_cb: la pasarela reintenta de inmediato si la radio no entregó.
+    void espnow_secure_send_status(const uint8_t *mac, esp_now_send_status_t status);
+
+    // Pasarela: nueva LMK aleatoria para cada par verificado; bloquea hasta activarla
+    // (SWITCH_MS) y sondear qué clave usa cada par.
+    esp_err_t espnow_secure_rotate(void);
+
+    // Pasarela: tarea de fondo que sondea los pares sin clave verificada y rota cada
+    // ESPNOW_SECURE_ROTATE_PERIOD_S.
+    esp_err_t espnow_secure_start_rotation(void);
+
+    #ifdef __cplusplus
+    }
+    #endif
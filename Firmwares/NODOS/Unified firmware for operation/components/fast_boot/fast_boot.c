@@ -0,0 +1,180 @@
+/************************************************************************************************
+ * Módulo: Arranque rápido hasta la primera trama ESP-NOW.
+ *
+ * Descripción: ESP-NOW solo necesita el controlador Wi-Fi iniciado: esp_netif y el bucle de
+ * eventos por defecto se crean después de la primera trama, y la configuración Wi-Fi vive en
+ * RAM (nvs_enable = 0). NVS se inicia igualmente porque guarda la calibración PHY, lo que
+ * evita una calibración completa en cada arranque. La tabla de pares en RTC lleva un número
+ * mágico: tras un arranque en frío se descarta y se reconstruye desde la configuración. Vive en
+ * RTC_NOINIT para sobrevivir también a un pánico o watchdog, que reanudan como un despertar.
+ *
+ * Autor:
+ *   - Victor Manuel Patiño Delgado.
+ *
+ * Licencia: THE BEER-WARE LICENSE.
+ * As long as you retain this notice you can do whatever you want with this stuff.
+ * If we meet some day, and you think this stuff is worth it, you can buy me a beer in return.
+************************************************************************************************/
+
+//***   Bibliotecas y declaraciones de preprocesador    ***//
+    #include <string.h>
+    #include "esp_attr.h"
+    #include "esp_now.h"
+    #include "esp_wifi.h"
+    #include "esp_netif.h"
+    #include "esp_event.h"
+    #include "esp_sleep.h"
+    #include "esp_system.h"
+    #include "esp_timer.h"
+    #include "esp_log.h"
+    #include "esp_check.h"
+    #include "nvs_flash.h"
+    #include "fast_boot.h"
+
+//***   Definición de constantes y macros   ***//
+    #define RTC_PEERS_MAGIC 0x50454552  // "PEER"
+
+    #if CONFIG_FAST_BOOT_ENABLE
+        #define BOOT_PATH "fast"
+    #else
+        #define BOOT_PATH "full"
+    #endif
+
+    static const char *TAG = "fast_boot";
+
+//***   Estructuras de datos y tipos personalizados ***//
+    #if CONFIG_FAST_BOOT_ENABLE
+    typedef struct {
+        uint32_t magic;
+        uint8_t count;
+        struct {
+            uint8_t mac[ESP_NOW_ETH_ALEN];
+            uint8_t channel;
+        } peers[CONFIG_FAST_BOOT_MAX_PEERS];
+    } rtc_peers_t;
+
+    static RTC_NOINIT_ATTR rtc_peers_t rtc_peers;
+    #endif
+
+    static bool first_tx_logged;
+
+//***   Declaraciones de funciones (prototipos) ***//
+    #if CONFIG_FAST_BOOT_ENABLE
+    static bool rtc_retained(void);
+    #endif
+
+//***Implementación de funciones***//
+    esp_err_t fast_boot_wifi_init(uint8_t channel)
+    {
+        esp_err_t err = nvs_flash_init();
+        if (err == ESP_ERR_NVS_NO_FREE_PAGES || err == ESP_ERR_NVS_NEW_VERSION_FOUND) {
+            nvs_flash_erase();
+            err = nvs_flash_init();
+        }
+        if (err != ESP_OK) {return err;}
+
+        wifi_init_config_t wifi_init_config = WIFI_INIT_CONFIG_DEFAULT();
+        wifi_init_config.nvs_enable = 0;
+        ESP_RETURN_ON_ERROR(esp_wifi_init(&wifi_init_config), TAG, "esp_wifi_init");
+        ESP_RETURN_ON_ERROR(esp_wifi_set_storage(WIFI_STORAGE_RAM), TAG, "esp_wifi_set_storage");
+        ESP_RETURN_ON_ERROR(esp_wifi_set_mode(WIFI_MODE_STA), TAG, "esp_wifi_set_mode");
+        ESP_RETURN_ON_ERROR(esp_wifi_start(), TAG, "esp_wifi_start");
+        return esp_wifi_set_channel(channel, WIFI_SECOND_CHAN_NONE);
+    }
+
+    esp_err_t fast_boot_deferred_init(void)
+    {
+    #if CONFIG_FAST_BOOT_ENABLE
+        esp_netif_init();
+        esp_err_t err = esp_event_loop_create_default();
+        return err == ESP_ERR_INVALID_STATE ? ESP_OK : err;
+    #else
+        return ESP_OK;
+    #endif
+    }
+
+    esp_err_t fast_boot_add_peer(const uint8_t *mac, uint8_t channel)
+    {
+        esp_now_peer_info_t esp_now_peer_info = {};
+        memcpy(esp_now_peer_info.peer_addr, mac, ESP_NOW_ETH_ALEN);
+        esp_now_peer_info.channel = channel;
+        esp_now_peer_info.ifidx = ESP_IF_WIFI_STA;
+        esp_err_t err = esp_now_add_peer(&esp_now_peer_info);
+    #if CONFIG_FAST_BOOT_ENABLE
+        if (rtc_peers.magic != RTC_PEERS_MAGIC) {
+            memset(&rtc_peers, 0, sizeof(rtc_peers));
+            rtc_peers.magic = RTC_PEERS_MAGIC;
+        }
+        bool known = false;
+        for (uint8_t i = 0; i < rtc_peers.count && !known; i++) {
+            known = memcmp(rtc_peers.peers[i].mac, mac, ESP_NOW_ETH_ALEN) == 0;
+        }
+        if (err == ESP_OK && !known && rtc_peers.count < CONFIG_FAST_BOOT_MAX_PEERS) {
+            memcpy(rtc_peers.peers[rtc_peers.count].mac, mac, ESP_NOW_ETH_ALEN);
+            rtc_peers.peers[rtc_peers.count].channel = channel;
+            rtc_peers.count++;
+        }
+    #endif
+        return err;
+    }
+
+    uint8_t fast_boot_restore_peers(void)
+    {
+    #if CONFIG_FAST_BOOT_ENABLE
+        if (!rtc_retained() || rtc_peers.magic != RTC_PEERS_MAGIC ||
+            rtc_peers.count > CONFIG_FAST_BOOT_MAX_PEERS) {
+            rtc_peers.magic = 0;
+            return 0;
+        }
+        uint8_t restored = 0;
+        for (uint8_t i = 0; i < rtc_peers.count; i++) {
+            esp_now_peer_info_t esp_now_peer_info = {};
+            memcpy(esp_now_peer_info.peer_addr, rtc_peers.peers[i].mac, ESP_NOW_ETH_ALEN);
+            esp_now_peer_info.channel = rtc_peers.peers[i].channel;
+            esp_now_peer_info.ifidx = ESP_IF_WIFI_STA;
+            if (esp_now_add_peer(&esp_now_peer_info) == ESP_OK) {restored++;}
+        }
+        return restored;
+    #else
+        return 0;
+    #endif
+    }
+
+    bool fast_boot_woken_by_gpio(void)
+    {
+        switch (esp_sleep_get_wakeup_cause()) {
+            case ESP_SLEEP_WAKEUP_EXT0:
+            case ESP_SLEEP_WAKEUP_EXT1:
+            case ESP_SLEEP_WAKEUP_GPIO:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    void fast_boot_tx_done(void)
+    {
+        if (first_tx_logged) {return;}
+        first_tx_logged = true;
+        ESP_LOGI(TAG, "boot-to-first-TX %lld us (%s path, reset reason %d, wake cause %d)",
+                 (long long)esp_timer_get_time(), BOOT_PATH,
+                 esp_reset_reason(), esp_sleep_get_wakeup_cause());
+    }
+
+    #if CONFIG_FAST_BOOT_ENABLE
+    // Reinicios tras los que la RAM RTC conserva lo escrito por el arranque anterior.
+    static bool rtc_retained(void)
+    {
+        switch (esp_reset_reason()) {
+            case ESP_RST_DEEPSLEEP:
+            case ESP_RST_SW:
+            case ESP_RST_PANIC:
+            case ESP_RST_INT_WDT:
+            case ESP_RST_TASK_WDT:
+            case ESP_RST_WDT:
+                return true;
+            default:
+                return false;
+        }
+    }
+    #endif
@@ -0,0 +1,51 @@
+/************************************************************************************************
+ * Módulo: Arranque rápido hasta la primera trama ESP-NOW.
+ *
+ * Descripción: Inicialización mínima de la radio para que una alerta (despertar por PIR) salga
+ * al aire lo antes posible, tabla de pares retenida en memoria RTC entre ciclos de sueño
+ * profundo y medición del tiempo arranque-primera transmisión. La medición se hace también con
+ * el arranque normal para comparar ambos caminos en el mismo hardware.
+ *
+ * Autor:
+ *   - Victor Manuel Patiño Delgado.
+ *
+ * Licencia: THE BEER-WARE LICENSE.
+ * As long as you retain this notice you can do whatever you want with this stuff.
+ * If we meet some day, and you think this stuff is worth it, you can buy me a beer in return.
+************************************************************************************************/
+#pragma once
+
+//***   Bibliotecas y declaraciones de preprocesador    ***//
+    #include <stdint.h>
+    #include <stdbool.h>
+    #include "esp_err.h"
+    #include "sdkconfig.h"
+
+    #ifdef __cplusplus
+    extern "C" {
+    #endif
+
+//***   Declaraciones de funciones (prototipos) ***//
+    // Wi-Fi en modo estación, almacenamiento en RAM y canal fijo, sin esp_netif ni eventos.
+    esp_err_t fast_boot_wifi_init(uint8_t channel);
+
+    // Trabajo omitido por fast_boot_wifi_init; llamar después de la primera trama.
+    esp_err_t fast_boot_deferred_init(void);
+
+    // esp_now_add_peer y copia en la tabla RTC.
+    esp_err_t fast_boot_add_peer(const uint8_t *mac, uint8_t channel);
+
+    // Tras un despertar de sueño profundo o un reinicio en caliente (software, pánico,
+    // watchdog) vuelve a registrar los pares de la tabla RTC.
+    // Retorna cuántos se restauraron (0: registrar desde la configuración).
+    uint8_t fast_boot_restore_peers(void);
+
+    // Verdadero si el arranque es un despertar por GPIO (PIR/radar).
+    bool fast_boot_woken_by_gpio(void);
+
+    // Llamar desde el callback de envío: la primera vez registra el tiempo arranque-TX.
+    void fast_boot_tx_done(void);
+
+    #ifdef __cplusplus
+    }
+    #endif
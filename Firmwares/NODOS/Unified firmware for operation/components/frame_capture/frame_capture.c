@@ -0,0 +1,206 @@
+/************************************************************************************************
+ * Módulo: Captura de las tramas ESP-NOW recibidas para reproducción en el host.
+ *
+ * Descripción: Anillo sin partición entre recv_cb y la tarea de vaciado, de clase BACKGROUND.
+ * En la partición "capture" los registros se escriben uno tras otro detrás de una cabecera y
+ * cada sector se borra recién al alcanzarlo, así arrancar la captura no detiene la radio
+ * borrando la partición completa; al llenarse la captura se detiene. Los registros que no
+ * entran en el anillo se cuentan en METRIC_CAPTURE_DROPPED: la captura pierde tramas antes
+ * que demorar la recepción.
+ *
+ * Autor:
+ *   - Victor Manuel Patiño Delgado.
+ *
+ * Licencia: THE BEER-WARE LICENSE.
+ * As long as you retain this notice you can do whatever you want with this stuff.
+ * If we meet some day, and you think this stuff is worth it, you can buy me a beer in return.
+************************************************************************************************/
+
+//***   Bibliotecas y declaraciones de preprocesador    ***//
+    #include <stdio.h>
+    #include <string.h>
+    #include "freertos/FreeRTOS.h"
+    #include "freertos/task.h"
+    #include "freertos/ringbuf.h"
+    #include "esp_timer.h"
+    #include "esp_mac.h"
+    #include "esp_log.h"
+    #include "esp_partition.h"
+    #include "sdkconfig.h"
+    #include "frame_capture.h"
+    #include "metrics.h"
+    #include "task_layout.h"
+
+//***   Definición de constantes y macros   ***//
+    #define CAPTURE_MAGIC 0x54504143    // "CAPT"
+    #define CAPTURE_VERSION 1
+    #define CAPTURE_PARTITION_LABEL "capture"
+    #define RING_SIZE(bytes) (((bytes) + 3) & ~3)
+
+    #if CONFIG_FRAME_CAPTURE_ENABLE
+    static const char *TAG = "frame_capture";
+    #endif
+
+//***   Estructuras de datos y tipos personalizados ***//
+    #if CONFIG_FRAME_CAPTURE_ENABLE
+    typedef struct __attribute__((packed)) {
+        uint32_t magic;
+        uint8_t version;
+        uint8_t record_size;
+        uint16_t reserved;
+    } flash_header_t;
+
+    static uint8_t ring_storage[RING_SIZE(CONFIG_FRAME_CAPTURE_RING_BYTES)] __attribute__((aligned(4)));
+    static StaticRingbuffer_t ring_buffer;
+    static RingbufHandle_t ring;
+    static volatile bool capturing;
+    static frame_capture_sink_t app_sink;
+    static uint32_t captured;
+
+    #if CONFIG_FRAME_CAPTURE_FLASH
+    static const esp_partition_t *partition;
+    static size_t write_offset;
+    static size_t erased_end;
+    #endif
+    #endif
+
+//***   Declaraciones de funciones (prototipos) ***//
+    #if CONFIG_FRAME_CAPTURE_ENABLE
+    static void drain_task(void *pvParameters);
+    #if CONFIG_FRAME_CAPTURE_FLASH
+    static esp_err_t open_partition(void);
+    static bool write_flash(const void *data, size_t len);
+    #else
+    static void write_uart(const frame_capture_record_t *record, const uint8_t *frame);
+    #endif
+    #endif
+
+//***Implementación de funciones***//
+    #if CONFIG_FRAME_CAPTURE_ENABLE
+    esp_err_t frame_capture_start(frame_capture_sink_t sink)
+    {
+        if (ring != NULL) {return ESP_ERR_INVALID_STATE;}
+        app_sink = sink;
+    #if CONFIG_FRAME_CAPTURE_UPLINK
+        if (app_sink == NULL) {ESP_LOGW(TAG, "No sink given, capturing to UART");}
+    #endif
+    #if CONFIG_FRAME_CAPTURE_FLASH
+        esp_err_t err = open_partition();
+        if (err != ESP_OK) {return err;}
+    #endif
+        ring = xRingbufferCreateStatic(sizeof(ring_storage), RINGBUF_TYPE_NOSPLIT, ring_storage, &ring_buffer);
+        if (ring == NULL) {return ESP_ERR_NO_MEM;}
+        capturing = true;
+        ESP_LOGI(TAG, "Capturing received frames (%d byte ring)", CONFIG_FRAME_CAPTURE_RING_BYTES);
+        return TASK_LAYOUT_CREATE(drain_task, "capture_drain", 3072, NULL, TASK_CLASS_BACKGROUND, NULL);
+    }
+
+    void frame_capture_stop(void)
+    {
+        if (!capturing) {return;}
+        capturing = false;
+        ESP_LOGI(TAG, "Capture stopped after %lu frames", (unsigned long)captured);
+    }
+
+    void frame_capture_record(const esp_now_recv_info_t *esp_now_info, const uint8_t *data, int data_len)
+    {
+        if (!capturing || data_len <= 0 || data_len > ESP_NOW_MAX_DATA_LEN) {return;}
+
+        void *slot = NULL;
+        if (xRingbufferSendAcquire(ring, &slot, sizeof(frame_capture_record_t) + data_len, 0) != pdTRUE) {
+            metrics_inc(METRIC_CAPTURE_DROPPED);
+            return;
+        }
+        frame_capture_record_t *record = (frame_capture_record_t *)slot;
+        record->time_us = esp_timer_get_time();
+        memcpy(record->src, esp_now_info->src_addr, FRAME_CAPTURE_MAC_LEN);
+        record->rssi = esp_now_info->rx_ctrl != NULL ? esp_now_info->rx_ctrl->rssi : 0;
+        record->len = (uint8_t)data_len;
+        memcpy(record + 1, data, data_len);
+        xRingbufferSendComplete(ring, slot);
+    }
+
+    static void drain_task(void *pvParameters)
+    {
+        const TickType_t wait = CONFIG_FRAME_CAPTURE_STOP_AFTER_MS > 0 ? pdMS_TO_TICKS(100) : portMAX_DELAY;
+        const int64_t stop_us = esp_timer_get_time() + (int64_t)CONFIG_FRAME_CAPTURE_STOP_AFTER_MS * 1000;
+        while (1) {
+            size_t size = 0;
+            const frame_capture_record_t *record = xRingbufferReceive(ring, &size, wait);
+            if (CONFIG_FRAME_CAPTURE_STOP_AFTER_MS > 0 && capturing && esp_timer_get_time() >= stop_us) {
+                frame_capture_stop();
+            }
+            if (record == NULL) {continue;}
+
+        #if CONFIG_FRAME_CAPTURE_FLASH
+            if (!write_flash(record, size) && capturing) {
+                ESP_LOGW(TAG, "\"%s\" partition full", CAPTURE_PARTITION_LABEL);
+                frame_capture_stop();
+            }
+        #else
+            const uint8_t *frame = (const uint8_t *)(record + 1);
+            if (app_sink != NULL) {app_sink(record, frame);}
+            else {write_uart(record, frame);}
+        #endif
+            vRingbufferReturnItem(ring, (void *)record);
+            captured++;
+        }
+    }
+
+    #if !CONFIG_FRAME_CAPTURE_FLASH
+    static void write_uart(const frame_capture_record_t *record, const uint8_t *frame)
+    {
+        char line[48 + 2 * ESP_NOW_MAX_DATA_LEN];
+        int len = snprintf(line, sizeof(line), "#CAP %lld " MACSTR " %d ", (long long)record->time_us,
+                           MAC2STR(record->src), record->rssi);
+        for (uint8_t i = 0; i < record->len; i++) {len += snprintf(line + len, sizeof(line) - len, "%02x", frame[i]);}
+        printf("%s\n", line);
+    }
+    #endif
+
+    #if CONFIG_FRAME_CAPTURE_FLASH
+    static esp_err_t open_partition(void)
+    {
+        partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, CAPTURE_PARTITION_LABEL);
+        if (partition == NULL) {
+            ESP_LOGE(TAG, "No \"%s\" partition", CAPTURE_PARTITION_LABEL);
+            return ESP_ERR_NOT_FOUND;
+        }
+        write_offset = 0;
+        erased_end = 0;
+        flash_header_t header = {
+            .magic = CAPTURE_MAGIC,
+            .version = CAPTURE_VERSION,
+            .record_size = sizeof(frame_capture_record_t),
+        };
+        return write_flash(&header, sizeof(header)) ? ESP_OK : ESP_ERR_INVALID_SIZE;
+    }
+
+    // Agrega data al final de la captura; false si no entra.
+    static bool write_flash(const void *data, size_t len)
+    {
+        if (write_offset + len > partition->size) {return false;}
+        while (erased_end < write_offset + len) {
+            if (esp_partition_erase_range(partition, erased_end, partition->erase_size) != ESP_OK) {return false;}
+            erased_end += partition->erase_size;
+        }
+        if (esp_partition_write(partition, write_offset, data, len) != ESP_OK) {return false;}
+        write_offset += len;
+        return true;
+    }
+    #endif
+    #else
+    esp_err_t frame_capture_start(frame_capture_sink_t sink)
+    {
+        ESP_LOGW("frame_capture", "FRAME_CAPTURE_ENABLE is off");
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    void frame_capture_stop(void)
+    {
+    }
+
+    void frame_capture_record(const esp_now_recv_info_t *esp_now_info, const uint8_t *data, int data_len)
+    {
+    }
+    #endif
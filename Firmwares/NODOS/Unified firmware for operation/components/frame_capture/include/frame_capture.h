@@ -0,0 +1,58 @@
+/************************************************************************************************
+ * Módulo: Captura de las tramas ESP-NOW recibidas para reproducción en el host.
+ *
+ * Descripción: recv_cb solo reserva un hueco en un anillo estático y copia la trama tal como
+ * llegó, antes de cualquier decodificación, con la marca de tiempo en µs, la MAC de origen y
+ * el RSSI; una tarea de fondo la vacía hacia la consola (líneas "#CAP"), la partición
+ * "capture" o una función de la aplicación. tools/capture_replay.py lleva cualquiera de los
+ * tres formatos al que reproduce el proyecto Replay.
+ *
+ * Autor:
+ *   - Victor Manuel Patiño Delgado.
+ *
+ * Licencia: THE BEER-WARE LICENSE.
+ * As long as you retain this notice you can do whatever you want with this stuff.
+ * If we meet some day, and you think this stuff is worth it, you can buy me a beer in return.
+************************************************************************************************/
+#pragma once
+
+//***   Bibliotecas y declaraciones de preprocesador    ***//
+    #include <stdint.h>
+    #include "esp_err.h"
+    #include "esp_now.h"
+    #include "sdkconfig.h"
+
+    #ifdef __cplusplus
+    extern "C" {
+    #endif
+
+//***   Definición de constantes y macros   ***//
+    #define FRAME_CAPTURE_MAC_LEN 6
+
+//***   Estructuras de datos y tipos personalizados ***//
+    // Cabecera de cada registro, seguida de len bytes de trama. Es también el formato de la
+    // partición; una marca de tiempo con todos los bits en 1 (flash borrada) cierra la captura.
+    typedef struct __attribute__((packed)) {
+        int64_t time_us;
+        uint8_t src[FRAME_CAPTURE_MAC_LEN];
+        int8_t rssi;
+        uint8_t len;
+    } frame_capture_record_t;
+
+    // Destino de la aplicación; se invoca desde la tarea de vaciado, nunca desde recv_cb.
+    typedef void (*frame_capture_sink_t)(const frame_capture_record_t *record, const uint8_t *frame);
+
+//***   Declaraciones de funciones (prototipos) ***//
+    // Crea el anillo y la tarea de vaciado y empieza a grabar. sink solo se usa con el destino
+    // "función de la aplicación"; NULL vuelca a la consola.
+    esp_err_t frame_capture_start(frame_capture_sink_t sink);
+
+    // Deja de grabar; lo que queda en el anillo se sigue vaciando.
+    void frame_capture_stop(void);
+
+    // Desde recv_cb, antes de decodificar. Sin bloqueo: si el anillo está lleno se descarta.
+    void frame_capture_record(const esp_now_recv_info_t *esp_now_info, const uint8_t *data, int data_len);
+
+    #ifdef __cplusplus
+    }
+    #endif
@@ -0,0 +1,48 @@
+/************************************************************************************************
+ * Módulo: Calidad de enlace por par y selección adaptativa de la tasa PHY de ESP-NOW.
+ *
+ * Descripción: recv_cb alimenta el RSSI de cada par (rx_ctrl) y send_cb la entrega de los
+ * envíos unicast (los broadcast no tienen ACK; en un nodo la medida sale del enlace ascendente,
+ * que espnow_group manda en unicast si ESPNOW_GROUP_GATEWAY_MAC está configurada). Una tarea de fondo elige periódicamente la
+ * tasa más rápida cuya sensibilidad, más un margen, cubre al par activo más débil, y la baja
+ * un peldaño por cada ventana en que la entrega a un par cae por debajo del objetivo. El
+ * tráfico de grupo es broadcast y debe decodificarlo el receptor más lejano, por eso la tasa
+ * es una sola para el nodo. Tasa vigente, cambios y peor RSSI viajan en las métricas. Con
+ * el perfil de largo alcance la interfaz STA suma WIFI_PROTOCOL_LR y, en modo automático, la
+ * escalera baja a 500 y 250 kbit/s cuando ni 1 Mbit/s logra la entrega objetivo.
+ *
+ * Autor:
+ *   - Victor Manuel Patiño Delgado.
+ *
+ * Licencia: THE BEER-WARE LICENSE.
+ * As long as you retain this notice you can do whatever you want with this stuff.
+ * If we meet some day, and you think this stuff is worth it, you can buy me a beer in return.
+************************************************************************************************/
+#pragma once
+
+//***   Bibliotecas y declaraciones de preprocesador    ***//
+    #include <stdint.h>
+    #include "esp_err.h"
+    #include "esp_now.h"
+    #include "sdkconfig.h"
+
+    #ifdef __cplusplus
+    extern "C" {
+    #endif
+
+//***   Declaraciones de funciones (prototipos) ***//
+    // Desde init_wifi(), después de esp_wifi_start(): agrega LR a la STA si el perfil lo pide.
+    esp_err_t link_quality_set_protocol(void);
+
+    // Arranca la evaluación periódica. Llamar después de esp_wifi_start() y esp_now_init().
+    esp_err_t link_quality_start(void);
+
+    // Desde recv_cb: actualiza el RSSI del emisor. Sin E/S, una búsqueda bajo un spinlock.
+    void link_quality_on_recv(const esp_now_recv_info_t *esp_now_info);
+
+    // Desde send_cb: cuenta la entrega a un par unicast; los envíos broadcast se ignoran.
+    void link_quality_on_send(const uint8_t *mac_addr, esp_now_send_status_t status);
+
+    #ifdef __cplusplus
+    }
+    #endif
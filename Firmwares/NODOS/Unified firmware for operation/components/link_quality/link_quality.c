@@ -0,0 +1,284 @@
+/************************************************************************************************
+ * Módulo: Calidad de enlace por par y selección adaptativa de la tasa PHY de ESP-NOW.
+ *
+ * Descripción: La escalera de tasas usa la sensibilidad típica de la hoja de datos del ESP32;
+ * para cada par el techo es el peldaño más alto cuya sensibilidad más el margen queda por
+ * debajo de su RSSI promediado. Bajar es inmediato; subir exige además la histéresis y avanza
+ * un peldaño por evaluación, así un desvanecimiento breve no provoca oscilaciones. La
+ * penalización por entrega baja se retira de a un peldaño tras varias ventanas buenas.
+ * ESP-IDF 5.1 solo configura la tasa de ESP-NOW por interfaz (esp_wifi_config_espnow_rate).
+ * Los peldaños LR quedan debajo de BASE_RUNG: el RSSI nunca lleva a ellos, solo la entrega,
+ * porque cuadruplican el tiempo de aire aunque 1 Mbit/s todavía llegue. El RSSI solo dice que el
+ * par llega hasta aquí, no que decodifique lo que se le envía a la tasa alta: un par sin ventana
+ * de entrega reciente (solo recibe broadcast, sin ACK) queda limitado a UNMEASURED_MAX_KBPS.
+ *
+ * Autor:
+ *   - Victor Manuel Patiño Delgado.
+ *
+ * Licencia: THE BEER-WARE LICENSE.
+ * As long as you retain this notice you can do whatever you want with this stuff.
+ * If we meet some day, and you think this stuff is worth it, you can buy me a beer in return.
+************************************************************************************************/
+
+//***   Bibliotecas y declaraciones de preprocesador    ***//
+    #include <string.h>
+    #include "freertos/FreeRTOS.h"
+    #include "freertos/task.h"
+    #include "esp_wifi.h"
+    #include "esp_log.h"
+    #include "link_quality.h"
+    #include "metrics.h"
+    #include "task_layout.h"
+
+//***   Definición de constantes y macros   ***//
+    #define LADDER_LEN ((uint8_t)(sizeof(ladder) / sizeof(ladder[0])))
+    #define RSSI_SHIFT 4            // RSSI promediado en dieciseisavos de dB
+    #define EWMA_SHIFT 3            // Peso 1/8 a cada trama nueva
+    #define MIN_SENDS 4             // Envíos unicast mínimos para juzgar una ventana
+    #define RECOVER_WINDOWS 4       // Ventanas buenas para retirar un peldaño de penalización
+    #define RECOVER_MAX 64          // Tope de la espera tras pruebas fallidas
+    #if CONFIG_LINK_QUALITY_LR_AUTO
+        #define BASE_RUNG 2         // 1 Mbit/s; debajo, los peldaños LR
+    #else
+        #define BASE_RUNG 0
+    #endif
+
+    static const char *TAG = "link_quality";
+
+//***   Estructuras de datos y tipos personalizados ***//
+    #if CONFIG_LINK_QUALITY_ENABLE
+    typedef struct {
+        wifi_phy_rate_t rate;
+        uint16_t kbps;
+        int8_t sensitivity_dbm;
+    } rung_t;
+
+    static const rung_t ladder[] = {
+    #if CONFIG_LINK_QUALITY_LR_AUTO
+        {WIFI_PHY_RATE_LORA_250K, 250, -105},
+        {WIFI_PHY_RATE_LORA_500K, 500, -102},
+    #endif
+        {WIFI_PHY_RATE_1M_L, 1000, -98},
+        {WIFI_PHY_RATE_2M_L, 2000, -96},
+        {WIFI_PHY_RATE_5M_L, 5500, -93},
+        {WIFI_PHY_RATE_11M_L, 11000, -88},
+        {WIFI_PHY_RATE_24M, 24000, -86},
+        {WIFI_PHY_RATE_36M, 36000, -83},
+        {WIFI_PHY_RATE_48M, 48000, -79},
+        {WIFI_PHY_RATE_54M, 54000, -76},
+    };
+
+    typedef struct {
+        bool valid;
+        bool heard;                 // Hay RSSI de este par
+        uint8_t mac[ESP_NOW_ETH_ALEN];
+        int16_t rssi;               // Promedio, en 1/16 dB
+        TickType_t last_heard;
+        uint16_t sent;              // Envíos unicast de la ventana actual
+        uint16_t delivered;
+        uint8_t penalty;            // Peldaños restados por entrega baja
+        uint8_t good_windows;
+        uint8_t recover;            // Ventanas buenas exigidas para retirar un peldaño
+        bool probing;               // La última ventana retiró un peldaño
+        bool measured;              // Alguna ventana de entrega cerró con MIN_SENDS envíos
+        TickType_t last_measured;
+    } peer_t;
+
+    static portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+    static peer_t peers[CONFIG_LINK_QUALITY_MAX_PEERS];
+    static uint8_t peer_next;
+    static uint8_t current;
+    static uint8_t unmeasured_rung;     // Techo de los pares sin entrega medida
+    #endif
+
+//***   Declaraciones de funciones (prototipos) ***//
+    #if CONFIG_LINK_QUALITY_ENABLE
+    static peer_t *find_peer(const uint8_t *mac);
+    static uint8_t ceiling_for(int16_t rssi_dbm, int16_t margin_db);
+    static uint8_t evaluate(int16_t *worst_rssi);
+    static void apply(uint8_t rung);
+    static void eval_task(void *pvParameters);
+    #endif
+
+//***Implementación de funciones***//
+    #if CONFIG_LINK_QUALITY_ENABLE
+    esp_err_t link_quality_set_protocol(void)
+    {
+    #if CONFIG_LINK_QUALITY_LR_OFF
+        return ESP_OK;
+    #else
+        ESP_LOGI(TAG, "Wi-Fi LR enabled on STA (%s)", BASE_RUNG > 0 ? "auto" : "receive only");
+        return esp_wifi_set_protocol(WIFI_IF_STA, WIFI_PROTOCOL_11B | WIFI_PROTOCOL_11G | WIFI_PROTOCOL_11N | WIFI_PROTOCOL_LR);
+    #endif
+    }
+
+    esp_err_t link_quality_start(void)
+    {
+        unmeasured_rung = BASE_RUNG;
+        while (unmeasured_rung + 1 < LADDER_LEN && ladder[unmeasured_rung + 1].kbps <= CONFIG_LINK_QUALITY_UNMEASURED_MAX_KBPS) {
+            unmeasured_rung++;
+        }
+        apply(BASE_RUNG);
+        ESP_LOGI(TAG, "Adaptive ESP-NOW rate, margin %d dB, delivery target %d%%",
+                 CONFIG_LINK_QUALITY_MARGIN_DB, CONFIG_LINK_QUALITY_TARGET_DELIVERY_PCT);
+        return TASK_LAYOUT_CREATE(eval_task, "link_quality", 2560, NULL, TASK_CLASS_BACKGROUND, NULL);
+    }
+
+    void link_quality_on_recv(const esp_now_recv_info_t *esp_now_info)
+    {
+        if (esp_now_info->rx_ctrl == NULL) {return;}
+        int16_t rssi = (int16_t)esp_now_info->rx_ctrl->rssi << RSSI_SHIFT;
+        taskENTER_CRITICAL(&lock);
+        peer_t *peer = find_peer(esp_now_info->src_addr);
+        if (!peer->heard) {peer->rssi = rssi;}
+        else {peer->rssi += (rssi - peer->rssi) >> EWMA_SHIFT;}
+        peer->heard = true;
+        peer->last_heard = xTaskGetTickCount();
+        taskEXIT_CRITICAL(&lock);
+    }
+
+    void link_quality_on_send(const uint8_t *mac_addr, esp_now_send_status_t status)
+    {
+        // Broadcast (bit de grupo en el primer octeto): sin ACK, el estado siempre es éxito.
+        if (mac_addr[0] & 0x01) {return;}
+        taskENTER_CRITICAL(&lock);
+        peer_t *peer = find_peer(mac_addr);
+        peer->sent++;
+        if (status == ESP_NOW_SEND_SUCCESS) {peer->delivered++;}
+        taskEXIT_CRITICAL(&lock);
+    }
+
+    // Llamar con el candado tomado. Un par nuevo reemplaza al más antiguo de la tabla.
+    static peer_t *find_peer(const uint8_t *mac)
+    {
+        for (uint8_t i = 0; i < CONFIG_LINK_QUALITY_MAX_PEERS; i++) {
+            if (peers[i].valid && memcmp(peers[i].mac, mac, ESP_NOW_ETH_ALEN) == 0) {return &peers[i];}
+        }
+        peer_t *peer = &peers[peer_next];
+        peer_next = (peer_next + 1) % CONFIG_LINK_QUALITY_MAX_PEERS;
+        memset(peer, 0, sizeof(*peer));
+        peer->valid = true;
+        memcpy(peer->mac, mac, ESP_NOW_ETH_ALEN);
+        peer->recover = RECOVER_WINDOWS;
+        return peer;
+    }
+
+    static uint8_t ceiling_for(int16_t rssi_dbm, int16_t margin_db)
+    {
+        uint8_t rung = BASE_RUNG;
+        while (rung + 1 < LADDER_LEN && rssi_dbm >= ladder[rung + 1].sensitivity_dbm + margin_db) {rung++;}
+        return rung;
+    }
+
+    // Cierra la ventana de entrega de cada par y devuelve el peldaño a aplicar.
+    static uint8_t evaluate(int16_t *worst_rssi)
+    {
+        const TickType_t now = xTaskGetTickCount();
+        uint8_t down = LADDER_LEN - 1;
+        uint8_t up = LADDER_LEN - 1;
+        bool any = false;
+        *worst_rssi = 0;
+
+        taskENTER_CRITICAL(&lock);
+        for (uint8_t i = 0; i < CONFIG_LINK_QUALITY_MAX_PEERS; i++) {
+            peer_t *peer = &peers[i];
+            if (!peer->valid) {continue;}
+            bool sending = peer->sent > 0;
+            if (peer->sent >= MIN_SENDS) {
+                if (peer->delivered * 100 < peer->sent * CONFIG_LINK_QUALITY_TARGET_DELIVERY_PCT) {
+                    if (peer->penalty + 1 < LADDER_LEN) {peer->penalty++;}
+                    // Caer justo después de subir: la próxima prueba espera el doble.
+                    if (peer->probing && peer->recover < RECOVER_MAX) {peer->recover *= 2;}
+                    peer->probing = false;
+                    peer->good_windows = 0;
+                } else {
+                    if (peer->probing) {peer->recover = RECOVER_WINDOWS;}
+                    peer->probing = false;
+                    if (peer->penalty > 0 && ++peer->good_windows >= peer->recover) {
+                        peer->penalty--;
+                        peer->probing = true;
+                        peer->good_windows = 0;
+                    }
+                }
+                peer->sent = 0;
+                peer->delivered = 0;
+                peer->measured = true;
+                peer->last_measured = now;
+            }
+
+            bool listening = peer->heard && (now - peer->last_heard) < pdMS_TO_TICKS(CONFIG_LINK_QUALITY_PEER_TIMEOUT_MS);
+            if (!listening && !sending) {continue;}
+            any = true;
+
+            // Sin RSSI (solo se le envía) el techo lo fija la entrega; sin entrega medida, UNMEASURED.
+            uint8_t ceiling = LADDER_LEN - 1;
+            uint8_t ceiling_up = LADDER_LEN - 1;
+            if (listening) {
+                int16_t rssi_dbm = peer->rssi >> RSSI_SHIFT;
+                ceiling = ceiling_for(rssi_dbm, CONFIG_LINK_QUALITY_MARGIN_DB);
+                ceiling_up = ceiling_for(rssi_dbm, CONFIG_LINK_QUALITY_MARGIN_DB + CONFIG_LINK_QUALITY_HYSTERESIS_DB);
+                if (rssi_dbm < *worst_rssi) {*worst_rssi = rssi_dbm;}
+            }
+            bool measured = peer->measured && (now - peer->last_measured) < pdMS_TO_TICKS(CONFIG_LINK_QUALITY_PEER_TIMEOUT_MS);
+            if (!measured && ceiling > unmeasured_rung) {ceiling = unmeasured_rung;}
+            if (!measured && ceiling_up > unmeasured_rung) {ceiling_up = unmeasured_rung;}
+            uint8_t rung = ceiling > peer->penalty ? ceiling - peer->penalty : 0;
+            uint8_t rung_up = ceiling_up > peer->penalty ? ceiling_up - peer->penalty : 0;
+            if (rung < down) {down = rung;}
+            if (rung_up < up) {up = rung_up;}
+        }
+        taskEXIT_CRITICAL(&lock);
+
+        // Sin pares activos no hay con qué medir: tasa base.
+        if (!any) {return BASE_RUNG;}
+        if (down < current) {return down;}
+        if (up > current) {return current + 1;}
+        return current;
+    }
+
+    static void apply(uint8_t rung)
+    {
+        esp_err_t err = esp_wifi_config_espnow_rate(WIFI_IF_STA, ladder[rung].rate);
+        if (err != ESP_OK) {
+            ESP_LOGW(TAG, "esp_wifi_config_espnow_rate: %s", esp_err_to_name(err));
+            return;
+        }
+        current = rung;
+        metrics_set(METRIC_PHY_RATE_KBPS, ladder[rung].kbps);
+    }
+
+    static void eval_task(void *pvParameters)
+    {
+        while (1) {
+            vTaskDelay(pdMS_TO_TICKS(CONFIG_LINK_QUALITY_EVAL_MS));
+            int16_t worst_rssi;
+            uint8_t rung = evaluate(&worst_rssi);
+            metrics_set(METRIC_LINK_RSSI_WORST, (uint32_t)-worst_rssi);
+            if (rung == current) {continue;}
+            uint16_t previous_kbps = ladder[current].kbps;
+            apply(rung);
+            if (current != rung) {continue;}
+            metrics_inc(METRIC_RATE_CHANGES);
+            ESP_LOGI(TAG, "ESP-NOW rate %u -> %u kbps (worst RSSI %d dBm)", previous_kbps, ladder[rung].kbps, worst_rssi);
+        }
+    }
+    #else
+    esp_err_t link_quality_set_protocol(void)
+    {
+        return ESP_OK;
+    }
+
+    esp_err_t link_quality_start(void)
+    {
+        ESP_LOGW(TAG, "LINK_QUALITY_ENABLE is off");
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    void link_quality_on_recv(const esp_now_recv_info_t *esp_now_info)
+    {
+    }
+
+    void link_quality_on_send(const uint8_t *mac_addr, esp_now_send_status_t status)
+    {
+    }
+    #endif
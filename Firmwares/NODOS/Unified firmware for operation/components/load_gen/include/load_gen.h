@@ -0,0 +1,67 @@
+/************************************************************************************************
+ * Módulo: Generador de tráfico sintético para pruebas de capacidad de la pasarela.
+ *
+ * Descripción: Un nodo con la imagen de la pasarela y CONFIG_LOAD_GEN_ENABLE emula N nodos de
+ * temperatura. ESP-NOW no permite cambiar la MAC de origen por trama, así que cada trama lleva
+ * al final el id del nodo virtual (ESPNOW_GROUP_FLAG_VNODE) y la pasarela, con
+ * CONFIG_LOAD_GEN_GATEWAY, la atribuye a una MAC virtual derivada de la del generador. Las
+ * sondas ESPNOW_MSG_LOAD_PROBE recorren el mismo camino que la telemetría y la pasarela las
+ * devuelve como ESPNOW_MSG_LOAD_ECHO: el generador mide la ida y vuelta y, con la pasarela en
+ * unicast, la latencia hasta el ACK de cada trama.
+ *
+ * Autor:
+ *   - Victor Manuel Patiño Delgado.
+ *
+ * Licencia: THE BEER-WARE LICENSE.
+ * As long as you retain this notice you can do whatever you want with this stuff.
+ * If we meet some day, and you think this stuff is worth it, you can buy me a beer in return.
+************************************************************************************************/
+#pragma once
+
+//***   Bibliotecas y declaraciones de preprocesador    ***//
+    #include <stdint.h>
+    #include <stdbool.h>
+    #include <stddef.h>
+    #include "esp_err.h"
+    #include "esp_now.h"
+    #include "espnow_group.h"
+    #include "sdkconfig.h"
+
+    #ifdef __cplusplus
+    extern "C" {
+    #endif
+
+//***   Definición de constantes y macros   ***//
+    #define LOAD_GEN_MAC_LEN 6
+
+//***   Estructuras de datos y tipos personalizados ***//
+    typedef struct __attribute__((packed)) {
+        uint32_t probe_id;
+        uint32_t sent_us;       // Reloj del generador; la pasarela lo devuelve sin interpretarlo
+    } load_gen_probe_t;
+
+    typedef struct __attribute__((packed)) {
+        uint8_t requester[LOAD_GEN_MAC_LEN];
+        load_gen_probe_t probe;
+    } load_gen_echo_t;
+
+//***   Declaraciones de funciones (prototipos) ***//
+    // Generador: tras esp_now_init y espnow_group_init, lanza la tarea de envío e informes.
+    esp_err_t load_gen_start(void);
+
+    // Desde recv_cb, después de metrics_strip. Si la trama trae id de nodo virtual lo quita de
+    // payload_len, escribe la MAC virtual en virtual_src y devuelve true (solo en la pasarela).
+    bool load_gen_virtual_source(const espnow_group_hdr_t *hdr, const uint8_t *src, const uint8_t *payload,
+                                 size_t *payload_len, uint8_t *virtual_src);
+
+    // Desde recv_cb: la pasarela responde las sondas y el generador consume los ecos. true si
+    // la trama era del generador y no debe seguir procesándose.
+    bool load_gen_handle(const esp_now_recv_info_t *esp_now_info, const espnow_group_hdr_t *hdr,
+                         const uint8_t *payload, size_t len);
+
+    // Desde send_cb: cierra la medición de latencia de ACK en el generador.
+    void load_gen_on_send(const uint8_t *mac_addr, esp_now_send_status_t status);
+
+    #ifdef __cplusplus
+    }
+    #endif
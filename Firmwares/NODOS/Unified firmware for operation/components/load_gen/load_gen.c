@@ -0,0 +1,358 @@
+/************************************************************************************************
+ * Módulo: Generador de tráfico sintético para pruebas de capacidad de la pasarela.
+ *
+ * Descripción: La tarea del generador, de clase RADIO_TX, compara cada tick las tramas que el
+ * patrón pedía hasta ese instante con las ya enviadas y envía la diferencia; si la radio no
+ * acepta más (cola de ESP-NOW llena) lo intenta en el tick siguiente y, con más de una ronda
+ * de atraso, descarta lo pendiente y lo cuenta en skipped: la tasa pedida y la lograda quedan
+ * a la vista en el informe. Las latencias de ACK y de ida y vuelta se guardan en ventanas de
+ * muestras que el informe ordena y vacía.
+ *
+ * Autor:
+ *   - Victor Manuel Patiño Delgado.
+ *
+ * Licencia: THE BEER-WARE LICENSE.
+ * As long as you retain this notice you can do whatever you want with this stuff.
+ * If we meet some day, and you think this stuff is worth it, you can buy me a beer in return.
+************************************************************************************************/
+
+//***   Bibliotecas y declaraciones de preprocesador    ***//
+    #include <stdio.h>
+    #include <stdlib.h>
+    #include <string.h>
+    #include "freertos/FreeRTOS.h"
+    #include "freertos/task.h"
+    #include "esp_timer.h"
+    #include "esp_random.h"
+    #include "esp_mac.h"
+    #include "esp_log.h"
+    #include "sdkconfig.h"
+    #include "load_gen.h"
+    #include "task_layout.h"
+
+//***   Definición de constantes y macros   ***//
+    #define LATENCY_SAMPLES 256
+    #define ACK_DEPTH 32                // Envíos unicast esperando send_cb
+    #define TELEMETRY_BASE_C 22.0f
+    #define ALERT_C 120.0f              // Sobre el límite del gabinete y dentro del rango del LM35
+
+    #if CONFIG_LOAD_GEN_STEADY
+    #define PATTERN_NAME "steady"
+    #elif CONFIG_LOAD_GEN_BURSTY
+    #define PATTERN_NAME "bursty"
+    #else
+    #define PATTERN_NAME "storm"
+    #endif
+
+    #if CONFIG_LOAD_GEN_ENABLE
+    static const char *TAG = "load_gen";
+    #endif
+
+//***   Estructuras de datos y tipos personalizados ***//
+    #if CONFIG_LOAD_GEN_ENABLE
+    typedef struct {
+        uint32_t samples[LATENCY_SAMPLES];  // Circular: con más muestras quedan las últimas
+        uint32_t count;
+        uint32_t max;
+    } latency_window_t;
+
+    typedef struct {
+        uint32_t sent;
+        uint32_t alerts;
+        uint32_t skipped;
+        uint32_t busy;
+        uint32_t acked;
+        uint32_t ack_fail;
+        uint32_t probes;
+        uint32_t echoes;
+    } counters_t;
+
+    static portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+    static bool running;
+    static uint8_t own_mac[LOAD_GEN_MAC_LEN];
+    static uint8_t gateway_mac[LOAD_GEN_MAC_LEN];
+    static bool unicast;
+    static uint16_t unicast_seq;
+    static int64_t ack_pending[ACK_DEPTH];
+    static uint32_t ack_head;
+    static uint32_t ack_tail;
+    static latency_window_t ack_window;
+    static latency_window_t rtt_window;
+    static counters_t counters;
+    static uint32_t frames;
+    static uint32_t probe_next;
+    #endif
+
+//***   Declaraciones de funciones (prototipos) ***//
+    #if CONFIG_LOAD_GEN_ENABLE
+    static void generator_task(void *pvParameters);
+    static bool send_scheduled(uint16_t vnode);
+    static bool send_reading(uint16_t vnode, float reading);
+    static bool send_frame(uint8_t type, const void *body, size_t len, uint16_t vnode);
+    static void window_add(latency_window_t *window, uint32_t latency_us);
+    static void window_summary(latency_window_t *window, uint32_t *p50, uint32_t *p99);
+    static void report(uint32_t window_ms);
+    static int compare_u32(const void *a, const void *b);
+    #endif
+
+//***Implementación de funciones***//
+    bool load_gen_virtual_source(const espnow_group_hdr_t *hdr, const uint8_t *src, const uint8_t *payload,
+                                 size_t *payload_len, uint8_t *virtual_src)
+    {
+        // El id se quita siempre para que el payload conserve su formato; atribuirlo es opcional.
+        uint16_t vnode;
+        if (!espnow_group_strip_vnode(hdr, payload, payload_len, &vnode)) {return false;}
+    #if CONFIG_LOAD_GEN_GATEWAY
+        espnow_group_vnode_mac(src, vnode, virtual_src);
+        return true;
+    #else
+        return false;
+    #endif
+    }
+
+    #if CONFIG_LOAD_GEN_GATEWAY
+    bool load_gen_handle(const esp_now_recv_info_t *esp_now_info, const espnow_group_hdr_t *hdr,
+                         const uint8_t *payload, size_t len)
+    {
+        if (hdr->type != ESPNOW_MSG_LOAD_PROBE) {return false;}
+        if (len == sizeof(load_gen_probe_t)) {
+            // El generador no es un par registrado: el eco sale por broadcast con su MAC.
+            load_gen_echo_t echo;
+            memcpy(echo.requester, esp_now_info->src_addr, LOAD_GEN_MAC_LEN);
+            memcpy(&echo.probe, payload, sizeof(echo.probe));
+            espnow_group_send(ESPNOW_GROUP_ALL, ESPNOW_MSG_LOAD_ECHO, 0, &echo, sizeof(echo));
+        }
+        return true;
+    }
+    #elif CONFIG_LOAD_GEN_ENABLE
+    bool load_gen_handle(const esp_now_recv_info_t *esp_now_info, const espnow_group_hdr_t *hdr,
+                         const uint8_t *payload, size_t len)
+    {
+        if (hdr->type != ESPNOW_MSG_LOAD_ECHO) {return false;}
+        load_gen_echo_t echo;
+        if (len != sizeof(echo)) {return true;}
+        memcpy(&echo, payload, sizeof(echo));
+        if (memcmp(echo.requester, own_mac, LOAD_GEN_MAC_LEN) != 0) {return true;}
+
+        uint32_t rtt_us = (uint32_t)esp_timer_get_time() - echo.probe.sent_us;
+        taskENTER_CRITICAL(&lock);
+        counters.echoes++;
+        window_add(&rtt_window, rtt_us);
+        taskEXIT_CRITICAL(&lock);
+        return true;
+    }
+    #else
+    bool load_gen_handle(const esp_now_recv_info_t *esp_now_info, const espnow_group_hdr_t *hdr,
+                         const uint8_t *payload, size_t len)
+    {
+        return false;
+    }
+    #endif
+
+    #if CONFIG_LOAD_GEN_ENABLE
+    esp_err_t load_gen_start(void)
+    {
+        if (running) {return ESP_ERR_INVALID_STATE;}
+        unsigned int mac[LOAD_GEN_MAC_LEN];
+        if (sscanf(CONFIG_LOAD_GEN_GATEWAY_MAC, "%x:%x:%x:%x:%x:%x",
+                   &mac[0], &mac[1], &mac[2], &mac[3], &mac[4], &mac[5]) != LOAD_GEN_MAC_LEN) {
+            ESP_LOGE(TAG, "Bad gateway MAC \"%s\"", CONFIG_LOAD_GEN_GATEWAY_MAC);
+            return ESP_ERR_INVALID_ARG;
+        }
+        for (uint8_t i = 0; i < LOAD_GEN_MAC_LEN; i++) {gateway_mac[i] = (uint8_t)mac[i];}
+        unicast = !(gateway_mac[0] & 0x01);
+        esp_read_mac(own_mac, ESP_MAC_WIFI_STA);
+
+        if (unicast && !esp_now_is_peer_exist(gateway_mac)) {
+            esp_now_peer_info_t peer = {
+                .channel = 0,
+                .ifidx = ESP_IF_WIFI_STA,
+            };
+            memcpy(peer.peer_addr, gateway_mac, LOAD_GEN_MAC_LEN);
+            esp_err_t err = esp_now_add_peer(&peer);
+            if (err != ESP_OK) {return err;}
+        }
+        running = true;
+        ESP_LOGI(TAG, "Emulating %d nodes every %d ms (%s) towards " MACSTR, CONFIG_LOAD_GEN_NODES,
+                 CONFIG_LOAD_GEN_PERIOD_MS, PATTERN_NAME, MAC2STR(gateway_mac));
+        return TASK_LAYOUT_CREATE(generator_task, "load_gen", 4096, NULL, TASK_CLASS_RADIO_TX, NULL);
+    }
+
+    void load_gen_on_send(const uint8_t *mac_addr, esp_now_send_status_t status)
+    {
+        if (!unicast || memcmp(mac_addr, gateway_mac, LOAD_GEN_MAC_LEN) != 0) {return;}
+        int64_t now = esp_timer_get_time();
+        taskENTER_CRITICAL(&lock);
+        // send_cb llega en el orden de los envíos: corresponde al más antiguo pendiente.
+        if (ack_tail != ack_head) {
+            int64_t sent_us = ack_pending[ack_tail++ % ACK_DEPTH];
+            if (status == ESP_NOW_SEND_SUCCESS) {
+                counters.acked++;
+                window_add(&ack_window, (uint32_t)(now - sent_us));
+            }
+            else {counters.ack_fail++;}
+        }
+        taskEXIT_CRITICAL(&lock);
+    }
+
+    static void generator_task(void *pvParameters)
+    {
+        const uint32_t nodes = CONFIG_LOAD_GEN_NODES;
+        const int64_t period_us = (int64_t)CONFIG_LOAD_GEN_PERIOD_MS * 1000;
+        const int64_t start_us = esp_timer_get_time();
+        int64_t report_us = start_us;
+        uint64_t scheduled = 0;
+        while (1) {
+            int64_t now = esp_timer_get_time();
+            int64_t elapsed_us = now - start_us;
+        #if CONFIG_LOAD_GEN_BURSTY
+            uint64_t due = (uint64_t)(elapsed_us / period_us + 1) * nodes;
+        #else
+            uint64_t due = (uint64_t)(elapsed_us * nodes / period_us) + 1;
+        #endif
+            if (due - scheduled > nodes) {
+                counters.skipped += due - scheduled - nodes;
+                scheduled = due - nodes;
+            }
+            while (scheduled < due && send_scheduled((uint16_t)(scheduled % nodes))) {scheduled++;}
+
+        #if CONFIG_LOAD_GEN_STORM
+            // La tormenta cierra cada intervalo: antes se mide la pasarela con tráfico constante.
+            const int64_t every_us = (int64_t)CONFIG_LOAD_GEN_STORM_EVERY_MS * 1000;
+            if (elapsed_us % every_us >= every_us - (int64_t)CONFIG_LOAD_GEN_STORM_MS * 1000) {
+                for (uint32_t vnode = 0; vnode < nodes && send_reading((uint16_t)vnode, ALERT_C); vnode++) {}
+            }
+        #endif
+
+            if (now - report_us >= (int64_t)CONFIG_LOAD_GEN_REPORT_MS * 1000) {
+                report((uint32_t)((now - report_us) / 1000));
+                report_us = now;
+            }
+            vTaskDelay(1);
+        }
+    }
+
+    // Una de cada LOAD_GEN_PROBE_EVERY tramas es una sonda; el resto, telemetría o alerta.
+    static bool send_scheduled(uint16_t vnode)
+    {
+        if (CONFIG_LOAD_GEN_PROBE_EVERY > 0 && (frames + 1) % CONFIG_LOAD_GEN_PROBE_EVERY == 0) {
+            load_gen_probe_t probe = {
+                .probe_id = probe_next,
+                .sent_us = (uint32_t)esp_timer_get_time(),
+            };
+            if (!send_frame(ESPNOW_MSG_LOAD_PROBE, &probe, sizeof(probe), vnode)) {return false;}
+            probe_next++;
+            counters.probes++;
+            frames++;
+            return true;
+        }
+        float reading = TELEMETRY_BASE_C + (vnode % 16) * 0.5f + ((int32_t)(esp_random() % 21) - 10) * 0.01f;
+        if (esp_random() % 100 < CONFIG_LOAD_GEN_ALERT_PERCENT) {reading = ALERT_C;}
+        if (!send_reading(vnode, reading)) {return false;}
+        frames++;
+        return true;
+    }
+
+    static bool send_reading(uint16_t vnode, float reading)
+    {
+        if (!send_frame(ESPNOW_MSG_TEMPERATURE, &reading, sizeof(reading), vnode)) {return false;}
+        if (reading == ALERT_C) {counters.alerts++;}
+        return true;
+    }
+
+    static bool send_frame(uint8_t type, const void *body, size_t len, uint16_t vnode)
+    {
+        uint8_t payload[sizeof(load_gen_probe_t) + ESPNOW_GROUP_VNODE_LEN];
+        memcpy(payload, body, len);
+        memcpy(payload + len, &vnode, ESPNOW_GROUP_VNODE_LEN);
+        len += ESPNOW_GROUP_VNODE_LEN;
+
+        esp_err_t err;
+        if (unicast) {
+            uint8_t frame[ESP_NOW_MAX_DATA_LEN];
+            size_t frame_len = espnow_group_encode(frame, ESPNOW_GROUP_GATEWAY, type, ESPNOW_GROUP_FLAG_VNODE,
+                                                   ++unicast_seq, payload, len);
+            taskENTER_CRITICAL(&lock);
+            bool full = ack_head - ack_tail >= ACK_DEPTH;
+            if (!full) {ack_pending[ack_head++ % ACK_DEPTH] = esp_timer_get_time();}
+            taskEXIT_CRITICAL(&lock);
+            err = full ? ESP_ERR_ESPNOW_NO_MEM : esp_now_send(gateway_mac, frame, frame_len);
+            if (err != ESP_OK && !full) {
+                // Sin send_cb para este envío: se retira su marca, que es la más reciente.
+                taskENTER_CRITICAL(&lock);
+                ack_head--;
+                taskEXIT_CRITICAL(&lock);
+            }
+        }
+        else {err = espnow_group_send(ESPNOW_GROUP_GATEWAY, type, ESPNOW_GROUP_FLAG_VNODE, payload, len);}
+
+        if (err != ESP_OK) {
+            counters.busy++;
+            return false;
+        }
+        counters.sent++;
+        return true;
+    }
+
+    // Llamar con el candado tomado.
+    static void window_add(latency_window_t *window, uint32_t latency_us)
+    {
+        window->samples[window->count % LATENCY_SAMPLES] = latency_us;
+        window->count++;
+        if (latency_us > window->max) {window->max = latency_us;}
+    }
+
+    static void window_summary(latency_window_t *window, uint32_t *p50, uint32_t *p99)
+    {
+        uint32_t count = window->count < LATENCY_SAMPLES ? window->count : LATENCY_SAMPLES;
+        qsort(window->samples, count, sizeof(uint32_t), compare_u32);
+        *p50 = count > 0 ? window->samples[count / 2] : 0;
+        *p99 = count > 0 ? window->samples[(count - 1) * 99 / 100] : 0;
+    }
+
+    // Línea "LOAD-REPORT clave=valor ..." por ventana; los contadores se reinician en cada una.
+    static void report(uint32_t window_ms)
+    {
+        static latency_window_t ack;
+        static latency_window_t rtt;
+        counters_t snapshot;
+        taskENTER_CRITICAL(&lock);
+        snapshot = counters;
+        ack = ack_window;
+        rtt = rtt_window;
+        memset(&counters, 0, sizeof(counters));
+        ack_window.count = ack_window.max = 0;
+        rtt_window.count = rtt_window.max = 0;
+        taskEXIT_CRITICAL(&lock);
+
+        uint32_t ack_p50, ack_p99, rtt_p50, rtt_p99;
+        window_summary(&ack, &ack_p50, &ack_p99);
+        window_summary(&rtt, &rtt_p50, &rtt_p99);
+        printf("LOAD-REPORT nodes=%d pattern=%s window_ms=%lu sent=%lu frames_per_s=%lu alerts=%lu skipped=%lu "
+               "busy=%lu acked=%lu ack_fail=%lu ack_p50_us=%lu ack_p99_us=%lu ack_max_us=%lu probes=%lu "
+               "echoes=%lu rtt_p50_us=%lu rtt_p99_us=%lu rtt_max_us=%lu\n",
+               CONFIG_LOAD_GEN_NODES, PATTERN_NAME, (unsigned long)window_ms, (unsigned long)snapshot.sent,
+               (unsigned long)(window_ms > 0 ? (uint64_t)snapshot.sent * 1000 / window_ms : 0),
+               (unsigned long)snapshot.alerts, (unsigned long)snapshot.skipped, (unsigned long)snapshot.busy,
+               (unsigned long)snapshot.acked, (unsigned long)snapshot.ack_fail, (unsigned long)ack_p50,
+               (unsigned long)ack_p99, (unsigned long)ack.max, (unsigned long)snapshot.probes,
+               (unsigned long)snapshot.echoes, (unsigned long)rtt_p50, (unsigned long)rtt_p99, (unsigned long)rtt.max);
+    }
+
+    static int compare_u32(const void *a, const void *b)
+    {
+        uint32_t x = *(const uint32_t *)a;
+        uint32_t y = *(const uint32_t *)b;
+        return (x > y) - (x < y);
+    }
+    #else
+    esp_err_t load_gen_start(void)
+    {
+        ESP_LOGW("load_gen", "LOAD_GEN_ENABLE is off");
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    void load_gen_on_send(const uint8_t *mac_addr, esp_now_send_status_t status)
+    {
+    }
+    #endif
@@ -0,0 +1,141 @@
+/************************************************************************************************
+ * Módulo: Métricas de ejecución exportadas por telemetría.
+ *
+ * Descripción: Registro de contadores y medidores de 32 bits actualizados con operaciones
+ * atómicas, seguros desde tareas, callbacks de ESP-NOW e ISRs. Periódicamente se toma un
+ * snapshot (heap, tareas, pila, CPU y contadores) que viaja anexado al final de una trama de
+ * telemetría existente; la pasarela lo separa y lo publica por su enlace ascendente.
+ *
+ * Autor:
+ *   - Victor Manuel Patiño Delgado.
+ *
+ * Licencia: THE BEER-WARE LICENSE.
+ * As long as you retain this notice you can do whatever you want with this stuff.
+ * If we meet some day, and you think this stuff is worth it, you can buy me a beer in return.
+************************************************************************************************/
+#pragma once
+
+//***   Bibliotecas y declaraciones de preprocesador    ***//
+    #include <stdint.h>
+    #include <stdbool.h>
+    #include <stddef.h>
+    #include "sdkconfig.h"
+
+    #ifdef __cplusplus
+    extern "C" {
+    #endif
+
+//***   Definición de constantes y macros   ***//
+    // Cambia solo si cambia la disposición del bloque; agregar métricas no la cambia.
+    #define METRICS_VERSION 2
+    #define METRICS_TASK_NAME_LEN 8
+    #define METRICS_MAX_TASKS 8
+
+//***   Estructuras de datos y tipos personalizados ***//
+    // El índice es parte del formato en el aire: agregar solo al final. Cada snapshot declara
+    // cuántos valores lleva, así que nodos con más o menos métricas siguen siendo legibles.
+    typedef enum {
+        METRIC_UPTIME_S,        // Medidor: segundos desde el arranque
+        METRIC_HEAP_FREE,       // Medidor: heap libre (bytes)
+        METRIC_HEAP_MIN,        // Medidor: mínimo histórico de heap libre (bytes)
+        METRIC_TASK_COUNT,      // Medidor: tareas existentes
+        METRIC_RADIO_TX,        // Contador: tramas aceptadas por esp_now_send
+        METRIC_RADIO_TX_FAIL,   // Contador: envíos rechazados o sin ACK
+        METRIC_RADIO_RX,        // Contador: tramas de grupo válidas recibidas
+        METRIC_RADIO_RX_DROP,   // Contador: tramas descartadas (cola llena, formato)
+        METRIC_RADIO_RETX,      // Contador: retransmisiones atendidas por NACK
+        METRIC_QUEUE_DEPTH,     // Medidor: máxima profundidad de cola observada
+        METRIC_ISR_PIR,         // Contador: flancos del PIR (interrupciones o PCNT)
+        METRIC_ISR_RADAR,       // Contador: flancos del radar (interrupciones o PCNT)
+        METRIC_ADC_SAMPLES,     // Contador: conversiones ADC
+        METRIC_ACTUATIONS,      // Contador: activaciones de actuadores
+        METRIC_RADAR_DOPPLER_HZ,// Medidor: última frecuencia Doppler estimada (Hz)
+        METRIC_THERMAL_LEVEL,   // Medidor: nivel del gobernador térmico (0 normal .. 3 crítico)
+        METRIC_DIE_TEMP_C,      // Medidor: temperatura interna del chip (°C, 0 si no hay lectura)
+        METRIC_THERMAL_CHANGES, // Contador: cambios de nivel térmico
+        METRIC_ANOMALIES,       // Contador: anomalías detectadas en lecturas recibidas
+        METRIC_UPLINK_PUBLISHED,// Contador: lotes aceptados por el cliente MQTT
+        METRIC_UPLINK_DROPPED,  // Contador: registros o lotes descartados por colas llenas
+        METRIC_WS_CLIENTS,      // Medidor: visores WebSocket conectados al tablero
+        METRIC_WS_PUSHES,       // Contador: tramas enviadas a los visores del tablero
+        METRIC_CMD_SENT,        // Contador: tramas de comando transmitidas (cambios y reparaciones)
+        METRIC_CMD_REPAIRS,     // Contador: reenvíos de estado a nodos atrasados
+        METRIC_CMD_APPLIED,     // Contador: cambios de actuador aplicados por comando
+        METRIC_CRASHES,         // Medidor: pánicos y watchdogs desde el último encendido
+        METRIC_RESET_REASON,    // Medidor: esp_reset_reason_t del arranque actual
+        METRIC_CRASH_UPTIME_S,  // Medidor: tiempo en marcha antes del último fallo (s)
+        METRIC_RECOVERY_MS,     // Medidor: arranque hasta aplicación operativa (ms)
+        METRIC_POOL_FAILURES,   // Contador: pedidos a block_pool sin bloque disponible
+        METRIC_POOL_PEAK_PCT,   // Medidor: mayor ocupación histórica de un pool de block_pool (%)
+        METRIC_PHY_RATE_KBPS,   // Medidor: tasa PHY vigente de ESP-NOW (kbps)
+        METRIC_RATE_CHANGES,    // Contador: cambios de tasa PHY de link_quality
+        METRIC_LINK_RSSI_WORST, // Medidor: RSSI del par activo más débil, en -dBm
+        METRIC_CAPTURE_DROPPED, // Contador: tramas que frame_capture no pudo grabar
+        METRIC_GW_PROCESSED,    // Contador: lecturas procesadas por completo en la pasarela
+        METRIC_QUEUE_OVERFLOW,  // Contador: registros rechazados por colas internas llenas
+        METRIC_COUNT
+    } metric_id_t;
+
+    typedef struct __attribute__((packed)) {
+        char name[METRICS_TASK_NAME_LEN];   // Truncado, sin terminador si ocupa los 8
+        uint16_t stack_free;                // Marca de agua de la pila (bytes)
+        uint8_t cpu_percent;                // Del total del chip, desde el snapshot anterior
+        uint8_t core;                       // 0xFF: sin afinidad
+    } metrics_task_t;
+
+    typedef struct __attribute__((packed)) {
+        uint8_t version;
+        uint8_t task_count;
+        uint16_t value_count;               // Valores en el aire; en la versión 1 era 0 (reservado)
+        uint32_t values[METRIC_COUNT];      // Los que el emisor no envió quedan en 0
+        metrics_task_t tasks[METRICS_MAX_TASKS];
+    } metrics_snapshot_t;
+
+    #define METRICS_HEADER_LEN offsetof(metrics_snapshot_t, values)
+    #define METRICS_WIRE_LEN(task_count) (offsetof(metrics_snapshot_t, tasks) + (task_count) * sizeof(metrics_task_t))
+
+    extern uint32_t metrics_values[METRIC_COUNT];
+
+//***   Declaraciones de funciones (prototipos) ***//
+    static inline void metrics_add(metric_id_t id, uint32_t amount)
+    {
+        __atomic_fetch_add(&metrics_values[id], amount, __ATOMIC_RELAXED);
+    }
+
+    static inline void metrics_inc(metric_id_t id)
+    {
+        __atomic_fetch_add(&metrics_values[id], 1, __ATOMIC_RELAXED);
+    }
+
+    static inline void metrics_set(metric_id_t id, uint32_t value)
+    {
+        __atomic_store_n(&metrics_values[id], value, __ATOMIC_RELAXED);
+    }
+
+    // Medidor de máximo: conserva el mayor valor observado entre snapshots.
+    static inline void metrics_max(metric_id_t id, uint32_t value)
+    {
+        uint32_t current = __atomic_load_n(&metrics_values[id], __ATOMIC_RELAXED);
+        while (value > current &&
+               !__atomic_compare_exchange_n(&metrics_values[id], &current, value, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        }
+    }
+
+    const char *metrics_name(metric_id_t id);
+
+    // Toma un snapshot completo; devuelve la longitud en el aire.
+    size_t metrics_capture(metrics_snapshot_t *snapshot);
+
+    // Anexa el snapshot más un byte de longitud si venció el periodo; devuelve los bytes
+    // agregados (0 si no corresponde). Marcar la trama con ESPNOW_GROUP_FLAG_METRICS.
+    size_t metrics_piggyback(uint8_t *buffer, size_t room);
+
+    // Separa el snapshot anexado al payload (attached: la trama lo indica) y ajusta payload_len
+    // a la parte de aplicación. snapshot puede ser NULL. Devuelve true si había snapshot válido.
+    // Acepta snapshots con otra cantidad de valores: snapshot->value_count queda en los
+    // recibidos, hasta METRIC_COUNT.
+    bool metrics_strip(bool attached, const uint8_t *payload, size_t *payload_len, metrics_snapshot_t *snapshot);
+
+    #ifdef __cplusplus
+    }
+    #endif
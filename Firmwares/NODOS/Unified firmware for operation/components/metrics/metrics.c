@@ -0,0 +1,224 @@
+/************************************************************************************************
+ * Módulo: Métricas de ejecución exportadas por telemetría.
+ *
+ * Descripción: Los contadores se actualizan sin bloqueo desde cualquier contexto; el costo de
+ * recorrer las tareas y consultar el heap solo se paga al tomar el snapshot, una vez por
+ * periodo. De las tareas se reportan las de menor margen de pila, que son las que anticipan
+ * un reinicio.
+ *
+ * Autor:
+ *   - Victor Manuel Patiño Delgado.
+ *
+ * Licencia: THE BEER-WARE LICENSE.
+ * As long as you retain this notice you can do whatever you want with this stuff.
+ * If we meet some day, and you think this stuff is worth it, you can buy me a beer in return.
+************************************************************************************************/
+
+//***   Bibliotecas y declaraciones de preprocesador    ***//
+    #include <string.h>
+    #include "freertos/FreeRTOS.h"
+    #include "freertos/task.h"
+    #include "esp_system.h"
+    #include "esp_timer.h"
+    #include "sdkconfig.h"
+    #include "metrics.h"
+
+//***   Definición de constantes y macros   ***//
+    #define MAX_TASKS CONFIG_METRICS_MAX_TASKS
+    #define SCAN_TASKS 24
+    #define TASK_STATS_ENABLED (CONFIG_FREERTOS_USE_TRACE_FACILITY && MAX_TASKS > 0)
+    #define CPU_STATS_ENABLED (TASK_STATS_ENABLED && CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS)
+
+    uint32_t metrics_values[METRIC_COUNT];
+
+    static const char *const names[METRIC_COUNT] = {
+        [METRIC_UPTIME_S]       = "uptime_s",
+        [METRIC_HEAP_FREE]      = "heap_free",
+        [METRIC_HEAP_MIN]       = "heap_min",
+        [METRIC_TASK_COUNT]     = "tasks",
+        [METRIC_RADIO_TX]       = "tx",
+        [METRIC_RADIO_TX_FAIL]  = "tx_fail",
+        [METRIC_RADIO_RX]       = "rx",
+        [METRIC_RADIO_RX_DROP]  = "rx_drop",
+        [METRIC_RADIO_RETX]     = "retx",
+        [METRIC_QUEUE_DEPTH]    = "queue_max",
+        [METRIC_ISR_PIR]        = "isr_pir",
+        [METRIC_ISR_RADAR]      = "isr_radar",
+        [METRIC_ADC_SAMPLES]    = "adc",
+        [METRIC_ACTUATIONS]     = "actuations",
+        [METRIC_RADAR_DOPPLER_HZ] = "doppler_hz",
+        [METRIC_THERMAL_LEVEL]  = "thermal_level",
+        [METRIC_DIE_TEMP_C]     = "die_temp_c",
+        [METRIC_THERMAL_CHANGES] = "thermal_changes",
+        [METRIC_ANOMALIES]      = "anomalies",
+        [METRIC_UPLINK_PUBLISHED] = "uplink_pub",
+        [METRIC_UPLINK_DROPPED] = "uplink_drop",
+        [METRIC_WS_CLIENTS]     = "ws_clients",
+        [METRIC_WS_PUSHES]      = "ws_pushes",
+        [METRIC_CMD_SENT]       = "cmd_sent",
+        [METRIC_CMD_REPAIRS]    = "cmd_repairs",
+        [METRIC_CMD_APPLIED]    = "cmd_applied",
+        [METRIC_CRASHES]        = "crashes",
+        [METRIC_RESET_REASON]   = "reset_reason",
+        [METRIC_CRASH_UPTIME_S] = "crash_uptime_s",
+        [METRIC_RECOVERY_MS]    = "recovery_ms",
+        [METRIC_POOL_FAILURES]  = "pool_fail",
+        [METRIC_POOL_PEAK_PCT]  = "pool_peak_pct",
+        [METRIC_PHY_RATE_KBPS]  = "phy_rate_kbps",
+        [METRIC_RATE_CHANGES]   = "rate_changes",
+        [METRIC_LINK_RSSI_WORST] = "rssi_worst",
+        [METRIC_CAPTURE_DROPPED] = "capture_drop",
+        [METRIC_GW_PROCESSED]   = "gw_processed",
+        [METRIC_QUEUE_OVERFLOW] = "queue_overflow",
+    };
+
+    static int64_t last_piggyback_us;
+
+//***   Estructuras de datos y tipos personalizados ***//
+    #if CPU_STATS_ENABLED
+    // Contador de ejecución de cada tarea en el snapshot anterior, para reportar CPU por intervalo.
+    static struct {
+        UBaseType_t number;
+        uint32_t run_time;
+    } previous_run[SCAN_TASKS];
+    static uint32_t previous_total;
+    #endif
+
+//***   Declaraciones de funciones (prototipos) ***//
+    static bool decode_snapshot(const uint8_t *block, size_t len, metrics_snapshot_t *snapshot);
+    #if TASK_STATS_ENABLED
+    static uint8_t capture_tasks(metrics_task_t *tasks);
+    #endif
+
+//***Implementación de funciones***//
+    const char *metrics_name(metric_id_t id)
+    {
+        return (id < METRIC_COUNT && names[id] != NULL) ? names[id] : "?";
+    }
+
+    size_t metrics_capture(metrics_snapshot_t *snapshot)
+    {
+        metrics_set(METRIC_UPTIME_S, (uint32_t)(esp_timer_get_time() / 1000000));
+        metrics_set(METRIC_HEAP_FREE, esp_get_free_heap_size());
+        metrics_set(METRIC_HEAP_MIN, esp_get_minimum_free_heap_size());
+        metrics_set(METRIC_TASK_COUNT, uxTaskGetNumberOfTasks());
+
+        memset(snapshot, 0, sizeof(*snapshot));
+        snapshot->version = METRICS_VERSION;
+        snapshot->value_count = METRIC_COUNT;
+        for (uint8_t i = 0; i < METRIC_COUNT; i++) {
+            snapshot->values[i] = __atomic_load_n(&metrics_values[i], __ATOMIC_RELAXED);
+        }
+        // El máximo de cola es por intervalo.
+        metrics_set(METRIC_QUEUE_DEPTH, 0);
+
+    #if TASK_STATS_ENABLED
+        snapshot->task_count = capture_tasks(snapshot->tasks);
+    #endif
+        return METRICS_WIRE_LEN(snapshot->task_count);
+    }
+
+    size_t metrics_piggyback(uint8_t *buffer, size_t room)
+    {
+        if (CONFIG_METRICS_PERIOD_MS == 0) {return 0;}
+        int64_t now = esp_timer_get_time();
+        if (last_piggyback_us != 0 && (now - last_piggyback_us) < (int64_t)CONFIG_METRICS_PERIOD_MS * 1000) {return 0;}
+
+        metrics_snapshot_t snapshot;
+        size_t len = metrics_capture(&snapshot);
+        // Si no cabe completo se recortan tareas; los contadores siempre viajan.
+        while (len + 1 > room && snapshot.task_count > 0) {
+            snapshot.task_count--;
+            len = METRICS_WIRE_LEN(snapshot.task_count);
+        }
+        if (len + 1 > room) {return 0;}
+
+        last_piggyback_us = now;
+        memcpy(buffer, &snapshot, len);
+        buffer[len] = (uint8_t)len;
+        return len + 1;
+    }
+
+    bool metrics_strip(bool attached, const uint8_t *payload, size_t *payload_len, metrics_snapshot_t *snapshot)
+    {
+        if (!attached || *payload_len < 1) {return false;}
+        size_t len = payload[*payload_len - 1];
+        if (len + 1 > *payload_len || len < METRICS_HEADER_LEN) {return false;}
+
+        const uint8_t *block = payload + *payload_len - 1 - len;
+        *payload_len -= len + 1;
+        if (snapshot == NULL) {return true;}
+        return decode_snapshot(block, len, snapshot);
+    }
+
+    // Los valores ocupan lo que queda entre la cabecera y las tareas, así que la cantidad se
+    // deduce de la longitud; en la versión 2 además debe coincidir con value_count.
+    static bool decode_snapshot(const uint8_t *block, size_t len, metrics_snapshot_t *snapshot)
+    {
+        uint8_t version = block[0];
+        uint8_t task_count = block[1];
+        size_t tasks_len = task_count * sizeof(metrics_task_t);
+        if (version == 0 || version > METRICS_VERSION || task_count > METRICS_MAX_TASKS) {return false;}
+        if (len < METRICS_HEADER_LEN + tasks_len || (len - METRICS_HEADER_LEN - tasks_len) % sizeof(uint32_t) != 0) {return false;}
+
+        size_t sent = (len - METRICS_HEADER_LEN - tasks_len) / sizeof(uint32_t);
+        uint16_t declared;
+        memcpy(&declared, block + offsetof(metrics_snapshot_t, value_count), sizeof(declared));
+        if (version >= 2 && declared != sent) {return false;}
+
+        memset(snapshot, 0, sizeof(*snapshot));
+        snapshot->version = version;
+        snapshot->task_count = task_count;
+        snapshot->value_count = sent < METRIC_COUNT ? sent : METRIC_COUNT;
+        memcpy(snapshot->values, block + METRICS_HEADER_LEN, snapshot->value_count * sizeof(uint32_t));
+        memcpy(snapshot->tasks, block + METRICS_HEADER_LEN + sent * sizeof(uint32_t), tasks_len);
+        return true;
+    }
+
+    #if TASK_STATS_ENABLED
+    static uint8_t capture_tasks(metrics_task_t *tasks)
+    {
+        static TaskStatus_t status[SCAN_TASKS];
+        uint32_t total = 0;
+        UBaseType_t count = uxTaskGetSystemState(status, SCAN_TASKS, &total);
+
+        // Selección de las MAX_TASKS tareas con menor margen de pila.
+        uint8_t selected = 0;
+        for (uint8_t n = 0; n < MAX_TASKS && n < count; n++) {
+            UBaseType_t lowest = n;
+            for (UBaseType_t i = n + 1; i < count; i++) {
+                if (status[i].usStackHighWaterMark < status[lowest].usStackHighWaterMark) {lowest = i;}
+            }
+            TaskStatus_t swap = status[n];
+            status[n] = status[lowest];
+            status[lowest] = swap;
+            selected++;
+        }
+
+        for (uint8_t n = 0; n < selected; n++) {
+            strncpy(tasks[n].name, status[n].pcTaskName, METRICS_TASK_NAME_LEN);
+            tasks[n].stack_free = status[n].usStackHighWaterMark > UINT16_MAX ? UINT16_MAX : status[n].usStackHighWaterMark;
+            tasks[n].core = (status[n].xCoreID == tskNO_AFFINITY) ? 0xFF : (uint8_t)status[n].xCoreID;
+        }
+
+    #if CPU_STATS_ENABLED
+        uint32_t elapsed = (total - previous_total) * portNUM_PROCESSORS;
+        for (uint8_t n = 0; n < selected && elapsed > 0; n++) {
+            for (uint8_t k = 0; k < SCAN_TASKS; k++) {
+                if (previous_run[k].number == status[n].xTaskNumber) {
+                    uint32_t run = status[n].ulRunTimeCounter - previous_run[k].run_time;
+                    tasks[n].cpu_percent = (uint8_t)(((uint64_t)run * 100) / elapsed);
+                    break;
+                }
+            }
+        }
+        memset(previous_run, 0, sizeof(previous_run));
+        for (UBaseType_t i = 0; i < count; i++) {
+            previous_run[i].number = status[i].xTaskNumber;
+            previous_run[i].run_time = status[i].ulRunTimeCounter;
+        }
+        previous_total = total;
+    #endif
+        return selected;
+    }
+    #endif
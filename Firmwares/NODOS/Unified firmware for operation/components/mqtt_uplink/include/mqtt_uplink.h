@@ -0,0 +1,68 @@
+/************************************************************************************************
+ * Módulo: Enlace ascendente Ethernet + MQTT de la pasarela.
+ *
+ * Descripción: Puente entre el tráfico ESP-NOW que recibe la pasarela y un broker MQTT,
+ * usando el puerto Ethernet (LAN8720) de la T-Internet-COM. Los registros se entregan sin
+ * bloquear a una cola en anillo; una tarea de fondo fuera del núcleo de radio los agrupa en
+ * lotes por clase (un tópico por clase), los publica con el QoS de esa clase y, mientras no
+ * hay conexión, los guarda en una cola acotada que se vacía en orden al reconectar. Los
+ * pedidos publicados en <prefijo>/<MAC>/query se responden en <prefijo>/<MAC>/reply.
+ *
+ * Autor:
+ *   - Victor Manuel Patiño Delgado.
+ *
+ * Licencia: THE BEER-WARE LICENSE.
+ * As long as you retain this notice you can do whatever you want with this stuff.
+ * If we meet some day, and you think this stuff is worth it, you can buy me a beer in return.
+************************************************************************************************/
+#pragma once
+
+//***   Bibliotecas y declaraciones de preprocesador    ***//
+    #include <stdint.h>
+    #include <stdbool.h>
+    #include <stddef.h>
+    #include "esp_err.h"
+    #include "sdkconfig.h"
+
+    #ifdef __cplusplus
+    extern "C" {
+    #endif
+
+//***   Definición de constantes y macros   ***//
+    #define MQTT_UPLINK_MAC_LEN 6
+
+//***   Estructuras de datos y tipos personalizados ***//
+    typedef enum {
+        MQTT_UPLINK_TELEMETRY,  // Lecturas de los nodos
+        MQTT_UPLINK_METRICS,    // Snapshots de métricas
+        MQTT_UPLINK_EVENTS,     // Anomalías y eventos de salud
+        MQTT_UPLINK_STATUS,     // Estado de la pasarela (online/offline)
+        MQTT_UPLINK_CLASS_COUNT
+    } mqtt_uplink_class_t;
+
+    // Atiende un pedido (terminado en NUL): escribe en out líneas completas de la respuesta y
+    // devuelve su longitud, 0 al terminar. Se llama desde la tarea de lotes con el mismo cursor,
+    // que empieza en 0, hasta agotar la respuesta; cada fragmento es un mensaje.
+    typedef size_t (*mqtt_uplink_query_handler_t)(const char *request, size_t len, uint32_t *cursor, char *out, size_t size);
+
+//***   Declaraciones de funciones (prototipos) ***//
+    // Levanta Ethernet, el cliente MQTT y la tarea de lotes. Llamar después de
+    // esp_netif_init() y esp_event_loop_create_default().
+    esp_err_t mqtt_uplink_start(void);
+
+    // Lectura numérica de un nodo; key debe ser una cadena estática. Apta para recv_cb: copia
+    // unos bytes a la cola y nunca bloquea. false si la cola estaba llena.
+    bool mqtt_uplink_post_value(mqtt_uplink_class_t msg_class, const uint8_t *mac, const char *key, float value);
+
+    // Objeto JSON ya formateado (sin salto de línea). Mismas garantías que post_value.
+    bool mqtt_uplink_post_json(mqtt_uplink_class_t msg_class, const uint8_t *mac, const char *json, size_t len);
+
+    // Registra quién responde los pedidos del tópico query; llamar antes de mqtt_uplink_start().
+    void mqtt_uplink_set_query_handler(mqtt_uplink_query_handler_t handler);
+
+    // true mientras el broker está conectado.
+    bool mqtt_uplink_connected(void);
+
+    #ifdef __cplusplus
+    }
+    #endif
@@ -0,0 +1,459 @@
+/************************************************************************************************
+ * Módulo: Enlace ascendente Ethernet + MQTT de la pasarela.
+ *
+ * Descripción: recv_cb solo reserva un hueco en la cola de entrada (anillo sin partición) y
+ * copia el registro; el formateo JSON, el armado de lotes y la red ocurren en la tarea de
+ * lotes, de clase BACKGROUND, en el núcleo opuesto a la radio. Cada lote es una línea JSON
+ * por registro. Un lote que no se puede publicar pasa a la cola sin conexión; el más antiguo
+ * se conserva tomado del anillo hasta que el broker lo acepte, así el orden se mantiene aun
+ * si la conexión cae a mitad del vaciado. Los pedidos del tópico query se copian desde la
+ * tarea del cliente MQTT a una cola y los responde la tarea de lotes, despertada con un
+ * registro vacío en la cola de entrada; la respuesta se publica en fragmentos del tamaño de un
+ * lote, así su memoria no depende del largo del historial pedido.
+ *
+ * Autor:
+ *   - Victor Manuel Patiño Delgado.
+ *
+ * Licencia: THE BEER-WARE LICENSE.
+ * As long as you retain this notice you can do whatever you want with this stuff.
+ * If we meet some day, and you think this stuff is worth it, you can buy me a beer in return.
+************************************************************************************************/
+
+//***   Bibliotecas y declaraciones de preprocesador    ***//
+    #include <stdio.h>
+    #include <string.h>
+    #include "freertos/FreeRTOS.h"
+    #include "freertos/task.h"
+    #include "esp_log.h"
+    #include "sdkconfig.h"
+    #include "mqtt_uplink.h"
+    #if CONFIG_MQTT_UPLINK_ENABLE
+    #include "freertos/ringbuf.h"
+    #include "esp_eth.h"
+    #include "esp_netif.h"
+    #include "esp_event.h"
+    #include "esp_mac.h"
+    #include "esp_timer.h"
+    #include "driver/gpio.h"
+    #include "mqtt_client.h"
+    #include "metrics.h"
+    #include "static_alloc.h"
+    #include "task_layout.h"
+    #endif
+
+//***   Definición de constantes y macros   ***//
+    #define RING_SIZE(bytes) (((bytes) + 3) & ~3)
+    #define TOPIC_LEN 64
+    #define LINE_LEN 768
+    #define QUERY_LEN 64
+    #define QUERY_QUEUE_LEN 2
+    #define WAKE_CLASS MQTT_UPLINK_CLASS_COUNT   // Registro sin datos: solo despierta la tarea
+
+    static const char *TAG = "mqtt_uplink";
+
+//***   Estructuras de datos y tipos personalizados ***//
+    #if CONFIG_MQTT_UPLINK_ENABLE
+    // Cabecera de cada registro en la cola de entrada; le sigue el JSON si key es NULL.
+    typedef struct {
+        uint8_t msg_class;
+        uint8_t mac[MQTT_UPLINK_MAC_LEN];
+        uint32_t time_ms;
+        const char *key;
+        float value;
+    } record_t;
+
+    typedef struct {
+        char data[CONFIG_MQTT_UPLINK_BATCH_BYTES];
+        size_t len;
+        int64_t opened_us;
+    } batch_t;
+
+    typedef struct {
+        char text[QUERY_LEN + 1];
+        size_t len;
+    } query_t;
+
+    static const char *const class_names[MQTT_UPLINK_CLASS_COUNT] = {"telemetry", "metrics", "events", "status"};
+    static const int class_qos[MQTT_UPLINK_CLASS_COUNT] = {
+        CONFIG_MQTT_UPLINK_QOS_TELEMETRY,
+        CONFIG_MQTT_UPLINK_QOS_METRICS,
+        CONFIG_MQTT_UPLINK_QOS_EVENTS,
+        CONFIG_MQTT_UPLINK_QOS_STATUS,
+    };
+
+    static uint8_t ingress_storage[RING_SIZE(CONFIG_MQTT_UPLINK_INGRESS_BYTES)] __attribute__((aligned(4)));
+    static StaticRingbuffer_t ingress_ring;
+    static RingbufHandle_t ingress;
+    static uint8_t offline_storage[RING_SIZE(CONFIG_MQTT_UPLINK_OFFLINE_BYTES)] __attribute__((aligned(4)));
+    static StaticRingbuffer_t offline_ring;
+    static RingbufHandle_t offline;
+    static uint8_t *offline_head;       // Lote más antiguo, tomado del anillo hasta publicarse
+    static size_t offline_head_len;
+
+    static batch_t batches[MQTT_UPLINK_CLASS_COUNT];
+    static char topics[MQTT_UPLINK_CLASS_COUNT][TOPIC_LEN];
+    static char query_topic[TOPIC_LEN];
+    static char reply_topic[TOPIC_LEN];
+    static mqtt_uplink_query_handler_t query_handler;
+    static QueueHandle_t query_queue;
+    static char reply_chunk[CONFIG_MQTT_UPLINK_BATCH_BYTES];
+    static esp_mqtt_client_handle_t client;
+    static volatile bool broker_connected;
+    #endif
+
+//***   Declaraciones de funciones (prototipos) ***//
+    #if CONFIG_MQTT_UPLINK_ENABLE
+    static esp_err_t init_ethernet(void);
+    static void ip_event_handler(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data);
+    static void mqtt_event_handler(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data);
+    static bool post_record(mqtt_uplink_class_t msg_class, const uint8_t *mac, const char *key, float value,
+                            const char *json, size_t len);
+    static void append_record(const record_t *record, size_t size);
+    static void flush_batch(uint8_t msg_class);
+    static void push_offline(uint8_t msg_class, const char *data, size_t len);
+    static void drain_offline(void);
+    static void queue_query(const esp_mqtt_event_t *event);
+    static void serve_queries(void);
+    static void batch_task(void *pvParameters);
+    #endif
+
+//***Implementación de funciones***//
+    #if CONFIG_MQTT_UPLINK_ENABLE
+    esp_err_t mqtt_uplink_start(void)
+    {
+        ingress = xRingbufferCreateStatic(sizeof(ingress_storage), RINGBUF_TYPE_NOSPLIT, ingress_storage, &ingress_ring);
+        offline = xRingbufferCreateStatic(sizeof(offline_storage), RINGBUF_TYPE_NOSPLIT, offline_storage, &offline_ring);
+        query_queue = STATIC_QUEUE_CREATE(QUERY_QUEUE_LEN, sizeof(query_t));
+        if (ingress == NULL || offline == NULL || query_queue == NULL) {return ESP_ERR_NO_MEM;}
+
+        uint8_t mac[MQTT_UPLINK_MAC_LEN];
+        esp_read_mac(mac, ESP_MAC_WIFI_STA);
+        for (uint8_t i = 0; i < MQTT_UPLINK_CLASS_COUNT; i++) {
+            snprintf(topics[i], TOPIC_LEN, "%s/%02x%02x%02x%02x%02x%02x/%s", CONFIG_MQTT_UPLINK_TOPIC_PREFIX,
+                     MAC2STR(mac), class_names[i]);
+        }
+        snprintf(query_topic, TOPIC_LEN, "%s/%02x%02x%02x%02x%02x%02x/query", CONFIG_MQTT_UPLINK_TOPIC_PREFIX, MAC2STR(mac));
+        snprintf(reply_topic, TOPIC_LEN, "%s/%02x%02x%02x%02x%02x%02x/reply", CONFIG_MQTT_UPLINK_TOPIC_PREFIX, MAC2STR(mac));
+
+        esp_err_t err = init_ethernet();
+        if (err != ESP_OK) {return err;}
+
+        esp_mqtt_client_config_t mqtt_config = {
+            .broker.address.uri = CONFIG_MQTT_UPLINK_BROKER_URI,
+            .session.last_will = {
+                .topic = topics[MQTT_UPLINK_STATUS],
+                .msg = "offline",
+                .qos = CONFIG_MQTT_UPLINK_QOS_STATUS,
+                .retain = 1,
+            },
+        };
+        client = esp_mqtt_client_init(&mqtt_config);
+        if (client == NULL) {return ESP_FAIL;}
+        esp_mqtt_client_register_event(client, ESP_EVENT_ANY_ID, mqtt_event_handler, NULL);
+        err = esp_mqtt_client_start(client);
+        if (err != ESP_OK) {return err;}
+
+        ESP_LOGI(TAG, "Uplink to %s, topics %s/...", CONFIG_MQTT_UPLINK_BROKER_URI, CONFIG_MQTT_UPLINK_TOPIC_PREFIX);
+        return TASK_LAYOUT_CREATE(batch_task, "mqtt_batch", 4096, NULL, TASK_CLASS_BACKGROUND, NULL);
+    }
+
+    bool mqtt_uplink_post_value(mqtt_uplink_class_t msg_class, const uint8_t *mac, const char *key, float value)
+    {
+        return post_record(msg_class, mac, key, value, NULL, 0);
+    }
+
+    bool mqtt_uplink_post_json(mqtt_uplink_class_t msg_class, const uint8_t *mac, const char *json, size_t len)
+    {
+        return post_record(msg_class, mac, NULL, 0, json, len);
+    }
+
+    void mqtt_uplink_set_query_handler(mqtt_uplink_query_handler_t handler)
+    {
+        query_handler = handler;
+    }
+
+    bool mqtt_uplink_connected(void)
+    {
+        return broker_connected;
+    }
+
+    static esp_err_t init_ethernet(void)
+    {
+        if (CONFIG_MQTT_UPLINK_ETH_POWER_GPIO >= 0) {
+            gpio_reset_pin(CONFIG_MQTT_UPLINK_ETH_POWER_GPIO);
+            gpio_set_direction(CONFIG_MQTT_UPLINK_ETH_POWER_GPIO, GPIO_MODE_OUTPUT);
+            gpio_set_level(CONFIG_MQTT_UPLINK_ETH_POWER_GPIO, 1);
+            vTaskDelay(pdMS_TO_TICKS(10));
+        }
+
+        eth_mac_config_t mac_config = ETH_MAC_DEFAULT_CONFIG();
+        eth_esp32_emac_config_t emac_config = ETH_ESP32_EMAC_DEFAULT_CONFIG();
+        emac_config.smi_mdc_gpio_num = CONFIG_MQTT_UPLINK_ETH_MDC_GPIO;
+        emac_config.smi_mdio_gpio_num = CONFIG_MQTT_UPLINK_ETH_MDIO_GPIO;
+    #if CONFIG_MQTT_UPLINK_ETH_CLOCK_GPIO0_IN
+        emac_config.clock_config.rmii.clock_mode = EMAC_CLK_EXT_IN;
+        emac_config.clock_config.rmii.clock_gpio = EMAC_CLK_IN_GPIO;
+    #else
+        emac_config.clock_config.rmii.clock_mode = EMAC_CLK_OUT;
+        #if CONFIG_MQTT_UPLINK_ETH_CLOCK_GPIO16_OUT
+        emac_config.clock_config.rmii.clock_gpio = EMAC_CLK_OUT_GPIO;
+        #elif CONFIG_MQTT_UPLINK_ETH_CLOCK_GPIO17_OUT
+        emac_config.clock_config.rmii.clock_gpio = EMAC_CLK_OUT_180_GPIO;
+        #else
+        emac_config.clock_config.rmii.clock_gpio = EMAC_APPL_CLK_OUT_GPIO;
+        #endif
+    #endif
+        esp_eth_mac_t *mac = esp_eth_mac_new_esp32(&emac_config, &mac_config);
+
+        eth_phy_config_t phy_config = ETH_PHY_DEFAULT_CONFIG();
+        phy_config.phy_addr = CONFIG_MQTT_UPLINK_ETH_PHY_ADDR;
+        phy_config.reset_gpio_num = -1;
+        esp_eth_phy_t *phy = esp_eth_phy_new_lan87xx(&phy_config);
+        if (mac == NULL || phy == NULL) {return ESP_FAIL;}
+
+        esp_eth_config_t eth_config = ETH_DEFAULT_CONFIG(mac, phy);
+        esp_eth_handle_t eth_handle = NULL;
+        esp_err_t err = esp_eth_driver_install(&eth_config, &eth_handle);
+        if (err != ESP_OK) {return err;}
+
+        esp_netif_config_t netif_config = ESP_NETIF_DEFAULT_ETH();
+        esp_netif_t *eth_netif = esp_netif_new(&netif_config);
+        esp_netif_attach(eth_netif, esp_eth_new_netif_glue(eth_handle));
+        esp_event_handler_register(IP_EVENT, IP_EVENT_ETH_GOT_IP, ip_event_handler, NULL);
+        return esp_eth_start(eth_handle);
+    }
+
+    static void ip_event_handler(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data)
+    {
+        const ip_event_got_ip_t *event = (const ip_event_got_ip_t *)event_data;
+        ESP_LOGI(TAG, "Ethernet up, IP " IPSTR, IP2STR(&event->ip_info.ip));
+    }
+
+    static void mqtt_event_handler(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data)
+    {
+        switch ((esp_mqtt_event_id_t)event_id) {
+            case MQTT_EVENT_CONNECTED:
+                broker_connected = true;
+                // Encolado: el manejador corre en la tarea del cliente y no debe esperar la red.
+                esp_mqtt_client_enqueue(client, topics[MQTT_UPLINK_STATUS], "online", 0,
+                                        CONFIG_MQTT_UPLINK_QOS_STATUS, 1, true);
+                if (query_handler != NULL) {esp_mqtt_client_subscribe(client, query_topic, 1);}
+                ESP_LOGI(TAG, "Broker connected");
+                break;
+            case MQTT_EVENT_DATA:
+                queue_query((const esp_mqtt_event_t *)event_data);
+                break;
+            case MQTT_EVENT_DISCONNECTED:
+                broker_connected = false;
+                ESP_LOGW(TAG, "Broker disconnected, batching offline");
+                break;
+            default:
+                break;
+        }
+    }
+
+    static bool post_record(mqtt_uplink_class_t msg_class, const uint8_t *mac, const char *key, float value,
+                            const char *json, size_t len)
+    {
+        if (ingress == NULL || msg_class >= MQTT_UPLINK_CLASS_COUNT) {return false;}
+
+        void *slot = NULL;
+        if (xRingbufferSendAcquire(ingress, &slot, sizeof(record_t) + len, 0) != pdTRUE) {
+            metrics_inc(METRIC_UPLINK_DROPPED);
+            metrics_inc(METRIC_QUEUE_OVERFLOW);
+            return false;
+        }
+        record_t *record = (record_t *)slot;
+        record->msg_class = msg_class;
+        memcpy(record->mac, mac, MQTT_UPLINK_MAC_LEN);
+        record->time_ms = (uint32_t)(esp_timer_get_time() / 1000);
+        record->key = key;
+        record->value = value;
+        if (len > 0) {memcpy(record + 1, json, len);}
+        xRingbufferSendComplete(ingress, slot);
+        return true;
+    }
+
+    static void append_record(const record_t *record, size_t size)
+    {
+        if (record->msg_class == WAKE_CLASS) {return;}
+        char line[LINE_LEN];
+        int len = snprintf(line, sizeof(line), "{\"node\":\"" MACSTR "\",\"t\":%lu,", MAC2STR(record->mac),
+                           (unsigned long)record->time_ms);
+        if (record->key != NULL) {
+            len += snprintf(line + len, sizeof(line) - len, "\"%s\":%.3f}\n", record->key, record->value);
+        } else {
+            len += snprintf(line + len, sizeof(line) - len, "\"data\":%.*s}\n", (int)(size - sizeof(record_t)),
+                            (const char *)(record + 1));
+        }
+        if (len >= (int)sizeof(line) || len > CONFIG_MQTT_UPLINK_BATCH_BYTES) {
+            metrics_inc(METRIC_UPLINK_DROPPED);
+            return;
+        }
+
+        batch_t *batch = &batches[record->msg_class];
+        if (batch->len + len > sizeof(batch->data)) {flush_batch(record->msg_class);}
+        if (batch->len == 0) {batch->opened_us = esp_timer_get_time();}
+        memcpy(batch->data + batch->len, line, len);
+        batch->len += len;
+    }
+
+    static void flush_batch(uint8_t msg_class)
+    {
+        batch_t *batch = &batches[msg_class];
+        if (batch->len == 0) {return;}
+
+        if (broker_connected) {drain_offline();}
+        bool published = false;
+        if (broker_connected && offline_head == NULL) {
+            published = esp_mqtt_client_publish(client, topics[msg_class], batch->data, batch->len,
+                                                class_qos[msg_class], 0) >= 0;
+        }
+        if (published) {metrics_inc(METRIC_UPLINK_PUBLISHED);}
+        else {push_offline(msg_class, batch->data, batch->len);}
+        batch->len = 0;
+    }
+
+    static void push_offline(uint8_t msg_class, const char *data, size_t len)
+    {
+        void *slot = NULL;
+        // Un lote que nunca cabría no debe vaciar el anillo antes de descartarse.
+        if (len + 1 > xRingbufferGetMaxItemSize(offline)) {
+            metrics_inc(METRIC_UPLINK_DROPPED);
+            return;
+        }
+        while (xRingbufferSendAcquire(offline, &slot, len + 1, 0) != pdTRUE) {
+            // Sin espacio: se descarta el lote más antiguo. Si drain_offline lo tiene tomado
+            // es ese: el anillo NOSPLIT solo libera espacio en orden, así que devolver lotes
+            // posteriores no haría sitio mientras la cabeza siga tomada.
+            if (offline_head != NULL) {
+                vRingbufferReturnItem(offline, offline_head);
+                offline_head = NULL;
+                metrics_inc(METRIC_UPLINK_DROPPED);
+                continue;
+            }
+            size_t size;
+            void *oldest = xRingbufferReceive(offline, &size, 0);
+            if (oldest == NULL) {
+                metrics_inc(METRIC_UPLINK_DROPPED);
+                return;
+            }
+            vRingbufferReturnItem(offline, oldest);
+            metrics_inc(METRIC_UPLINK_DROPPED);
+        }
+        uint8_t *item = (uint8_t *)slot;
+        item[0] = msg_class;
+        memcpy(item + 1, data, len);
+        xRingbufferSendComplete(offline, slot);
+    }
+
+    static void drain_offline(void)
+    {
+        while (broker_connected) {
+            if (offline_head == NULL) {
+                offline_head = xRingbufferReceive(offline, &offline_head_len, 0);
+                if (offline_head == NULL) {return;}
+            }
+            uint8_t msg_class = offline_head[0];
+            if (esp_mqtt_client_publish(client, topics[msg_class], (const char *)offline_head + 1, offline_head_len - 1,
+                                        class_qos[msg_class], 0) < 0) {return;}
+            metrics_inc(METRIC_UPLINK_PUBLISHED);
+            vRingbufferReturnItem(offline, offline_head);
+            offline_head = NULL;
+        }
+    }
+
+    // En la tarea del cliente MQTT: solo copia el pedido, la respuesta puede ser larga.
+    static void queue_query(const esp_mqtt_event_t *event)
+    {
+        if (query_handler == NULL || event->topic_len != (int)strlen(query_topic) ||
+            memcmp(event->topic, query_topic, event->topic_len) != 0) {return;}
+        // Un pedido fragmentado o más largo que QUERY_LEN no es válido.
+        if (event->data_len != event->total_data_len || event->data_len > QUERY_LEN) {return;}
+
+        query_t query = {.len = event->data_len};
+        memcpy(query.text, event->data, event->data_len);
+        query.text[query.len] = '\0';
+        if (xQueueSend(query_queue, &query, 0) != pdTRUE) {
+            ESP_LOGW(TAG, "Query dropped, %d pending", QUERY_QUEUE_LEN);
+            return;
+        }
+        void *slot = NULL;
+        if (xRingbufferSendAcquire(ingress, &slot, sizeof(record_t), 0) == pdTRUE) {
+            ((record_t *)slot)->msg_class = WAKE_CLASS;
+            xRingbufferSendComplete(ingress, slot);
+        }
+    }
+
+    static void serve_queries(void)
+    {
+        query_t query;
+        while (xQueueReceive(query_queue, &query, 0) == pdTRUE) {
+            uint32_t cursor = 0;
+            size_t len;
+            while ((len = query_handler(query.text, query.len, &cursor, reply_chunk, sizeof(reply_chunk))) > 0) {
+                if (!broker_connected || esp_mqtt_client_publish(client, reply_topic, reply_chunk, len, 0, 0) < 0) {
+                    ESP_LOGW(TAG, "Reply to \"%s\" cut short", query.text);
+                    break;
+                }
+            }
+        }
+    }
+
+    static void batch_task(void *pvParameters)
+    {
+        const int64_t batch_us = (int64_t)CONFIG_MQTT_UPLINK_BATCH_MS * 1000;
+
+        while (1) {
+            // Espera hasta el vencimiento del lote más antiguo, o un periodo para vaciar la
+            // cola sin conexión aunque no entren registros.
+            int64_t now = esp_timer_get_time();
+            int64_t wait_us = batch_us;
+            for (uint8_t i = 0; i < MQTT_UPLINK_CLASS_COUNT; i++) {
+                if (batches[i].len > 0) {
+                    int64_t left = batches[i].opened_us + batch_us - now;
+                    if (left < wait_us) {wait_us = left > 0 ? left : 0;}
+                }
+            }
+
+            size_t size;
+            record_t *record = xRingbufferReceive(ingress, &size, pdMS_TO_TICKS(wait_us / 1000));
+            if (record != NULL) {
+                append_record(record, size);
+                vRingbufferReturnItem(ingress, record);
+            }
+
+            now = esp_timer_get_time();
+            for (uint8_t i = 0; i < MQTT_UPLINK_CLASS_COUNT; i++) {
+                if (batches[i].len > 0 && now - batches[i].opened_us >= batch_us) {flush_batch(i);}
+            }
+            if (broker_connected) {drain_offline();}
+            serve_queries();
+        }
+    }
+    #else
+    esp_err_t mqtt_uplink_start(void)
+    {
+        ESP_LOGW(TAG, "MQTT_UPLINK_ENABLE is off");
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    bool mqtt_uplink_post_value(mqtt_uplink_class_t msg_class, const uint8_t *mac, const char *key, float value)
+    {
+        return false;
+    }
+
+    bool mqtt_uplink_post_json(mqtt_uplink_class_t msg_class, const uint8_t *mac, const char *json, size_t len)
+    {
+        return false;
+    }
+
+    void mqtt_uplink_set_query_handler(mqtt_uplink_query_handler_t handler)
+    {
+    }
+
+    bool mqtt_uplink_connected(void)
+    {
+        return false;
+    }
+    #endif
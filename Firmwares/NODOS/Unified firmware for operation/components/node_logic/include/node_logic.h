@@ -0,0 +1,92 @@
+/************************************************************************************************
+ * Módulo: Lógica de nodo independiente del hardware.
+ *
+ * Descripción: Conversión del LM35, lógica de detección PIR/radar, codificación de la trama de
+ * sensores, reacción del actuador a las tramas remotas y búsqueda de pares. No depende de
+ * periféricos ni de la radio, por lo que la misma implementación que corre en los nodos se
+ * mide en el banco de pruebas (Benchmarks) y se reproduce contra capturas (Replay) tanto en
+ * el destino como en el host Linux.
+ *
+ * Autor:
+ *   - Victor Manuel Patiño Delgado.
+ *
+ * Licencia: THE BEER-WARE LICENSE.
+ * As long as you retain this notice you can do whatever you want with this stuff.
+ * If we meet some day, and you think this stuff is worth it, you can buy me a beer in return.
+************************************************************************************************/
+#pragma once
+
+//***   Bibliotecas y declaraciones de preprocesador    ***//
+    #include <stdint.h>
+    #include <stdbool.h>
+    #include <stddef.h>
+
+    #ifdef __cplusplus
+    extern "C" {
+    #endif
+
+//***   Definición de constantes y macros   ***//
+    #define NODE_MAC_LEN 6
+    #define NODE_LM35_PACKET_ID 0x01
+
+    // servo_control del receptor: ida y vuelta del pulso a un paso por NODE_SERVO_STEP_MS con una
+    // pausa en cada extremo, sin consultar la entrada mientras tanto.
+    #define NODE_SERVO_MIN_PULSEWIDTH 300
+    #define NODE_SERVO_MAX_PULSEWIDTH 700
+    #define NODE_SERVO_STEP_MS 10
+    #define NODE_SERVO_PAUSE_MS 500
+    #define NODE_SERVO_SWEEP_MS (2 * ((NODE_SERVO_MAX_PULSEWIDTH - NODE_SERVO_MIN_PULSEWIDTH + 1) * NODE_SERVO_STEP_MS + \
+                                  NODE_SERVO_PAUSE_MS))
+    #define NODE_ACTUATION_COOLDOWN_MS 1000     // Entre barridos, con el gobernador térmico al 100 %
+
+//***   Estructuras de datos y tipos personalizados ***//
+    typedef struct {
+        float temperature;
+        uint8_t pir_state;
+        uint8_t radar_state;
+    } device_data_t;
+
+    typedef struct {
+        uint8_t packet_id;
+        float lm35_temperature;
+        uint8_t pir_state;
+        uint8_t radar_state;
+        device_data_t other_device_data;
+    } sensor_data_t;
+
+    typedef struct {
+        uint8_t pir;
+        uint8_t radar;
+        uint8_t led;
+    } detection_state_t;
+
+    // Arranque del barrido del servo: solo en un flanco de subida de la entrada y pasado el
+    // enfriamiento desde el barrido anterior.
+    typedef struct {
+        uint8_t previous_input;
+        uint32_t last_start;
+    } actuation_gate_t;
+
+//***   Declaraciones de funciones (prototipos) ***//
+    // Promedio crudo del ADC de 12 bits (referencia 5 V) a grados Celsius.
+    float node_lm35_celsius(uint32_t adc_average);
+
+    // Un ciclo de la lógica de detección. Las edades son el tiempo desde el último flanco de
+    // cada sensor, en las mismas unidades que timeout. Devuelve el nivel a aplicar al LED.
+    uint8_t node_detection_process(detection_state_t *state, uint32_t pir_age, uint32_t radar_age, uint32_t timeout);
+
+    // Nivel del actuador que pide una trama de sensores remota: sigue al radar del otro nodo.
+    uint8_t node_remote_actuator_level(const sensor_data_t *data);
+
+    // true si con input debe arrancar un barrido en now (mismas unidades que cooldown).
+    bool node_actuation_gate(actuation_gate_t *gate, uint8_t input, uint32_t now, uint32_t cooldown);
+
+    size_t node_sensor_encode(uint8_t *buffer, size_t room, const sensor_data_t *data);
+    bool node_sensor_decode(const uint8_t *payload, size_t payload_len, sensor_data_t *data);
+
+    // Índice de mac en la tabla, -1 si no está.
+    int node_peer_index(const uint8_t (*table)[NODE_MAC_LEN], size_t count, const uint8_t *mac);
+
+    #ifdef __cplusplus
+    }
+    #endif
@@ -0,0 +1,76 @@
+/************************************************************************************************
+ * Módulo: Lógica de nodo independiente del hardware.
+ *
+ * Descripción: Implementación compartida por los nodos de detección, la pasarela, el banco
+ * de pruebas y la reproducción de capturas. Cualquier cambio aquí se refleja directamente en
+ * los resultados de Benchmarks y en las salidas de Replay.
+ *
+ * Autor:
+ *   - Victor Manuel Patiño Delgado.
+ *
+ * Licencia: THE BEER-WARE LICENSE.
+ * As long as you retain this notice you can do whatever you want with this stuff.
+ * If we meet some day, and you think this stuff is worth it, you can buy me a beer in return.
+************************************************************************************************/
+
+//***   Bibliotecas y declaraciones de preprocesador    ***//
+    #include <string.h>
+    #include "node_logic.h"
+
+//***Implementación de funciones***//
+    float node_lm35_celsius(uint32_t adc_average)
+    {
+        float voltage = adc_average * (5.0 / 4095.0);
+        return voltage * 100.0;
+    }
+
+    uint8_t node_detection_process(detection_state_t *state, uint32_t pir_age, uint32_t radar_age, uint32_t timeout)
+    {
+        state->led = (state->pir || state->radar || state->led) ? 1 : 0;
+        uint8_t level = state->led;
+
+        if (pir_age >= timeout) {
+            state->pir = 0;
+            state->led = 0;
+        }
+        if (radar_age >= timeout) {
+            state->radar = 0;
+            state->led = 0;
+        }
+        return level;
+    }
+
+    uint8_t node_remote_actuator_level(const sensor_data_t *data)
+    {
+        return data->radar_state ? 1 : 0;
+    }
+
+    bool node_actuation_gate(actuation_gate_t *gate, uint8_t input, uint32_t now, uint32_t cooldown)
+    {
+        bool start = input == 1 && gate->previous_input == 0 && (now - gate->last_start) >= cooldown;
+        if (start) {gate->last_start = now;}
+        gate->previous_input = input;
+        return start;
+    }
+
+    size_t node_sensor_encode(uint8_t *buffer, size_t room, const sensor_data_t *data)
+    {
+        if (room < sizeof(sensor_data_t)) {return 0;}
+        memcpy(buffer, data, sizeof(sensor_data_t));
+        return sizeof(sensor_data_t);
+    }
+
+    bool node_sensor_decode(const uint8_t *payload, size_t payload_len, sensor_data_t *data)
+    {
+        if (payload == NULL || payload_len != sizeof(sensor_data_t)) {return false;}
+        memcpy(data, payload, sizeof(sensor_data_t));
+        return true;
+    }
+
+    int node_peer_index(const uint8_t (*table)[NODE_MAC_LEN], size_t count, const uint8_t *mac)
+    {
+        for (size_t i = 0; i < count; i++) {
+            if (memcmp(table[i], mac, NODE_MAC_LEN) == 0) {return (int)i;}
+        }
+        return -1;
+    }
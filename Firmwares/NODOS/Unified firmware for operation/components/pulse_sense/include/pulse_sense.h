@@ -0,0 +1,47 @@
+/************************************************************************************************
+ * Módulo: Front end de sensado por contador de pulsos (PCNT).
+ *
+ * Descripción: PIR y radar se conectan a unidades PCNT que cuentan flancos de bajada en
+ * hardware, con filtro de glitches. Una tarea de muestreo de clase SENSING lee los contadores
+ * a periodo fijo y entrega a la aplicación los flancos de la ventana, la densidad de pulsos y,
+ * para el radar, la frecuencia Doppler estimada y la velocidad relativa. Ningún flanco genera
+ * una interrupción.
+ *
+ * Autor:
+ *   - Victor Manuel Patiño Delgado.
+ *
+ * Licencia: THE BEER-WARE LICENSE.
+ * As long as you retain this notice you can do whatever you want with this stuff.
+ * If we meet some day, and you think this stuff is worth it, you can buy me a beer in return.
+************************************************************************************************/
+#pragma once
+
+//***   Bibliotecas y declaraciones de preprocesador    ***//
+    #include <stdint.h>
+    #include "esp_err.h"
+    #include "sdkconfig.h"
+
+    #ifdef __cplusplus
+    extern "C" {
+    #endif
+
+//***   Estructuras de datos y tipos personalizados ***//
+    typedef struct {
+        uint32_t window_us;         // Duración real de la ventana
+        uint32_t pir_edges;         // Flancos del PIR en la ventana
+        uint32_t radar_edges;       // Flancos del radar en la ventana
+        float pir_density_hz;       // Flancos por segundo del PIR
+        float radar_doppler_hz;     // Un flanco por ciclo de la señal Doppler
+        float radar_speed_mps;      // 0 si no hay portadora configurada
+    } pulse_sense_sample_t;
+
+    // Se invoca desde la tarea de muestreo una vez por periodo.
+    typedef void (*pulse_sense_cb_t)(const pulse_sense_sample_t *sample, void *arg);
+
+//***   Declaraciones de funciones (prototipos) ***//
+    // Configura ambas unidades PCNT y lanza la tarea de muestreo.
+    esp_err_t pulse_sense_start(int pir_gpio, int radar_gpio, pulse_sense_cb_t callback, void *arg);
+
+    #ifdef __cplusplus
+    }
+    #endif
@@ -0,0 +1,139 @@
+/************************************************************************************************
+ * Módulo: Front end de sensado por contador de pulsos (PCNT).
+ *
+ * Descripción: Los contadores no se borran entre muestras: el PCNT vuelve a cero al alcanzar
+ * el límite alto y la diferencia se toma módulo ese límite, así no se pierden los flancos que
+ * lleguen entre la lectura y un borrado. La ventana es válida mientras entren menos de
+ * PCNT_LIMIT flancos por periodo (1.6 MHz con el periodo por defecto).
+ *
+ * Autor:
+ *   - Victor Manuel Patiño Delgado.
+ *
+ * Licencia: THE BEER-WARE LICENSE.
+ * As long as you retain this notice you can do whatever you want with this stuff.
+ * If we meet some day, and you think this stuff is worth it, you can buy me a beer in return.
+************************************************************************************************/
+
+//***   Bibliotecas y declaraciones de preprocesador    ***//
+    #include "freertos/FreeRTOS.h"
+    #include "freertos/task.h"
+    #include "driver/pulse_cnt.h"
+    #include "esp_timer.h"
+    #include "esp_log.h"
+    #include "esp_check.h"
+    #include "sdkconfig.h"
+    #include "pulse_sense.h"
+    #include "task_layout.h"
+
+//***   Definición de constantes y macros   ***//
+    #define PCNT_LIMIT 32767
+    #define SPEED_OF_LIGHT 299792458.0f
+
+    static const char *TAG = "pulse_sense";
+
+//***   Estructuras de datos y tipos personalizados ***//
+    #if CONFIG_PULSE_SENSE_ENABLE
+    typedef struct {
+        pcnt_unit_handle_t unit;
+        int previous;
+    } edge_counter_t;
+
+    static edge_counter_t pir_counter;
+    static edge_counter_t radar_counter;
+    static pulse_sense_cb_t sample_callback;
+    static void *sample_arg;
+    #endif
+
+//***   Declaraciones de funciones (prototipos) ***//
+    #if CONFIG_PULSE_SENSE_ENABLE
+    static esp_err_t counter_init(edge_counter_t *counter, int gpio);
+    static uint32_t counter_delta(edge_counter_t *counter);
+    static void sampler_task(void *pvParameters);
+    #endif
+
+//***Implementación de funciones***//
+    #if CONFIG_PULSE_SENSE_ENABLE
+    esp_err_t pulse_sense_start(int pir_gpio, int radar_gpio, pulse_sense_cb_t callback, void *arg)
+    {
+        sample_callback = callback;
+        sample_arg = arg;
+        ESP_RETURN_ON_ERROR(counter_init(&pir_counter, pir_gpio), TAG, "PIR counter");
+        ESP_RETURN_ON_ERROR(counter_init(&radar_counter, radar_gpio), TAG, "radar counter");
+        ESP_LOGI(TAG, "PCNT front end: period %d ms, glitch filter %d ns", CONFIG_PULSE_SENSE_PERIOD_MS,
+                 CONFIG_PULSE_SENSE_GLITCH_NS);
+        return TASK_LAYOUT_CREATE(sampler_task, "pulse_sense", 3072, NULL, TASK_CLASS_SENSING, NULL);
+    }
+
+    static esp_err_t counter_init(edge_counter_t *counter, int gpio)
+    {
+        pcnt_unit_config_t unit_config = {
+            .low_limit = -1,
+            .high_limit = PCNT_LIMIT,
+        };
+        ESP_RETURN_ON_ERROR(pcnt_new_unit(&unit_config, &counter->unit), TAG, "pcnt_new_unit");
+
+        if (CONFIG_PULSE_SENSE_GLITCH_NS > 0) {
+            pcnt_glitch_filter_config_t filter_config = {.max_glitch_ns = CONFIG_PULSE_SENSE_GLITCH_NS};
+            ESP_RETURN_ON_ERROR(pcnt_unit_set_glitch_filter(counter->unit, &filter_config), TAG, "glitch filter");
+        }
+
+        pcnt_chan_config_t channel_config = {
+            .edge_gpio_num = gpio,
+            .level_gpio_num = -1,
+        };
+        pcnt_channel_handle_t channel;
+        ESP_RETURN_ON_ERROR(pcnt_new_channel(counter->unit, &channel_config, &channel), TAG, "pcnt_new_channel");
+        // Mismo flanco que disparaban las interrupciones: bajada.
+        ESP_RETURN_ON_ERROR(pcnt_channel_set_edge_action(channel, PCNT_CHANNEL_EDGE_ACTION_HOLD,
+                                                         PCNT_CHANNEL_EDGE_ACTION_INCREASE), TAG, "edge action");
+
+        ESP_RETURN_ON_ERROR(pcnt_unit_enable(counter->unit), TAG, "pcnt_unit_enable");
+        ESP_RETURN_ON_ERROR(pcnt_unit_clear_count(counter->unit), TAG, "pcnt_unit_clear_count");
+        counter->previous = 0;
+        return pcnt_unit_start(counter->unit);
+    }
+
+    static uint32_t counter_delta(edge_counter_t *counter)
+    {
+        int count = 0;
+        pcnt_unit_get_count(counter->unit, &count);
+        int delta = count - counter->previous;
+        if (delta < 0) {delta += PCNT_LIMIT;}
+        counter->previous = count;
+        return (uint32_t)delta;
+    }
+
+    static void sampler_task(void *pvParameters)
+    {
+        const float meters_per_cycle = CONFIG_PULSE_SENSE_RADAR_CARRIER_MHZ > 0 ?
+                                       SPEED_OF_LIGHT / (2.0f * CONFIG_PULSE_SENSE_RADAR_CARRIER_MHZ * 1e6f) : 0.0f;
+        TickType_t wake = xTaskGetTickCount();
+        int64_t previous_us = esp_timer_get_time();
+
+        while (1) {
+            vTaskDelayUntil(&wake, pdMS_TO_TICKS(CONFIG_PULSE_SENSE_PERIOD_MS));
+
+            int64_t now_us = esp_timer_get_time();
+            pulse_sense_sample_t sample = {
+                .window_us = (uint32_t)(now_us - previous_us),
+                .pir_edges = counter_delta(&pir_counter),
+                .radar_edges = counter_delta(&radar_counter),
+            };
+            previous_us = now_us;
+
+            float window_s = sample.window_us / 1e6f;
+            if (window_s > 0) {
+                sample.pir_density_hz = sample.pir_edges / window_s;
+                sample.radar_doppler_hz = sample.radar_edges / window_s;
+                sample.radar_speed_mps = sample.radar_doppler_hz * meters_per_cycle;
+            }
+            if (sample_callback != NULL) {sample_callback(&sample, sample_arg);}
+        }
+    }
+    #else
+    esp_err_t pulse_sense_start(int pir_gpio, int radar_gpio, pulse_sense_cb_t callback, void *arg)
+    {
+        ESP_LOGW(TAG, "PULSE_SENSE_ENABLE is off");
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    #endif
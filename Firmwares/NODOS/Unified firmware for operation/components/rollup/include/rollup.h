@@ -0,0 +1,59 @@
+/************************************************************************************************
+ * Módulo: Historial por nodo en memoria fija con varias resoluciones (rollups).
+ *
+ * Descripción: Cada nodo tiene un anillo de muestras crudas y dos anillos de agregados (1
+ * minuto y 1 hora) con mínimo, máximo, media y cantidad. Cada inserción actualiza en O(1) los
+ * acumuladores de los periodos en curso y cierra los periodos vencidos; los periodos sin
+ * lecturas quedan con cantidad 0, así el índice de cada anillo es el tiempo. Los valores se
+ * guardan en centésimas (int16): el rango útil es de -327.67 a 327.67. El tiempo es el de
+ * marcha de la pasarela, en segundos.
+ *
+ * Autor:
+ *   - Victor Manuel Patiño Delgado.
+ *
+ * Licencia: THE BEER-WARE LICENSE.
+ * As long as you retain this notice you can do whatever you want with this stuff.
+ * If we meet some day, and you think this stuff is worth it, you can buy me a beer in return.
+************************************************************************************************/
+#pragma once
+
+//***   Bibliotecas y declaraciones de preprocesador    ***//
+    #include <stdint.h>
+    #include <stddef.h>
+    #include "sdkconfig.h"
+
+    #ifdef __cplusplus
+    extern "C" {
+    #endif
+
+//***   Definición de constantes y macros   ***//
+    #define ROLLUP_MAC_LEN 6
+
+//***   Estructuras de datos y tipos personalizados ***//
+    typedef enum {
+        ROLLUP_RAW,
+        ROLLUP_MINUTE,
+        ROLLUP_HOUR,
+        ROLLUP_LEVEL_COUNT
+    } rollup_level_t;
+
+    typedef struct {
+        int16_t min;            // Centésimas
+        int16_t max;
+        int16_t mean;
+        uint16_t count;         // 0: periodo sin lecturas
+    } rollup_bucket_t;
+
+//***   Declaraciones de funciones (prototipos) ***//
+    // Registra una lectura de un nodo. Sin reservas ni E/S; apta para recv_cb.
+    void rollup_insert(const uint8_t *mac, float value);
+
+    // Responde "<mac> raw|minute|hour" (terminado en NUL) con líneas JSON: una cabecera y un
+    // registro por muestra o periodo, del más antiguo al en curso. Escribe en out solo líneas
+    // completas y devuelve su longitud; se llama con cursor en 0 y de nuevo con el mismo cursor
+    // hasta que devuelve 0. Firma compatible con mqtt_uplink_query_handler_t.
+    size_t rollup_query(const char *request, size_t len, uint32_t *cursor, char *out, size_t size);
+
+    #ifdef __cplusplus
+    }
+    #endif
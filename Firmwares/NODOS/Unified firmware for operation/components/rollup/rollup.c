@@ -0,0 +1,294 @@
+/************************************************************************************************
+ * Módulo: Historial por nodo en memoria fija con varias resoluciones (rollups).
+ *
+ * Descripción: El periodo k de un nivel ocupa la posición k % longitud de su anillo, con k el
+ * tiempo de marcha dividido por el periodo; cerrar un periodo es copiar su acumulador a esa
+ * posición. Minutos y horas se acumulan ambos desde las lecturas crudas, no la hora desde los
+ * minutos, así la media horaria pondera cada lectura igual. La consulta copia cada registro
+ * bajo el candado y le da formato afuera, para no demorar la inserción desde recv_cb. El
+ * cursor es el número de periodo o de muestra siguiente, no una posición: un periodo que se
+ * cierra entre dos fragmentos no duplica ni salta registros.
+ *
+ * Autor:
+ *   - Victor Manuel Patiño Delgado.
+ *
+ * Licencia: THE BEER-WARE LICENSE.
+ * As long as you retain this notice you can do whatever you want with this stuff.
+ * If we meet some day, and you think this stuff is worth it, you can buy me a beer in return.
+************************************************************************************************/
+
+//***   Bibliotecas y declaraciones de preprocesador    ***//
+    #include <stdio.h>
+    #include <string.h>
+    #include <stdbool.h>
+    #include <math.h>
+    #include "freertos/FreeRTOS.h"
+    #include "esp_timer.h"
+    #include "esp_log.h"
+    #include "rollup.h"
+
+//***   Definición de constantes y macros   ***//
+    #define CURSOR_DONE UINT32_MAX
+    #define LINE_LEN 96
+    #define VALUE_LIMIT 32767
+
+    static const char *TAG = "rollup";
+
+//***   Estructuras de datos y tipos personalizados ***//
+    #if CONFIG_ROLLUP_ENABLE
+    typedef struct {
+        uint32_t t_s;
+        int16_t value;
+    } raw_sample_t;
+
+    // Periodo en curso de un nivel agregado.
+    typedef struct {
+        uint32_t open_id;
+        uint32_t first_id;          // Primer periodo con datos de este nodo
+        int32_t sum;
+        int16_t min;
+        int16_t max;
+        uint16_t count;
+    } level_state_t;
+
+    typedef struct {
+        bool valid;
+        uint8_t mac[ROLLUP_MAC_LEN];
+        uint32_t raw_total;         // Muestras crudas insertadas; la última está en (total - 1) % longitud
+        raw_sample_t raw[CONFIG_ROLLUP_RAW_SAMPLES];
+        level_state_t levels[ROLLUP_LEVEL_COUNT];   // ROLLUP_RAW sin uso
+        rollup_bucket_t minutes[CONFIG_ROLLUP_MINUTES];
+        rollup_bucket_t hours[CONFIG_ROLLUP_HOURS];
+    } node_t;
+
+    typedef enum {
+        ENTRY_NONE,
+        ENTRY_CLOSED,
+        ENTRY_OPEN,                 // Periodo en curso, siempre el último
+    } entry_kind_t;
+
+    static const char *const level_names[ROLLUP_LEVEL_COUNT] = {"raw", "minute", "hour"};
+    static const uint32_t level_period_s[ROLLUP_LEVEL_COUNT] = {0, 60, 3600};
+
+    static portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+    static node_t nodes[CONFIG_ROLLUP_MAX_NODES];
+    static bool full_reported;
+    #endif
+
+//***   Declaraciones de funciones (prototipos) ***//
+    #if CONFIG_ROLLUP_ENABLE
+    static node_t *find_node(const uint8_t *mac, bool create, uint32_t now_s);
+    static rollup_bucket_t *level_ring(node_t *node, rollup_level_t level, uint32_t *len);
+    static void roll(node_t *node, rollup_level_t level, uint32_t now_s);
+    static entry_kind_t read_entry(node_t *node, rollup_level_t level, uint32_t *id, rollup_bucket_t *bucket, uint32_t *t_s);
+    static int format_entry(char *line, rollup_level_t level, entry_kind_t kind, const rollup_bucket_t *bucket, uint32_t t_s);
+    #endif
+
+//***Implementación de funciones***//
+    #if CONFIG_ROLLUP_ENABLE
+    void rollup_insert(const uint8_t *mac, float value)
+    {
+        uint32_t now_s = (uint32_t)(esp_timer_get_time() / 1000000);
+        float scaled = roundf(value * 100);
+        int16_t centi = scaled >= VALUE_LIMIT ? VALUE_LIMIT : scaled <= -VALUE_LIMIT ? -VALUE_LIMIT : (int16_t)scaled;
+
+        taskENTER_CRITICAL(&lock);
+        node_t *node = find_node(mac, true, now_s);
+        if (node != NULL) {
+            raw_sample_t *sample = &node->raw[node->raw_total % CONFIG_ROLLUP_RAW_SAMPLES];
+            sample->t_s = now_s;
+            sample->value = centi;
+            node->raw_total++;
+            for (rollup_level_t level = ROLLUP_MINUTE; level < ROLLUP_LEVEL_COUNT; level++) {
+                roll(node, level, now_s);
+                level_state_t *state = &node->levels[level];
+                if (state->count == 0 || centi < state->min) {state->min = centi;}
+                if (state->count == 0 || centi > state->max) {state->max = centi;}
+                state->sum += centi;
+                if (state->count < UINT16_MAX) {state->count++;}
+            }
+        }
+        taskEXIT_CRITICAL(&lock);
+
+        if (node == NULL && !full_reported) {
+            full_reported = true;
+            ESP_LOGW(TAG, "Table full (%d nodes, %u bytes), new nodes are not recorded", CONFIG_ROLLUP_MAX_NODES,
+                     (unsigned)sizeof(nodes));
+        }
+    }
+
+    size_t rollup_query(const char *request, size_t len, uint32_t *cursor, char *out, size_t size)
+    {
+        if (*cursor == CURSOR_DONE) {return 0;}
+
+        uint8_t mac[ROLLUP_MAC_LEN];
+        char level_name[8];
+        rollup_level_t level = ROLLUP_LEVEL_COUNT;
+        if (sscanf(request, "%hhx:%hhx:%hhx:%hhx:%hhx:%hhx %7s", &mac[0], &mac[1], &mac[2], &mac[3], &mac[4], &mac[5],
+                   level_name) == 7) {
+            for (level = ROLLUP_RAW; level < ROLLUP_LEVEL_COUNT && strcmp(level_name, level_names[level]) != 0; level++) {}
+        }
+        uint32_t now_s = (uint32_t)(esp_timer_get_time() / 1000000);
+        node_t *node = NULL;
+        if (level < ROLLUP_LEVEL_COUNT) {
+            taskENTER_CRITICAL(&lock);
+            node = find_node(mac, false, now_s);
+            // Cierra los periodos vencidos desde la última lectura, para que figuren vacíos.
+            if (node != NULL && *cursor == 0) {
+                for (rollup_level_t i = ROLLUP_MINUTE; i < ROLLUP_LEVEL_COUNT; i++) {roll(node, i, now_s);}
+            }
+            taskEXIT_CRITICAL(&lock);
+        }
+
+        int used = 0;
+        if (node == NULL) {
+            *cursor = CURSOR_DONE;
+            used = snprintf(out, size, level < ROLLUP_LEVEL_COUNT ? "{\"error\":\"unknown node\"}\n" :
+                            "{\"error\":\"usage: <mac> raw|minute|hour\"}\n");
+            return used > 0 && (size_t)used < size ? used : 0;
+        }
+        if (*cursor == 0) {
+            used = snprintf(out, size, "{\"node\":\"%02x:%02x:%02x:%02x:%02x:%02x\",\"res\":\"%s\",\"period_s\":%lu,\"now\":%lu}\n",
+                            mac[0], mac[1], mac[2], mac[3], mac[4], mac[5], level_names[level],
+                            (unsigned long)level_period_s[level], (unsigned long)now_s);
+            if (used <= 0 || (size_t)used >= size) {return 0;}
+            *cursor = 1;
+        }
+
+        while (1) {
+            uint32_t id = *cursor - 1;
+            rollup_bucket_t bucket;
+            uint32_t t_s;
+            taskENTER_CRITICAL(&lock);
+            entry_kind_t kind = read_entry(node, level, &id, &bucket, &t_s);
+            taskEXIT_CRITICAL(&lock);
+            if (kind == ENTRY_NONE) {
+                *cursor = CURSOR_DONE;
+                break;
+            }
+
+            char line[LINE_LEN];
+            int line_len = format_entry(line, level, kind, &bucket, t_s);
+            if (line_len <= 0 || line_len >= LINE_LEN) {line_len = 0;}
+            if ((size_t)(used + line_len) > size) {break;}
+            memcpy(out + used, line, line_len);
+            used += line_len;
+            *cursor = kind == ENTRY_OPEN ? CURSOR_DONE : id + 2;
+            if (kind == ENTRY_OPEN) {break;}
+        }
+        return used;
+    }
+
+    // Llamar con el candado tomado.
+    static node_t *find_node(const uint8_t *mac, bool create, uint32_t now_s)
+    {
+        node_t *free_node = NULL;
+        for (uint8_t i = 0; i < CONFIG_ROLLUP_MAX_NODES; i++) {
+            if (nodes[i].valid && memcmp(nodes[i].mac, mac, ROLLUP_MAC_LEN) == 0) {return &nodes[i];}
+            if (!nodes[i].valid && free_node == NULL) {free_node = &nodes[i];}
+        }
+        if (!create || free_node == NULL) {return NULL;}
+
+        memset(free_node, 0, sizeof(*free_node));
+        free_node->valid = true;
+        memcpy(free_node->mac, mac, ROLLUP_MAC_LEN);
+        for (rollup_level_t level = ROLLUP_MINUTE; level < ROLLUP_LEVEL_COUNT; level++) {
+            free_node->levels[level].open_id = now_s / level_period_s[level];
+            free_node->levels[level].first_id = free_node->levels[level].open_id;
+        }
+        return free_node;
+    }
+
+    static rollup_bucket_t *level_ring(node_t *node, rollup_level_t level, uint32_t *len)
+    {
+        *len = level == ROLLUP_MINUTE ? CONFIG_ROLLUP_MINUTES : CONFIG_ROLLUP_HOURS;
+        return level == ROLLUP_MINUTE ? node->minutes : node->hours;
+    }
+
+    // Cierra el periodo en curso y los vacíos hasta now_s. Solo se escriben los que todavía
+    // caben en el anillo: tras una ausencia larga no se recorre más de una vuelta.
+    static void roll(node_t *node, rollup_level_t level, uint32_t now_s)
+    {
+        level_state_t *state = &node->levels[level];
+        uint32_t now_id = now_s / level_period_s[level];
+        if (now_id <= state->open_id) {return;}
+
+        uint32_t len;
+        rollup_bucket_t *ring = level_ring(node, level, &len);
+        uint32_t id = now_id - state->open_id > len ? now_id - len : state->open_id;
+        for (; id < now_id; id++) {
+            rollup_bucket_t *bucket = &ring[id % len];
+            if (id == state->open_id && state->count > 0) {
+                bucket->min = state->min;
+                bucket->max = state->max;
+                bucket->mean = (int16_t)lroundf((float)state->sum / state->count);
+                bucket->count = state->count;
+            } else {
+                memset(bucket, 0, sizeof(*bucket));
+            }
+        }
+        state->open_id = now_id;
+        state->sum = 0;
+        state->count = 0;
+    }
+
+    // Registro id de un nivel, o el más antiguo que sigue en memoria si id ya se sobrescribió.
+    // Llamar con el candado tomado.
+    static entry_kind_t read_entry(node_t *node, rollup_level_t level, uint32_t *id, rollup_bucket_t *bucket, uint32_t *t_s)
+    {
+        if (level == ROLLUP_RAW) {
+            uint32_t oldest = node->raw_total > CONFIG_ROLLUP_RAW_SAMPLES ? node->raw_total - CONFIG_ROLLUP_RAW_SAMPLES : 0;
+            if (*id < oldest) {*id = oldest;}
+            if (*id >= node->raw_total) {return ENTRY_NONE;}
+            const raw_sample_t *sample = &node->raw[*id % CONFIG_ROLLUP_RAW_SAMPLES];
+            *t_s = sample->t_s;
+            bucket->min = bucket->max = bucket->mean = sample->value;
+            bucket->count = 1;
+            // Las crudas no tienen periodo en curso: la última cierra la respuesta igual.
+            return *id + 1 == node->raw_total ? ENTRY_OPEN : ENTRY_CLOSED;
+        }
+
+        const level_state_t *state = &node->levels[level];
+        uint32_t len;
+        const rollup_bucket_t *ring = level_ring(node, level, &len);
+        uint32_t oldest = state->open_id > len ? state->open_id - len : 0;
+        if (oldest < state->first_id) {oldest = state->first_id;}
+        if (*id < oldest) {*id = oldest;}
+        if (*id > state->open_id) {return ENTRY_NONE;}
+
+        *t_s = *id * level_period_s[level];
+        if (*id < state->open_id) {
+            *bucket = ring[*id % len];
+            return ENTRY_CLOSED;
+        }
+        bucket->min = state->min;
+        bucket->max = state->max;
+        bucket->mean = state->count > 0 ? (int16_t)lroundf((float)state->sum / state->count) : 0;
+        bucket->count = state->count;
+        return ENTRY_OPEN;
+    }
+
+    static int format_entry(char *line, rollup_level_t level, entry_kind_t kind, const rollup_bucket_t *bucket, uint32_t t_s)
+    {
+        if (level == ROLLUP_RAW) {
+            return snprintf(line, LINE_LEN, "{\"t\":%lu,\"v\":%.2f}\n", (unsigned long)t_s, bucket->mean / 100.0);
+        }
+        const char *open = kind == ENTRY_OPEN ? ",\"open\":true" : "";
+        if (bucket->count == 0) {
+            return snprintf(line, LINE_LEN, "{\"t\":%lu,\"count\":0%s}\n", (unsigned long)t_s, open);
+        }
+        return snprintf(line, LINE_LEN, "{\"t\":%lu,\"min\":%.2f,\"max\":%.2f,\"mean\":%.2f,\"count\":%u%s}\n",
+                        (unsigned long)t_s, bucket->min / 100.0, bucket->max / 100.0, bucket->mean / 100.0,
+                        bucket->count, open);
+    }
+    #else
+    void rollup_insert(const uint8_t *mac, float value)
+    {
+    }
+
+    size_t rollup_query(const char *request, size_t len, uint32_t *cursor, char *out, size_t size)
+    {
+        ESP_LOGW(TAG, "ROLLUP_ENABLE is off");
+        return 0;
+    }
+    #endif
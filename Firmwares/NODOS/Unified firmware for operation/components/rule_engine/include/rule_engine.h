@@ -0,0 +1,113 @@
+/************************************************************************************************
+ * Módulo: Motor de reglas sensor-actuador de la pasarela.
+ *
+ * Descripción: Las reglas se escriben en texto, una directiva por línea ('#' comenta):
+ *
+ *     node B 58:bf:25:05:6f:f8
+ *     node C c4:4f:33:6a:ca:81
+ *     zone A B C
+ *     rule radar@A and temp@A < 30 -> servo 0 300 on B C
+ *
+ * Una condición es <sensor>@<nodo|zona|*> [<op> <número>], con sensor radar, pir o temp y op
+ * <, <=, >, >=, == o !=; sin comparación equivale a "!= 0". Sobre una zona se cumple si algún
+ * nodo de la zona la cumple. La acción es <actuador> <índice> <ms> on <nodos|zonas>; solo se
+ * aceptan actuadores e índices que algún nodo ejecuta (hoy servo 0, que sostiene el extremo
+ * del barrido <ms>, o NODE_SERVO_PAUSE_MS con 0); led y valve quedan reservados en la trama.
+ * rule_engine_load compila el texto a una tabla estática de condiciones con un índice por
+ * sensor; cada evento recorre solo las condiciones de su sensor que incluyen al nodo y ajusta
+ * contadores, sin asignar memoria. Una regla se dispara al pasar a cumplirse y se rearma al
+ * dejar de cumplirse. Es independiente de la radio: compila también para el objetivo linux.
+ *
+ * Autor:
+ *   - Victor Manuel Patiño Delgado.
+ *
+ * Licencia: THE BEER-WARE LICENSE.
+ * As long as you retain this notice you can do whatever you want with this stuff.
+ * If we meet some day, and you think this stuff is worth it, you can buy me a beer in return.
+************************************************************************************************/
+#pragma once
+
+//***   Bibliotecas y declaraciones de preprocesador    ***//
+    #include <stdint.h>
+    #include <stdbool.h>
+    #include <stddef.h>
+    #include "esp_err.h"
+    #include "sdkconfig.h"
+
+    #ifdef __cplusplus
+    extern "C" {
+    #endif
+
+//***   Definición de constantes y macros   ***//
+    #define RULE_ENGINE_MAC_LEN 6
+    #define RULE_ENGINE_MAX_NODES 32        // Un bit por nodo en las máscaras de alcance
+    #define RULE_ENGINE_PARTITION_LABEL "rules"
+
+//***   Estructuras de datos y tipos personalizados ***//
+    typedef enum {
+        RULE_SENSOR_RADAR,
+        RULE_SENSOR_PIR,
+        RULE_SENSOR_TEMP,
+        RULE_SENSOR_COUNT
+    } rule_sensor_t;
+
+    typedef enum {
+        RULE_ACTUATOR_LED,
+        RULE_ACTUATOR_SERVO,
+        RULE_ACTUATOR_VALVE,
+        RULE_ACTUATOR_COUNT
+    } rule_actuator_t;
+
+    typedef struct {
+        uint16_t rule;                  // Posición de la regla en el texto, desde 0
+        uint8_t actuator;               // rule_actuator_t
+        uint8_t index;
+        uint16_t duration_ms;
+        uint32_t targets;               // Bit n: nodo n (rule_engine_node_mac)
+    } rule_engine_action_t;
+
+    // Se invoca desde rule_engine_event, en el contexto de quien reporta el evento.
+    typedef void (*rule_engine_action_fn_t)(const rule_engine_action_t *action);
+
+    // Payload de ESPNOW_MSG_ACTUATE: la orden seguida de target_count MACs destino.
+    typedef struct __attribute__((packed)) {
+        uint8_t actuator;
+        uint8_t index;
+        uint16_t duration_ms;
+        uint8_t target_count;
+    } rule_engine_actuation_t;
+
+    #define RULE_ENGINE_ACTUATION_MAX_LEN (sizeof(rule_engine_actuation_t) + RULE_ENGINE_MAX_NODES * RULE_ENGINE_MAC_LEN)
+
+//***   Declaraciones de funciones (prototipos) ***//
+    // Compila las reglas (len bytes o hasta NUL/0xFF) y descarta los hechos anteriores. Ante
+    // un error lo informa con su número de línea y deja la tabla vacía. No usar en paralelo
+    // con rule_engine_event.
+    esp_err_t rule_engine_load(const char *text, size_t len, rule_engine_action_fn_t action);
+
+    #if !CONFIG_IDF_TARGET_LINUX
+    // Lee el texto de la partición RULE_ENGINE_PARTITION_LABEL y lo compila.
+    // ESP_ERR_NOT_FOUND si no hay partición o está borrada.
+    esp_err_t rule_engine_load_partition(rule_engine_action_fn_t action);
+    #endif
+
+    uint16_t rule_engine_rule_count(void);
+
+    // Índice del nodo declarado con esa MAC, o -1.
+    int rule_engine_node(const uint8_t *mac);
+
+    const uint8_t *rule_engine_node_mac(uint8_t node);
+
+    // Nueva lectura de un nodo; devuelve cuántas reglas disparó.
+    uint16_t rule_engine_event(int node, rule_sensor_t sensor, float value);
+
+    // Arma el payload de ESPNOW_MSG_ACTUATE para una acción; devuelve su longitud.
+    size_t rule_engine_actuation_encode(const rule_engine_action_t *action, uint8_t *out, size_t size);
+
+    // true si el payload es una orden válida dirigida a own_mac; la copia en actuation.
+    bool rule_engine_actuation_decode(const uint8_t *payload, size_t len, const uint8_t *own_mac,
+                                      rule_engine_actuation_t *actuation);
+
+    #ifdef __cplusplus
+    }
+    #endif
@@ -0,0 +1,467 @@
+/************************************************************************************************
+ * Módulo: Motor de reglas sensor-actuador de la pasarela.
+ *
+ * Descripción: La compilación deja cada condición como una instrucción de 16 bytes (umbral,
+ * máscara de nodos, comparación, regla) y las ordena por sensor. Cada condición cuenta
+ * cuántos nodos de su alcance la cumplen y cada regla cuántas condiciones le faltan; un evento
+ * solo mueve esos contadores cuando la comparación de ese nodo cambia de resultado, así el
+ * costo depende de las condiciones sobre ese sensor y no del total de reglas ni de nodos. El
+ * texto se lee línea por línea desde una copia local, de modo que también se compila
+ * directamente desde la partición mapeada en memoria.
+ *
+ * Autor:
+ *   - Victor Manuel Patiño Delgado.
+ *
+ * Licencia: THE BEER-WARE LICENSE.
+ * As long as you retain this notice you can do whatever you want with this stuff.
+ * If we meet some day, and you think this stuff is worth it, you can buy me a beer in return.
+************************************************************************************************/
+
+//***   Bibliotecas y declaraciones de preprocesador    ***//
+    #include <stdio.h>
+    #include <stdlib.h>
+    #include <string.h>
+    #include "esp_log.h"
+    #include "sdkconfig.h"
+    #include "rule_engine.h"
+    #if !CONFIG_IDF_TARGET_LINUX
+    #include "esp_partition.h"
+    #endif
+
+//***   Definición de constantes y macros   ***//
+    #define MAX_ZONES 16
+    #define MAX_RULE_CONDITIONS 8
+    #define NAME_LEN 12
+    #define LINE_LEN 160
+    #define MAX_TOKENS 48
+    #define SCOPE_ALL UINT32_MAX
+
+    static const char *TAG = "rule_engine";
+
+//***   Estructuras de datos y tipos personalizados ***//
+    typedef enum {
+        OP_LT,
+        OP_LE,
+        OP_GT,
+        OP_GE,
+        OP_EQ,
+        OP_NE,
+    } op_t;
+
+    typedef struct {
+        float threshold;
+        uint32_t scope;                 // Nodos que la evalúan
+        uint16_t rule;
+        uint8_t op;                     // op_t
+        uint8_t sensor;                 // rule_sensor_t
+        uint8_t satisfied;              // Nodos del alcance que hoy la cumplen
+    } condition_t;
+
+    typedef struct {
+        uint32_t targets;
+        uint16_t duration_ms;
+        uint8_t actuator;
+        uint8_t index;
+        uint8_t conditions;
+        uint8_t pending;                // Condiciones que no se cumplen; 0 = regla activa
+    } rule_t;
+
+    typedef struct {
+        char name[NAME_LEN];
+        uint32_t members;
+    } zone_t;
+
+    static const char *const sensor_names[RULE_SENSOR_COUNT] = {"radar", "pir", "temp"};
+    static const char *const actuator_names[RULE_ACTUATOR_COUNT] = {"led", "servo", "valve"};
+    // Salidas que algún firmware de la red ejecuta: hoy solo el servo del receptor sensorial.
+    // Digital_Actuators_Valves no tiene radio, por eso "valve" se rechaza al compilar.
+    static const uint8_t actuator_slots[RULE_ACTUATOR_COUNT] = {0, 1, 0};
+    static const char *const op_names[] = {"<", "<=", ">", ">=", "==", "!="};
+
+    static char node_names[RULE_ENGINE_MAX_NODES][NAME_LEN];
+    static uint8_t node_macs[RULE_ENGINE_MAX_NODES][RULE_ENGINE_MAC_LEN];
+    static uint8_t node_count;
+    static zone_t zones[MAX_ZONES];
+    static uint8_t zone_count;
+
+    static condition_t conditions[CONFIG_RULE_ENGINE_MAX_CONDITIONS];
+    static uint16_t condition_count;
+    static rule_t rules[CONFIG_RULE_ENGINE_MAX_RULES];
+    static uint16_t rule_count;
+    static uint16_t by_sensor[CONFIG_RULE_ENGINE_MAX_CONDITIONS];
+    static uint16_t sensor_start[RULE_SENSOR_COUNT + 1];
+
+    static float facts[RULE_ENGINE_MAX_NODES][RULE_SENSOR_COUNT];
+    static uint32_t known[RULE_SENSOR_COUNT];
+    static rule_engine_action_fn_t action_fn;
+
+//***   Declaraciones de funciones (prototipos) ***//
+    static void reset(void);
+    static const char *compile_line(char *line);
+    static const char *parse_node(char **tokens, int count);
+    static const char *parse_zone(char **tokens, int count);
+    static const char *parse_rule(char **tokens, int count);
+    static const char *parse_condition(const char *token, condition_t *condition);
+    static bool lookup_scope(const char *name, uint32_t *scope);
+    static int find_name(const char *const *names, int count, const char *name);
+    static bool parse_long(const char *text, long min, long max, const char *suffix, long *value);
+    static void build_index(void);
+    static bool compare(uint8_t op, float value, float threshold);
+    static void fire(uint16_t index);
+
+//***Implementación de funciones***//
+    esp_err_t rule_engine_load(const char *text, size_t len, rule_engine_action_fn_t action)
+    {
+        reset();
+        action_fn = action;
+        char line[LINE_LEN];
+        uint32_t line_number = 0;
+        size_t pos = 0;
+        while (pos < len && text[pos] != '\0' && (uint8_t)text[pos] != 0xFF) {
+            size_t end = pos;
+            while (end < len && text[end] != '\n' && text[end] != '\0' && (uint8_t)text[end] != 0xFF) {end++;}
+            line_number++;
+            const char *error = "line too long";
+            if (end - pos < sizeof(line)) {
+                memcpy(line, text + pos, end - pos);
+                line[end - pos] = '\0';
+                error = compile_line(line);
+            }
+            if (error != NULL) {
+                ESP_LOGE(TAG, "line %lu: %s", (unsigned long)line_number, error);
+                reset();
+                return ESP_ERR_INVALID_ARG;
+            }
+            pos = end + (end < len && text[end] == '\n');
+        }
+        build_index();
+        ESP_LOGI(TAG, "%u rules, %u conditions, %u nodes", rule_count, condition_count, node_count);
+        return ESP_OK;
+    }
+
+    #if !CONFIG_IDF_TARGET_LINUX
+    esp_err_t rule_engine_load_partition(rule_engine_action_fn_t action)
+    {
+        const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY,
+                                                                    RULE_ENGINE_PARTITION_LABEL);
+        if (partition == NULL) {return ESP_ERR_NOT_FOUND;}
+
+        // Se compila sobre la flash mapeada: el texto no ocupa RAM.
+        const void *text = NULL;
+        esp_partition_mmap_handle_t handle;
+        esp_err_t err = esp_partition_mmap(partition, 0, partition->size, ESP_PARTITION_MMAP_DATA, &text, &handle);
+        if (err != ESP_OK) {return err;}
+        if (*(const uint8_t *)text == 0xFF) {err = ESP_ERR_NOT_FOUND;}
+        else {err = rule_engine_load(text, partition->size, action);}
+        esp_partition_munmap(handle);
+        return err;
+    }
+    #endif
+
+    uint16_t rule_engine_rule_count(void)
+    {
+        return rule_count;
+    }
+
+    int rule_engine_node(const uint8_t *mac)
+    {
+        for (uint8_t i = 0; i < node_count; i++) {
+            if (memcmp(node_macs[i], mac, RULE_ENGINE_MAC_LEN) == 0) {return i;}
+        }
+        return -1;
+    }
+
+    const uint8_t *rule_engine_node_mac(uint8_t node)
+    {
+        return node < node_count ? node_macs[node] : NULL;
+    }
+
+    uint16_t rule_engine_event(int node, rule_sensor_t sensor, float value)
+    {
+        if (node < 0 || node >= node_count || sensor >= RULE_SENSOR_COUNT) {return 0;}
+
+        const uint32_t bit = 1u << node;
+        const bool had = known[sensor] & bit;
+        const float previous = facts[node][sensor];
+        facts[node][sensor] = value;
+        known[sensor] |= bit;
+
+        uint16_t fired = 0;
+        for (uint16_t i = sensor_start[sensor]; i < sensor_start[sensor + 1]; i++) {
+            condition_t *condition = &conditions[by_sensor[i]];
+            if (!(condition->scope & bit)) {continue;}
+            bool was = had && compare(condition->op, previous, condition->threshold);
+            bool is = compare(condition->op, value, condition->threshold);
+            if (was == is) {continue;}
+
+            rule_t *rule = &rules[condition->rule];
+            if (is) {
+                // Primera coincidencia de la condición; si era la última que faltaba, se dispara.
+                if (condition->satisfied++ == 0 && --rule->pending == 0) {
+                    fire(condition->rule);
+                    fired++;
+                }
+            }
+            else if (--condition->satisfied == 0) {rule->pending++;}
+        }
+        return fired;
+    }
+
+    size_t rule_engine_actuation_encode(const rule_engine_action_t *action, uint8_t *out, size_t size)
+    {
+        if (size < sizeof(rule_engine_actuation_t)) {return 0;}
+        rule_engine_actuation_t header = {
+            .actuator = action->actuator,
+            .index = action->index,
+            .duration_ms = action->duration_ms,
+            .target_count = 0,
+        };
+        size_t len = sizeof(header);
+        for (uint8_t node = 0; node < node_count; node++) {
+            if (!(action->targets & (1u << node))) {continue;}
+            if (len + RULE_ENGINE_MAC_LEN > size) {return 0;}
+            memcpy(out + len, node_macs[node], RULE_ENGINE_MAC_LEN);
+            len += RULE_ENGINE_MAC_LEN;
+            header.target_count++;
+        }
+        memcpy(out, &header, sizeof(header));
+        return len;
+    }
+
+    bool rule_engine_actuation_decode(const uint8_t *payload, size_t len, const uint8_t *own_mac,
+                                      rule_engine_actuation_t *actuation)
+    {
+        if (len < sizeof(*actuation)) {return false;}
+        memcpy(actuation, payload, sizeof(*actuation));
+        if (actuation->actuator >= RULE_ACTUATOR_COUNT ||
+            len != sizeof(*actuation) + (size_t)actuation->target_count * RULE_ENGINE_MAC_LEN) {
+            return false;
+        }
+        const uint8_t *targets = payload + sizeof(*actuation);
+        for (uint8_t i = 0; i < actuation->target_count; i++) {
+            if (memcmp(targets + i * RULE_ENGINE_MAC_LEN, own_mac, RULE_ENGINE_MAC_LEN) == 0) {return true;}
+        }
+        return false;
+    }
+
+    static void reset(void)
+    {
+        node_count = 0;
+        zone_count = 0;
+        condition_count = 0;
+        rule_count = 0;
+        memset(sensor_start, 0, sizeof(sensor_start));
+        memset(known, 0, sizeof(known));
+    }
+
+    static const char *compile_line(char *line)
+    {
+        char *comment = strchr(line, '#');
+        if (comment != NULL) {*comment = '\0';}
+
+        char *tokens[MAX_TOKENS];
+        int count = 0;
+        char *save = NULL;
+        for (char *token = strtok_r(line, " \t\r,", &save); token != NULL; token = strtok_r(NULL, " \t\r,", &save)) {
+            if (count == MAX_TOKENS) {return "too many tokens";}
+            tokens[count++] = token;
+        }
+        if (count == 0) {return NULL;}
+        if (strcmp(tokens[0], "node") == 0) {return parse_node(tokens, count);}
+        if (strcmp(tokens[0], "zone") == 0) {return parse_zone(tokens, count);}
+        if (strcmp(tokens[0], "rule") == 0) {return parse_rule(tokens, count);}
+        return "expected node, zone or rule";
+    }
+
+    // node <nombre> <mac>
+    static const char *parse_node(char **tokens, int count)
+    {
+        uint32_t scope;
+        if (count != 3) {return "usage: node <name> <mac>";}
+        if (strlen(tokens[1]) >= NAME_LEN) {return "name too long";}
+        if (lookup_scope(tokens[1], &scope)) {return "name already used";}
+        if (node_count == RULE_ENGINE_MAX_NODES) {return "too many nodes";}
+
+        uint8_t *mac = node_macs[node_count];
+        int used = 0;
+        if (sscanf(tokens[2], "%hhx:%hhx:%hhx:%hhx:%hhx:%hhx%n", &mac[0], &mac[1], &mac[2], &mac[3], &mac[4], &mac[5],
+                   &used) != RULE_ENGINE_MAC_LEN || tokens[2][used] != '\0') {
+            return "bad MAC";
+        }
+        if (rule_engine_node(mac) >= 0) {return "MAC already declared";}
+        strcpy(node_names[node_count], tokens[1]);
+        node_count++;
+        return NULL;
+    }
+
+    // zone <nombre> <nodo|zona>...
+    static const char *parse_zone(char **tokens, int count)
+    {
+        uint32_t scope;
+        if (count < 3) {return "usage: zone <name> <node>...";}
+        if (strlen(tokens[1]) >= NAME_LEN) {return "name too long";}
+        if (lookup_scope(tokens[1], &scope)) {return "name already used";}
+        if (zone_count == MAX_ZONES) {return "too many zones";}
+
+        zone_t *zone = &zones[zone_count];
+        zone->members = 0;
+        for (int i = 2; i < count; i++) {
+            if (!lookup_scope(tokens[i], &scope)) {return "unknown node or zone";}
+            zone->members |= scope;
+        }
+        strcpy(zone->name, tokens[1]);
+        zone_count++;
+        return NULL;
+    }
+
+    // rule <condición> [and <condición>]... -> <actuador> <índice> <ms> on <nodo|zona>...
+    static const char *parse_rule(char **tokens, int count)
+    {
+        if (rule_count == CONFIG_RULE_ENGINE_MAX_RULES) {return "too many rules";}
+        rule_t rule = {0};
+        int i = 1;
+        while (1) {
+            if (i >= count) {return "expected condition";}
+            if (condition_count == CONFIG_RULE_ENGINE_MAX_CONDITIONS) {return "too many conditions";}
+            if (rule.conditions == MAX_RULE_CONDITIONS) {return "too many conditions in rule";}
+
+            condition_t *condition = &conditions[condition_count];
+            const char *error = parse_condition(tokens[i++], condition);
+            if (error != NULL) {return error;}
+            int op = i < count ? find_name(op_names, sizeof(op_names) / sizeof(op_names[0]), tokens[i]) : -1;
+            if (op >= 0) {
+                char *end;
+                if (++i >= count) {return "expected number";}
+                condition->op = op;
+                condition->threshold = strtof(tokens[i], &end);
+                if (end == tokens[i] || *end != '\0') {return "bad number";}
+                i++;
+            }
+            condition->rule = rule_count;
+            condition_count++;
+            rule.conditions++;
+            if (i < count && strcmp(tokens[i], "and") == 0) {
+                i++;
+                continue;
+            }
+            break;
+        }
+
+        long index, duration_ms;
+        if (i >= count || strcmp(tokens[i++], "->") != 0) {return "expected '->'";}
+        int actuator = i < count ? find_name(actuator_names, RULE_ACTUATOR_COUNT, tokens[i++]) : -1;
+        if (actuator < 0) {return "expected led, servo or valve";}
+        if (actuator_slots[actuator] == 0) {return "actuator has no consumer in this network";}
+        if (i >= count || !parse_long(tokens[i++], 0, actuator_slots[actuator] - 1, "", &index)) {return "bad actuator index";}
+        if (i >= count || !parse_long(tokens[i++], 0, UINT16_MAX, "ms", &duration_ms)) {return "bad duration";}
+        if (i >= count || strcmp(tokens[i++], "on") != 0 || i >= count) {return "expected 'on' and targets";}
+        for (; i < count; i++) {
+            uint32_t scope;
+            if (!lookup_scope(tokens[i], &scope) || scope == SCOPE_ALL) {return "unknown target";}
+            rule.targets |= scope;
+        }
+
+        rule.actuator = actuator;
+        rule.index = index;
+        rule.duration_ms = duration_ms;
+        rule.pending = rule.conditions;
+        rules[rule_count++] = rule;
+        return NULL;
+    }
+
+    // <sensor>@<nodo|zona|*>, por omisión "!= 0".
+    static const char *parse_condition(const char *token, condition_t *condition)
+    {
+        const char *at = strchr(token, '@');
+        if (at == NULL) {return "expected <sensor>@<scope>";}
+        char sensor[NAME_LEN];
+        size_t sensor_len = at - token;
+        if (sensor_len >= sizeof(sensor)) {return "unknown sensor";}
+        memcpy(sensor, token, sensor_len);
+        sensor[sensor_len] = '\0';
+
+        int id = find_name(sensor_names, RULE_SENSOR_COUNT, sensor);
+        if (id < 0) {return "unknown sensor";}
+        if (!lookup_scope(at + 1, &condition->scope)) {return "unknown node or zone";}
+        condition->sensor = id;
+        condition->op = OP_NE;
+        condition->threshold = 0;
+        condition->satisfied = 0;
+        return NULL;
+    }
+
+    static bool lookup_scope(const char *name, uint32_t *scope)
+    {
+        if (strcmp(name, "*") == 0) {
+            *scope = SCOPE_ALL;
+            return true;
+        }
+        for (uint8_t i = 0; i < node_count; i++) {
+            if (strcmp(node_names[i], name) == 0) {
+                *scope = 1u << i;
+                return true;
+            }
+        }
+        for (uint8_t i = 0; i < zone_count; i++) {
+            if (strcmp(zones[i].name, name) == 0) {
+                *scope = zones[i].members;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static int find_name(const char *const *names, int count, const char *name)
+    {
+        for (int i = 0; i < count; i++) {
+            if (strcmp(names[i], name) == 0) {return i;}
+        }
+        return -1;
+    }
+
+    // Entero en [min, max], seguido opcionalmente del sufijo dado.
+    static bool parse_long(const char *text, long min, long max, const char *suffix, long *value)
+    {
+        char *end;
+        *value = strtol(text, &end, 10);
+        if (end == text || (*end != '\0' && strcmp(end, suffix) != 0)) {return false;}
+        return *value >= min && *value <= max;
+    }
+
+    static void build_index(void)
+    {
+        uint16_t cursor[RULE_SENSOR_COUNT];
+        memset(sensor_start, 0, sizeof(sensor_start));
+        for (uint16_t i = 0; i < condition_count; i++) {sensor_start[conditions[i].sensor + 1]++;}
+        for (uint8_t s = 0; s < RULE_SENSOR_COUNT; s++) {
+            sensor_start[s + 1] += sensor_start[s];
+            cursor[s] = sensor_start[s];
+        }
+        for (uint16_t i = 0; i < condition_count; i++) {by_sensor[cursor[conditions[i].sensor]++] = i;}
+    }
+
+    static bool compare(uint8_t op, float value, float threshold)
+    {
+        switch (op) {
+            case OP_LT: return value < threshold;
+            case OP_LE: return value <= threshold;
+            case OP_GT: return value > threshold;
+            case OP_GE: return value >= threshold;
+            case OP_EQ: return value == threshold;
+            default: return value != threshold;
+        }
+    }
+
+    static void fire(uint16_t index)
+    {
+        if (action_fn == NULL) {return;}
+        const rule_t *rule = &rules[index];
+        rule_engine_action_t action = {
+            .rule = index,
+            .actuator = rule->actuator,
+            .index = rule->index,
+            .duration_ms = rule->duration_ms,
+            .targets = rule->targets,
+        };
+        action_fn(&action);
+    }
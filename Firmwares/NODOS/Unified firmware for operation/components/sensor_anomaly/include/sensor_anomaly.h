@@ -0,0 +1,87 @@
+/************************************************************************************************
+ * Módulo: Detección de anomalías en flujo para las lecturas que llegan a la pasarela.
+ *
+ * Descripción: Por cada par (nodo, sensor) se mantiene en memoria constante una media y una
+ * varianza exponenciales, la última lectura y un contador de repeticiones. Cada lectura se
+ * evalúa al recibirse contra los rieles del sensor, el límite alto, la razón de cambio, la
+ * desviación respecto a la media y el atascamiento. Los eventos se encolan al entrar y al
+ * salir de una anomalía y una tarea de fondo los publica de inmediato; no hace falta
+ * consultar ni procesar los registros después.
+ *
+ * Autor:
+ *   - Victor Manuel Patiño Delgado.
+ *
+ * Licencia: THE BEER-WARE LICENSE.
+ * As long as you retain this notice you can do whatever you want with this stuff.
+ * If we meet some day, and you think this stuff is worth it, you can buy me a beer in return.
+************************************************************************************************/
+#pragma once
+
+//***   Bibliotecas y declaraciones de preprocesador    ***//
+    #include <stdint.h>
+    #include <stdbool.h>
+    #include "esp_err.h"
+    #include "sdkconfig.h"
+
+    #ifdef __cplusplus
+    extern "C" {
+    #endif
+
+//***   Definición de constantes y macros   ***//
+    #define SENSOR_ANOMALY_MAC_LEN 6
+    #define SENSOR_ANOMALY_MAX_SENSORS 4
+
+//***   Estructuras de datos y tipos personalizados ***//
+    typedef enum {
+        SENSOR_ANOMALY_LM35,
+    } sensor_anomaly_sensor_t;
+
+    // Cada tipo es un bit de estado del flujo; se notifica al activarse.
+    typedef enum {
+        ANOMALY_RAIL = 1 << 0,          // Lectura en un riel: sensor desconectado o en corto
+        ANOMALY_OVER_LIMIT = 1 << 1,    // Por encima del límite (gabinete sobrecalentado)
+        ANOMALY_RATE = 1 << 2,          // Cambio más rápido que lo físicamente esperable
+        ANOMALY_OUTLIER = 1 << 3,       // Fuera de la banda de sigmas alrededor de la media
+        ANOMALY_STUCK = 1 << 4,         // La misma lectura demasiadas veces seguidas
+    } sensor_anomaly_kind_t;
+
+    typedef struct {
+        float rail_low;         // Lecturas <= rail_low o >= rail_high se tratan como riel
+        float rail_high;
+        float high_limit;       // NAN para no vigilar el límite
+    } sensor_anomaly_profile_t;
+
+    typedef struct {
+        uint8_t mac[SENSOR_ANOMALY_MAC_LEN];
+        uint8_t sensor;
+        uint8_t raised;         // Tipos que se activaron con esta lectura
+        uint8_t active;         // Tipos activos tras esta lectura; 0 = recuperado
+        float value;
+        float mean;
+        float stddev;
+    } sensor_anomaly_event_t;
+
+    // Se invoca desde la tarea de publicación, después de registrar el evento.
+    typedef void (*sensor_anomaly_cb_t)(const sensor_anomaly_event_t *event);
+
+//***   Declaraciones de funciones (prototipos) ***//
+    // Límites de un tipo de sensor; llamar antes de sensor_anomaly_start().
+    void sensor_anomaly_set_profile(sensor_anomaly_sensor_t sensor, const sensor_anomaly_profile_t *profile);
+
+    // Crea la cola de eventos y la tarea que los publica. callback puede ser NULL.
+    esp_err_t sensor_anomaly_start(sensor_anomaly_cb_t callback);
+
+    // Evalúa una lectura y actualiza las estadísticas del flujo. Sin reservas de memoria; pensada
+    // para el callback de recepción. Llamar siempre desde el mismo contexto.
+    void sensor_anomaly_observe(const uint8_t *mac, sensor_anomaly_sensor_t sensor, float value);
+
+    // Igual que sensor_anomaly_observe con el reloj dado (ms) en lugar de esp_timer, para
+    // reproducir capturas con su propia línea de tiempo. Devuelve los tipos activados.
+    uint8_t sensor_anomaly_observe_at(const uint8_t *mac, sensor_anomaly_sensor_t sensor, float value, uint32_t now_ms);
+
+    // Nombre corto de un tipo, para registros y enlaces ascendentes.
+    const char *sensor_anomaly_kind_name(sensor_anomaly_kind_t kind);
+
+    #ifdef __cplusplus
+    }
+    #endif
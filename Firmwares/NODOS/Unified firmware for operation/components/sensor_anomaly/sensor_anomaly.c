@@ -0,0 +1,246 @@
+/************************************************************************************************
+ * Módulo: Detección de anomalías en flujo para las lecturas que llegan a la pasarela.
+ *
+ * Descripción: Los flujos viven en una tabla hash estática de direccionamiento abierto,
+ * indexada por MAC y sensor, así que buscar un nodo cuesta lo mismo con cientos de nodos que
+ * con cuatro. Las lecturas en un riel no actualizan las estadísticas para no contaminar la
+ * media con un sensor desconectado. La varianza exponencial sigue la actualización
+ * incremental de Finch: media y varianza con una sola pasada y sin historial.
+ *
+ * Autor:
+ *   - Victor Manuel Patiño Delgado.
+ *
+ * Licencia: THE BEER-WARE LICENSE.
+ * As long as you retain this notice you can do whatever you want with this stuff.
+ * If we meet some day, and you think this stuff is worth it, you can buy me a beer in return.
+************************************************************************************************/
+
+//***   Bibliotecas y declaraciones de preprocesador    ***//
+    #include <stdio.h>
+    #include <string.h>
+    #include <math.h>
+    #include "freertos/FreeRTOS.h"
+    #include "freertos/queue.h"
+    #include "esp_timer.h"
+    #include "esp_mac.h"
+    #include "esp_log.h"
+    #include "sdkconfig.h"
+    #include "sensor_anomaly.h"
+    #include "metrics.h"
+    #include "static_alloc.h"
+    #include "task_layout.h"
+
+//***   Definición de constantes y macros   ***//
+    #define ALPHA (CONFIG_SENSOR_ANOMALY_ALPHA_PERMILLE / 1000.0f)
+    #define Z_LIMIT (CONFIG_SENSOR_ANOMALY_Z_X10 / 10.0f)
+    #define MIN_STDDEV (CONFIG_SENSOR_ANOMALY_MIN_STDDEV_X100 / 100.0f)
+    #define RATE_PER_MIN (CONFIG_SENSOR_ANOMALY_RATE_X10 / 10.0f)
+    #define KIND_COUNT 5
+    // Una anomalía activa se libera con el 80 % del umbral que la activó, para no oscilar.
+    #define RELEASE_FACTOR 0.8f
+
+    static const char *TAG = "sensor_anomaly";
+
+    static const char *const kind_names[KIND_COUNT] = {"rail", "over_limit", "rate", "outlier", "stuck"};
+
+//***   Estructuras de datos y tipos personalizados ***//
+    typedef struct {
+        uint8_t mac[SENSOR_ANOMALY_MAC_LEN];
+        uint8_t sensor;
+        uint8_t used;
+        uint8_t active;
+        uint16_t samples;
+        uint16_t repeats;
+        uint32_t last_ms;
+        float last_value;
+        float mean;
+        float variance;
+        float rate_per_min;     // Razón de cambio suavizada con el mismo peso
+    } stream_t;
+
+    static stream_t streams[CONFIG_SENSOR_ANOMALY_MAX_STREAMS];
+    static sensor_anomaly_profile_t profiles[SENSOR_ANOMALY_MAX_SENSORS];
+    static uint8_t profiled;    // Bit por sensor con perfil asignado
+    static QueueHandle_t event_queue;
+    static sensor_anomaly_cb_t event_callback;
+    static volatile uint32_t dropped_events;
+    static bool table_full_reported;
+
+//***   Declaraciones de funciones (prototipos) ***//
+    static stream_t *find_stream(const uint8_t *mac, uint8_t sensor);
+    static uint8_t evaluate(stream_t *stream, const sensor_anomaly_profile_t *profile, float value, uint32_t now_ms);
+    static void format_kinds(char *text, size_t room, uint8_t kinds);
+    static void publisher_task(void *pvParameters);
+
+//***Implementación de funciones***//
+    void sensor_anomaly_set_profile(sensor_anomaly_sensor_t sensor, const sensor_anomaly_profile_t *profile)
+    {
+        if (sensor >= SENSOR_ANOMALY_MAX_SENSORS) {return;}
+        profiles[sensor] = *profile;
+        profiled |= 1 << sensor;
+    }
+
+    esp_err_t sensor_anomaly_start(sensor_anomaly_cb_t callback)
+    {
+        event_callback = callback;
+        event_queue = STATIC_QUEUE_CREATE(CONFIG_SENSOR_ANOMALY_QUEUE_LEN, sizeof(sensor_anomaly_event_t));
+        if (event_queue == NULL) {return ESP_ERR_NO_MEM;}
+        ESP_LOGI(TAG, "Watching up to %d streams, alpha %.3f, %.1f sigma, %.1f/min",
+                 CONFIG_SENSOR_ANOMALY_MAX_STREAMS, ALPHA, Z_LIMIT, RATE_PER_MIN);
+        return TASK_LAYOUT_CREATE(publisher_task, "anomaly_pub", 3072, NULL, TASK_CLASS_BACKGROUND, NULL);
+    }
+
+    void sensor_anomaly_observe(const uint8_t *mac, sensor_anomaly_sensor_t sensor, float value)
+    {
+        sensor_anomaly_observe_at(mac, sensor, value, (uint32_t)(esp_timer_get_time() / 1000));
+    }
+
+    uint8_t sensor_anomaly_observe_at(const uint8_t *mac, sensor_anomaly_sensor_t sensor, float value, uint32_t now_ms)
+    {
+        if (event_queue == NULL || sensor >= SENSOR_ANOMALY_MAX_SENSORS || !(profiled & (1 << sensor))) {return 0;}
+
+        stream_t *stream = find_stream(mac, sensor);
+        if (stream == NULL) {
+            if (!table_full_reported) {
+                table_full_reported = true;
+                ESP_LOGW(TAG, "Stream table full (%d), new nodes are not watched", CONFIG_SENSOR_ANOMALY_MAX_STREAMS);
+            }
+            return 0;
+        }
+
+        uint8_t previous = stream->active;
+        uint8_t active = evaluate(stream, &profiles[sensor], value, now_ms);
+        stream->active = active;
+
+        uint8_t raised = active & ~previous;
+        if (raised == 0 && !(active == 0 && previous != 0)) {return 0;}
+
+        sensor_anomaly_event_t event = {
+            .sensor = sensor,
+            .raised = raised,
+            .active = active,
+            .value = value,
+            .mean = stream->mean,
+            .stddev = sqrtf(stream->variance),
+        };
+        memcpy(event.mac, mac, SENSOR_ANOMALY_MAC_LEN);
+        if (raised != 0) {metrics_inc(METRIC_ANOMALIES);}
+        if (xQueueSend(event_queue, &event, 0) != pdTRUE) {
+            dropped_events++;
+            metrics_inc(METRIC_QUEUE_OVERFLOW);
+        }
+        return raised;
+    }
+
+    const char *sensor_anomaly_kind_name(sensor_anomaly_kind_t kind)
+    {
+        for (uint8_t i = 0; i < KIND_COUNT; i++) {
+            if ((uint32_t)kind == (1u << i)) {return kind_names[i];}
+        }
+        return "unknown";
+    }
+
+    static stream_t *find_stream(const uint8_t *mac, uint8_t sensor)
+    {
+        // FNV-1a sobre MAC y sensor.
+        uint32_t hash = 2166136261u;
+        for (uint8_t i = 0; i < SENSOR_ANOMALY_MAC_LEN; i++) {hash = (hash ^ mac[i]) * 16777619u;}
+        hash = (hash ^ sensor) * 16777619u;
+
+        uint32_t index = hash % CONFIG_SENSOR_ANOMALY_MAX_STREAMS;
+        for (uint32_t probe = 0; probe < CONFIG_SENSOR_ANOMALY_MAX_STREAMS; probe++) {
+            stream_t *stream = &streams[index];
+            if (!stream->used) {
+                memset(stream, 0, sizeof(*stream));
+                stream->used = 1;
+                stream->sensor = sensor;
+                memcpy(stream->mac, mac, SENSOR_ANOMALY_MAC_LEN);
+                return stream;
+            }
+            if (stream->sensor == sensor && memcmp(stream->mac, mac, SENSOR_ANOMALY_MAC_LEN) == 0) {return stream;}
+            index = (index + 1) % CONFIG_SENSOR_ANOMALY_MAX_STREAMS;
+        }
+        return NULL;
+    }
+
+    static uint8_t evaluate(stream_t *stream, const sensor_anomaly_profile_t *profile, float value, uint32_t now_ms)
+    {
+        if (value <= profile->rail_low || value >= profile->rail_high) {return ANOMALY_RAIL;}
+
+        uint8_t active = 0;
+        if (!isnan(profile->high_limit) && value > profile->high_limit) {active |= ANOMALY_OVER_LIMIT;}
+
+        if (stream->samples > 0) {
+            // La razón entre dos lecturas seguidas es sobre todo ruido de cuantización; se suaviza
+            // igual que la media para que solo una tendencia sostenida la supere.
+            uint32_t elapsed_ms = now_ms - stream->last_ms;
+            if (elapsed_ms > 0) {
+                float rate = (value - stream->last_value) * 60000.0f / elapsed_ms;
+                stream->rate_per_min += ALPHA * (rate - stream->rate_per_min);
+            }
+            float rate_limit = RATE_PER_MIN * ((stream->active & ANOMALY_RATE) ? RELEASE_FACTOR : 1.0f);
+            if (stream->samples >= CONFIG_SENSOR_ANOMALY_WARMUP && fabsf(stream->rate_per_min) > rate_limit) {
+                active |= ANOMALY_RATE;
+            }
+            stream->repeats = value == stream->last_value ? stream->repeats + (stream->repeats < UINT16_MAX) : 0;
+            if (stream->repeats + 1 >= CONFIG_SENSOR_ANOMALY_STUCK_SAMPLES) {active |= ANOMALY_STUCK;}
+        }
+
+        if (stream->samples >= CONFIG_SENSOR_ANOMALY_WARMUP) {
+            float stddev = fmaxf(sqrtf(stream->variance), MIN_STDDEV);
+            float z_limit = Z_LIMIT * ((stream->active & ANOMALY_OUTLIER) ? RELEASE_FACTOR : 1.0f);
+            if (fabsf(value - stream->mean) > z_limit * stddev) {active |= ANOMALY_OUTLIER;}
+        }
+
+        if (stream->samples == 0) {
+            stream->mean = value;
+            stream->variance = 0;
+        } else {
+            float diff = value - stream->mean;
+            float increment = ALPHA * diff;
+            stream->mean += increment;
+            stream->variance = (1.0f - ALPHA) * (stream->variance + diff * increment);
+        }
+        if (stream->samples < UINT16_MAX) {stream->samples++;}
+        stream->last_value = value;
+        stream->last_ms = now_ms;
+        return active;
+    }
+
+    static void format_kinds(char *text, size_t room, uint8_t kinds)
+    {
+        int len = 0;
+        text[0] = '\0';
+        for (uint8_t i = 0; i < KIND_COUNT && len >= 0 && len < (int)room; i++) {
+            if (kinds & (1 << i)) {len += snprintf(text + len, room - len, "%s%s", len > 0 ? "," : "", kind_names[i]);}
+        }
+    }
+
+    static void publisher_task(void *pvParameters)
+    {
+        sensor_anomaly_event_t event;
+        uint32_t reported_drops = 0;
+        char raised[48], active[48];
+
+        while (1) {
+            if (xQueueReceive(event_queue, &event, portMAX_DELAY) != pdTRUE) {continue;}
+
+            if (event.active == 0) {
+                ESP_LOGI(TAG, MACSTR " sensor=%u recovered value=%.2f mean=%.2f sd=%.2f", MAC2STR(event.mac),
+                         event.sensor, event.value, event.mean, event.stddev);
+            } else {
+                format_kinds(raised, sizeof(raised), event.raised);
+                format_kinds(active, sizeof(active), event.active);
+                ESP_LOGW(TAG, MACSTR " sensor=%u anomaly=%s active=%s value=%.2f mean=%.2f sd=%.2f",
+                         MAC2STR(event.mac), event.sensor, raised, active, event.value, event.mean, event.stddev);
+            }
+
+            uint32_t drops = dropped_events;
+            if (drops != reported_drops) {
+                ESP_LOGW(TAG, "%lu events dropped, queue full", (unsigned long)(drops - reported_drops));
+                reported_drops = drops;
+            }
+
+            if (event_callback != NULL) {event_callback(&event);}
+        }
+    }
@@ -0,0 +1,93 @@
+/************************************************************************************************
+ * Módulo: Estado compartido entre ISRs y tareas sin bloquear a los lectores.
+ *
+ * Descripción: Dos primitivas para reemplazar globales volatile escritas desde varios
+ * contextos. Un seqlock protege estados de varios campos (banderas y marcas de tiempo que
+ * deben leerse juntas): el escritor incrementa la secuencia antes y después de modificar los
+ * datos, y el lector copia y repite si la secuencia cambió o era impar, así nunca ve un estado
+ * a medio escribir ni detiene al escritor. Las banderas de una sola palabra se publican con
+ * operaciones atómicas de 32 bits.
+ * Los escritores se serializan con un spinlock en sección crítica, válido desde tareas e ISRs
+ * en ambos núcleos; como la sección enmascara interrupciones, un lector del mismo núcleo
+ * nunca encuentra una escritura a medias y solo un lector del otro núcleo puede reintentar.
+ *
+ * Autor:
+ *   - Victor Manuel Patiño Delgado.
+ *
+ * Licencia: THE BEER-WARE LICENSE.
+ * As long as you retain this notice you can do whatever you want with this stuff.
+ * If we meet some day, and you think this stuff is worth it, you can buy me a beer in return.
+************************************************************************************************/
+#pragma once
+
+//***   Bibliotecas y declaraciones de preprocesador    ***//
+    #include <stdint.h>
+    #include <stddef.h>
+    #include "freertos/FreeRTOS.h"
+    #include "sdkconfig.h"
+
+    #ifdef __cplusplus
+    extern "C" {
+    #endif
+
+//***   Definición de constantes y macros   ***//
+    #define SHARED_SEQLOCK_INITIALIZER {0, portMUX_INITIALIZER_UNLOCKED}
+    #define SHARED_FLAG_INITIALIZER(v) {(v)}
+
+    #if CONFIG_IDF_TARGET_LINUX
+    #define SHARED_ENTER_CRITICAL(mux) taskENTER_CRITICAL(mux)
+    #define SHARED_EXIT_CRITICAL(mux) taskEXIT_CRITICAL(mux)
+    #else
+    #define SHARED_ENTER_CRITICAL(mux) portENTER_CRITICAL_SAFE(mux)
+    #define SHARED_EXIT_CRITICAL(mux) portEXIT_CRITICAL_SAFE(mux)
+    #endif
+
+//***   Estructuras de datos y tipos personalizados ***//
+    typedef struct {
+        uint32_t sequence;      // Impar mientras hay una escritura en curso
+        portMUX_TYPE writer;    // Serializa escritores entre núcleos e ISRs
+    } shared_seqlock_t;
+
+    typedef struct {
+        uint32_t value;
+    } shared_flag_t;
+
+//***   Declaraciones de funciones (prototipos) ***//
+    // Abre una escritura; los datos protegidos se modifican entre begin y end. Apta para ISRs
+    // en IRAM (se expande en línea). La sección debe ser corta: solo asignaciones.
+    static inline __attribute__((always_inline)) void shared_seqlock_write_begin(shared_seqlock_t *lock)
+    {
+        SHARED_ENTER_CRITICAL(&lock->writer);
+        __atomic_store_n(&lock->sequence, lock->sequence + 1, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+    }
+
+    static inline __attribute__((always_inline)) void shared_seqlock_write_end(shared_seqlock_t *lock)
+    {
+        __atomic_store_n(&lock->sequence, lock->sequence + 1, __ATOMIC_RELEASE);
+        SHARED_EXIT_CRITICAL(&lock->writer);
+    }
+
+    // Copia len bytes de src a dst como un estado consistente. No bloquea al escritor; devuelve
+    // cuántas veces tuvo que repetir la copia. Solo desde tareas.
+    uint32_t shared_seqlock_read(shared_seqlock_t *lock, void *dst, const void *src, size_t len);
+
+    static inline __attribute__((always_inline)) uint32_t shared_flag_get(const shared_flag_t *flag)
+    {
+        return __atomic_load_n(&flag->value, __ATOMIC_ACQUIRE);
+    }
+
+    static inline __attribute__((always_inline)) void shared_flag_set(shared_flag_t *flag, uint32_t value)
+    {
+        __atomic_store_n(&flag->value, value, __ATOMIC_RELEASE);
+    }
+
+    // Lee y reemplaza en una sola operación (p. ej. consumir una marca de tiempo).
+    static inline __attribute__((always_inline)) uint32_t shared_flag_exchange(shared_flag_t *flag, uint32_t value)
+    {
+        return __atomic_exchange_n(&flag->value, value, __ATOMIC_ACQ_REL);
+    }
+
+    #ifdef __cplusplus
+    }
+    #endif
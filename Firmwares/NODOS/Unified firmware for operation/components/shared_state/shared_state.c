@@ -0,0 +1,32 @@
+/************************************************************************************************
+ * Módulo: Estado compartido entre ISRs y tareas sin bloquear a los lectores.
+ *
+ * Descripción: Lado lector del seqlock. La barrera de adquisición tras la copia impide que
+ * las lecturas de datos se reordenen después de la segunda lectura de la secuencia.
+ *
+ * Autor:
+ *   - Victor Manuel Patiño Delgado.
+ *
+ * Licencia: THE BEER-WARE LICENSE.
+ * As long as you retain this notice you can do whatever you want with this stuff.
+ * If we meet some day, and you think this stuff is worth it, you can buy me a beer in return.
+************************************************************************************************/
+
+//***   Bibliotecas y declaraciones de preprocesador    ***//
+    #include <string.h>
+    #include "shared_state.h"
+
+//***Implementación de funciones***//
+    uint32_t shared_seqlock_read(shared_seqlock_t *lock, void *dst, const void *src, size_t len)
+    {
+        uint32_t retries = 0;
+        while (1) {
+            uint32_t begin = __atomic_load_n(&lock->sequence, __ATOMIC_ACQUIRE);
+            if ((begin & 1) == 0) {
+                memcpy(dst, src, len);
+                __atomic_thread_fence(__ATOMIC_ACQUIRE);
+                if (__atomic_load_n(&lock->sequence, __ATOMIC_RELAXED) == begin) {return retries;}
+            }
+            retries++;
+        }
+    }
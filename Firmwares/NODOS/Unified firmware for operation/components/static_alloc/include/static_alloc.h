@@ -0,0 +1,59 @@
+/************************************************************************************************
+ * Módulo: Modo de asignación estática.
+ *
+ * Descripción: Macros de creación de colas y semáforos que, con CONFIG_STATIC_ALLOC_ONLY,
+ * reservan su almacenamiento en un búfer estático propio de cada punto de llamada y, sin la
+ * opción, equivalen a las APIs dinámicas. Cada punto de llamada debe ejecutarse una sola vez
+ * (inicialización). Las tareas se crean con TASK_LAYOUT_CREATE (task_layout.h).
+ * static_alloc_seal() marca el fin de la inicialización: desde ese momento el gancho de heap
+ * verifica que las tareas protegidas no reserven memoria dinámica.
+ *
+ * Autor:
+ *   - Victor Manuel Patiño Delgado.
+ *
+ * Licencia: THE BEER-WARE LICENSE.
+ * As long as you retain this notice you can do whatever you want with this stuff.
+ * If we meet some day, and you think this stuff is worth it, you can buy me a beer in return.
+************************************************************************************************/
+#pragma once
+
+//***   Bibliotecas y declaraciones de preprocesador    ***//
+    #include <stdint.h>
+    #include "sdkconfig.h"
+    #include "freertos/FreeRTOS.h"
+    #include "freertos/queue.h"
+    #include "freertos/semphr.h"
+
+    #ifdef __cplusplus
+    extern "C" {
+    #endif
+
+//***   Definición de constantes y macros   ***//
+    #if CONFIG_STATIC_ALLOC_ONLY
+    #define STATIC_QUEUE_CREATE(length, item_size) ({ \
+            static uint8_t _storage[(length) * (item_size)]; \
+            static StaticQueue_t _queue; \
+            xQueueCreateStatic((length), (item_size), _storage, &_queue); })
+
+    #define STATIC_SEMAPHORE_CREATE_BINARY() ({ \
+            static StaticSemaphore_t _semaphore; \
+            xSemaphoreCreateBinaryStatic(&_semaphore); })
+    #else
+    #define STATIC_QUEUE_CREATE(length, item_size) xQueueCreate((length), (item_size))
+    #define STATIC_SEMAPHORE_CREATE_BINARY() xSemaphoreCreateBinary()
+    #endif
+
+//***   Declaraciones de funciones (prototipos) ***//
+    // Protege la tarea actual: desde el sellado no puede reservar heap.
+    void static_alloc_guard_current_task(void);
+
+    // Fin de la inicialización: activa la verificación. Un app_main que sigue en un lazo se
+    // protege antes con static_alloc_guard_current_task(); uno que retorna no debe hacerlo.
+    void static_alloc_seal(void);
+
+    // Asignaciones de heap detectadas desde tareas protegidas tras el sellado.
+    uint32_t static_alloc_violations(void);
+
+    #ifdef __cplusplus
+    }
+    #endif
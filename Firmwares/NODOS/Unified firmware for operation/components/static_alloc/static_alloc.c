@@ -0,0 +1,98 @@
+/************************************************************************************************
+ * Módulo: Modo de asignación estática.
+ *
+ * Descripción: Registro de tareas protegidas y gancho de asignación del heap. Solo se verifican
+ * las tareas propias de la aplicación: la pila Wi-Fi, esp_timer y las tareas de fondo (OTA,
+ * volcados) conservan su heap. Antes de protegerse, cada tarea ejecuta una conversión de punto
+ * flotante para que newlib reserve de una vez su estado de conversión por tarea, que de otro
+ * modo se asignaría en el primer ESP_LOGx con %f.
+ *
+ * Autor:
+ *   - Victor Manuel Patiño Delgado.
+ *
+ * Licencia: THE BEER-WARE LICENSE.
+ * As long as you retain this notice you can do whatever you want with this stuff.
+ * If we meet some day, and you think this stuff is worth it, you can buy me a beer in return.
+************************************************************************************************/
+
+//***   Bibliotecas y declaraciones de preprocesador    ***//
+    #include <stdio.h>
+    #include <stdlib.h>
+    #include <stdbool.h>
+    #include "freertos/FreeRTOS.h"
+    #include "freertos/task.h"
+    #include "esp_attr.h"
+    #include "esp_heap_caps.h"
+    #include "esp_log.h"
+    #include "esp_rom_sys.h"
+    #include "sdkconfig.h"
+    #include "static_alloc.h"
+
+//***   Definición de constantes y macros   ***//
+    #if CONFIG_STATIC_ALLOC_ONLY
+    static const char *TAG = "static_alloc";
+
+    static portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+    static TaskHandle_t guarded[CONFIG_STATIC_ALLOC_MAX_GUARDED_TASKS];
+    static volatile uint8_t guarded_count;
+    static volatile bool sealed;
+    static volatile uint32_t violations;
+    #endif
+
+//***Implementación de funciones***//
+    #if CONFIG_STATIC_ALLOC_ONLY
+    void static_alloc_guard_current_task(void)
+    {
+        char warmup[32];
+        snprintf(warmup, sizeof(warmup), "%.2f %.3e", 1234.5678, 1e-7);
+
+        taskENTER_CRITICAL(&lock);
+        bool stored = guarded_count < CONFIG_STATIC_ALLOC_MAX_GUARDED_TASKS;
+        if (stored) {guarded[guarded_count++] = xTaskGetCurrentTaskHandle();}
+        taskEXIT_CRITICAL(&lock);
+        if (!stored) {ESP_LOGW(TAG, "%s not guarded, raise STATIC_ALLOC_MAX_GUARDED_TASKS", pcTaskGetName(NULL));}
+    }
+
+    void static_alloc_seal(void)
+    {
+        sealed = true;
+        ESP_LOGI(TAG, "init sealed: %d task(s) guarded, heap free %u, min %u", guarded_count,
+                 (unsigned)heap_caps_get_free_size(MALLOC_CAP_DEFAULT),
+                 (unsigned)heap_caps_get_minimum_free_size(MALLOC_CAP_DEFAULT));
+    }
+
+    uint32_t static_alloc_violations(void)
+    {
+        return violations;
+    }
+
+    // Gancho de heap (HEAP_USE_HOOKS): corre tras cada asignación exitosa.
+    void IRAM_ATTR esp_heap_trace_alloc_hook(void *ptr, size_t size, uint32_t caps)
+    {
+        if (!sealed || xPortInIsrContext()) {return;}
+        TaskHandle_t current = xTaskGetCurrentTaskHandle();
+        for (uint8_t i = 0; i < guarded_count; i++) {
+            if (guarded[i] != current) {continue;}
+            violations++;
+            esp_rom_printf("static_alloc: %u bytes (caps 0x%x) allocated by %s after init\n", (unsigned)size,
+                           (unsigned)caps, pcTaskGetName(current));
+        #if CONFIG_STATIC_ALLOC_VIOLATION_ABORT
+            abort();
+        #endif
+            return;
+        }
+    }
+    #else
+    void static_alloc_guard_current_task(void)
+    {
+    }
+
+    void static_alloc_seal(void)
+    {
+    }
+
+    uint32_t static_alloc_violations(void)
+    {
+        return 0;
+    }
+    #endif
@@ -0,0 +1,82 @@
+/************************************************************************************************
+ * Módulo: Distribución de tareas por núcleo y clase de latencia.
+ *
+ * Descripción: Centraliza la creación de tareas de los nodos ESP32-S3. Cada tarea declara su
+ * clase de latencia y de ella se derivan núcleo y prioridad según la distribución elegida en
+ * menuconfig. El monitor periódico reporta la utilización de cada núcleo y la dispersión de la
+ * latencia detección-actuación para verificar el efecto de la distribución.
+ * Con CONFIG_STATIC_ALLOC_ONLY, TASK_LAYOUT_CREATE reserva pila y TCB estáticos por punto de
+ * llamada y la tarea se protege contra asignaciones de heap (salvo la clase de fondo).
+ *
+ * Autor:
+ *   - Victor Manuel Patiño Delgado.
+ *
+ * Licencia: THE BEER-WARE LICENSE.
+ * As long as you retain this notice you can do whatever you want with this stuff.
+ * If we meet some day, and you think this stuff is worth it, you can buy me a beer in return.
+************************************************************************************************/
+#pragma once
+
+//***   Bibliotecas y declaraciones de preprocesador    ***//
+    #include <stdint.h>
+    #include "esp_err.h"
+    #include "freertos/FreeRTOS.h"
+    #include "freertos/task.h"
+    #include "sdkconfig.h"
+
+    #ifdef __cplusplus
+    extern "C" {
+    #endif
+
+//***   Estructuras de datos y tipos personalizados ***//
+    typedef enum {
+        TASK_CLASS_RADIO_RX,    // Procesamiento de tramas recibidas
+        TASK_CLASS_RADIO_TX,    // Programación de envíos
+        TASK_CLASS_ACTUATION,   // Servo, láser, válvulas
+        TASK_CLASS_SENSING,     // Muestreo y lógica de detección
+        TASK_CLASS_BACKGROUND,  // OTA, reportes, mantenimiento
+    } task_class_t;
+
+    // Almacenamiento de una tarea estática; la pila se declara aparte por su tamaño variable.
+    typedef struct {
+        StaticTask_t tcb;
+        TaskFunction_t task;
+        void *arg;
+        task_class_t task_class;
+    } task_layout_static_t;
+
+//***   Definición de constantes y macros   ***//
+    #if CONFIG_STATIC_ALLOC_ONLY
+    #define TASK_LAYOUT_CREATE(task, name, stack_size, arg, task_class, handle) ({ \
+            static StackType_t _stack[(stack_size) / sizeof(StackType_t)]; \
+            static task_layout_static_t _slot; \
+            task_layout_create_static((task), (name), (stack_size), (arg), (task_class), _stack, &_slot, (handle)); })
+    #else
+    #define TASK_LAYOUT_CREATE(task, name, stack_size, arg, task_class, handle) \
+            task_layout_create((task), (name), (stack_size), (arg), (task_class), (handle))
+    #endif
+
+//***   Declaraciones de funciones (prototipos) ***//
+    BaseType_t task_layout_core(task_class_t task_class);
+    UBaseType_t task_layout_priority(task_class_t task_class);
+
+    // xTaskCreatePinnedToCore con núcleo y prioridad derivados de la clase. ESP_ERR_NO_MEM si
+    // la tarea no se pudo crear.
+    esp_err_t task_layout_create(TaskFunction_t task, const char *name, uint32_t stack_size, void *arg,
+                                 task_class_t task_class, TaskHandle_t *handle);
+
+    // Igual que task_layout_create (mismos códigos de error) sobre búferes estáticos; usar
+    // mediante TASK_LAYOUT_CREATE.
+    esp_err_t task_layout_create_static(TaskFunction_t task, const char *name, uint32_t stack_size, void *arg,
+                                        task_class_t task_class, StackType_t *stack, task_layout_static_t *slot,
+                                        TaskHandle_t *handle);
+
+    // Lanza el reporte periódico de utilización por núcleo (si está habilitado).
+    esp_err_t task_layout_start_monitor(void);
+
+    // Registra una muestra de latencia detección-actuación en microsegundos.
+    void task_layout_record_latency(uint32_t latency_us);
+
+    #ifdef __cplusplus
+    }
+    #endif
@@ -0,0 +1,187 @@
+/************************************************************************************************
+ * Módulo: Distribución de tareas por núcleo y clase de latencia.
+ *
+ * Descripción: Tabla de núcleo y prioridad por clase. Las clases de radio quedan por debajo de
+ * la tarea Wi-Fi (prioridad 23) para no retrasar la pila; la actuación se antepone al sensado
+ * porque el tiempo detección-actuación es el que percibe la fauna.
+ *
+ * Autor:
+ *   - Victor Manuel Patiño Delgado.
+ *
+ * Licencia: THE BEER-WARE LICENSE.
+ * As long as you retain this notice you can do whatever you want with this stuff.
+ * If we meet some day, and you think this stuff is worth it, you can buy me a beer in return.
+************************************************************************************************/
+
+//***   Bibliotecas y declaraciones de preprocesador    ***//
+    #include "freertos/FreeRTOS.h"
+    #include "freertos/task.h"
+    #include "esp_log.h"
+    #include "sdkconfig.h"
+    #include "task_layout.h"
+    #include "static_alloc.h"
+
+//***   Definición de constantes y macros   ***//
+    #if CONFIG_TASK_LAYOUT_SPLIT
+        #define RADIO_CORE CONFIG_TASK_LAYOUT_RADIO_CORE
+        #define SENSE_CORE (1 - CONFIG_TASK_LAYOUT_RADIO_CORE)
+    #else
+        #define RADIO_CORE tskNO_AFFINITY
+        #define SENSE_CORE tskNO_AFFINITY
+    #endif
+
+    #define LAYOUT_STATS_ENABLED (CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS && CONFIG_FREERTOS_USE_TRACE_FACILITY)
+
+    static const char *TAG = "task_layout";
+
+//***   Estructuras de datos y tipos personalizados ***//
+    typedef struct {
+        BaseType_t core;
+        UBaseType_t priority;
+    } class_placement_t;
+
+    static const class_placement_t placement[] = {
+        [TASK_CLASS_RADIO_RX]   = {RADIO_CORE, 19},
+        [TASK_CLASS_RADIO_TX]   = {RADIO_CORE, 18},
+        [TASK_CLASS_ACTUATION]  = {SENSE_CORE, 17},
+        [TASK_CLASS_SENSING]    = {SENSE_CORE, 16},
+        [TASK_CLASS_BACKGROUND] = {tskNO_AFFINITY, 3},
+    };
+
+    static portMUX_TYPE latency_lock = portMUX_INITIALIZER_UNLOCKED;
+    static struct {
+        uint32_t count;
+        uint32_t min_us;
+        uint32_t max_us;
+        uint64_t sum_us;
+    } latency = {.min_us = UINT32_MAX};
+
+//***   Declaraciones de funciones (prototipos) ***//
+    static void static_task_entry(void *pvParameters);
+    #if LAYOUT_STATS_ENABLED
+    static void layout_monitor_task(void *pvParameters);
+    #endif
+
+//***Implementación de funciones***//
+    BaseType_t task_layout_core(task_class_t task_class)
+    {
+        return placement[task_class].core;
+    }
+
+    UBaseType_t task_layout_priority(task_class_t task_class)
+    {
+        return placement[task_class].priority;
+    }
+
+    esp_err_t task_layout_create(TaskFunction_t task, const char *name, uint32_t stack_size, void *arg,
+                                 task_class_t task_class, TaskHandle_t *handle)
+    {
+        BaseType_t result = xTaskCreatePinnedToCore(task, name, stack_size, arg, placement[task_class].priority,
+                                                    handle, placement[task_class].core);
+        if (result != pdPASS) {
+            ESP_LOGE(TAG, "Failed to create %s", name);
+            return ESP_ERR_NO_MEM;
+        }
+        return ESP_OK;
+    }
+
+    esp_err_t task_layout_create_static(TaskFunction_t task, const char *name, uint32_t stack_size, void *arg,
+                                        task_class_t task_class, StackType_t *stack, task_layout_static_t *slot,
+                                        TaskHandle_t *handle)
+    {
+        slot->task = task;
+        slot->arg = arg;
+        slot->task_class = task_class;
+        TaskHandle_t created = xTaskCreateStaticPinnedToCore(static_task_entry, name, stack_size, slot,
+                                                             placement[task_class].priority, stack, &slot->tcb,
+                                                             placement[task_class].core);
+        if (created == NULL) {
+            ESP_LOGE(TAG, "Failed to create %s", name);
+            return ESP_ERR_NO_MEM;
+        }
+        if (handle != NULL) {*handle = created;}
+        return ESP_OK;
+    }
+
+    // Las tareas de fondo (OTA, volcados) usan servicios de IDF que reservan heap.
+    static void static_task_entry(void *pvParameters)
+    {
+        task_layout_static_t *slot = pvParameters;
+        if (slot->task_class != TASK_CLASS_BACKGROUND) {static_alloc_guard_current_task();}
+        slot->task(slot->arg);
+    }
+
+    void task_layout_record_latency(uint32_t latency_us)
+    {
+        taskENTER_CRITICAL(&latency_lock);
+        latency.count++;
+        latency.sum_us += latency_us;
+        if (latency_us < latency.min_us) {latency.min_us = latency_us;}
+        if (latency_us > latency.max_us) {latency.max_us = latency_us;}
+        taskEXIT_CRITICAL(&latency_lock);
+    }
+
+    esp_err_t task_layout_start_monitor(void)
+    {
+    #if LAYOUT_STATS_ENABLED
+        if (CONFIG_TASK_LAYOUT_MONITOR_PERIOD_MS == 0) {return ESP_OK;}
+        return TASK_LAYOUT_CREATE(layout_monitor_task, "layout_monitor", 3072, NULL, TASK_CLASS_BACKGROUND, NULL);
+    #else
+        ESP_LOGW(TAG, "Per-core utilization needs FREERTOS_GENERATE_RUN_TIME_STATS and FREERTOS_USE_TRACE_FACILITY");
+        return ESP_ERR_NOT_SUPPORTED;
+    #endif
+    }
+
+    #if LAYOUT_STATS_ENABLED
+    static void layout_monitor_task(void *pvParameters)
+    {
+        static TaskStatus_t status[CONFIG_TASK_LAYOUT_MAX_TASKS];
+        uint32_t previous_idle[portNUM_PROCESSORS] = {0};
+        uint32_t previous_total = 0;
+
+        while (1) {
+            vTaskDelay(pdMS_TO_TICKS(CONFIG_TASK_LAYOUT_MONITOR_PERIOD_MS));
+
+            uint32_t total = 0;
+            uint32_t idle[portNUM_PROCESSORS] = {0};
+            UBaseType_t count = uxTaskGetSystemState(status, CONFIG_TASK_LAYOUT_MAX_TASKS, &total);
+            if (count == 0) {
+                ESP_LOGW(TAG, "More than %d tasks, raise TASK_LAYOUT_MAX_TASKS", CONFIG_TASK_LAYOUT_MAX_TASKS);
+                continue;
+            }
+            for (UBaseType_t i = 0; i < count; i++) {
+                for (UBaseType_t core = 0; core < portNUM_PROCESSORS; core++) {
+                    if (status[i].xHandle == xTaskGetIdleTaskHandleForCPU(core)) {idle[core] = status[i].ulRunTimeCounter;}
+                }
+            }
+
+            uint32_t elapsed = total - previous_total;
+            uint32_t load[portNUM_PROCESSORS] = {0};
+            for (UBaseType_t core = 0; core < portNUM_PROCESSORS && elapsed > 0; core++) {
+                uint32_t idle_time = idle[core] - previous_idle[core];
+                load[core] = idle_time >= elapsed ? 0 : (uint32_t)(100 - ((uint64_t)idle_time * 100) / elapsed);
+                previous_idle[core] = idle[core];
+            }
+            previous_total = total;
+
+            taskENTER_CRITICAL(&latency_lock);
+            uint32_t samples = latency.count;
+            uint32_t min_us = latency.min_us;
+            uint32_t max_us = latency.max_us;
+            uint32_t avg_us = samples ? (uint32_t)(latency.sum_us / samples) : 0;
+            latency.count = 0;
+            latency.sum_us = 0;
+            latency.min_us = UINT32_MAX;
+            latency.max_us = 0;
+            taskEXIT_CRITICAL(&latency_lock);
+
+            if (samples > 0) {
+                ESP_LOGI(TAG, "CPU0=%lu%% CPU1=%lu%% | detection->actuation n=%lu min=%lu avg=%lu max=%lu jitter=%lu us",
+                         (unsigned long)load[0], (unsigned long)load[portNUM_PROCESSORS - 1], (unsigned long)samples,
+                         (unsigned long)min_us, (unsigned long)avg_us, (unsigned long)max_us, (unsigned long)(max_us - min_us));
+            } else {
+                ESP_LOGI(TAG, "CPU0=%lu%% CPU1=%lu%%", (unsigned long)load[0], (unsigned long)load[portNUM_PROCESSORS - 1]);
+            }
+        }
+    }
+    #endif
@@ -0,0 +1,55 @@
+/************************************************************************************************
+ * Módulo: Gobernador térmico.
+ *
+ * Descripción: Servicio de fondo que combina el sensor de temperatura interno del chip con la
+ * temperatura del gabinete (LM35) para estimar el margen térmico del nodo. Según el margen se
+ * elige un nivel que fija frecuencia de CPU y potencia de transmisión, y que la aplicación
+ * consulta para espaciar activaciones de actuadores y reportes periódicos. Nivel, temperatura
+ * del chip y cambios de nivel viajan en las métricas de telemetría.
+ *
+ * Autor:
+ *   - Victor Manuel Patiño Delgado.
+ *
+ * Licencia: THE BEER-WARE LICENSE.
+ * As long as you retain this notice you can do whatever you want with this stuff.
+ * If we meet some day, and you think this stuff is worth it, you can buy me a beer in return.
+************************************************************************************************/
+#pragma once
+
+//***   Bibliotecas y declaraciones de preprocesador    ***//
+    #include <stdint.h>
+    #include "esp_err.h"
+    #include "sdkconfig.h"
+
+    #ifdef __cplusplus
+    extern "C" {
+    #endif
+
+//***   Estructuras de datos y tipos personalizados ***//
+    typedef enum {
+        THERMAL_LEVEL_NORMAL,
+        THERMAL_LEVEL_WARM,
+        THERMAL_LEVEL_HOT,
+        THERMAL_LEVEL_CRITICAL,
+    } thermal_level_t;
+
+//***   Declaraciones de funciones (prototipos) ***//
+    // Instala el sensor interno (si el chip lo tiene) y lanza la tarea de fondo. Llamar
+    // después de iniciar Wi-Fi.
+    esp_err_t thermal_gov_start(void);
+
+    // Entrega la última lectura del LM35; no agrega conversiones ADC propias.
+    void thermal_gov_report_enclosure(float celsius);
+
+    thermal_level_t thermal_gov_level(void);
+
+    // Ciclo de trabajo permitido a los actuadores (100 en nivel NORMAL).
+    uint8_t thermal_gov_actuator_percent(void);
+
+    // Factor por el que se espacian los reportes periódicos (1, 2, 4, 8). Las alertas de
+    // detección no se espacian.
+    uint8_t thermal_gov_report_scale(void);
+
+    #ifdef __cplusplus
+    }
+    #endif
@@ -0,0 +1,174 @@
+/************************************************************************************************
+ * Módulo: Gobernador térmico.
+ *
+ * Descripción: El margen es la menor diferencia entre cada límite y su lectura: chip y gabinete
+ * se vigilan por separado porque bajo sol directo el gabinete se calienta antes que el chip.
+ * Se sube de nivel en cuanto el margen cruza un umbral y se baja solo cuando lo supera por la
+ * histéresis, para no oscilar alrededor del umbral. La acción de cada nivel se aplica una vez,
+ * al cambiar; el resto del tiempo la tarea solo lee el sensor.
+ *
+ * Autor:
+ *   - Victor Manuel Patiño Delgado.
+ *
+ * Licencia: THE BEER-WARE LICENSE.
+ * As long as you retain this notice you can do whatever you want with this stuff.
+ * If we meet some day, and you think this stuff is worth it, you can buy me a beer in return.
+************************************************************************************************/
+
+//***   Bibliotecas y declaraciones de preprocesador    ***//
+    #include <math.h>
+    #include "freertos/FreeRTOS.h"
+    #include "freertos/task.h"
+    #include "soc/soc_caps.h"
+    #include "esp_wifi.h"
+    #include "esp_log.h"
+    #include "sdkconfig.h"
+    #include "thermal_gov.h"
+    #include "metrics.h"
+    #include "task_layout.h"
+    #if SOC_TEMP_SENSOR_SUPPORTED
+        #include "driver/temperature_sensor.h"
+    #endif
+    #if CONFIG_THERMAL_GOV_CPU_SCALING
+        #include "esp_pm.h"
+    #endif
+
+//***   Definición de constantes y macros   ***//
+    static const char *TAG = "thermal_gov";
+
+//***   Estructuras de datos y tipos personalizados ***//
+    typedef struct {
+        const char *name;
+        int cpu_mhz;            // 0: frecuencia por defecto
+        int8_t tx_power;        // Unidades de 0.25 dBm
+        uint8_t actuator_percent;
+        uint8_t report_scale;
+    } level_policy_t;
+
+    static const level_policy_t policy[] = {
+        [THERMAL_LEVEL_NORMAL]   = {"normal",   0,   80, 100, 1},
+        [THERMAL_LEVEL_WARM]     = {"warm",     160, 68, 75,  2},
+        [THERMAL_LEVEL_HOT]      = {"hot",      80,  52, 50,  4},
+        [THERMAL_LEVEL_CRITICAL] = {"critical", 80,  34, 25,  8},
+    };
+
+    static volatile thermal_level_t current_level = THERMAL_LEVEL_NORMAL;
+    static volatile float enclosure_c = NAN;
+
+    #if CONFIG_THERMAL_GOV_ENABLE
+    static const int level_headroom[] = {
+        [THERMAL_LEVEL_WARM]     = CONFIG_THERMAL_GOV_WARM_HEADROOM_C,
+        [THERMAL_LEVEL_HOT]      = CONFIG_THERMAL_GOV_HOT_HEADROOM_C,
+        [THERMAL_LEVEL_CRITICAL] = CONFIG_THERMAL_GOV_CRITICAL_HEADROOM_C,
+    };
+    #endif
+
+    #if CONFIG_THERMAL_GOV_ENABLE && SOC_TEMP_SENSOR_SUPPORTED
+    static temperature_sensor_handle_t die_sensor;
+    #endif
+
+//***   Declaraciones de funciones (prototipos) ***//
+    #if CONFIG_THERMAL_GOV_ENABLE
+    static float read_die_celsius(void);
+    static thermal_level_t next_level(thermal_level_t level, float headroom);
+    static void apply_level(thermal_level_t level, float die, float enclosure);
+    static void governor_task(void *pvParameters);
+    #endif
+
+//***Implementación de funciones***//
+    esp_err_t thermal_gov_start(void)
+    {
+    #if CONFIG_THERMAL_GOV_ENABLE
+        #if SOC_TEMP_SENSOR_SUPPORTED
+        temperature_sensor_config_t config = TEMPERATURE_SENSOR_CONFIG_DEFAULT(-10, 80);
+        if (temperature_sensor_install(&config, &die_sensor) != ESP_OK || temperature_sensor_enable(die_sensor) != ESP_OK) {
+            ESP_LOGW(TAG, "Internal temperature sensor unavailable, using enclosure only");
+            die_sensor = NULL;
+        }
+        #else
+        ESP_LOGW(TAG, "No internal temperature sensor on this chip, using enclosure only");
+        #endif
+        return TASK_LAYOUT_CREATE(governor_task, "thermal_gov", 3072, NULL, TASK_CLASS_BACKGROUND, NULL);
+    #else
+        return ESP_OK;
+    #endif
+    }
+
+    void thermal_gov_report_enclosure(float celsius)
+    {
+        enclosure_c = celsius;
+    }
+
+    thermal_level_t thermal_gov_level(void)
+    {
+        return current_level;
+    }
+
+    uint8_t thermal_gov_actuator_percent(void)
+    {
+        return policy[current_level].actuator_percent;
+    }
+
+    uint8_t thermal_gov_report_scale(void)
+    {
+        return policy[current_level].report_scale;
+    }
+
+    #if CONFIG_THERMAL_GOV_ENABLE
+    static float read_die_celsius(void)
+    {
+    #if SOC_TEMP_SENSOR_SUPPORTED
+        float celsius;
+        if (die_sensor != NULL && temperature_sensor_get_celsius(die_sensor, &celsius) == ESP_OK) {return celsius;}
+    #endif
+        return NAN;
+    }
+
+    static thermal_level_t next_level(thermal_level_t level, float headroom)
+    {
+        while (level < THERMAL_LEVEL_CRITICAL && headroom < level_headroom[level + 1]) {level++;}
+        while (level > THERMAL_LEVEL_NORMAL && headroom >= level_headroom[level] + CONFIG_THERMAL_GOV_HYSTERESIS_C) {level--;}
+        return level;
+    }
+
+    static void apply_level(thermal_level_t level, float die, float enclosure)
+    {
+        const level_policy_t *p = &policy[level];
+    #if CONFIG_THERMAL_GOV_CPU_SCALING
+        int mhz = p->cpu_mhz != 0 ? p->cpu_mhz : CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ;
+        esp_pm_config_t pm_config = {
+            .max_freq_mhz = mhz,
+            .min_freq_mhz = mhz,
+            .light_sleep_enable = false,
+        };
+        if (esp_pm_configure(&pm_config) != ESP_OK) {ESP_LOGW(TAG, "esp_pm_configure %d MHz failed", mhz);}
+    #endif
+        esp_wifi_set_max_tx_power(p->tx_power);
+        ESP_LOGW(TAG, "Level %s (die %.1f C, enclosure %.1f C): CPU %d MHz, TX %.1f dBm, actuators %d%%, reports x%d",
+                 p->name, die, enclosure, p->cpu_mhz != 0 ? p->cpu_mhz : CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ,
+                 p->tx_power / 4.0f, p->actuator_percent, p->report_scale);
+    }
+
+    static void governor_task(void *pvParameters)
+    {
+        while (1) {
+            float die = read_die_celsius();
+            float enclosure = enclosure_c;
+
+            float headroom = INFINITY;
+            if (!isnan(die)) {headroom = fminf(headroom, CONFIG_THERMAL_GOV_DIE_LIMIT_C - die);}
+            if (!isnan(enclosure)) {headroom = fminf(headroom, CONFIG_THERMAL_GOV_ENCLOSURE_LIMIT_C - enclosure);}
+
+            thermal_level_t level = next_level(current_level, headroom);
+            if (level != current_level) {
+                current_level = level;
+                apply_level(level, die, enclosure);
+                metrics_inc(METRIC_THERMAL_CHANGES);
+            }
+            metrics_set(METRIC_THERMAL_LEVEL, level);
+            metrics_set(METRIC_DIE_TEMP_C, !isnan(die) && die > 0 ? (uint32_t)lroundf(die) : 0);
+
+            vTaskDelay(pdMS_TO_TICKS(CONFIG_THERMAL_GOV_PERIOD_MS));
+        }
+    }
+    #endif
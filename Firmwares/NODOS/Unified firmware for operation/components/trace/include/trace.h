@@ -0,0 +1,99 @@
+/************************************************************************************************
+ * Módulo: Trazas de ciclos en rutas críticas.
+ *
+ * Descripción: Eventos de inicio/fin/instante marcados con el contador de ciclos de la CPU y
+ * almacenados en un búfer circular por núcleo. Cada núcleo escribe solo su búfer y reserva la
+ * posición con un incremento atómico, por lo que las macros son seguras desde ISRs y tareas
+ * sin bloqueos. Con CONFIG_TRACE_ENABLE deshabilitado las macros desaparecen del binario.
+ * El volcado (UART o partición "trace") se convierte a JSON de Chrome/Perfetto con
+ * tools/trace_to_perfetto.py.
+ *
+ * Autor:
+ *   - Victor Manuel Patiño Delgado.
+ *
+ * Licencia: THE BEER-WARE LICENSE.
+ * As long as you retain this notice you can do whatever you want with this stuff.
+ * If we meet some day, and you think this stuff is worth it, you can buy me a beer in return.
+************************************************************************************************/
+#pragma once
+
+//***   Bibliotecas y declaraciones de preprocesador    ***//
+    #include <stdint.h>
+    #include <stdbool.h>
+    #include "esp_err.h"
+    #include "sdkconfig.h"
+    #if CONFIG_TRACE_ENABLE
+    #include "freertos/FreeRTOS.h"
+    #include "esp_cpu.h"
+    #endif
+
+    #ifdef __cplusplus
+    extern "C" {
+    #endif
+
+//***   Definición de constantes y macros   ***//
+    #define TRACE_PHASE_BEGIN 'B'
+    #define TRACE_PHASE_END 'E'
+    #define TRACE_PHASE_INSTANT 'i'
+
+//***   Estructuras de datos y tipos personalizados ***//
+    // Puntos de traza conocidos; el índice es parte del formato del volcado.
+    typedef enum {
+        TRACE_ISR_PIR,          // Flanco del PIR
+        TRACE_ISR_RADAR,        // Flanco del radar
+        TRACE_PROCESS,          // Lógica de detección
+        TRACE_LM35_READ,        // Promediado del ADC
+        TRACE_ESPNOW_SEND,      // Preparación y esp_now_send (arg: secuencia)
+        TRACE_RECV_CB,          // Callback de recepción (arg: secuencia)
+        TRACE_RX_TASK,          // Procesamiento de la trama recibida
+        TRACE_SERVO_ACTUATE,    // Barrido del servo
+        TRACE_POINT_COUNT
+    } trace_point_t;
+
+    typedef struct __attribute__((packed)) {
+        uint32_t cycles;
+        uint8_t point;
+        uint8_t phase;
+        uint16_t arg;
+    } trace_event_t;
+
+    #if CONFIG_TRACE_ENABLE
+    #define TRACE_EVENTS_MASK (CONFIG_TRACE_EVENTS_PER_CORE - 1)
+    _Static_assert((CONFIG_TRACE_EVENTS_PER_CORE & TRACE_EVENTS_MASK) == 0, "TRACE_EVENTS_PER_CORE must be a power of 2");
+
+    extern volatile bool trace_active;
+    extern uint32_t trace_heads[portNUM_PROCESSORS];
+    extern trace_event_t trace_buffers[portNUM_PROCESSORS][CONFIG_TRACE_EVENTS_PER_CORE];
+
+    static inline __attribute__((always_inline)) void trace_record(trace_point_t point, uint8_t phase, uint16_t arg)
+    {
+        if (!trace_active) {return;}
+        uint32_t cycles = esp_cpu_get_cycle_count();
+        int core = esp_cpu_get_core_id();
+        uint32_t index = __atomic_fetch_add(&trace_heads[core], 1, __ATOMIC_RELAXED) & TRACE_EVENTS_MASK;
+        trace_buffers[core][index] = (trace_event_t){cycles, (uint8_t)point, phase, arg};
+    }
+
+    #define TRACE_BEGIN(point) trace_record((point), TRACE_PHASE_BEGIN, 0)
+    #define TRACE_BEGIN_ARG(point, arg) trace_record((point), TRACE_PHASE_BEGIN, (arg))
+    #define TRACE_END(point) trace_record((point), TRACE_PHASE_END, 0)
+    #define TRACE_END_ARG(point, arg) trace_record((point), TRACE_PHASE_END, (arg))
+    #define TRACE_INSTANT(point, arg) trace_record((point), TRACE_PHASE_INSTANT, (arg))
+    #else
+    #define TRACE_BEGIN(point) do {} while (0)
+    #define TRACE_BEGIN_ARG(point, arg) do {} while (0)
+    #define TRACE_END(point) do {} while (0)
+    #define TRACE_END_ARG(point, arg) do {} while (0)
+    #define TRACE_INSTANT(point, arg) do {} while (0)
+    #endif
+
+//***   Declaraciones de funciones (prototipos) ***//
+    // Activa la captura y, si está configurado, programa el volcado automático.
+    esp_err_t trace_start(void);
+
+    // Detiene la captura y vuelca ambos búferes al destino configurado.
+    esp_err_t trace_dump(void);
+
+    #ifdef __cplusplus
+    }
+    #endif
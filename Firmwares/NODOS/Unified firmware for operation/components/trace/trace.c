@@ -0,0 +1,176 @@
+/************************************************************************************************
+ * Módulo: Trazas de ciclos en rutas críticas.
+ *
+ * Descripción: Almacenamiento y volcado de los búferes por núcleo. El volcado detiene la
+ * captura, espera a que terminen las escrituras en curso y emite los eventos en orden de
+ * llegada de cada núcleo; la reconstrucción de la línea de tiempo (desborde del contador de
+ * 32 bits, conversión a microsegundos, emparejado entre dispositivos) se hace en el host.
+ *
+ * Autor:
+ *   - Victor Manuel Patiño Delgado.
+ *
+ * Licencia: THE BEER-WARE LICENSE.
+ * As long as you retain this notice you can do whatever you want with this stuff.
+ * If we meet some day, and you think this stuff is worth it, you can buy me a beer in return.
+************************************************************************************************/
+
+//***   Bibliotecas y declaraciones de preprocesador    ***//
+    #include <stdio.h>
+    #include <string.h>
+    #include "freertos/FreeRTOS.h"
+    #include "freertos/task.h"
+    #include "esp_log.h"
+    #include "esp_partition.h"
+    #include "sdkconfig.h"
+    #include "trace.h"
+    #include "task_layout.h"
+
+//***   Definición de constantes y macros   ***//
+    #define TRACE_MAGIC 0x45435254  // "TRCE"
+    #define TRACE_VERSION 1
+    #define TRACE_NAME_LEN 16
+    #define TRACE_PARTITION_LABEL "trace"
+
+    #if CONFIG_TRACE_ENABLE
+    static const char *TAG = "trace";
+
+    static const char *const point_names[TRACE_POINT_COUNT] = {
+        [TRACE_ISR_PIR]         = "isr_pir",
+        [TRACE_ISR_RADAR]       = "isr_radar",
+        [TRACE_PROCESS]         = "process",
+        [TRACE_LM35_READ]       = "lm35_read",
+        [TRACE_ESPNOW_SEND]     = "espnow_send",
+        [TRACE_RECV_CB]         = "recv_cb",
+        [TRACE_RX_TASK]         = "rx_task",
+        [TRACE_SERVO_ACTUATE]   = "servo_actuate",
+    };
+    #endif
+
+//***   Estructuras de datos y tipos personalizados ***//
+    #if CONFIG_TRACE_ENABLE
+    typedef struct __attribute__((packed)) {
+        uint32_t magic;
+        uint8_t version;
+        uint8_t cores;
+        uint16_t cpu_mhz;
+        uint32_t events_per_core;
+        uint32_t heads[2];
+        uint8_t point_count;
+        uint8_t reserved[3];
+    } flash_header_t;
+
+    volatile bool trace_active;
+    uint32_t trace_heads[portNUM_PROCESSORS];
+    trace_event_t trace_buffers[portNUM_PROCESSORS][CONFIG_TRACE_EVENTS_PER_CORE];
+    #endif
+
+//***   Declaraciones de funciones (prototipos) ***//
+    #if CONFIG_TRACE_ENABLE
+    static void trace_dump_task(void *pvParameters);
+    static esp_err_t dump_uart(void);
+    #if CONFIG_TRACE_DUMP_FLASH
+    static esp_err_t dump_flash(void);
+    #endif
+    #endif
+
+//***Implementación de funciones***//
+    #if CONFIG_TRACE_ENABLE
+    esp_err_t trace_start(void)
+    {
+        memset(trace_heads, 0, sizeof(trace_heads));
+        trace_active = true;
+        ESP_LOGI(TAG, "tracing %d events per core", CONFIG_TRACE_EVENTS_PER_CORE);
+        if (CONFIG_TRACE_DUMP_AFTER_MS == 0) {return ESP_OK;}
+        return TASK_LAYOUT_CREATE(trace_dump_task, "trace_dump", 3072, NULL, TASK_CLASS_BACKGROUND, NULL);
+    }
+
+    esp_err_t trace_dump(void)
+    {
+        trace_active = false;
+        // Deja terminar una escritura que haya leído trace_active antes del cambio.
+        vTaskDelay(1);
+    #if CONFIG_TRACE_DUMP_FLASH
+        return dump_flash();
+    #else
+        return dump_uart();
+    #endif
+    }
+
+    static void trace_dump_task(void *pvParameters)
+    {
+        vTaskDelay(pdMS_TO_TICKS(CONFIG_TRACE_DUMP_AFTER_MS));
+        trace_dump();
+        vTaskDelete(NULL);
+    }
+
+    static esp_err_t dump_uart(void)
+    {
+        printf("#TRACE v%d cpu_mhz=%d cores=%d events=%d\n", TRACE_VERSION, CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ,
+               portNUM_PROCESSORS, CONFIG_TRACE_EVENTS_PER_CORE);
+        for (uint8_t i = 0; i < TRACE_POINT_COUNT; i++) {printf("#TRACE-POINT %d %s\n", i, point_names[i]);}
+
+        for (uint8_t core = 0; core < portNUM_PROCESSORS; core++) {
+            uint32_t head = trace_heads[core];
+            uint32_t count = head < CONFIG_TRACE_EVENTS_PER_CORE ? head : CONFIG_TRACE_EVENTS_PER_CORE;
+            for (uint32_t n = head - count; n != head; n++) {
+                const trace_event_t *event = &trace_buffers[core][n & TRACE_EVENTS_MASK];
+                printf("#TRACE-EV %d %lu %d %c %d\n", core, (unsigned long)event->cycles, event->point,
+                       event->phase, event->arg);
+            }
+        }
+        printf("#TRACE-END\n");
+        return ESP_OK;
+    }
+
+    #if CONFIG_TRACE_DUMP_FLASH
+    static esp_err_t dump_flash(void)
+    {
+        const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY,
+                                                                    TRACE_PARTITION_LABEL);
+        if (partition == NULL) {
+            ESP_LOGE(TAG, "No \"%s\" partition, falling back to UART", TRACE_PARTITION_LABEL);
+            return dump_uart();
+        }
+
+        flash_header_t header = {
+            .magic = TRACE_MAGIC,
+            .version = TRACE_VERSION,
+            .cores = portNUM_PROCESSORS,
+            .cpu_mhz = CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ,
+            .events_per_core = CONFIG_TRACE_EVENTS_PER_CORE,
+            .point_count = TRACE_POINT_COUNT,
+        };
+        memcpy(header.heads, trace_heads, sizeof(trace_heads));
+
+        size_t total = sizeof(header) + TRACE_POINT_COUNT * TRACE_NAME_LEN + sizeof(trace_buffers);
+        if (total > partition->size) {return ESP_ERR_INVALID_SIZE;}
+        size_t erase = (total + partition->erase_size - 1) / partition->erase_size * partition->erase_size;
+        esp_err_t err = esp_partition_erase_range(partition, 0, erase);
+
+        size_t offset = 0;
+        if (err == ESP_OK) {err = esp_partition_write(partition, offset, &header, sizeof(header));}
+        offset += sizeof(header);
+        for (uint8_t i = 0; i < TRACE_POINT_COUNT && err == ESP_OK; i++) {
+            char name[TRACE_NAME_LEN] = {0};
+            strncpy(name, point_names[i], TRACE_NAME_LEN - 1);
+            err = esp_partition_write(partition, offset, name, TRACE_NAME_LEN);
+            offset += TRACE_NAME_LEN;
+        }
+        if (err == ESP_OK) {err = esp_partition_write(partition, offset, trace_buffers, sizeof(trace_buffers));}
+
+        if (err == ESP_OK) {ESP_LOGI(TAG, "Trace written to \"%s\" (%u bytes)", TRACE_PARTITION_LABEL, (unsigned)total);}
+        else {ESP_LOGE(TAG, "Trace dump failed: %s", esp_err_to_name(err));}
+        return err;
+    }
+    #endif
+    #else
+    esp_err_t trace_start(void)
+    {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    esp_err_t trace_dump(void)
+    {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    #endif
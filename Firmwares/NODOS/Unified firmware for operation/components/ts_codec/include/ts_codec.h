@@ -0,0 +1,82 @@
+/************************************************************************************************
+ * Módulo: Compresión de series de tiempo para tramas de telemetría por lotes.
+ *
+ * Descripción: Códec por flujo al estilo Gorilla para empaquetar muchas muestras
+ * (marca de tiempo, valor) en una sola trama ESP-NOW. Las marcas de tiempo se codifican como
+ * delta de deltas y los valores como delta en punto fijo con los decimales elegidos; ambos
+ * pasan por zigzag y se escriben en cubetas de ancho variable, de modo que una muestra
+ * periódica sin cambio cuesta 2 bits. El codificador escribe sobre el búfer del llamador y no
+ * reserva memoria; la trama es válida después de cada muestra agregada.
+ *
+ * Formato (little endian): versión (1 B), decimales (1 B), número de muestras (2 B), primera
+ * marca de tiempo (4 B), primer valor en punto fijo (4 B) y el flujo de bits, MSB primero.
+ * tools/ts_decode.py decodifica el mismo formato en el host.
+ *
+ * Autor:
+ *   - Victor Manuel Patiño Delgado.
+ *
+ * Licencia: THE BEER-WARE LICENSE.
+ * As long as you retain this notice you can do whatever you want with this stuff.
+ * If we meet some day, and you think this stuff is worth it, you can buy me a beer in return.
+************************************************************************************************/
+#pragma once
+
+//***   Bibliotecas y declaraciones de preprocesador    ***//
+    #include <stdint.h>
+    #include <stdbool.h>
+    #include <stddef.h>
+
+    #ifdef __cplusplus
+    extern "C" {
+    #endif
+
+//***   Definición de constantes y macros   ***//
+    #define TS_CODEC_VERSION 1
+    #define TS_CODEC_HEADER_LEN 12
+    #define TS_CODEC_MAX_DECIMALS 4
+
+//***   Estructuras de datos y tipos personalizados ***//
+    typedef struct {
+        uint8_t *buffer;
+        size_t room;
+        size_t bit_pos;
+        uint16_t count;
+        float scale;            // 10^decimales
+        uint32_t last_timestamp;
+        uint32_t last_delta;
+        uint32_t last_value;    // Punto fijo, aritmética módulo 2^32
+    } ts_encoder_t;
+
+    typedef struct {
+        const uint8_t *frame;
+        size_t len;
+        size_t bit_pos;
+        uint16_t count;
+        uint16_t index;
+        float scale;
+        uint32_t last_timestamp;
+        uint32_t last_delta;
+        uint32_t last_value;
+    } ts_decoder_t;
+
+//***   Declaraciones de funciones (prototipos) ***//
+    // Prepara una trama vacía en buffer. Los valores se redondean a decimals cifras decimales.
+    void ts_encoder_init(ts_encoder_t *encoder, uint8_t *buffer, size_t room, uint8_t decimals);
+
+    // Agrega una muestra. La unidad de timestamp la elige el llamador: cuanto más gruesa, más
+    // muestras salen con delta de deltas cero. Devuelve false sin modificar la trama si no
+    // cabe: el llamador envía la trama actual y empieza otra con la misma muestra.
+    bool ts_encoder_append(ts_encoder_t *encoder, uint32_t timestamp, float value);
+
+    // Bytes ocupados por la trama (0 si no tiene muestras).
+    size_t ts_encoder_size(const ts_encoder_t *encoder);
+
+    // Valida la cabecera; false si la trama no es de este formato.
+    bool ts_decoder_init(ts_decoder_t *decoder, const uint8_t *frame, size_t len);
+
+    // Siguiente muestra; false al terminar o si la trama está truncada.
+    bool ts_decoder_next(ts_decoder_t *decoder, uint32_t *timestamp, float *value);
+
+    #ifdef __cplusplus
+    }
+    #endif
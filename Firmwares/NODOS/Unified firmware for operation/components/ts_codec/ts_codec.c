@@ -0,0 +1,230 @@
+/************************************************************************************************
+ * Módulo: Compresión de series de tiempo para tramas de telemetría por lotes.
+ *
+ * Descripción: Cada campo se codifica como un entero zigzag en una de cinco cubetas:
+ * '0' para cero, y '10', '110', '1110' o '1111' seguidos del ancho correspondiente. Las
+ * marcas de tiempo usan anchos pensados para jitter de milisegundos en un periodo fijo y los
+ * valores anchos pequeños porque un LM35 promediado cambia a lo sumo unos pasos de ADC entre
+ * muestras. Las diferencias se toman módulo 2^32 para que ningún par de muestras desborde.
+ *
+ * Autor:
+ *   - Victor Manuel Patiño Delgado.
+ *
+ * Licencia: THE BEER-WARE LICENSE.
+ * As long as you retain this notice you can do whatever you want with this stuff.
+ * If we meet some day, and you think this stuff is worth it, you can buy me a beer in return.
+************************************************************************************************/
+
+//***   Bibliotecas y declaraciones de preprocesador    ***//
+    #include <math.h>
+    #include "ts_codec.h"
+
+//***   Definición de constantes y macros   ***//
+    #define BUCKETS 4
+
+    static const uint8_t timestamp_widths[BUCKETS] = {4, 8, 12, 32};
+    static const uint8_t value_widths[BUCKETS] = {3, 6, 12, 32};
+    static const float decimal_scale[TS_CODEC_MAX_DECIMALS + 1] = {1.0f, 10.0f, 100.0f, 1000.0f, 10000.0f};
+
+//***   Declaraciones de funciones (prototipos) ***//
+    static inline uint32_t zigzag(uint32_t delta);
+    static inline uint32_t unzigzag(uint32_t zz);
+    static uint32_t to_fixed(float value, float scale);
+    static uint8_t bucket_bits(uint32_t zz, const uint8_t *widths);
+    static void write_bits(uint8_t *buffer, size_t *bit_pos, uint32_t value, uint8_t bits);
+    static void write_bucket(uint8_t *buffer, size_t *bit_pos, uint32_t zz, const uint8_t *widths);
+    static bool read_bits(ts_decoder_t *decoder, uint8_t bits, uint32_t *value);
+    static bool read_bucket(ts_decoder_t *decoder, const uint8_t *widths, uint32_t *zz);
+    static void put_u32(uint8_t *buffer, uint32_t value);
+    static uint32_t get_u32(const uint8_t *buffer);
+
+//***Implementación de funciones***//
+    void ts_encoder_init(ts_encoder_t *encoder, uint8_t *buffer, size_t room, uint8_t decimals)
+    {
+        if (decimals > TS_CODEC_MAX_DECIMALS) {decimals = TS_CODEC_MAX_DECIMALS;}
+        *encoder = (ts_encoder_t){
+            .buffer = buffer,
+            .room = room,
+            .scale = decimal_scale[decimals],
+        };
+        if (room >= TS_CODEC_HEADER_LEN) {
+            buffer[0] = TS_CODEC_VERSION;
+            buffer[1] = decimals;
+            buffer[2] = 0;
+            buffer[3] = 0;
+        }
+    }
+
+    bool ts_encoder_append(ts_encoder_t *encoder, uint32_t timestamp, float value)
+    {
+        uint32_t fixed = to_fixed(value, encoder->scale);
+
+        if (encoder->count == 0) {
+            if (encoder->room < TS_CODEC_HEADER_LEN) {return false;}
+            put_u32(&encoder->buffer[4], timestamp);
+            put_u32(&encoder->buffer[8], fixed);
+            encoder->bit_pos = TS_CODEC_HEADER_LEN * 8;
+            encoder->last_delta = 0;
+        } else {
+            if (encoder->count == UINT16_MAX) {return false;}
+            uint32_t delta = timestamp - encoder->last_timestamp;
+            uint32_t timestamp_zz = zigzag(delta - encoder->last_delta);
+            uint32_t value_zz = zigzag(fixed - encoder->last_value);
+
+            size_t bits = bucket_bits(timestamp_zz, timestamp_widths) + bucket_bits(value_zz, value_widths);
+            if (encoder->bit_pos + bits > encoder->room * 8) {return false;}
+
+            write_bucket(encoder->buffer, &encoder->bit_pos, timestamp_zz, timestamp_widths);
+            write_bucket(encoder->buffer, &encoder->bit_pos, value_zz, value_widths);
+            encoder->last_delta = delta;
+        }
+
+        encoder->last_timestamp = timestamp;
+        encoder->last_value = fixed;
+        encoder->count++;
+        encoder->buffer[2] = encoder->count & 0xFF;
+        encoder->buffer[3] = encoder->count >> 8;
+        return true;
+    }
+
+    size_t ts_encoder_size(const ts_encoder_t *encoder)
+    {
+        return encoder->count == 0 ? 0 : (encoder->bit_pos + 7) / 8;
+    }
+
+    bool ts_decoder_init(ts_decoder_t *decoder, const uint8_t *frame, size_t len)
+    {
+        if (frame == NULL || len < TS_CODEC_HEADER_LEN) {return false;}
+        if (frame[0] != TS_CODEC_VERSION || frame[1] > TS_CODEC_MAX_DECIMALS) {return false;}
+        *decoder = (ts_decoder_t){
+            .frame = frame,
+            .len = len,
+            .bit_pos = TS_CODEC_HEADER_LEN * 8,
+            .count = frame[2] | (frame[3] << 8),
+            .scale = decimal_scale[frame[1]],
+            .last_timestamp = get_u32(&frame[4]),
+            .last_value = get_u32(&frame[8]),
+        };
+        return true;
+    }
+
+    bool ts_decoder_next(ts_decoder_t *decoder, uint32_t *timestamp, float *value)
+    {
+        if (decoder->index >= decoder->count) {return false;}
+
+        if (decoder->index > 0) {
+            uint32_t timestamp_zz, value_zz;
+            if (!read_bucket(decoder, timestamp_widths, &timestamp_zz) ||
+                !read_bucket(decoder, value_widths, &value_zz)) {return false;}
+            decoder->last_delta += unzigzag(timestamp_zz);
+            decoder->last_timestamp += decoder->last_delta;
+            decoder->last_value += unzigzag(value_zz);
+        }
+
+        decoder->index++;
+        *timestamp = decoder->last_timestamp;
+        *value = (int32_t)decoder->last_value / decoder->scale;
+        return true;
+    }
+
+    static inline uint32_t zigzag(uint32_t delta)
+    {
+        return (delta << 1) ^ (uint32_t)((int32_t)delta >> 31);
+    }
+
+    static inline uint32_t unzigzag(uint32_t zz)
+    {
+        return (zz >> 1) ^ (0u - (zz & 1));
+    }
+
+    static uint32_t to_fixed(float value, float scale)
+    {
+        float scaled = value * scale;
+        // Fuera de rango o NaN se satura en lugar de provocar un comportamiento indefinido.
+        if (!(scaled > (float)INT32_MIN)) {return (uint32_t)INT32_MIN;}
+        if (scaled >= (float)INT32_MAX) {return (uint32_t)INT32_MAX;}
+        return (uint32_t)(int32_t)lroundf(scaled);
+    }
+
+    static uint8_t bucket_bits(uint32_t zz, const uint8_t *widths)
+    {
+        if (zz == 0) {return 1;}
+        for (uint8_t i = 0; i < BUCKETS - 1; i++) {
+            if (zz < (1u << widths[i])) {return i + 2 + widths[i];}
+        }
+        return BUCKETS + widths[BUCKETS - 1];
+    }
+
+    static void write_bits(uint8_t *buffer, size_t *bit_pos, uint32_t value, uint8_t bits)
+    {
+        while (bits > 0) {
+            size_t byte = *bit_pos >> 3;
+            uint8_t free = 8 - (*bit_pos & 7);
+            uint8_t take = bits < free ? bits : free;
+            uint8_t chunk = (value >> (bits - take)) & ((1u << take) - 1);
+            // El búfer no se borra al iniciar: cada byte nuevo se limpia al empezar a escribirlo.
+            if (free == 8) {buffer[byte] = 0;}
+            buffer[byte] |= chunk << (free - take);
+            *bit_pos += take;
+            bits -= take;
+        }
+    }
+
+    static void write_bucket(uint8_t *buffer, size_t *bit_pos, uint32_t zz, const uint8_t *widths)
+    {
+        if (zz == 0) {
+            write_bits(buffer, bit_pos, 0, 1);
+            return;
+        }
+        uint8_t bucket = 0;
+        while (bucket < BUCKETS - 1 && zz >= (1u << widths[bucket])) {bucket++;}
+        if (bucket < BUCKETS - 1) {
+            // bucket + 1 unos y un cero.
+            write_bits(buffer, bit_pos, (1u << (bucket + 2)) - 2, bucket + 2);
+        } else {
+            write_bits(buffer, bit_pos, (1u << BUCKETS) - 1, BUCKETS);
+        }
+        write_bits(buffer, bit_pos, zz, widths[bucket]);
+    }
+
+    static bool read_bits(ts_decoder_t *decoder, uint8_t bits, uint32_t *value)
+    {
+        if (decoder->bit_pos + bits > decoder->len * 8) {return false;}
+        uint32_t result = 0;
+        while (bits > 0) {
+            uint8_t free = 8 - (decoder->bit_pos & 7);
+            uint8_t take = bits < free ? bits : free;
+            uint8_t chunk = (decoder->frame[decoder->bit_pos >> 3] >> (free - take)) & ((1u << take) - 1);
+            result = (result << take) | chunk;
+            decoder->bit_pos += take;
+            bits -= take;
+        }
+        *value = result;
+        return true;
+    }
+
+    static bool read_bucket(ts_decoder_t *decoder, const uint8_t *widths, uint32_t *zz)
+    {
+        uint32_t bit;
+        uint8_t ones = 0;
+        while (ones < BUCKETS) {
+            if (!read_bits(decoder, 1, &bit)) {return false;}
+            if (bit == 0) {break;}
+            ones++;
+        }
+        if (ones == 0) {
+            *zz = 0;
+            return true;
+        }
+        return read_bits(decoder, widths[ones - 1], zz);
+    }
+
+    static void put_u32(uint8_t *buffer, uint32_t value)
+    {
+        for (uint8_t i = 0; i < 4; i++) {buffer[i] = value >> (8 * i);}
+    }
+
+    static uint32_t get_u32(const uint8_t *buffer)
+    {
+        return buffer[0] | (buffer[1] << 8) | (buffer[2] << 16) | ((uint32_t)buffer[3] << 24);
+    }
@@ -0,0 +1,51 @@
+/************************************************************************************************
+ * Módulo: Tablero en vivo de la pasarela por WebSocket.
+ *
+ * Descripción: La pasarela sirve con esp_http_server una página estática embebida en flash y
+ * un flujo WebSocket. La ruta de recepción solo anota el valor nuevo de un campo en una tabla
+ * fija; una tarea de fondo serializa, una vez por ventana, únicamente los campos que
+ * cambiaron y los envía a todos los visores. Cada visor nuevo recibe primero el estado
+ * completo. Visores conectados y envíos realizados viajan en las métricas.
+ *
+ * Autor:
+ *   - Victor Manuel Patiño Delgado.
+ *
+ * Licencia: THE BEER-WARE LICENSE.
+ * As long as you retain this notice you can do whatever you want with this stuff.
+ * If we meet some day, and you think this stuff is worth it, you can buy me a beer in return.
+************************************************************************************************/
+#pragma once
+
+//***   Bibliotecas y declaraciones de preprocesador    ***//
+    #include <stdint.h>
+    #include "esp_err.h"
+    #include "sdkconfig.h"
+
+    #ifdef __cplusplus
+    extern "C" {
+    #endif
+
+//***   Definición de constantes y macros   ***//
+    #define WS_DASHBOARD_MAC_LEN 6
+
+//***   Estructuras de datos y tipos personalizados ***//
+    typedef enum {
+        WS_FIELD_TEMP_C,        // Última temperatura LM35
+        WS_FIELD_RSSI,          // RSSI de la última trama (dBm)
+        WS_FIELD_ONLINE,        // 1 conectado, 0 desconectado
+        WS_FIELD_ANOMALY,       // Bits de anomalías activas (sensor_anomaly)
+        WS_FIELD_COUNT
+    } ws_field_t;
+
+//***   Declaraciones de funciones (prototipos) ***//
+    // Arranca el servidor HTTP y la tarea de envío. Requiere una interfaz de red levantada
+    // (punto de acceso o Ethernet) para ser alcanzable, no para iniciar.
+    esp_err_t ws_dashboard_start(void);
+
+    // Anota el valor de un campo. Apta para recv_cb: sin serialización ni E/S, solo una
+    // búsqueda en la tabla bajo un spinlock. Un valor igual al anterior no genera envío.
+    void ws_dashboard_update(const uint8_t *mac, ws_field_t field, float value);
+
+    #ifdef __cplusplus
+    }
+    #endif
@@ -0,0 +1,299 @@
+/************************************************************************************************
+ * Módulo: Tablero en vivo de la pasarela por WebSocket.
+ *
+ * Descripción: Cada nodo tiene un valor y un bit de cambio por campo. recv_cb escribe bajo un
+ * spinlock y la tarea de envío toma, también bajo el spinlock, una copia de los nodos con
+ * cambios y limpia los bits; la serialización JSON y el envío ocurren fuera de la sección
+ * crítica. Varios cambios del mismo campo dentro de una ventana se reducen al último valor.
+ * Un visor lento solo retrasa a la tarea de envío, nunca a la radio, y se descarta si el
+ * envío falla.
+ *
+ * Autor:
+ *   - Victor Manuel Patiño Delgado.
+ *
+ * Licencia: THE BEER-WARE LICENSE.
+ * As long as you retain this notice you can do whatever you want with this stuff.
+ * If we meet some day, and you think this stuff is worth it, you can buy me a beer in return.
+************************************************************************************************/
+
+//***   Bibliotecas y declaraciones de preprocesador    ***//
+    #include <stdio.h>
+    #include <string.h>
+    #include <stdbool.h>
+    #include <math.h>
+    #include "freertos/FreeRTOS.h"
+    #include "freertos/task.h"
+    #include "esp_log.h"
+    #include "sdkconfig.h"
+    #include "ws_dashboard.h"
+    #if CONFIG_WS_DASHBOARD_ENABLE
+    #include <unistd.h>
+    #include "esp_http_server.h"
+    #include "esp_mac.h"
+    #include "metrics.h"
+    #include "task_layout.h"
+    #endif
+
+//***   Definición de constantes y macros   ***//
+    // Peor caso por nodo: MAC y los cuatro campos con valores largos.
+    #define NODE_JSON_LEN 112
+
+    static const char *TAG = "ws_dashboard";
+
+//***   Estructuras de datos y tipos personalizados ***//
+    #if CONFIG_WS_DASHBOARD_ENABLE
+    typedef struct {
+        bool valid;
+        uint8_t mac[WS_DASHBOARD_MAC_LEN];
+        uint8_t dirty;                  // Bit por campo cambiado en la ventana actual
+        float values[WS_FIELD_COUNT];   // NAN hasta el primer valor
+    } node_entry_t;
+
+    typedef struct {
+        int fd;                         // -1 libre
+        bool needs_full;
+    } viewer_t;
+
+    static const char *const field_names[WS_FIELD_COUNT] = {"temp_c", "rssi", "online", "anomaly"};
+
+    extern const char dashboard_html_start[] asm("_binary_dashboard_html_start");
+    extern const char dashboard_html_end[] asm("_binary_dashboard_html_end");
+
+    static portMUX_TYPE node_lock = portMUX_INITIALIZER_UNLOCKED;
+    static portMUX_TYPE viewer_lock = portMUX_INITIALIZER_UNLOCKED;
+    static node_entry_t nodes[CONFIG_WS_DASHBOARD_MAX_NODES];
+    static node_entry_t changes[CONFIG_WS_DASHBOARD_MAX_NODES];
+    static viewer_t viewers[CONFIG_WS_DASHBOARD_MAX_CLIENTS];
+    static char json[CONFIG_WS_DASHBOARD_MAX_NODES * NODE_JSON_LEN + 4];
+    static httpd_handle_t server;
+    #endif
+
+//***   Declaraciones de funciones (prototipos) ***//
+    #if CONFIG_WS_DASHBOARD_ENABLE
+    static esp_err_t page_handler(httpd_req_t *req);
+    static esp_err_t ws_handler(httpd_req_t *req);
+    static void close_handler(httpd_handle_t handle, int sockfd);
+    static bool add_viewer(int fd);
+    static void remove_viewer(int fd);
+    static size_t take_nodes(node_entry_t *out, bool full);
+    static size_t serialize(const node_entry_t *entries, size_t count, bool full);
+    static void send_to(int fd, size_t len);
+    static void push_task(void *pvParameters);
+    #endif
+
+//***Implementación de funciones***//
+    #if CONFIG_WS_DASHBOARD_ENABLE
+    esp_err_t ws_dashboard_start(void)
+    {
+        for (uint8_t i = 0; i < CONFIG_WS_DASHBOARD_MAX_CLIENTS; i++) {viewers[i].fd = -1;}
+
+        httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+        config.server_port = CONFIG_WS_DASHBOARD_PORT;
+        config.max_open_sockets = CONFIG_WS_DASHBOARD_MAX_CLIENTS + 2;
+        config.lru_purge_enable = true;
+        config.send_wait_timeout = 1;
+        config.close_fn = close_handler;
+        config.core_id = task_layout_core(TASK_CLASS_BACKGROUND);
+        config.task_priority = task_layout_priority(TASK_CLASS_BACKGROUND);
+        esp_err_t err = httpd_start(&server, &config);
+        if (err != ESP_OK) {return err;}
+
+        httpd_uri_t page = {.uri = "/", .method = HTTP_GET, .handler = page_handler};
+        httpd_uri_t feed = {.uri = "/ws", .method = HTTP_GET, .handler = ws_handler, .is_websocket = true};
+        httpd_register_uri_handler(server, &page);
+        httpd_register_uri_handler(server, &feed);
+
+        ESP_LOGI(TAG, "Dashboard on port %d, %d ms window, up to %d viewers", CONFIG_WS_DASHBOARD_PORT,
+                 CONFIG_WS_DASHBOARD_WINDOW_MS, CONFIG_WS_DASHBOARD_MAX_CLIENTS);
+        return TASK_LAYOUT_CREATE(push_task, "ws_push", 4096, NULL, TASK_CLASS_BACKGROUND, NULL);
+    }
+
+    void ws_dashboard_update(const uint8_t *mac, ws_field_t field, float value)
+    {
+        if (field >= WS_FIELD_COUNT) {return;}
+
+        taskENTER_CRITICAL(&node_lock);
+        node_entry_t *entry = NULL;
+        node_entry_t *free_entry = NULL;
+        for (uint8_t i = 0; i < CONFIG_WS_DASHBOARD_MAX_NODES; i++) {
+            if (nodes[i].valid && memcmp(nodes[i].mac, mac, WS_DASHBOARD_MAC_LEN) == 0) {
+                entry = &nodes[i];
+                break;
+            }
+            if (!nodes[i].valid && free_entry == NULL) {free_entry = &nodes[i];}
+        }
+        if (entry == NULL && free_entry != NULL) {
+            entry = free_entry;
+            entry->valid = true;
+            entry->dirty = 0;
+            memcpy(entry->mac, mac, WS_DASHBOARD_MAC_LEN);
+            for (uint8_t i = 0; i < WS_FIELD_COUNT; i++) {entry->values[i] = NAN;}
+        }
+        if (entry != NULL && !(entry->values[field] == value)) {
+            entry->values[field] = value;
+            entry->dirty |= 1 << field;
+        }
+        taskEXIT_CRITICAL(&node_lock);
+    }
+
+    static esp_err_t page_handler(httpd_req_t *req)
+    {
+        httpd_resp_set_type(req, "text/html");
+        // EMBED_TXTFILES agrega un terminador nulo que no se envía.
+        return httpd_resp_send(req, dashboard_html_start, dashboard_html_end - dashboard_html_start - 1);
+    }
+
+    static esp_err_t ws_handler(httpd_req_t *req)
+    {
+        if (req->method == HTTP_GET) {
+            // Fin del saludo: el visor recibe el estado completo en la próxima ventana.
+            if (!add_viewer(httpd_req_to_sockfd(req))) {
+                ESP_LOGW(TAG, "Viewer limit reached (%d)", CONFIG_WS_DASHBOARD_MAX_CLIENTS);
+                return ESP_FAIL;
+            }
+            return ESP_OK;
+        }
+
+        // Los visores no envían datos; se leen y descartan las tramas que lleguen.
+        uint8_t discard[32];
+        httpd_ws_frame_t frame = {.payload = discard};
+        esp_err_t err = httpd_ws_recv_frame(req, &frame, 0);
+        if (err != ESP_OK || frame.len > sizeof(discard)) {return ESP_FAIL;}    // Cierra la sesión
+        return frame.len > 0 ? httpd_ws_recv_frame(req, &frame, sizeof(discard)) : ESP_OK;
+    }
+
+    static void close_handler(httpd_handle_t handle, int sockfd)
+    {
+        remove_viewer(sockfd);
+        close(sockfd);
+    }
+
+    static bool add_viewer(int fd)
+    {
+        bool added = false;
+        taskENTER_CRITICAL(&viewer_lock);
+        for (uint8_t i = 0; i < CONFIG_WS_DASHBOARD_MAX_CLIENTS && !added; i++) {
+            if (viewers[i].fd < 0) {
+                viewers[i] = (viewer_t){.fd = fd, .needs_full = true};
+                added = true;
+            }
+        }
+        taskEXIT_CRITICAL(&viewer_lock);
+        return added;
+    }
+
+    static void remove_viewer(int fd)
+    {
+        taskENTER_CRITICAL(&viewer_lock);
+        for (uint8_t i = 0; i < CONFIG_WS_DASHBOARD_MAX_CLIENTS; i++) {
+            if (viewers[i].fd == fd) {viewers[i].fd = -1;}
+        }
+        taskEXIT_CRITICAL(&viewer_lock);
+    }
+
+    // Copia los nodos con cambios (o todos, si full) y limpia los bits de cambio tomados.
+    static size_t take_nodes(node_entry_t *out, bool full)
+    {
+        size_t count = 0;
+        taskENTER_CRITICAL(&node_lock);
+        for (uint8_t i = 0; i < CONFIG_WS_DASHBOARD_MAX_NODES; i++) {
+            if (nodes[i].valid && (full || nodes[i].dirty != 0)) {
+                out[count++] = nodes[i];
+                if (!full) {nodes[i].dirty = 0;}
+            }
+        }
+        taskEXIT_CRITICAL(&node_lock);
+        return count;
+    }
+
+    static size_t serialize(const node_entry_t *entries, size_t count, bool full)
+    {
+        int len = snprintf(json, sizeof(json), "{");
+        for (size_t n = 0; n < count && len < (int)sizeof(json); n++) {
+            len += snprintf(json + len, sizeof(json) - len, "%s\"" MACSTR "\":{", n > 0 ? "," : "",
+                            MAC2STR(entries[n].mac));
+            bool first = true;
+            for (uint8_t f = 0; f < WS_FIELD_COUNT && len < (int)sizeof(json); f++) {
+                bool wanted = full ? !isnan(entries[n].values[f]) : (entries[n].dirty & (1 << f));
+                if (!wanted) {continue;}
+                len += snprintf(json + len, sizeof(json) - len, f == WS_FIELD_TEMP_C ? "%s\"%s\":%.2f" : "%s\"%s\":%.0f",
+                                first ? "" : ",", field_names[f], entries[n].values[f]);
+                first = false;
+            }
+            if (len < (int)sizeof(json)) {len += snprintf(json + len, sizeof(json) - len, "}");}
+        }
+        if (len < (int)sizeof(json)) {len += snprintf(json + len, sizeof(json) - len, "}");}
+        return len < (int)sizeof(json) ? (size_t)len : 0;
+    }
+
+    static void send_to(int fd, size_t len)
+    {
+        if (httpd_ws_get_fd_info(server, fd) != HTTPD_WS_CLIENT_WEBSOCKET) {
+            remove_viewer(fd);
+            return;
+        }
+        httpd_ws_frame_t frame = {
+            .type = HTTPD_WS_TYPE_TEXT,
+            .payload = (uint8_t *)json,
+            .len = len,
+            .final = true,
+        };
+        if (httpd_ws_send_frame_async(server, fd, &frame) == ESP_OK) {
+            metrics_inc(METRIC_WS_PUSHES);
+        } else {
+            remove_viewer(fd);
+            httpd_sess_trigger_close(server, fd);
+        }
+    }
+
+    static void push_task(void *pvParameters)
+    {
+        TickType_t wake = xTaskGetTickCount();
+
+        while (1) {
+            vTaskDelayUntil(&wake, pdMS_TO_TICKS(CONFIG_WS_DASHBOARD_WINDOW_MS));
+
+            int fds[CONFIG_WS_DASHBOARD_MAX_CLIENTS];
+            bool needs_full[CONFIG_WS_DASHBOARD_MAX_CLIENTS];
+            uint8_t viewer_count = 0;
+            bool any_full = false;
+            taskENTER_CRITICAL(&viewer_lock);
+            for (uint8_t i = 0; i < CONFIG_WS_DASHBOARD_MAX_CLIENTS; i++) {
+                if (viewers[i].fd < 0) {continue;}
+                fds[viewer_count] = viewers[i].fd;
+                needs_full[viewer_count] = viewers[i].needs_full;
+                any_full |= viewers[i].needs_full;
+                viewers[i].needs_full = false;
+                viewer_count++;
+            }
+            taskEXIT_CRITICAL(&viewer_lock);
+            metrics_set(METRIC_WS_CLIENTS, viewer_count);
+
+            // Estado completo para los visores nuevos, antes del delta de esta ventana.
+            if (any_full) {
+                size_t len = serialize(changes, take_nodes(changes, true), true);
+                for (uint8_t i = 0; i < viewer_count && len > 0; i++) {
+                    if (needs_full[i]) {send_to(fds[i], len);}
+                }
+            }
+
+            // Los cambios se toman aunque no haya visores: el próximo recibirá el estado completo.
+            size_t count = take_nodes(changes, false);
+            if (count == 0 || viewer_count == 0) {continue;}
+            size_t len = serialize(changes, count, false);
+            for (uint8_t i = 0; i < viewer_count && len > 0; i++) {
+                if (!needs_full[i]) {send_to(fds[i], len);}
+            }
+        }
+    }
+    #else
+    esp_err_t ws_dashboard_start(void)
+    {
+        ESP_LOGW(TAG, "WS_DASHBOARD_ENABLE is off");
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    void ws_dashboard_update(const uint8_t *mac, ws_field_t field, float value)
+    {
+    }
+    #endif
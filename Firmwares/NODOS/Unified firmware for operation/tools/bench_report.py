@@ -0,0 +1,107 @@
+#!/usr/bin/env python3
+################################################################################################
+# Programa: Reporte de regresiones del banco de micro-pruebas.
+#
+# Descripción: Lee la salida de consola del proyecto Benchmarks (líneas "BENCH ..." de QEMU,
+# del objetivo linux o de una placa real), la compara contra la línea base del mismo objetivo
+# en Benchmarks/baselines/<objetivo>.json e informa la variación de cada caso. Se compara
+# ciclos/op cuando el objetivo los reporta y ns/op en el host. Un caso más lento que la línea
+# base por encima del umbral se marca como regresión y el programa termina con código 1.
+#
+# Uso: bench_report.py bench.log [--threshold 10] [--update]
+#
+# Autor:
+#   - Victor Manuel Patiño Delgado.
+#
+# Licencia: THE BEER-WARE LICENSE.
+# As long as you retain this notice you can do whatever you want with this stuff.
+# If we meet some day, and you think this stuff is worth it, you can buy me a beer in return.
+################################################################################################
+
+import argparse
+import json
+import os
+import sys
+
+BASELINE_DIR = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "Benchmarks", "baselines")
+
+
+def parse_log(text):
+    target = None
+    results = {}
+    done = False
+    for line in text.splitlines():
+        start = line.find("BENCH")
+        if start < 0:
+            continue
+        fields = line[start:].split()
+        if fields[0] == "BENCH-TARGET":
+            target = fields[1]
+        elif fields[0] == "BENCH" and len(fields) > 2:
+            results[fields[1]] = {key: float(value) for key, value in (field.split("=", 1) for field in fields[2:])}
+        elif fields[0] == "BENCH-DONE":
+            done = True
+    if target is None or not results:
+        raise ValueError("no BENCH output found")
+    if not done:
+        print("warning: BENCH-DONE missing, run may be incomplete", file=sys.stderr)
+    return target, results
+
+
+def metric(result):
+    return "cycles_per_op" if result.get("cycles_per_op", 0) > 0 else "ns_per_op"
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Compare benchmark output against the stored baseline")
+    parser.add_argument("log", help="console capture containing BENCH lines")
+    parser.add_argument("--threshold", type=float, default=10.0, help="allowed slowdown in percent")
+    parser.add_argument("--baseline", help="baseline file (default: Benchmarks/baselines/<target>.json)")
+    parser.add_argument("--update", action="store_true", help="store this run as the new baseline")
+    args = parser.parse_args()
+
+    with open(args.log, errors="replace") as handle:
+        target, results = parse_log(handle.read())
+    path = args.baseline or os.path.join(BASELINE_DIR, f"{target}.json")
+
+    if args.update:
+        os.makedirs(os.path.dirname(path), exist_ok=True)
+        with open(path, "w") as handle:
+            json.dump({"target": target, "results": results}, handle, indent=2, sort_keys=True)
+            handle.write("\n")
+        print(f"{path}: baseline updated with {len(results)} case(s)")
+        return 0
+
+    if not os.path.exists(path):
+        print(f"{path}: no baseline for target '{target}', run with --update first", file=sys.stderr)
+        return 2
+    with open(path) as handle:
+        baseline = json.load(handle)["results"]
+
+    regressions = 0
+    print(f"target {target}, threshold {args.threshold:.1f}%")
+    print(f"{'case':<16}{'metric':<15}{'baseline':>12}{'current':>12}{'delta':>9}")
+    for name, result in results.items():
+        if name not in baseline:
+            print(f"{name:<16}{'-':<15}{'-':>12}{'-':>12}{'new':>9}")
+            continue
+        key = metric(result)
+        reference = baseline[name].get(key, 0)
+        if reference <= 0:
+            print(f"{name:<16}{key:<15}{'-':>12}{result[key]:>12.1f}{'n/a':>9}")
+            continue
+        delta = (result[key] - reference) * 100.0 / reference
+        status = ""
+        if delta > args.threshold:
+            status = "  REGRESSION"
+            regressions += 1
+        print(f"{name:<16}{key:<15}{reference:>12.1f}{result[key]:>12.1f}{delta:>+8.1f}%{status}")
+    for name in baseline.keys() - results.keys():
+        print(f"{name:<16}{'-':<15}{'-':>12}{'-':>12}{'missing':>9}")
+
+    print(f"{regressions} regression(s)")
+    return 1 if regressions else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
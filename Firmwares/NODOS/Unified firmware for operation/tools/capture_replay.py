@@ -0,0 +1,177 @@
+#!/usr/bin/env python3
+################################################################################################
+# Programa: Extracción y comparación de capturas de tráfico ESP-NOW.
+#
+# Descripción: "extract" lleva una captura de frame_capture al formato que incrusta el
+# proyecto Replay (líneas "#CAP <t_us> <mac> <rssi> <hex>" en orden de llegada) desde
+# cualquiera de sus destinos: la consola de la pasarela, un volcado de la partición "capture"
+# (esptool.py read_flash) o lo recibido por MQTT (mosquitto_sub -v del tópico de telemetría).
+# "compare" toma la salida de dos ejecuciones de Replay, normalmente dos versiones del
+# firmware sobre la misma captura, informa las diferencias en las salidas (actuaciones y
+# alertas) y la variación de caudal y latencia. Termina con código 1 si las salidas difieren.
+#
+# Uso: capture_replay.py extract pasarela.log -o ../Replay/capture.cap
+#      capture_replay.py compare base.log nuevo.log [--threshold 10]
+#
+# Autor:
+#   - Victor Manuel Patiño Delgado.
+#
+# Licencia: THE BEER-WARE LICENSE.
+# As long as you retain this notice you can do whatever you want with this stuff.
+# If we meet some day, and you think this stuff is worth it, you can buy me a beer in return.
+################################################################################################
+
+import argparse
+import difflib
+import json
+import struct
+import sys
+
+CAPTURE_MAGIC = 0x54504143  # "CAPT"
+FLASH_HEADER = struct.Struct("<IBBH")
+FLASH_RECORD = struct.Struct("<q6sbB")
+# Métricas donde más es mejor; en el resto (latencias, tardías) más es peor.
+HIGHER_IS_BETTER = {"frames_per_s"}
+
+
+def format_mac(raw):
+    return ":".join(f"{b:02x}" for b in raw)
+
+
+def parse_flash(blob):
+    _, version, record_size, _ = FLASH_HEADER.unpack_from(blob, 0)
+    if version != 1 or record_size != FLASH_RECORD.size:
+        raise ValueError(f"unsupported capture version {version} (record {record_size} bytes)")
+    frames = []
+    offset = FLASH_HEADER.size
+    while offset + FLASH_RECORD.size <= len(blob):
+        time_us, src, rssi, length = FLASH_RECORD.unpack_from(blob, offset)
+        if time_us == -1:  # Flash borrada: fin de la captura
+            break
+        offset += FLASH_RECORD.size
+        if offset + length > len(blob):
+            break
+        frames.append((time_us, format_mac(src), rssi, blob[offset:offset + length].hex()))
+        offset += length
+    return frames
+
+
+def parse_text(text):
+    frames = []
+    for line in text.splitlines():
+        start = line.find("#CAP ")
+        if start >= 0:
+            fields = line[start:].split()
+            if len(fields) == 5:
+                frames.append((int(fields[1]), fields[2].lower(), int(fields[3]), fields[4].lower()))
+            continue
+        # Registro de mqtt_uplink: {"node":..,"t":..,"data":{"t_us":..,"rssi":..,"frame":..}}
+        start = line.find("{")
+        if start < 0:
+            continue
+        try:
+            record = json.loads(line[start:])
+        except ValueError:
+            continue
+        data = record.get("data") if isinstance(record, dict) else None
+        if isinstance(data, dict) and "frame" in data:
+            frames.append((int(data["t_us"]), record["node"].lower(), int(data["rssi"]), data["frame"].lower()))
+    return frames
+
+
+def extract(args):
+    with open(args.input, "rb") as source:
+        blob = source.read()
+    if len(blob) >= FLASH_HEADER.size and FLASH_HEADER.unpack_from(blob, 0)[0] == CAPTURE_MAGIC:
+        frames = parse_flash(blob)
+    else:
+        frames = parse_text(blob.decode("utf-8", errors="replace"))
+    if not frames:
+        print(f"{args.input}: no captured frames", file=sys.stderr)
+        return 1
+
+    # Orden estable por tiempo: el enlace MQTT puede entregar lotes fuera de orden.
+    frames.sort(key=lambda frame: frame[0])
+    with open(args.output, "w") as out:
+        for frame in frames:
+            out.write("#CAP {} {} {} {}\n".format(*frame))
+    span_s = (frames[-1][0] - frames[0][0]) / 1e6
+    print(f"{args.output}: {len(frames)} frames over {span_s:.1f} s")
+    return 0
+
+
+def parse_replay(path):
+    target = None
+    outputs = []
+    stats = {}
+    done = False
+    with open(path, errors="replace") as log:
+        for line in log:
+            start = line.find("REPLAY")
+            if start < 0:
+                continue
+            fields = line[start:].split()
+            if fields[0] == "REPLAY-TARGET":
+                target = " ".join(fields[1:])
+            elif fields[0] == "REPLAY-OUT":
+                outputs.append(" ".join(fields[1:]))
+            elif fields[0] == "REPLAY-STATS":
+                stats = {key: float(value) for key, value in (field.split("=", 1) for field in fields[1:])}
+            elif fields[0] == "REPLAY-DONE":
+                done = True
+    if not done:
+        print(f"warning: {path} has no REPLAY-DONE, run may be incomplete", file=sys.stderr)
+    return target, outputs, stats
+
+
+def compare(args):
+    base_target, base_outputs, base_stats = parse_replay(args.base)
+    new_target, new_outputs, new_stats = parse_replay(args.new)
+    print(f"base: {base_target}")
+    print(f"new:  {new_target}")
+
+    print(f"{'stat':<14}{'base':>12}{'new':>12}{'delta':>10}")
+    for key, base in base_stats.items():
+        if key not in new_stats:
+            continue
+        new = new_stats[key]
+        delta = (new - base) * 100.0 / base if base else 0.0
+        status = ""
+        if key.startswith("lat_") or key in HIGHER_IS_BETTER:
+            worse = -delta if key in HIGHER_IS_BETTER else delta
+            if worse > args.threshold:
+                status = "  SLOWER"
+        print(f"{key:<14}{base:>12.1f}{new:>12.1f}{delta:>+9.1f}%{status}")
+
+    diff = list(difflib.unified_diff(base_outputs, new_outputs, args.base, args.new, lineterm="", n=1))
+    if not diff:
+        print(f"outputs identical ({len(base_outputs)})")
+        return 0
+    print(f"outputs differ ({len(base_outputs)} base, {len(new_outputs)} new):")
+    for line in diff:
+        print(line)
+    return 1
+
+
+def main():
+    parser = argparse.ArgumentParser(description="ESP-NOW capture extraction and replay comparison")
+    commands = parser.add_subparsers(dest="command", required=True)
+
+    extract_parser = commands.add_parser("extract", help="normalize a capture for the Replay project")
+    extract_parser.add_argument("input", help="console log, MQTT dump or capture partition image")
+    extract_parser.add_argument("-o", "--output", default="capture.cap")
+    extract_parser.set_defaults(run=extract)
+
+    compare_parser = commands.add_parser("compare", help="compare two Replay runs")
+    compare_parser.add_argument("base")
+    compare_parser.add_argument("new")
+    compare_parser.add_argument("--threshold", type=float, default=10.0,
+                                help="percent change in latency or throughput flagged as slower")
+    compare_parser.set_defaults(run=compare)
+
+    args = parser.parse_args()
+    return args.run(args)
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,161 @@
+#!/usr/bin/env python3
+################################################################################################
+# Programa: Conversión de trazas de ciclos a JSON de Chrome/Perfetto.
+#
+# Descripción: Lee uno o más volcados del componente trace, ya sea la captura de consola UART
+# (líneas "#TRACE...", el resto del log se ignora) o el binario leído de la partición "trace",
+# y produce un archivo JSON abrible en ui.perfetto.dev o chrome://tracing. Cada volcado es un
+# proceso y cada núcleo un hilo. Los envíos ESP-NOW de un volcado se enlazan con la recepción
+# de la misma secuencia en otro volcado; como los relojes de los dispositivos no comparten
+# origen, cada volcado adicional se desplaza lo mínimo para que ninguna recepción anteceda a
+# su envío (la latencia en el aire del par más rápido queda en cero).
+#
+# Uso: trace_to_perfetto.py emisor.log receptor.bin -o trace.json
+#
+# Autor:
+#   - Victor Manuel Patiño Delgado.
+#
+# Licencia: THE BEER-WARE LICENSE.
+# As long as you retain this notice you can do whatever you want with this stuff.
+# If we meet some day, and you think this stuff is worth it, you can buy me a beer in return.
+################################################################################################
+
+import argparse
+import json
+import os
+import struct
+import sys
+
+TRACE_MAGIC = 0x45435254
+HEADER = struct.Struct("<IBBHI2IB3x")
+EVENT = struct.Struct("<IBBH")
+NAME_LEN = 16
+SEND_POINT = "espnow_send"
+RECV_POINT = "recv_cb"
+
+
+def parse_text(text):
+    dump = None
+    for line in text.splitlines():
+        start = line.find("#TRACE")
+        if start < 0:
+            continue
+        fields = line[start:].split()
+        if fields[0] == "#TRACE":
+            options = dict(field.split("=", 1) for field in fields[2:])
+            dump = {"cpu_mhz": int(options["cpu_mhz"]), "names": {}, "events": []}
+        elif dump is None:
+            continue
+        elif fields[0] == "#TRACE-POINT":
+            dump["names"][int(fields[1])] = fields[2]
+        elif fields[0] == "#TRACE-EV":
+            core, cycles, point, phase, arg = fields[1:6]
+            dump["events"].append((int(core), int(cycles), int(point), phase, int(arg)))
+        elif fields[0] == "#TRACE-END":
+            return dump
+    if dump is None:
+        raise ValueError("no #TRACE header found")
+    return dump
+
+
+def parse_binary(blob):
+    magic, version, cores, cpu_mhz, per_core, head0, head1, point_count = HEADER.unpack_from(blob, 0)
+    if magic != TRACE_MAGIC or version != 1:
+        raise ValueError("not a trace partition image")
+    offset = HEADER.size
+    names = {}
+    for point in range(point_count):
+        names[point] = blob[offset:offset + NAME_LEN].split(b"\0", 1)[0].decode()
+        offset += NAME_LEN
+
+    events = []
+    for core, head in enumerate((head0, head1)[:cores]):
+        base = offset + core * per_core * EVENT.size
+        count = min(head, per_core)
+        for n in range(head - count, head):
+            cycles, point, phase, arg = EVENT.unpack_from(blob, base + (n % per_core) * EVENT.size)
+            events.append((core, cycles, point, chr(phase), arg))
+    return {"cpu_mhz": cpu_mhz, "names": names, "events": events}
+
+
+def load(path):
+    with open(path, "rb") as handle:
+        blob = handle.read()
+    if len(blob) >= 4 and struct.unpack_from("<I", blob)[0] == TRACE_MAGIC:
+        return parse_binary(blob)
+    return parse_text(blob.decode(errors="replace"))
+
+
+def timeline(dump):
+    """Eventos con marca en microsegundos, corrigiendo el desborde de 32 bits por núcleo."""
+    last = {}
+    wraps = {}
+    result = []
+    for core, cycles, point, phase, arg in dump["events"]:
+        if core in last and cycles < last[core]:
+            wraps[core] = wraps.get(core, 0) + 1
+        last[core] = cycles
+        absolute = cycles + (wraps.get(core, 0) << 32)
+        result.append((absolute / dump["cpu_mhz"], core, dump["names"].get(point, str(point)), phase, arg))
+    if result:
+        origin = min(event[0] for event in result)
+        result = [(event[0] - origin,) + event[1:] for event in result]
+    return result
+
+
+def endpoints(events, point):
+    """Marca de cierre por secuencia para el punto dado."""
+    return {arg: ts for ts, _, name, phase, arg in events if name == point and phase == "E" and arg != 0}
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("dumps", nargs="+", help="UART logs or raw 'trace' partition images")
+    parser.add_argument("-o", "--output", default="trace.json")
+    args = parser.parse_args()
+
+    timelines = [timeline(load(path)) for path in args.dumps]
+
+    # Alineación causal de cada volcado respecto del primero.
+    sends = endpoints(timelines[0], SEND_POINT)
+    for index in range(1, len(timelines)):
+        recvs = endpoints(timelines[index], RECV_POINT)
+        deltas = [sends[seq] - recvs[seq] for seq in recvs.keys() & sends.keys()]
+        if deltas:
+            shift = max(deltas)
+            timelines[index] = [(event[0] + shift,) + event[1:] for event in timelines[index]]
+        else:
+            print(f"{args.dumps[index]}: no matching sequence numbers, timeline left unaligned", file=sys.stderr)
+
+    trace_events = []
+    flow_id = 0
+    send_index = {}
+    for pid, (path, events) in enumerate(zip(args.dumps, timelines)):
+        trace_events.append({"ph": "M", "name": "process_name", "pid": pid, "args": {"name": os.path.basename(path)}})
+        for core in sorted({event[1] for event in events}):
+            trace_events.append({"ph": "M", "name": "thread_name", "pid": pid, "tid": core,
+                                 "args": {"name": f"core {core}"}})
+        for ts, core, name, phase, arg in events:
+            event = {"name": name, "ph": phase, "ts": round(ts, 3), "pid": pid, "tid": core}
+            if phase == "i":
+                event["s"] = "t"
+            if arg:
+                event["args"] = {"seq": arg}
+            trace_events.append(event)
+            if name == SEND_POINT and phase == "E" and arg:
+                send_index.setdefault(arg, (pid, core, ts))
+            elif name == RECV_POINT and phase == "E" and arg in send_index and send_index[arg][0] != pid:
+                flow_id += 1
+                src_pid, src_core, src_ts = send_index[arg]
+                trace_events.append({"name": "espnow", "cat": "radio", "ph": "s", "id": flow_id,
+                                     "ts": round(src_ts, 3), "pid": src_pid, "tid": src_core})
+                trace_events.append({"name": "espnow", "cat": "radio", "ph": "f", "bp": "e", "id": flow_id,
+                                     "ts": round(ts, 3), "pid": pid, "tid": core})
+
+    with open(args.output, "w") as handle:
+        json.dump({"traceEvents": trace_events, "displayTimeUnit": "ns"}, handle)
+    print(f"{args.output}: {len(trace_events)} events from {len(args.dumps)} dump(s)")
+
+
+if __name__ == "__main__":
+    main()
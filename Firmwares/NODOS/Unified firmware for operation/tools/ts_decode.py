@@ -0,0 +1,133 @@
+#!/usr/bin/env python3
+################################################################################################
+# Programa: Decodificador en el host de tramas comprimidas del componente ts_codec.
+#
+# Descripción: Lee tramas en hexadecimal, una por línea (se toma la última palabra de cada
+# línea, así sirve tanto un volcado de consola como un archivo con solo las tramas), o un
+# binario con una sola trama, y escribe las muestras como CSV "timestamp,value". Implementa
+# el mismo formato que components/ts_codec: cabecera de 12 bytes y flujo de bits MSB primero
+# con delta de deltas para las marcas de tiempo y delta en punto fijo para los valores.
+#
+# Uso: ts_decode.py tramas.log [--binary] [-o muestras.csv]
+#
+# Autor:
+#   - Victor Manuel Patiño Delgado.
+#
+# Licencia: THE BEER-WARE LICENSE.
+# As long as you retain this notice you can do whatever you want with this stuff.
+# If we meet some day, and you think this stuff is worth it, you can buy me a beer in return.
+################################################################################################
+
+import argparse
+import string
+import struct
+import sys
+
+VERSION = 1
+HEADER = struct.Struct("<BBHIi")
+MAX_DECIMALS = 4
+TIMESTAMP_WIDTHS = (4, 8, 12, 32)
+VALUE_WIDTHS = (3, 6, 12, 32)
+MASK32 = 0xFFFFFFFF
+
+
+class BitReader:
+    def __init__(self, data, bit_pos):
+        self.data = data
+        self.bit_pos = bit_pos
+
+    def read(self, bits):
+        if self.bit_pos + bits > len(self.data) * 8:
+            raise ValueError("truncated frame")
+        value = 0
+        for _ in range(bits):
+            byte = self.data[self.bit_pos >> 3]
+            value = (value << 1) | ((byte >> (7 - (self.bit_pos & 7))) & 1)
+            self.bit_pos += 1
+        return value
+
+    def bucket(self, widths):
+        ones = 0
+        while ones < len(widths) and self.read(1):
+            ones += 1
+        return 0 if ones == 0 else self.read(widths[ones - 1])
+
+
+def unzigzag(zz):
+    return (zz >> 1) ^ (-(zz & 1) & MASK32)
+
+
+def to_int32(value):
+    value &= MASK32
+    return value - (1 << 32) if value & 0x80000000 else value
+
+
+def decode(frame):
+    if len(frame) < HEADER.size:
+        raise ValueError("frame shorter than header")
+    version, decimals, count, timestamp, fixed = HEADER.unpack_from(frame)
+    if version != VERSION or decimals > MAX_DECIMALS:
+        raise ValueError(f"unsupported frame (version {version}, decimals {decimals})")
+
+    scale = 10 ** decimals
+    reader = BitReader(frame, HEADER.size * 8)
+    delta = 0
+    samples = []
+    for index in range(count):
+        if index > 0:
+            delta = (delta + unzigzag(reader.bucket(TIMESTAMP_WIDTHS))) & MASK32
+            timestamp = (timestamp + delta) & MASK32
+            fixed = to_int32(fixed + unzigzag(reader.bucket(VALUE_WIDTHS)))
+        samples.append((timestamp, round(fixed / scale, decimals)))
+    return samples
+
+
+def hex_frames(text):
+    for line in text.splitlines():
+        fields = line.split()
+        if not fields:
+            continue
+        word = fields[-1]
+        if len(word) >= HEADER.size * 2 and len(word) % 2 == 0 and all(c in string.hexdigits for c in word):
+            yield bytes.fromhex(word)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Decode ts_codec frames to CSV")
+    parser.add_argument("input", help="text file with one hex frame per line, or a raw frame with --binary")
+    parser.add_argument("--binary", action="store_true", help="input is a single raw frame")
+    parser.add_argument("-o", "--output", help="CSV file (default: stdout)")
+    args = parser.parse_args()
+
+    if args.binary:
+        with open(args.input, "rb") as file:
+            frames = [file.read()]
+    else:
+        with open(args.input, encoding="utf-8", errors="replace") as file:
+            frames = list(hex_frames(file.read()))
+
+    output = open(args.output, "w", encoding="utf-8") if args.output else sys.stdout
+    output.write("timestamp,value\n")
+    total_bytes = 0
+    total_samples = 0
+    for number, frame in enumerate(frames):
+        try:
+            samples = decode(frame)
+        except ValueError as error:
+            print(f"frame {number}: {error}", file=sys.stderr)
+            continue
+        total_bytes += len(frame)
+        total_samples += len(samples)
+        for timestamp, value in samples:
+            output.write(f"{timestamp},{value}\n")
+    if output is not sys.stdout:
+        output.close()
+
+    if total_samples:
+        print(f"{len(frames)} frames, {total_samples} samples, {total_bytes * 8 / total_samples:.2f} bits/sample",
+              file=sys.stderr)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())